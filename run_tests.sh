@@ -26,9 +26,38 @@ python3 tests/test_endpoints.py
 
 TEST_EXIT_CODE=$?
 
+python3 tests/test_cgi_pool.py || TEST_EXIT_CODE=1
+python3 tests/test_access_log.py || TEST_EXIT_CODE=1
+python3 tests/test_metrics.py || TEST_EXIT_CODE=1
+python3 tests/test_pools.py || TEST_EXIT_CODE=1
+
 echo -e "${GREEN}Stopping server...${NC}"
 kill $SERVER_PID
 
+# Starts its own FastCGI responder and webserv (configs/fastcgi.conf)
+echo -e "${GREEN}Running FastCGI tests...${NC}"
+python3 tests/test_fastcgi.py || TEST_EXIT_CODE=1
+
+# Starts its own webserv, its console on a pipe nobody reads
+echo -e "${GREEN}Running logger tests...${NC}"
+python3 tests/test_logger.py || TEST_EXIT_CODE=1
+
+# Starts its own webserv (configs/memory.conf, a 1 MB memory_budget)
+echo -e "${GREEN}Running memory budget tests...${NC}"
+python3 tests/test_memory_budget.py || TEST_EXIT_CODE=1
+
+# Starts its own webserv on a temporary configuration it rewrites
+echo -e "${GREEN}Running SIGHUP reload tests...${NC}"
+python3 tests/test_reload.py || TEST_EXIT_CODE=1
+
+# Starts its own webserv, which replaces itself twice (SIGUSR2)
+echo -e "${GREEN}Running binary upgrade tests...${NC}"
+python3 tests/test_upgrade.py || TEST_EXIT_CODE=1
+
+# Starts its own webserv three times, stopped with SIGTERM (shutdown_timeout 3)
+echo -e "${GREEN}Running graceful shutdown tests...${NC}"
+python3 tests/test_shutdown.py || TEST_EXIT_CODE=1
+
 if [ $TEST_EXIT_CODE -eq 0 ]; then
     echo -e "${GREEN}All tests passed!${NC}"
     exit 0
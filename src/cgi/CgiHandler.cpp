@@ -1,19 +1,47 @@
 #include "CgiHandler.hpp"
 
-
 using std::string;
 using std::map;
 
-CgiHandler::CgiHandler(Response& resp, const string& scriptPath, 
-						const string& interpreterPath) :
-	_resp(resp),
-	_scriptPath(scriptPath),
-	_interpreterPath(interpreterPath)
-{
-	setupEnv();
+/*
+ * Entries are NUL separated: a value holding a NUL would end its own and
+ * add another variable, it is left out (HttpParser already rejects them).
+ */
+static bool	hasNul(const string& value, size_t pos, size_t len) {
+	if (pos >= value.size())
+		return false;
+	len = std::min(len, value.size() - pos);
+	return std::memchr(value.data() + pos, '\0', len) != NULL;
+}
+
+static void	appendVar(string& block, const char* name, const string& value) {
+	if (hasNul(value, 0, value.size()))
+		return;
+	block.append(name).push_back('=');
+	block.append(value).push_back('\0');
+}
+
+// `len` bytes of `value` from `pos`: a part of the URI without a substr()
+static void	appendVar(string& block, const char* name, const string& value, size_t pos, size_t len) {
+	if (hasNul(value, pos, len))
+		return;
+	block.append(name).push_back('=');
+	block.append(value, pos, len).push_back('\0');
 }
 
-CgiHandler::~CgiHandler() {}
+/**
+ * The variables that do not depend on the request. `loc` may be NULL
+ * (DOCUMENT_ROOT is then the server root).
+ */
+void	CgiHandler::buildStaticEnv(const Server& server, const Location* loc, string& block) {
+	block.clear();
+	appendVar(block, "GATEWAY_INTERFACE", "CGI/1.1");
+	appendVar(block, "SERVER_SOFTWARE", "webserv/1.0");
+	appendVar(block, "REDIRECT_STATUS", "200"); // Required by some CGI engines (like php-cgi)
+	appendVar(block, "SERVER_NAME", server.getFirstServerName());
+	appendVar(block, "SERVER_PORT", toString(server.getPort()));
+	appendVar(block, "DOCUMENT_ROOT", (loc && !loc->getRoot().empty()) ? loc->getRoot() : server.getRoot());
+}
 
 /** 
  * Info: CGI scripts are separate programs that our web server executes. 
@@ -21,241 +49,84 @@ CgiHandler::~CgiHandler() {}
  * specification defines that request information must be passed 
  * via environment variables.
  * 
- * execve() passes them in executeCgi() method
+ * Appends the location's precomputed block, then the per-request
+ * variables. execve() takes the block as is (CgiPool's launcher points
+ * envp into it), nothing is allocated per variable.
  * 
  * HTTP Headers Conversion because CGI standard requires HTTP headers to be prefixed 
  * with HTTP_ and use underscores.
  * */
-void	CgiHandler::setupEnv() {
-	const Request*	req = _resp.getRequest();
-
-	_env["REQUEST_METHOD"] = req->getMethod();
-	_env["SCRIPT_FILENAME"] = _scriptPath;
-	_env["SERVER_PROTOCOL"] = req->getVersion();
-	_env["REDIRECT_STATUS"] = "200"; // Required by some CGI engines (like php-cgi)
-	_env["GATEWAY_INTERFACE"] = "CGI/1.1";
-	_env["SERVER_SOFTWARE"] = "webserv/1.0";
-	_env["SERVER_NAME"] = _resp.getServerConfig().getFirstServerName();
-	_env["SERVER_PORT"] = toString(_resp.getServerConfig().getPort());
-	_env["SCRIPT_NAME"] = req->getUri().substr(0, req->getUri().find('?'));
-
-	// Parse Query String
-	string	uri = req->getUri();
-	size_t	queryPos = uri.find('?');
-	if (queryPos != string::npos) {
-		_env["QUERY_STRING"] = uri.substr(queryPos + 1);
-		_env["PATH_INFO"] = uri.substr(0, queryPos);
+void	CgiHandler::buildEnvBlock(Response& resp, const string& scriptPath, string& block) {
+	const Request*	req = resp.getRequest();
+	const Location*	loc = resp.getLocation();
+	const string&	raw = req->getRawHeaders();
+
+	block.reserve(block.size() + 512 + raw.size());
+	if (loc != NULL && !loc->getCgiEnv().empty()) {
+		block += loc->getCgiEnv();
 	} else {
-		_env["QUERY_STRING"] = "";
-		_env["PATH_INFO"] = uri;
+		string	staticEnv;
+		buildStaticEnv(resp.getServerConfig(), loc, staticEnv);
+		block += staticEnv;
 	}
+	appendVar(block, "REQUEST_METHOD", req->getMethod());
+	appendVar(block, "SCRIPT_FILENAME", scriptPath);
+	appendVar(block, "SERVER_PROTOCOL", req->getVersion());
 
-	// Handle Body / Content-Type
-	if (!req->getBody().empty()) {
-		std::ostringstream	ss;
-
-		ss << req->getBody().length();
-		_env["CONTENT_LENGTH"] = ss.str();
-		_env["CONTENT_TYPE"] = req->getHeaderValue("content-type");
-	}
-	
-	// Convert headers to HTTP_ format. Convert "User-Agent" to "HTTP_USER_AGENT"
-	map<string, string>	headers = req->getHeaders();
-	for (map<string, string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
-		string	key = it->first;
-		string	value = it->second;
-		string	envKey = "HTTP_";
-
-		for (size_t i = 0; i < key.length(); ++i) {
-			if (key[i] == '-')
-				envKey += '_';
-			else
-				envKey += std::toupper(key[i]);
-		}
-		_env[envKey] = value;
-	}
-}
-
-/**
- * Executes a CGI script using fork/exec and captures its output.
- * 
- *  I/O topology:
- *  - pipeIn:  parent writes request body -> child's stdin
- *  - pipeOut: child's stdout -> parent reads CGI output
- *  
- * - Forks a child process to run the CGI script
- * - Child process:
- *    - Redirects stdin/stdout to the pipes
- *    - Closes unused file descriptors to prevent leakage
- *    - Executes the script using execve() with environment variables
- * 4. Parent process:
- *    - Writes request body to script's stdin
- *    - Reads script's output from stdout
- *    - Waits for child process to complete
- * 
- *  Timeout handling: 
- * - Set both pipe fds (pipeIn[1], pipeOut[0]) to O_NONBLOCK.
- * - Record start = time(NULL); enforce a hard limit CGI_TIMEOUT_SEC.
- * - In a read phase: After each iteration check child state with waitpid with
- *   a flag WNOHANG.
- * 
- * @return The complete output from the CGI script (headers + body),
- *         or an error message string if execution fails
- */
-string	CgiHandler::executeCgi()
-{
-	const Request*	req = _resp.getRequest();
-
-	int		pipeIn[2];  // To send Body to script
-	int		pipeOut[2]; // To read Output from script
-
-	if (pipe(pipeIn) == -1 || pipe(pipeOut) == -1) {
-		return "Status: 500\r\n\r\nInternal Server Error (Pipe)";
-	}
-
-	pid_t	pid = fork();
-	if (pid == -1) {
-		return "Status: 500\r\n\r\nInternal Server Error (Fork)";
+	// Parse Query String
+	const string&	uri = req->getUri();
+	size_t			queryPos = uri.find('?');
+	size_t			pathLen = queryPos == string::npos ? uri.size() : queryPos;
+	size_t			queryFrom = queryPos == string::npos ? uri.size() : queryPos + 1;
+	appendVar(block, "SCRIPT_NAME", uri, 0, pathLen);
+	appendVar(block, "PATH_INFO", uri, 0, pathLen);
+	appendVar(block, "QUERY_STRING", uri, queryFrom, string::npos);
+
+	// Handle Body / Content-Type. A Content-Length body may still be on its
+	// way: it is streamed into the script (CgiPool::feedBody)
+	size_t	bodyLen = req->getBody().length();
+	if (!req->isTransferEncodingHeader() && req->isContentLengthHeader())
+		HttpParser::safeParseContentLength(req->getHeaderValue(Request::HDR_CONTENT_LENGTH), bodyLen);
+	if (bodyLen > 0) {
+		appendVar(block, "CONTENT_LENGTH", toString(bodyLen));
+		appendVar(block, "CONTENT_TYPE", req->getHeaderValue(Request::HDR_CONTENT_TYPE));
 	}
 
-	if (pid == 0) { // Child Process
-		close(pipeIn[1]);
-		close(pipeOut[0]);
-		dup2(pipeIn[0], STDIN_FILENO);
-		dup2(pipeOut[1], STDOUT_FILENO);
-		close(pipeIn[0]);
-		close(pipeOut[1]);
-
-		// Close all other file descriptors to prevent leakage
-		int	max_fd = sysconf(_SC_OPEN_MAX);
-		if (max_fd == -1) max_fd = 1024; // Fallback if sysconf fails
-		for (int i = 3; i < max_fd; ++i) {
-			close(i);
-		}
-
-		char**	env = getEnvArray();
-		char*	argv[] = {
-			const_cast<char*>(_interpreterPath.c_str()),
-			const_cast<char*>(_scriptPath.c_str()),
-			NULL
-		};
-
-		execve(_interpreterPath.c_str(), argv, env);
-		std::cerr << "Execve failed" << std::endl;
-		freeEnvArray(env);
-		exit(1);
-	} else { // Parent Process
-		close(pipeIn[0]);
-		close(pipeOut[1]);
-
-		// For a a CGI timeout: Non-blocking I/O on pipes
-		fcntl(pipeIn[1], F_SETFL, O_NONBLOCK);
-		fcntl(pipeOut[0], F_SETFL, O_NONBLOCK);
-		const time_t	CGI_TIMEOUT_SEC = 5; // adjust as needed
-		const time_t	start = time(NULL);
-
-		// For a a CGI timeout: Write request body (best-effort, 
-		// non-blocking, with timeout).
-		// write() system call is not guaranteed to send all your data in one go;
-		// written - a counter to keep track of how many bytes have been sent
-		const string&	body = req->getBody();
-		size_t			written = 0;
-		while (written < body.size()) {
-			ssize_t	n = write(pipeIn[1], body.c_str() + written, body.size() - written);
-			if (n > 0) {
-				written += static_cast<size_t>(n);
-				continue;
-			}
-			// if n <= 0 - check timeout and give up writing for now
-			if (time(NULL) - start >= CGI_TIMEOUT_SEC) {
-				kill(pid, SIGKILL);
-				close(pipeIn[1]);
-				close(pipeOut[0]);
-				int	status;
-				waitpid(pid, &status, 0);
-				if (CGI_DEBUG) std::cout << "CGI Script Timeout (write)" << std::endl;
-				return "Status: 504\r\n\r\nCGI Script Timeout (write)";
-			}
-			break;
-		}
-
-		/* TO DELETE // Write request body to the script's stdin
-		if (!req->getBody().empty()) {
-			write(pipeIn[1], req->getBody().c_str(), req->getBody().length());
-		} */
-		close(pipeIn[1]); // Done writing (or child closed early)
-
-		// Read script's stdout
-		// For a a CGI timeout: read until child exits or timeout
-		string		result;
-		char		buffer[4096];
-
-		while (true) {
-			// Timeout check
-			if (time(NULL) - start >= CGI_TIMEOUT_SEC) {
-				kill(pid, SIGKILL);
-				close(pipeOut[0]);
-				int	status;
-				waitpid(pid, &status, 0);
-				if (CGI_DEBUG) std::cout << "CGI Script Timeout (read)" << std::endl;
-				return "Status: 504\r\n\r\nCGI Script Timeout";
-			}
-
-			ssize_t n = read(pipeOut[0], buffer, sizeof(buffer));
-			if (n > 0)
-				result.append(buffer, static_cast<size_t>(n));
-
-			// Check if child has exited
-			int		status;
-			// WNOHANG - return immediately if no child has exited.
-			// If a child died, its pid will be returned by waitpid() and process 
-			// can act on that. If nothing died, then the returned pid is 0.
-			pid_t	r = waitpid(pid, &status, WNOHANG);
-			if (r == pid) {
-				// Drain any remaining data once more
-				while (true) {
-					ssize_t n = read(pipeOut[0], buffer, sizeof(buffer));
-					if (n > 0)
-						result.append(buffer, static_cast<size_t>(n));
-					else break;
-				}
-				close(pipeOut[0]);
-				if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-					if (CGI_DEBUG) std::cout << "executeCgi(): Child process failed" << std::endl;
-					return "Status: 500\r\n\r\nCGI Script Error";
-				}
-				if (WIFSIGNALED(status)) {
-					if (CGI_DEBUG) std::cout << "executeCgi(): Child process terminated by signal" << std::endl;
-					return "Status: 500\r\n\r\nCGI Script Terminated";
-				}
-				return result;
-			}
+	// Convert headers to HTTP_ format. Convert "User-Agent" to "HTTP_USER_AGENT"
+	// Straight from the parsed spans; of a repeated header the last one wins.
+	const std::vector<HeaderField>&	fields = req->getHeaderFields();
+	for (size_t f = 0; f < fields.size(); ++f) {
+		const char*	key = raw.data() + fields[f].name.off;
+		size_t		len = fields[f].name.len;
+		bool		repeated = false;
+
+		for (size_t later = f + 1; later < fields.size() && !repeated; ++later) {
+			repeated = fields[later].name.len == len
+				&& strncasecmp(raw.data() + fields[later].name.off, key, len) == 0;
 		}
-		return result;
+		if (repeated || hasNul(raw, fields[f].value.off, fields[f].value.len))
+			continue;
+		block.append("HTTP_");
+		for (size_t i = 0; i < len; ++i)
+			block.push_back(key[i] == '-' ? '_' : std::toupper(static_cast<unsigned char>(key[i])));
+		block.push_back('=');
+		block.append(raw, fields[f].value.off, fields[f].value.len).push_back('\0');
 	}
 }
 
-char**	CgiHandler::getEnvArray()
-{
-	char**	env = new char*[_env.size() + 1];
-	size_t	i = 0;
-	for (map<string, string>::const_iterator it = _env.begin(); it != _env.end(); ++it)
-	{
-		string	element = it->first + "=" + it->second;
-		env[i] = new char[element.size() + 1];
-		std::strcpy(env[i], element.c_str());
-		i++;
-	}
-	env[i] = NULL;
-	return env;
-}
+// Same variables as a map (FastCGI sends them as FCGI_PARAMS)
+void	CgiHandler::buildEnv(Response& resp, const string& scriptPath, map<string, string>& env) {
+	string	block;
 
-void	CgiHandler::freeEnvArray(char** envArray)
-{
-	if (!envArray) return;
+	buildEnvBlock(resp, scriptPath, block);
+	for (size_t pos = 0; pos < block.size(); ) {
+		size_t	end = block.find('\0', pos);
+		size_t	eq = block.find('=', pos);
 
-	for (size_t i = 0; envArray[i]; ++i) {
-		delete[] envArray[i];
+		if (end == string::npos)
+			end = block.size();
+		if (eq != string::npos && eq < end)
+			env[block.substr(pos, eq - pos)].assign(block, eq + 1, end - eq - 1);
+		pos = end + 1;
 	}
-	delete[] envArray;
 }
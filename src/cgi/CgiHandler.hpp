@@ -9,24 +9,22 @@
 
 class Response;
 
+/**
+ * CGI/1.1 meta-variables of a request, as an environment block
+ * ("NAME=value\0NAME=value\0...") for CgiPool or as a map for the FCGI_PARAMS
+ * of FastCgiClient. The request-independent part is built once per
+ * location at startup (Server::prepareCgiEnv) and copied as is.
+ */
 class CgiHandler {
 	public:
-		// Pass the request, the full path to the script, and the path to the python interpreter
-		CgiHandler(Response& resp, const std::string& scriptPath, const std::string& interpreterPath);
-		~CgiHandler();
-
-		// Executes the script and returns the full output (headers + body)
-		std::string	executeCgi();
+		static void	buildStaticEnv(const Server& server, const Location* loc, std::string& block);
+		static void	buildEnvBlock(Response& resp, const std::string& scriptPath, std::string& block);
+		static void	buildEnv(Response& resp, const std::string& scriptPath,
+						std::map<std::string, std::string>& env);
 
 	private:
-		Response&							_resp;
-		std::string							_scriptPath;
-		std::string							_interpreterPath;
-		std::map<std::string, std::string>	_env;
-
-		void	setupEnv();
-		char**	getEnvArray();
-		void	freeEnvArray(char** envArray);
+		CgiHandler();
+		~CgiHandler();
 };
 
 #endif
@@ -0,0 +1,895 @@
+#include "CgiPool.hpp"
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+using std::string;
+using std::map;
+using std::vector;
+
+// launcher -> server: 'P' script pid, 'S' its wait status
+struct	ControlMsg {
+	char	type;
+	int		value;
+};
+
+// --- fd passing ----------------------------------------------------------
+
+static ssize_t	sendFds(int sock, const char* data, size_t len, const int* fds, int nfds) {
+	struct msghdr	msg;
+	struct iovec	iov;
+	char			control[CMSG_SPACE(2 * sizeof(int))];
+
+	std::memset(&msg, 0, sizeof(msg));
+	std::memset(control, 0, sizeof(control));
+	iov.iov_base = const_cast<char*>(data);
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+	struct cmsghdr*	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+	std::memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+	return sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// Blocking; used by the spawner and the launchers only
+static ssize_t	recvFds(int sock, char* data, size_t cap, int* fds, int maxFds, int& nfds) {
+	struct msghdr	msg;
+	struct iovec	iov;
+	char			control[CMSG_SPACE(2 * sizeof(int))];
+
+	std::memset(&msg, 0, sizeof(msg));
+	iov.iov_base = data;
+	iov.iov_len = cap;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	nfds = 0;
+	ssize_t	n = recvmsg(sock, &msg, 0);
+	if (n <= 0)
+		return n;
+	for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+			continue;
+		int	count = static_cast<int>((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		for (int i = 0; i < count; ++i) {
+			int	fd;
+			std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+			if (nfds < maxFds)
+				fds[nfds++] = fd;
+			else
+				close(fd);
+		}
+	}
+	if (msg.msg_flags & MSG_TRUNC)
+		return -1;
+	return n;
+}
+
+// --- child side: spawner and launchers (never return, _exit only) ----------
+
+static void	sendControl(int ctl, char type, int value) {
+	ControlMsg	msg;
+
+	msg.type = type;
+	msg.value = value;
+	send(ctl, &msg, sizeof(msg), MSG_NOSIGNAL);
+}
+
+/**
+ * "interpreter\0script\0NAME=value\0..." -> argv/envp pointing into the
+ * job, then posix_spawn(): the pipe ends become stdin/stdout through file
+ * actions and SIGPIPE gets its default back. glibc spawns with
+ * CLONE_VFORK, so no page table is copied, and an exec failure comes
+ * back as the return value. Returns the pid or -1.
+ */
+static pid_t	spawnScript(int ctl, char* job, size_t len, const int* fds) {
+	vector<char*>				parts;
+	posix_spawn_file_actions_t	actions;
+	posix_spawnattr_t			attr;
+	sigset_t					defaults;
+	pid_t						pid = -1;
+
+	for (size_t i = 0; i < len; i += std::strlen(job + i) + 1)
+		parts.push_back(job + i);
+	if (parts.size() < 2)
+		return -1;
+	char*	argv[] = { parts[0], parts[1], NULL };
+	parts.push_back(NULL);
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, fds[0]);
+	posix_spawn_file_actions_addclose(&actions, fds[1]);
+	posix_spawn_file_actions_addclose(&actions, ctl);
+	posix_spawnattr_init(&attr);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	sigaddset(&defaults, SIGHUP);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+	int	err = posix_spawn(&pid, argv[0], &actions, &attr, argv, &parts[2]);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if (err != 0) {
+		std::cerr << "Execve failed: " << argv[0] << ": " << std::strerror(err) << std::endl;
+		return -1;
+	}
+	return pid;
+}
+
+static void	setLimit(int resource, rlim_t soft, rlim_t hard) {
+	struct rlimit	lim;
+
+	lim.rlim_cur = soft;
+	lim.rlim_max = hard;
+	if (setrlimit(resource, &lim) == -1)
+		std::cerr << "CGI launcher: setrlimit: " << std::strerror(errno) << std::endl;
+}
+
+/**
+ * posix_spawn() has no rlimit attribute, so the launcher takes on the
+ * scripts' limits itself: it runs nothing of its own between scripts and
+ * needs a handful of descriptors. ASan reserves terabytes of address
+ * space, a sanitized build leaves RLIMIT_AS alone.
+ */
+static void	limitScripts() {
+	setLimit(RLIMIT_CPU, CGI_RLIMIT_CPU_SEC, CGI_RLIMIT_CPU_SEC + 1);
+	setLimit(RLIMIT_NOFILE, CGI_RLIMIT_NOFILE, CGI_RLIMIT_NOFILE);
+#ifndef __SANITIZE_ADDRESS__
+	setLimit(RLIMIT_AS, static_cast<rlim_t>(CGI_RLIMIT_AS_MB) << 20,
+		static_cast<rlim_t>(CGI_RLIMIT_AS_MB) << 20);
+#endif
+}
+
+/**
+ * One job at a time: spawn the script, report its pid, wait for it and
+ * report the status. Exits when the server closes the socket.
+ */
+static void	launcherLoop(int ctl) {
+	static char	job[CGI_JOB_MAX + 1];
+
+	limitScripts();
+	while (true) {
+		int		fds[2];
+		int		nfds;
+		ssize_t	n = recvFds(ctl, job, CGI_JOB_MAX, fds, 2, nfds);
+		if (n == 0 || (n < 0 && errno != EINTR))
+			_exit(0);
+		if (n < 0)
+			continue;
+		int	status = 1 << 8; // as if exit(1): 500
+		if (nfds == 2) {
+			job[n] = '\0';
+			pid_t	pid = spawnScript(ctl, job, static_cast<size_t>(n), fds);
+			if (pid > 0) {
+				sendControl(ctl, 'P', pid);
+				while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+					;
+			}
+		}
+		for (int i = 0; i < nfds; ++i)
+			close(fds[i]);
+		sendControl(ctl, 'S', status);
+	}
+}
+
+/**
+ * Forked once, before the server grows: every launcher is a copy of this
+ * small process rather than of the server. Each message carries the
+ * launcher's end of a fresh control socket.
+ */
+static void	spawnerLoop(int sock) {
+	signal(SIGCHLD, SIG_IGN); // launchers are reaped by the kernel
+	while (true) {
+		char	c;
+		int		fd;
+		int		nfds;
+		ssize_t	n = recvFds(sock, &c, 1, &fd, 1, nfds);
+		if (n == 0 || (n < 0 && errno != EINTR)) {
+			// server gone: outlive the launchers, they exit on EOF too
+			while (wait(NULL) != -1 || errno == EINTR)
+				;
+			_exit(0);
+		}
+		if (n < 0 || nfds != 1)
+			continue;
+		if (fork() == 0) {
+			close(sock);
+			signal(SIGCHLD, SIG_DFL); // the launcher waits for its scripts
+			launcherLoop(fd);
+		}
+		close(fd); // fork failure: the server sees EOF on this launcher
+	}
+}
+
+// --- pool ----------------------------------------------------------------
+
+static double	msSince(const struct timeval& then) {
+	struct timeval	now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - then.tv_sec) * 1000.0 + (now.tv_usec - then.tv_usec) / 1000.0;
+}
+
+CgiPool::CgiPool() : _spawner(-1), _spawnerPid(-1), _maxConcurrent(CGI_MAX_CONCURRENT) { }
+
+CgiPool::~CgiPool() {
+	closeAll();
+}
+
+/**
+ * Forks the spawner and warms up CGI_POOL_MIN launchers per extension.
+ * Called before the first poll(); the spawner keeps only its socket.
+ * Called again after a configuration reload, it only warms up the
+ * extensions not seen before (and forks the spawner if there was none).
+ */
+bool	CgiPool::start(const std::set<string>& extensions) {
+	std::set<string>	added;
+
+	for (std::set<string>::const_iterator it = extensions.begin(); it != extensions.end(); ++it) {
+		if (_stats.find(*it) == _stats.end())
+			added.insert(*it);
+	}
+	if (added.empty())
+		return true;
+	if (_spawner == -1 && !startSpawner())
+		return false;
+	for (std::set<string>::const_iterator it = added.begin(); it != added.end(); ++it) {
+		std::memset(&_stats[*it], 0, sizeof(CgiPoolStats));
+		for (size_t i = 0; i < CGI_POOL_MIN; ++i)
+			spawnWorker(*it);
+	}
+	Logger::log(LOG_INFO, "CGI pool: " + toString(_workers.size()) + " launchers for "
+		+ toString(_stats.size()) + " extension(s)");
+	return true;
+}
+
+bool	CgiPool::startSpawner() {
+	int	sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		Logger::logErrno(LOG_ERROR, "CGI pool: socketpair");
+		return false;
+	}
+	Logger::flush();	// or the spawner would write buffered lines a second time
+	pid_t	pid = fork();
+	if (pid == -1) {
+		Logger::logErrno(LOG_ERROR, "CGI pool: fork");
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	}
+	if (pid == 0) {
+		int	max_fd = sysconf(_SC_OPEN_MAX);
+		if (max_fd == -1) max_fd = 1024;
+		for (int i = 3; i < max_fd; ++i) {
+			if (i != sv[1])
+				close(i);
+		}
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		signal(SIGHUP, SIG_IGN);	// a reload is for the server, not its CGI processes
+		spawnerLoop(sv[1]);
+	}
+	close(sv[1]);
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	_spawner = sv[0];
+	_spawnerPid = pid;
+	return true;
+}
+
+// Top-level cgi_max_concurrent
+void	CgiPool::setMaxConcurrent(size_t max) {
+	_maxConcurrent = max;
+}
+
+/**
+ * `env` is CgiHandler::buildEnvBlock()'s "NAME=value\0..." block. With
+ * bodyComplete false the rest of the request body follows via feedBody().
+ * A groupLimit other than 0 caps the scripts of `group` running at once.
+ */
+void	CgiPool::submit(int clientFd, const string& interpreter, const string& script,
+						const string& env, const string& body, bool bodyComplete,
+						const string& group, size_t groupLimit) {
+	Job		job;
+	size_t	dot = script.find_last_of('.');
+
+	job.clientFd = clientFd;
+	job.ext = (dot == string::npos) ? "" : script.substr(dot + 1);
+	job.payload.reserve(interpreter.size() + script.size() + 2 + env.size());
+	job.payload.append(interpreter).push_back('\0');
+	job.payload.append(script).push_back('\0');
+	job.payload.append(env);
+	if (job.payload.size() > CGI_JOB_MAX) {
+		Logger::log(LOG_ERROR, "CGI: environment too large for " + script);
+		finish(clientFd, 500, "");
+		return;
+	}
+	CgiPoolStats&	stats = _stats[job.ext];
+	if (_queue.size() >= CGI_QUEUE_MAX) {
+		Logger::log(LOG_WARNING, "CGI: queue full, rejecting " + script);
+		stats.rejected++;
+		finish(clientFd, 503, "");
+		return;
+	}
+	job.group = group;
+	job.groupLimit = groupLimit;
+	job.body = body;
+	job.bodyComplete = bodyComplete;
+	gettimeofday(&job.queued, NULL);
+	_queue.push_back(job);
+	size_t	queued = queuedCount(job.ext);
+	if (queued > stats.peakQueued)
+		stats.peakQueued = queued;
+	pump();
+}
+
+/**
+ * Hands queued jobs to idle launchers in FIFO order while fewer than
+ * _maxConcurrent scripts run, asking the spawner for new launchers while
+ * an extension is below CGI_POOL_MAX. Jobs of a location at its
+ * cgi_max_concurrent, or of an extension without a free launcher, are
+ * passed over. A launcher that was just requested can take a job right
+ * away: it waits in its socket.
+ */
+void	CgiPool::pump() {
+	size_t	running = busyCount(NULL);
+
+	for (std::deque<Job>::iterator it = _queue.begin(); it != _queue.end() && running < _maxConcurrent; ) {
+		if (it->groupLimit > 0 && busyCount(&it->group) >= it->groupLimit) {
+			++it;
+			continue;
+		}
+		Worker*	idle = idleWorker(it->ext);
+		if (idle == NULL && workerCount(it->ext) < CGI_POOL_MAX && spawnWorker(it->ext))
+			idle = idleWorker(it->ext);
+		if (idle == NULL) {
+			if (workerCount(it->ext) == 0) {
+				Logger::log(LOG_ERROR, "CGI pool: no launcher available for ." + it->ext);
+				finish(it->clientFd, 502, "");
+				it = _queue.erase(it);
+			} else {
+				++it;
+			}
+			continue;
+		}
+		Job	job;
+		job.clientFd = it->clientFd;
+		job.queued = it->queued;
+		job.group.swap(it->group);
+		job.payload.swap(it->payload);
+		job.body.swap(it->body);
+		job.bodyComplete = it->bodyComplete;
+		it = _queue.erase(it);
+		if (dispatch(*idle, job))
+			++running;
+		else
+			finish(job.clientFd, 500, "");
+	}
+}
+
+CgiPool::Worker*	CgiPool::idleWorker(const string& ext) {
+	for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		if (it->second.state == IDLE && it->second.ext == ext)
+			return &it->second;
+	}
+	return NULL;
+}
+
+bool	CgiPool::spawnWorker(const string& ext) {
+	int		sv[2];
+	char	c = 'L';
+
+	if (_spawner == -1)
+		return false;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		Logger::logErrno(LOG_ERROR, "CGI pool: socketpair");
+		return false;
+	}
+	if (sendFds(_spawner, &c, 1, &sv[1], 1) == -1) {
+		Logger::log(LOG_ERROR, "CGI pool: spawner is gone");
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	}
+	close(sv[1]);
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	Worker&	worker = _workers[sv[0]];
+	worker.ctl = sv[0];
+	worker.ext = ext;
+	worker.state = IDLE;
+	worker.served = 0;
+	worker.lastUse = time(NULL);
+	worker.clientFd = -1;
+	worker.in = -1;
+	worker.out = -1;
+	worker.paused = false;
+	worker.bodySent = 0;
+	worker.bodyComplete = true;
+	worker.pid = -1;
+	worker.exited = false;
+	worker.status = 0;
+	worker.started = 0;
+	worker.lastIo = 0;
+	_stats[ext].spawned++;
+	if (CGI_POOL_DEBUG) std::cout << "CGI pool: launcher " << sv[0] << " for ." << ext << std::endl;
+	return true;
+}
+
+/**
+ * Creates the script's stdin/stdout pipes and sends their far ends with
+ * the job. A launcher that cannot be reached is dropped.
+ */
+bool	CgiPool::dispatch(Worker& worker, Job& job) {
+	int	in[2];
+	int	out[2];
+
+	if (pipe(in) == -1) {
+		Logger::logErrno(LOG_ERROR, "CGI: pipe");
+		return false;
+	}
+	if (pipe(out) == -1) {
+		Logger::logErrno(LOG_ERROR, "CGI: pipe");
+		close(in[0]);
+		close(in[1]);
+		return false;
+	}
+	int		passed[2] = { in[0], out[1] };
+	ssize_t	sent = sendFds(worker.ctl, job.payload.data(), job.payload.size(), passed, 2);
+	close(in[0]);
+	close(out[1]);
+	if (sent == -1) {
+		Logger::log(LOG_WARNING, "CGI pool: launcher " + toString(worker.ctl) + " unreachable");
+		close(in[1]);
+		close(out[0]);
+		closeWorker(worker.ctl);
+		return false;
+	}
+	fcntl(in[1], F_SETFD, FD_CLOEXEC);
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+	fcntl(out[0], F_SETFD, FD_CLOEXEC);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+	worker.state = BUSY;
+	worker.group.swap(job.group);
+	worker.clientFd = job.clientFd;
+	worker.in = in[1];
+	worker.out = out[0];
+	worker.paused = false;
+	worker.body.swap(job.body);
+	worker.bodySent = 0;
+	worker.bodyComplete = job.bodyComplete;
+	worker.pid = -1;
+	worker.exited = false;
+	worker.status = 0;
+	worker.started = time(NULL);
+	worker.lastIo = worker.started;
+	_pipes[worker.in] = worker.ctl;
+	_pipes[worker.out] = worker.ctl;
+	if (worker.body.empty() && worker.bodyComplete)
+		closePipe(worker.in);
+
+	CgiPoolStats&	stats = _stats[worker.ext];
+	double			waited = msSince(job.queued);
+	stats.dispatched++;
+	stats.waitTotalMs += waited;
+	if (waited > stats.waitMaxMs)
+		stats.waitMaxMs = waited;
+	return true;
+}
+
+void	CgiPool::cancel(int clientFd) {
+	vector<int>	running;
+
+	// output read in this iteration, not picked up yet
+	for (vector<UpstreamResult>::iterator it = _finished.begin(); it != _finished.end(); ) {
+		if (it->clientFd == clientFd)
+			it = _finished.erase(it);
+		else
+			++it;
+	}
+	for (std::deque<Job>::iterator it = _queue.begin(); it != _queue.end(); ) {
+		if (it->clientFd == clientFd)
+			it = _queue.erase(it);
+		else
+			++it;
+	}
+	for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		if (it->second.state == BUSY && it->second.clientFd == clientFd)
+			running.push_back(it->first);
+	}
+	for (size_t i = 0; i < running.size(); ++i) {
+		map<int, Worker>::iterator	it = _workers.find(running[i]);
+		if (it != _workers.end())
+			detach(it->second);
+	}
+}
+
+/**
+ * More of the request body of a submitted job. It waits in the job
+ * until a launcher takes it, then is written as the script's stdin
+ * pipe has room. Dropped once the script is gone or closed its stdin.
+ */
+void	CgiPool::feedBody(int clientFd, const string& data, bool last) {
+	for (std::deque<Job>::iterator it = _queue.begin(); it != _queue.end(); ++it) {
+		if (it->clientFd == clientFd) {
+			it->body.append(data);
+			it->bodyComplete = last;
+			return;
+		}
+	}
+	for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		Worker&	worker = it->second;
+		if (worker.state != BUSY || worker.clientFd != clientFd || worker.in == -1)
+			continue;
+		if (worker.bodySent > 0) {
+			worker.body.erase(0, worker.bodySent);
+			worker.bodySent = 0;
+		}
+		worker.body.append(data);
+		worker.bodyComplete = last;
+		writeBody(worker);
+		return;
+	}
+}
+
+// Request body accepted for this client but not written to the script yet
+size_t	CgiPool::bodyBacklog(int clientFd) const {
+	for (std::deque<Job>::const_iterator it = _queue.begin(); it != _queue.end(); ++it) {
+		if (it->clientFd == clientFd)
+			return it->body.size();
+	}
+	for (map<int, Worker>::const_iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		const Worker&	worker = it->second;
+		if (worker.state == BUSY && worker.clientFd == clientFd && worker.in != -1)
+			return worker.body.size() - worker.bodySent;
+	}
+	return 0;
+}
+
+/**
+ * Stops (or resumes) reading the script's stdout for this client. A
+ * paused script blocks once its pipe is full; only CGI_RUN_MAX_SEC
+ * still applies to it.
+ */
+void	CgiPool::throttle(int clientFd, bool paused) {
+	for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		Worker&	worker = it->second;
+		if (worker.state != BUSY || worker.clientFd != clientFd || worker.paused == paused)
+			continue;
+		worker.paused = paused;
+		if (!paused)
+			worker.lastIo = time(NULL);
+	}
+}
+
+// --- events --------------------------------------------------------------
+
+bool	CgiPool::owns(int fd) const {
+	return _workers.find(fd) != _workers.end() || _pipes.find(fd) != _pipes.end();
+}
+
+void	CgiPool::pollEvents(map<int, short>& out) const {
+	for (map<int, Worker>::const_iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		out[it->first] = POLLIN;
+		if (it->second.in != -1 && it->second.bodySent < it->second.body.size())
+			out[it->second.in] = POLLOUT;
+		if (it->second.out != -1 && !it->second.paused)
+			out[it->second.out] = POLLIN;
+	}
+}
+
+void	CgiPool::handleEvent(int fd, short revents) {
+	map<int, Worker>::iterator	w = _workers.find(fd);
+	if (w != _workers.end()) {
+		readControl(w->second);
+		return;
+	}
+	map<int, int>::iterator	p = _pipes.find(fd);
+	if (p == _pipes.end())
+		return;
+	Worker&	worker = _workers[p->second];
+	if (fd == worker.in) {
+		if (revents & (POLLERR | POLLHUP))
+			closePipe(worker.in); // the script does not read (all of) its stdin
+		else
+			writeBody(worker);
+	} else if (fd == worker.out) {
+		readOutput(worker);
+	}
+	settle(worker);
+}
+
+void	CgiPool::readControl(Worker& worker) {
+	ControlMsg	msg;
+
+	while (true) {
+		ssize_t	n = recv(worker.ctl, &msg, sizeof(msg), MSG_DONTWAIT);
+		if (n < 0)
+			break;
+		if (n == 0) {
+			// crashed or killed launcher, or the spawner could not fork it
+			string	ext = worker.ext;
+			Logger::log(LOG_WARNING, "CGI pool: launcher for ." + ext + " exited");
+			if (worker.state == BUSY && worker.clientFd != -1)
+				finish(worker.clientFd, 500, "");
+			closeWorker(worker.ctl);
+			pump();
+			return;
+		}
+		if (n != sizeof(msg))
+			continue;
+		if (msg.type == 'P') {
+			worker.pid = msg.value;
+			if (worker.clientFd == -1 && worker.state == BUSY)
+				kill(worker.pid, SIGKILL); // timed out or cancelled before it started
+		} else if (msg.type == 'S') {
+			worker.exited = true;
+			worker.status = msg.value;
+		}
+	}
+	settle(worker);
+}
+
+void	CgiPool::writeBody(Worker& worker) {
+	while (worker.bodySent < worker.body.size()) {
+		ssize_t	n = write(worker.in, worker.body.data() + worker.bodySent,
+						worker.body.size() - worker.bodySent);
+		if (n <= 0)
+			return; // pipe full: wait for POLLOUT, a closed reader comes back as POLLERR
+		worker.bodySent += static_cast<size_t>(n);
+		worker.lastIo = time(NULL);
+	}
+	worker.bodySent = 0;
+	if (!worker.bodyComplete) {
+		worker.body.clear(); // the client sends more
+		return;
+	}
+	string().swap(worker.body);
+	closePipe(worker.in);
+}
+
+// One read per event, passed on right away: ServerManager gets to
+// throttle() between two reads
+void	CgiPool::readOutput(Worker& worker) {
+	char	buf[65536];
+
+	if (worker.paused)
+		return;
+	ssize_t	n = read(worker.out, buf, sizeof(buf));
+	if (n > 0) {
+		worker.lastIo = time(NULL);
+		if (worker.clientFd != -1)
+			forward(worker.clientFd, buf, static_cast<size_t>(n));
+	} else if (n == 0) {
+		closePipe(worker.out);
+	}
+}
+
+/**
+ * A job is over once the script exited and its output ended (or the
+ * request was given up). The launcher then goes back to the pool, or is
+ * replaced after CGI_POOL_MAX_REQUESTS scripts.
+ */
+void	CgiPool::settle(Worker& worker) {
+	if (worker.state != BUSY || !worker.exited)
+		return;
+	if (worker.clientFd != -1) {
+		if (worker.out != -1)
+			return;
+		short	code = 0;
+		if (WIFEXITED(worker.status) && WEXITSTATUS(worker.status) != 0) {
+			if (CGI_POOL_DEBUG) std::cout << "CGI: script exited with " << WEXITSTATUS(worker.status) << std::endl;
+			code = 500;
+		} else if (WIFSIGNALED(worker.status)) {
+			if (CGI_POOL_DEBUG) std::cout << "CGI: script terminated by signal" << std::endl;
+			code = 500;
+		}
+		finish(worker.clientFd, code, "");
+		worker.clientFd = -1;
+	}
+	closePipe(worker.in);
+	closePipe(worker.out);
+	string().swap(worker.body);
+	worker.state = IDLE;
+	worker.paused = false;
+	worker.pid = -1;
+	worker.served++;
+	worker.lastUse = time(NULL);
+
+	if (worker.served >= CGI_POOL_MAX_REQUESTS) {
+		_stats[worker.ext].retired++;
+		closeWorker(worker.ctl);
+	}
+	pump();
+}
+
+// Gives up the running script (timeout, client gone); the launcher stays
+// busy until the killed script's status arrives.
+void	CgiPool::detach(Worker& worker) {
+	worker.clientFd = -1;
+	closePipe(worker.in);
+	closePipe(worker.out);
+	if (worker.pid > 0 && !worker.exited)
+		kill(worker.pid, SIGKILL);
+	settle(worker);
+}
+
+void	CgiPool::forward(int clientFd, const char* data, size_t len) {
+	UpstreamResult	result;
+
+	result.clientFd = clientFd;
+	result.errorCode = 0;
+	result.complete = false;
+	_finished.push_back(result);
+	_finished.back().output.assign(data, len);
+}
+
+void	CgiPool::finish(int clientFd, short errorCode, const string& output) {
+	UpstreamResult	result;
+
+	result.clientFd = clientFd;
+	result.errorCode = errorCode;
+	result.complete = true;
+	_finished.push_back(result);
+	_finished.back().output = output;
+}
+
+void	CgiPool::takeFinished(vector<UpstreamResult>& out) {
+	out.insert(out.end(), _finished.begin(), _finished.end());
+	_finished.clear();
+}
+
+/**
+ * Script timeouts (silent too long, or running too long) and queue
+ * timeouts, then pool upkeep: idle launchers above CGI_POOL_MIN exit,
+ * missing ones (crashed, recycled) are replaced.
+ */
+void	CgiPool::checkTimeouts(time_t now) {
+	vector<int>	expired;
+
+	for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		const Worker&	worker = it->second;
+		if (worker.state != BUSY || worker.clientFd == -1)
+			continue;
+		if (now - worker.started >= CGI_RUN_MAX_SEC
+				|| (!worker.paused && now - worker.lastIo >= CGI_TIMEOUT_SEC))
+			expired.push_back(it->first);
+	}
+	for (size_t i = 0; i < expired.size(); ++i) {
+		map<int, Worker>::iterator	it = _workers.find(expired[i]);
+		if (it == _workers.end())
+			continue;
+		Logger::log(LOG_WARNING, "CGI: script timed out (." + it->second.ext + ")");
+		_stats[it->second.ext].timeouts++;
+		finish(it->second.clientFd, 504, "");
+		detach(it->second);
+	}
+	for (map<string, CgiPoolStats>::iterator s = _stats.begin(); s != _stats.end(); ++s) {
+		const string&	ext = s->first;
+		vector<int>		idle;
+		for (map<int, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+			if (it->second.ext == ext && it->second.state == IDLE
+					&& now - it->second.lastUse > CGI_POOL_IDLE_SEC)
+				idle.push_back(it->first);
+		}
+		for (size_t i = 0; i < idle.size() && workerCount(ext) > CGI_POOL_MIN; ++i) {
+			s->second.retired++;
+			closeWorker(idle[i]);
+		}
+		while (workerCount(ext) < CGI_POOL_MIN && spawnWorker(ext))
+			;
+	}
+	while (!_queue.empty() && now - _queue.front().queued.tv_sec > CGI_QUEUE_TIMEOUT_SEC) {
+		Logger::log(LOG_WARNING, "CGI: request waited too long to run (." + _queue.front().ext + ")");
+		_stats[_queue.front().ext].rejected++;
+		finish(_queue.front().clientFd, 503, "");
+		_queue.pop_front();
+	}
+}
+
+// --- descriptors -----------------------------------------------------------
+
+// Forgets the pipe now, close()s it in reapClosed()
+void	CgiPool::closePipe(int& fd) {
+	if (fd == -1)
+		return;
+	_pipes.erase(fd);
+	_closed.push_back(fd);
+	fd = -1;
+}
+
+// The launcher exits when it reads EOF on its control socket
+void	CgiPool::closeWorker(int ctl) {
+	map<int, Worker>::iterator	it = _workers.find(ctl);
+	if (it == _workers.end())
+		return;
+	Worker&	worker = it->second;
+	if (worker.state == BUSY && worker.pid > 0 && !worker.exited)
+		kill(worker.pid, SIGKILL);
+	closePipe(worker.in);
+	closePipe(worker.out);
+	_closed.push_back(ctl);
+	_workers.erase(it);
+}
+
+void	CgiPool::reapClosed() {
+	for (size_t i = 0; i < _closed.size(); ++i)
+		close(_closed[i]);
+	_closed.clear();
+}
+
+void	CgiPool::closeAll() {
+	if (_spawner == -1)
+		return;
+	for (map<string, CgiPoolStats>::iterator s = _stats.begin(); s != _stats.end(); ++s) {
+		const CgiPoolStats&	st = s->second;
+		Logger::log(LOG_INFO, "CGI pool ." + s->first + ": " + toString(st.dispatched) + " scripts, wait avg "
+			+ toString(st.dispatched ? st.waitTotalMs / st.dispatched : 0.0) + " ms, max "
+			+ toString(st.waitMaxMs) + " ms, peak queue " + toString(st.peakQueued)
+			+ ", spawned " + toString(st.spawned) + ", retired " + toString(st.retired)
+			+ ", timeouts " + toString(st.timeouts) + ", rejected " + toString(st.rejected));
+	}
+	while (!_workers.empty())
+		closeWorker(_workers.begin()->first);
+	_queue.clear();
+	reapClosed();
+	close(_spawner);
+	_spawner = -1;
+	waitpid(_spawnerPid, NULL, 0);
+	_spawnerPid = -1;
+}
+
+void	CgiPool::getStats(map<string, CgiPoolStats>& out) const {
+	out = _stats;
+	for (map<string, CgiPoolStats>::iterator s = out.begin(); s != out.end(); ++s) {
+		s->second.queued = queuedCount(s->first);
+		s->second.workers = workerCount(s->first);
+		s->second.idle = 0;
+	}
+	for (map<int, Worker>::const_iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		if (it->second.state == IDLE)
+			out[it->second.ext].idle++;
+	}
+}
+
+size_t	CgiPool::workerCount(const string& ext) const {
+	size_t	count = 0;
+
+	for (map<int, Worker>::const_iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		if (it->second.ext == ext)
+			++count;
+	}
+	return count;
+}
+
+// Scripts running (or being killed), of one location if `group` is set
+size_t	CgiPool::busyCount(const string* group) const {
+	size_t	count = 0;
+
+	for (map<int, Worker>::const_iterator it = _workers.begin(); it != _workers.end(); ++it) {
+		if (it->second.state == BUSY && (group == NULL || it->second.group == *group))
+			++count;
+	}
+	return count;
+}
+
+size_t	CgiPool::queuedCount(const string& ext) const {
+	size_t	count = 0;
+
+	for (std::deque<Job>::const_iterator it = _queue.begin(); it != _queue.end(); ++it) {
+		if (it->ext == ext)
+			++count;
+	}
+	return count;
+}
@@ -0,0 +1,174 @@
+#ifndef CGIPOOL_HPP
+# define CGIPOOL_HPP
+
+# include "../../inc/Webserv.hpp"
+# include "UpstreamResult.hpp"
+# include <deque>
+# include <sys/time.h>
+
+# define CGI_POOL_DEBUG 0
+
+# define CGI_POOL_MIN 2				// launchers kept warm per extension
+# define CGI_POOL_MAX 16			// launchers per extension
+# define CGI_MAX_CONCURRENT 32		// scripts running at once, all extensions (cgi_max_concurrent)
+# define CGI_POOL_IDLE_SEC 60		// launchers above CGI_POOL_MIN exit after this
+# define CGI_POOL_MAX_REQUESTS 500	// a launcher is replaced after this many scripts
+# define CGI_TIMEOUT_SEC 5			// no traffic on the script's pipes, and it did not exit
+# define CGI_RUN_MAX_SEC 25			// from dispatch, paused or not (client timeout is 30)
+# define CGI_QUEUE_MAX 256			// requests waiting to run; more are answered 503
+# define CGI_QUEUE_TIMEOUT_SEC 10	// waiting to run, then 503
+# define CGI_JOB_MAX 65536			// interpreter, script and environment of one job
+# define CGI_STREAM_BUFFER 65536	// bytes waiting at which reading script or client pauses
+# define CGI_RLIMIT_CPU_SEC 30		// per script: CPU time (SIGXCPU, SIGKILL a second later)
+# define CGI_RLIMIT_AS_MB 1024		// address space
+# define CGI_RLIMIT_NOFILE 64		// open files
+
+// Per-extension counters, see CgiPool::getStats()
+struct	CgiPoolStats {
+	size_t	workers;		// launchers alive
+	size_t	idle;
+	size_t	queued;			// requests waiting for a launcher right now
+	size_t	peakQueued;
+	size_t	dispatched;
+	size_t	spawned;
+	size_t	retired;		// idle-reaped or recycled after CGI_POOL_MAX_REQUESTS
+	size_t	timeouts;
+	size_t	rejected;		// 503: queue full or waited CGI_QUEUE_TIMEOUT_SEC
+	double	waitTotalMs;	// submit -> dispatch, summed over `dispatched`
+	double	waitMaxMs;
+};
+
+/**
+ * Briefly: runs CGI scripts through a pool of pre-forked launchers.
+ *
+ * A CGI script needs a fresh interpreter per request, so what is kept
+ * warm is the process that starts it. start() forks one spawner while
+ * the server is still small; on request the spawner forks launchers, one
+ * control socket (AF_UNIX, SOCK_SEQPACKET) each. A launcher receives a
+ * job (interpreter, script, environment and the two pipe ends of the
+ * script's stdin/stdout via SCM_RIGHTS), starts the script with
+ * posix_spawn(), reports its pid and waits for its exit status. The server never
+ * forks itself, and the stdin/stdout pipes are served by the poll() loop
+ * like any other socket, so a slow script blocks nobody else.
+ *
+ * Output is handed on as it is read (UpstreamResult::complete false),
+ * the exit status follows in a last result. ServerManager pauses the
+ * read side with throttle() while the client is behind by
+ * CGI_STREAM_BUFFER bytes; the script then blocks on its full pipe.
+ * The request body can likewise arrive after submit(), through
+ * feedBody(); ServerManager stops reading the client while
+ * bodyBacklog() is CGI_STREAM_BUFFER or more.
+ *
+ * Launchers are grouped per CGI extension ("py", "php", ... from
+ * Location::getCgi()): CGI_POOL_MIN of them are started up front, more
+ * on demand up to CGI_POOL_MAX, idle ones above the minimum exit after
+ * CGI_POOL_IDLE_SEC and each one is recycled after CGI_POOL_MAX_REQUESTS
+ * scripts.
+ *
+ * Admission: at most CGI_MAX_CONCURRENT scripts (the top-level
+ * cgi_max_concurrent directive) run at once, and at most the location's
+ * cgi_max_concurrent of one location. Requests beyond that wait in one
+ * FIFO queue of CGI_QUEUE_MAX entries; a job whose location is full
+ * does not hold up those behind it. A full queue, or a wait longer than
+ * CGI_QUEUE_TIMEOUT_SEC, is answered 503. Each launcher runs under the
+ * CGI_RLIMIT_* limits, which its scripts inherit.
+ *
+ * Used by ServerManager exactly like FastCgiClient: pollEvents(),
+ * handleEvent(), takeFinished(), reapClosed().
+ */
+class	CgiPool {
+
+	public:
+		CgiPool();
+		~CgiPool();
+
+		bool	start(const std::set<std::string>& extensions);
+		void	setMaxConcurrent(size_t max);
+		void	submit(int clientFd, const std::string& interpreter, const std::string& script,
+					const std::string& env, const std::string& body, bool bodyComplete,
+					const std::string& group, size_t groupLimit);
+		void	feedBody(int clientFd, const std::string& data, bool last);
+		size_t	bodyBacklog(int clientFd) const;
+		void	cancel(int clientFd);
+		void	throttle(int clientFd, bool paused);
+		bool	owns(int fd) const;
+		void	handleEvent(int fd, short revents);
+		void	checkTimeouts(time_t now);
+		void	pollEvents(std::map<int, short>& out) const;
+		void	takeFinished(std::vector<UpstreamResult>& out);
+		void	reapClosed();
+		void	closeAll();
+		void	getStats(std::map<std::string, CgiPoolStats>& out) const;
+
+	private:
+		CgiPool(const CgiPool&);
+		CgiPool&	operator=(const CgiPool&);
+
+		struct	Job {
+			int				clientFd;
+			std::string		ext;
+			std::string		group;		// location, when it has a cgi_max_concurrent
+			size_t			groupLimit;
+			std::string		payload;	// "interpreter\0script\0NAME=value\0..."
+			std::string		body;
+			bool			bodyComplete;
+			struct timeval	queued;
+		};
+
+		enum	e_worker_state {
+			IDLE,
+			BUSY		// a script runs, or its exit status is still due
+		};
+
+		struct	Worker {
+			int				ctl;		// control socket, keys _workers
+			std::string		ext;
+			e_worker_state	state;
+			size_t			served;
+			time_t			lastUse;
+			// the running script
+			std::string		group;
+			int				clientFd;	// -1 once answered, timed out or cancelled
+			int				in;			// its stdin, -1 when the body is written
+			int				out;		// its stdout, -1 at EOF
+			bool			paused;		// stdout not polled: the client is behind
+			std::string		body;		// request body not written yet, from bodySent on
+			size_t			bodySent;
+			bool			bodyComplete;	// no more body will be fed
+			pid_t			pid;
+			bool			exited;
+			int				status;
+			time_t			started;	// dispatched, for CGI_RUN_MAX_SEC
+			time_t			lastIo;		// start, last read or write, end of a pause
+		};
+
+		int										_spawner;
+		pid_t									_spawnerPid;
+		std::map<int, Worker>					_workers;
+		std::map<int, int>						_pipes;		// script stdin/stdout -> ctl
+		std::deque<Job>							_queue;
+		size_t									_maxConcurrent;
+		std::map<std::string, CgiPoolStats>		_stats;
+		std::vector<UpstreamResult>				_finished;
+		std::vector<int>						_closed;
+
+		void	pump();
+		bool	startSpawner();
+		bool	spawnWorker(const std::string& ext);
+		Worker*	idleWorker(const std::string& ext);
+		bool	dispatch(Worker& worker, Job& job);
+		void	readControl(Worker& worker);
+		void	writeBody(Worker& worker);
+		void	readOutput(Worker& worker);
+		void	settle(Worker& worker);
+		void	detach(Worker& worker);
+		void	closePipe(int& fd);
+		void	closeWorker(int ctl);
+		void	forward(int clientFd, const char* data, size_t len);
+		void	finish(int clientFd, short errorCode, const std::string& output);
+		size_t	workerCount(const std::string& ext) const;
+		size_t	busyCount(const std::string* group) const;
+		size_t	queuedCount(const std::string& ext) const;
+};
+
+#endif
@@ -0,0 +1,560 @@
+#include "FastCgiClient.hpp"
+#include <netdb.h>
+#include <poll.h>
+#include <sys/un.h>
+
+using std::string;
+using std::map;
+using std::vector;
+
+// FastCGI 1.0 record types and constants
+enum	e_fcgi {
+	FCGI_VERSION_1 = 1,
+	FCGI_BEGIN_REQUEST = 1,
+	FCGI_END_REQUEST = 3,
+	FCGI_PARAMS = 4,
+	FCGI_STDIN = 5,
+	FCGI_STDOUT = 6,
+	FCGI_STDERR = 7,
+	FCGI_RESPONDER = 1,
+	FCGI_KEEP_CONN = 1,
+	FCGI_REQUEST_COMPLETE = 0,
+	FCGI_OVERLOADED = 2,
+	FCGI_HEADER_LEN = 8,
+	FCGI_MAX_CONTENT = 65528	// largest multiple of 8 below 65535: no padding
+};
+
+FastCgiClient::FastCgiClient() { }
+
+FastCgiClient::~FastCgiClient() {
+	closeAll();
+}
+
+// --- encoding ------------------------------------------------------------
+
+static void	appendRecord(string& out, unsigned char type, const char* data, size_t len) {
+	unsigned char	padding = static_cast<unsigned char>((8 - len % 8) % 8);
+	char			header[FCGI_HEADER_LEN] = {
+		FCGI_VERSION_1, static_cast<char>(type),
+		0, 1,	// request id, set on dispatch
+		static_cast<char>((len >> 8) & 0xFF), static_cast<char>(len & 0xFF),
+		static_cast<char>(padding), 0
+	};
+
+	out.append(header, FCGI_HEADER_LEN);
+	out.append(data, len);
+	out.append(padding, '\0');
+}
+
+// Splits a stream (PARAMS or STDIN) into records and terminates it
+static void	appendStream(string& out, unsigned char type, const string& data) {
+	for (size_t off = 0; off < data.size(); off += FCGI_MAX_CONTENT)
+		appendRecord(out, type, data.data() + off, std::min<size_t>(FCGI_MAX_CONTENT, data.size() - off));
+	appendRecord(out, type, "", 0);
+}
+
+static void	appendLength(string& out, size_t len) {
+	if (len < 128) {
+		out += static_cast<char>(len);
+		return;
+	}
+	out += static_cast<char>(((len >> 24) & 0x7F) | 0x80);
+	out += static_cast<char>((len >> 16) & 0xFF);
+	out += static_cast<char>((len >> 8) & 0xFF);
+	out += static_cast<char>(len & 0xFF);
+}
+
+/**
+ * BEGIN_REQUEST (responder, keep the connection) + the params as
+ * name-value pairs, closed by an empty record. The body follows as STDIN
+ * records, cut while it is sent (nextStdinRecord).
+ */
+void	FastCgiClient::encodeRequest(string& out, const map<string, string>& params) {
+	const char	begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+	string		pairs;
+
+	for (map<string, string>::const_iterator it = params.begin(); it != params.end(); ++it) {
+		appendLength(pairs, it->first.size());
+		appendLength(pairs, it->second.size());
+		pairs += it->first;
+		pairs += it->second;
+	}
+	out.reserve(out.size() + pairs.size() + 32);
+	appendRecord(out, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+	appendStream(out, FCGI_PARAMS, pairs);
+}
+
+static void	setRequestId(string& records, unsigned short id) {
+	size_t	pos = 0;
+
+	while (pos + FCGI_HEADER_LEN <= records.size()) {
+		const unsigned char*	h = reinterpret_cast<const unsigned char*>(records.data() + pos);
+		size_t					len = (static_cast<size_t>(h[4]) << 8 | h[5]) + h[6];
+
+		records[pos + 2] = static_cast<char>(id >> 8);
+		records[pos + 3] = static_cast<char>(id & 0xFF);
+		pos += FCGI_HEADER_LEN + len;
+	}
+}
+
+// --- requests ------------------------------------------------------------
+
+void	FastCgiClient::submit(int clientFd, const string& address,
+							const map<string, string>& params, const string& body) {
+	Job	job;
+
+	job.clientFd = clientFd;
+	job.address = address;
+	job.queued = time(NULL);
+	job.retried = false;
+	encodeRequest(job.records, params);
+	_queues[address].push_back(job);
+	_queues[address].back().body = body;
+	pump(address);
+}
+
+/**
+ * Hands queued requests to idle pooled connections, opening new ones
+ * while the address is below FASTCGI_MAX_CONNS.
+ */
+void	FastCgiClient::pump(const string& address) {
+	std::deque<Job>&	queue = _queues[address];
+
+	while (!queue.empty()) {
+		Conn*	idle = NULL;
+		for (map<int, Conn>::iterator it = _conns.begin(); it != _conns.end(); ++it) {
+			if (it->second.state == IDLE && it->second.address == address) {
+				idle = &it->second;
+				break;
+			}
+		}
+		if (idle == NULL && connCount(address) >= FASTCGI_MAX_CONNS)
+			break;
+		Job	job;
+		job.records.swap(queue.front().records);
+		job.body.swap(queue.front().body);
+		job.clientFd = queue.front().clientFd;
+		job.address = address;
+		job.queued = queue.front().queued;
+		job.retried = queue.front().retried;
+		queue.pop_front();
+		if (idle != NULL) {
+			startJob(*idle, job);
+		} else if (!openConn(address, job)) {
+			finish(job.clientFd, 502, "");
+		}
+	}
+}
+
+bool	FastCgiClient::openConn(const string& address, Job& job) {
+	struct sockaddr_storage	addr;
+	socklen_t				len;
+
+	if (!resolve(address, addr, len)) {
+		Logger::log(LOG_ERROR, "FastCGI: cannot resolve " + address);
+		return false;
+	}
+	int	fd = socket(addr.ss_family, SOCK_STREAM, 0);
+	if (fd == -1) {
+		Logger::logErrno(LOG_ERROR, "FastCGI: socket");
+		return false;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	int	rc = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+	if (rc == -1 && errno != EINPROGRESS) {
+		Logger::logErrno(LOG_ERROR, "FastCGI: connect to " + address);
+		close(fd);
+		return false;
+	}
+	Conn&	conn = _conns[fd];
+	conn.fd = fd;
+	conn.address = address;
+	conn.state = (rc == 0) ? ACTIVE : CONNECTING;
+	conn.outSent = 0;
+	conn.requestId = 0;
+	conn.reused = false;
+	conn.paused = false;
+	startJob(conn, job);
+	if (FCGI_DEBUG) std::cout << "FastCGI: new connection " << fd << " to " << address << std::endl;
+	return true;
+}
+
+/**
+ * Queues the encoded head of the request on the connection; poll()
+ * reports POLLOUT next. The job keeps its records and body until the
+ * responder answers, a retry may need them (failConn).
+ */
+void	FastCgiClient::startJob(Conn& conn, Job& job) {
+	conn.requestId = static_cast<unsigned short>(conn.requestId % 0xFFFF + 1);
+	setRequestId(job.records, conn.requestId);
+	conn.out = job.records;
+	conn.outSent = 0;
+	conn.bodySent = 0;
+	conn.stdinDone = false;
+	conn.in.clear();
+	conn.job.clientFd = job.clientFd;
+	conn.job.address = job.address;
+	conn.job.queued = job.queued;
+	conn.job.retried = job.retried;
+	conn.job.records.swap(job.records);
+	conn.job.body.swap(job.body);
+	conn.answered = false;
+	conn.paused = false;
+	if (conn.state == IDLE) {
+		conn.state = ACTIVE;
+		conn.reused = true;
+	}
+	conn.lastUse = time(NULL);
+}
+
+void	FastCgiClient::cancel(int clientFd) {
+	// output read in this iteration, not picked up yet
+	for (vector<UpstreamResult>::iterator it = _finished.begin(); it != _finished.end(); ) {
+		if (it->clientFd == clientFd)
+			it = _finished.erase(it);
+		else
+			++it;
+	}
+	for (map<string, std::deque<Job> >::iterator q = _queues.begin(); q != _queues.end(); ++q) {
+		for (std::deque<Job>::iterator it = q->second.begin(); it != q->second.end(); ) {
+			if (it->clientFd == clientFd)
+				it = q->second.erase(it);
+			else
+				++it;
+		}
+	}
+	for (map<int, Conn>::iterator it = _conns.begin(); it != _conns.end(); ++it) {
+		if (it->second.state != IDLE && it->second.job.clientFd == clientFd) {
+			// the responder would keep answering: drop the connection
+			string	address = it->second.address;
+			closeConn(it->first);
+			pump(address);
+			return;
+		}
+	}
+}
+
+/**
+ * Stops or resumes reading the responder of `clientFd`'s request. The
+ * time spent waiting for the client does not count towards
+ * FASTCGI_TIMEOUT_SEC.
+ */
+void	FastCgiClient::throttle(int clientFd, bool paused) {
+	for (map<int, Conn>::iterator it = _conns.begin(); it != _conns.end(); ++it) {
+		Conn&	conn = it->second;
+		if (conn.state == IDLE || conn.job.clientFd != clientFd || conn.paused == paused)
+			continue;
+		conn.paused = paused;
+		if (paused)
+			conn.pausedAt = time(NULL);
+		else
+			conn.job.queued += time(NULL) - conn.pausedAt;
+		return;
+	}
+}
+
+// --- events --------------------------------------------------------------
+
+bool	FastCgiClient::owns(int fd) const {
+	return _conns.find(fd) != _conns.end();
+}
+
+void	FastCgiClient::pollEvents(map<int, short>& out) const {
+	for (map<int, Conn>::const_iterator it = _conns.begin(); it != _conns.end(); ++it) {
+		const Conn&	conn = it->second;
+		if (conn.state == CONNECTING)
+			out[conn.fd] = POLLOUT;
+		else
+			out[conn.fd] = (conn.paused ? 0 : POLLIN)
+				| (conn.state == ACTIVE && (conn.outSent < conn.out.size() || !conn.stdinDone) ? POLLOUT : 0);
+	}
+}
+
+void	FastCgiClient::handleEvent(int fd, short revents) {
+	map<int, Conn>::iterator	it = _conns.find(fd);
+	if (it == _conns.end())
+		return;
+	Conn&	conn = it->second;
+
+	if (conn.state == CONNECTING) {
+		if (!(revents & (POLLOUT | POLLERR | POLLHUP)))
+			return;
+		int			err = 0;
+		socklen_t	errLen = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == -1 || err != 0) {
+			Logger::log(LOG_ERROR, "FastCGI: connect to " + conn.address + " failed");
+			failConn(conn, 502);
+			return;
+		}
+		conn.state = ACTIVE;
+	}
+	if (revents & POLLOUT)
+		flush(conn);
+	if (revents & (POLLIN | POLLHUP | POLLERR))
+		readFrom(conn);
+}
+
+void	FastCgiClient::flush(Conn& conn) {
+	while (conn.outSent < conn.out.size() || nextStdinRecord(conn)) {
+		ssize_t	n = write(conn.fd, conn.out.data() + conn.outSent, conn.out.size() - conn.outSent);
+		if (n <= 0)
+			return; // socket buffer full: wait for POLLOUT, errors come back as POLLERR/POLLHUP
+		conn.outSent += static_cast<size_t>(n);
+	}
+	release(conn);
+}
+
+/**
+ * Once everything before went out: the next STDIN record of the body,
+ * or the empty one that ends it. False when the request is fully sent.
+ */
+bool	FastCgiClient::nextStdinRecord(Conn& conn) {
+	if (conn.stdinDone || conn.state != ACTIVE)
+		return false;
+	size_t	len = std::min<size_t>(FCGI_MAX_CONTENT, conn.job.body.size() - conn.bodySent);
+
+	conn.out.clear();
+	conn.outSent = 0;
+	appendRecord(conn.out, FCGI_STDIN, conn.job.body.data() + conn.bodySent, len);
+	setRequestId(conn.out, conn.requestId);
+	conn.bodySent += len;
+	conn.stdinDone = (len == 0);
+	return true;
+}
+
+/**
+ * The request went out and the responder started to answer: there is
+ * no retry any more, records and body are freed instead of being kept
+ * until END_REQUEST.
+ */
+void	FastCgiClient::release(Conn& conn) {
+	if (!conn.answered || !conn.stdinDone || conn.outSent < conn.out.size())
+		return;
+	string().swap(conn.out);
+	conn.outSent = 0;
+	string().swap(conn.job.records);
+	string().swap(conn.job.body);
+}
+
+void	FastCgiClient::readFrom(Conn& conn) {
+	char	buf[65536];
+	bool	eof = false;
+
+	if (conn.paused)
+		return;
+	while (true) {
+		ssize_t	n = read(conn.fd, buf, sizeof(buf));
+		if (n > 0) {
+			conn.in.append(buf, static_cast<size_t>(n));
+			continue;
+		}
+		eof = (n == 0);
+		break;
+	}
+	int	fd = conn.fd;
+	parseRecords(conn);
+	map<int, Conn>::iterator	it = _conns.find(fd);
+	if (!eof || it == _conns.end())
+		return;
+	if (it->second.state == IDLE) {
+		if (FCGI_DEBUG) std::cout << "FastCGI: responder closed idle connection " << fd << std::endl;
+		closeConn(fd);
+	} else {
+		Logger::log(LOG_WARNING, "FastCGI: " + it->second.address + " closed the connection mid-request");
+		failConn(it->second, 502);
+	}
+}
+
+/**
+ * Consumes every complete record. STDOUT is handed on as it comes,
+ * STDERR goes to the log, END_REQUEST finishes the request and returns
+ * the connection to the pool. Records for other request ids are skipped.
+ */
+void	FastCgiClient::parseRecords(Conn& conn) {
+	size_t	pos = 0;
+
+	while (conn.in.size() - pos >= FCGI_HEADER_LEN) {
+		const unsigned char*	h = reinterpret_cast<const unsigned char*>(conn.in.data() + pos);
+		unsigned short			id = static_cast<unsigned short>(h[2] << 8 | h[3]);
+		size_t					contentLen = static_cast<size_t>(h[4]) << 8 | h[5];
+		size_t					recordLen = FCGI_HEADER_LEN + contentLen + h[6];
+
+		if (h[0] != FCGI_VERSION_1) {
+			Logger::log(LOG_ERROR, "FastCGI: malformed record from " + conn.address);
+			failConn(conn, 502);
+			return;
+		}
+		if (conn.in.size() - pos < recordLen)
+			break;
+		const char*	content = conn.in.data() + pos + FCGI_HEADER_LEN;
+		pos += recordLen;
+		if (conn.state != ACTIVE || id != conn.requestId)
+			continue;
+		if (!conn.answered) {
+			conn.answered = true;
+			release(conn);
+		}
+		if (h[1] == FCGI_STDOUT) {
+			if (contentLen > 0)
+				forward(conn.job.clientFd, content, contentLen);
+		} else if (h[1] == FCGI_STDERR && contentLen > 0) {
+			Logger::log(LOG_WARNING, "FastCGI stderr: " + string(content, contentLen));
+		} else if (h[1] == FCGI_END_REQUEST && contentLen >= 8) {
+			unsigned char	protocolStatus = static_cast<unsigned char>(content[4]);
+			short			code = 0;
+			if (protocolStatus == FCGI_OVERLOADED)
+				code = 503;
+			else if (protocolStatus != FCGI_REQUEST_COMPLETE)
+				code = 502;
+			string	address = conn.address;
+			string().swap(conn.out);
+			conn.outSent = 0;
+			string().swap(conn.job.records);
+			string().swap(conn.job.body);
+			conn.in.erase(0, pos);
+			pos = 0;
+			conn.state = IDLE;
+			conn.paused = false;
+			conn.lastUse = time(NULL);
+			finish(conn.job.clientFd, code, "");
+			pump(address);
+		}
+	}
+	conn.in.erase(0, pos);
+}
+
+/**
+ * A pooled connection may have been closed by the responder while it
+ * sat idle; the request that found out is sent once more on a fresh one.
+ */
+void	FastCgiClient::failConn(Conn& conn, short errorCode) {
+	string	address = conn.address;
+
+	if (conn.state != IDLE) {
+		if (conn.reused && !conn.answered && !conn.job.retried) {
+			Job	job = conn.job; // records and body are still there: nothing was answered
+			job.retried = true; // startJob patches the request id again
+			_queues[address].push_front(job);
+		} else {
+			finish(conn.job.clientFd, errorCode, "");
+		}
+	}
+	closeConn(conn.fd);
+	pump(address);
+}
+
+void	FastCgiClient::forward(int clientFd, const char* data, size_t len) {
+	UpstreamResult	result;
+
+	result.clientFd = clientFd;
+	result.errorCode = 0;
+	result.complete = false;
+	_finished.push_back(result);
+	_finished.back().output.assign(data, len);
+}
+
+void	FastCgiClient::finish(int clientFd, short errorCode, const string& output) {
+	UpstreamResult	result;
+
+	result.clientFd = clientFd;
+	result.errorCode = errorCode;
+	result.complete = true;
+	_finished.push_back(result);
+	_finished.back().output = output;
+}
+
+void	FastCgiClient::takeFinished(vector<UpstreamResult>& out) {
+	out.insert(out.end(), _finished.begin(), _finished.end());
+	_finished.clear();
+}
+
+void	FastCgiClient::checkTimeouts(time_t now) {
+	vector<int>				expired;
+	std::set<string>		addresses;
+
+	for (map<int, Conn>::iterator it = _conns.begin(); it != _conns.end(); ++it) {
+		const Conn&	conn = it->second;
+		if (conn.state == IDLE ? now - conn.lastUse > FASTCGI_IDLE_SEC
+				: !conn.paused && now - conn.job.queued > FASTCGI_TIMEOUT_SEC)
+			expired.push_back(it->first);
+	}
+	for (size_t i = 0; i < expired.size(); ++i) {
+		const Conn&	conn = _conns[expired[i]];
+		if (conn.state != IDLE) {
+			Logger::log(LOG_WARNING, "FastCGI: request to " + conn.address + " timed out");
+			finish(conn.job.clientFd, 504, "");
+		}
+		addresses.insert(conn.address);
+		closeConn(expired[i]);
+	}
+	for (std::set<string>::iterator it = addresses.begin(); it != addresses.end(); ++it)
+		pump(*it);
+	for (map<string, std::deque<Job> >::iterator q = _queues.begin(); q != _queues.end(); ++q) {
+		while (!q->second.empty() && now - q->second.front().queued > FASTCGI_TIMEOUT_SEC) {
+			finish(q->second.front().clientFd, 504, "");
+			q->second.pop_front();
+		}
+	}
+}
+
+// --- connections ---------------------------------------------------------
+
+// Forgets the connection now, close()s it in reapClosed()
+void	FastCgiClient::closeConn(int fd) {
+	_conns.erase(fd);
+	_closed.push_back(fd);
+}
+
+void	FastCgiClient::reapClosed() {
+	for (size_t i = 0; i < _closed.size(); ++i)
+		close(_closed[i]);
+	_closed.clear();
+}
+
+void	FastCgiClient::closeAll() {
+	for (map<int, Conn>::iterator it = _conns.begin(); it != _conns.end(); ++it)
+		_closed.push_back(it->first);
+	_conns.clear();
+	_queues.clear();
+	reapClosed();
+}
+
+size_t	FastCgiClient::connCount(const string& address) const {
+	size_t	count = 0;
+
+	for (map<int, Conn>::const_iterator it = _conns.begin(); it != _conns.end(); ++it) {
+		if (it->second.address == address)
+			++count;
+	}
+	return count;
+}
+
+// "unix:/path/to.sock" or "host:port" (checked by Config)
+bool	FastCgiClient::resolve(const string& address, struct sockaddr_storage& addr, socklen_t& len) {
+	std::memset(&addr, 0, sizeof(addr));
+	if (address.compare(0, 5, "unix:") == 0) {
+		struct sockaddr_un*	un = reinterpret_cast<struct sockaddr_un*>(&addr);
+		string				path = address.substr(5);
+		if (path.size() >= sizeof(un->sun_path))
+			return false;
+		un->sun_family = AF_UNIX;
+		std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+		len = sizeof(struct sockaddr_un);
+		return true;
+	}
+	size_t				colon = address.rfind(':');
+	struct addrinfo		hints;
+	struct addrinfo*	res = NULL;
+	if (colon == string::npos)
+		return false;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &res) != 0)
+		return false;
+	std::memcpy(&addr, res->ai_addr, res->ai_addrlen);
+	len = res->ai_addrlen;
+	freeaddrinfo(res);
+	return true;
+}
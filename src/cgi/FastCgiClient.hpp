@@ -0,0 +1,117 @@
+#ifndef FASTCGICLIENT_HPP
+# define FASTCGICLIENT_HPP
+
+# include "../../inc/Webserv.hpp"
+# include "UpstreamResult.hpp"
+# include <deque>
+# include <sys/socket.h>
+
+# define FCGI_DEBUG 0
+
+# define FASTCGI_MAX_CONNS 8		// open connections per upstream address
+# define FASTCGI_TIMEOUT_SEC 25		// request sent -> FCGI_END_REQUEST (client timeout is 30)
+# define FASTCGI_IDLE_SEC 60		// idle pooled connections are closed after this
+
+/**
+ * Briefly: FastCGI (responder role) client driven by the poll() loop.
+ *
+ * Requests are queued per upstream address ("unix:/path" or
+ * "host:port") and run over a pool of persistent, non-blocking
+ * connections opened with FCGI_KEEP_CONN. Every connection carries one
+ * request at a time (responders rarely set FCGI_MPXS_CONNS); up to
+ * FASTCGI_MAX_CONNS requests per address run in parallel, the rest wait.
+ *
+ * Records are streamed both ways through the poll() loop: STDIN records
+ * are cut from the request body as the socket has room, STDOUT content
+ * is handed on as it arrives (UpstreamResult::complete false) and
+ * END_REQUEST closes the request with a last result. ServerManager
+ * pauses reading with throttle() while the client is CGI_STREAM_BUFFER
+ * bytes behind; the responder then blocks on its full socket.
+ *
+ * The client never touches the pollfd set: ServerManager asks for the
+ * wanted events with pollEvents(), forwards revents to handleEvent()
+ * and collects output and finished requests with takeFinished(). Closed sockets
+ * are only close()d in reapClosed(), after ServerManager dropped them
+ * from its pollfd set, so a descriptor number is never reused while a
+ * stale entry still refers to it.
+ */
+class	FastCgiClient {
+
+	public:
+		FastCgiClient();
+		~FastCgiClient();
+
+		void	submit(int clientFd, const std::string& address,
+					const std::map<std::string, std::string>& params, const std::string& body);
+		void	cancel(int clientFd);
+		void	throttle(int clientFd, bool paused);
+		bool	owns(int fd) const;
+		void	handleEvent(int fd, short revents);
+		void	checkTimeouts(time_t now);
+		void	pollEvents(std::map<int, short>& out) const;
+		void	takeFinished(std::vector<UpstreamResult>& out);
+		void	reapClosed();
+		void	closeAll();
+
+		static void	encodeRequest(std::string& out, const std::map<std::string, std::string>& params);
+
+	private:
+		FastCgiClient(const FastCgiClient&);
+		FastCgiClient&	operator=(const FastCgiClient&);
+
+		struct	Job {
+			int			clientFd;
+			std::string	address;
+			std::string	records;	// BEGIN_REQUEST + PARAMS, request id patched on dispatch
+			std::string	body;		// sent as STDIN records, cut as the socket has room
+			time_t		queued;
+			bool		retried;
+		};
+
+		enum	e_conn_state {
+			CONNECTING,
+			ACTIVE,		// a request is being sent or answered
+			IDLE		// kept alive, waiting in the pool
+		};
+
+		struct	Conn {
+			int				fd;
+			std::string		address;
+			e_conn_state	state;
+			std::string		out;
+			size_t			outSent;
+			size_t			bodySent;	// of job.body, already cut into records
+			bool			stdinDone;	// the empty STDIN record is queued
+			std::string		in;
+			Job				job;
+			unsigned short	requestId;
+			bool			reused;		// served a request before the current one
+			bool			answered;	// a record of the current request arrived
+			bool			paused;		// not read: the client is behind
+			time_t			pausedAt;
+			time_t			lastUse;
+		};
+
+		std::map<int, Conn>						_conns;
+		std::map<std::string, std::deque<Job> >	_queues;
+		std::vector<UpstreamResult>				_finished;
+		std::vector<int>						_closed;
+
+		void	pump(const std::string& address);
+		bool	openConn(const std::string& address, Job& job);
+		void	startJob(Conn& conn, Job& job);
+		void	flush(Conn& conn);
+		bool	nextStdinRecord(Conn& conn);
+		void	release(Conn& conn);
+		void	readFrom(Conn& conn);
+		void	parseRecords(Conn& conn);
+		void	failConn(Conn& conn, short errorCode);
+		void	forward(int clientFd, const char* data, size_t len);
+		void	finish(int clientFd, short errorCode, const std::string& output);
+		void	closeConn(int fd);
+		size_t	connCount(const std::string& address) const;
+
+		static bool	resolve(const std::string& address, struct sockaddr_storage& addr, socklen_t& len);
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef UPSTREAMRESULT_HPP
+# define UPSTREAMRESULT_HPP
+
+# include <string>
+
+/**
+ * FastCGI or CGI output picked up by ServerManager. Output is passed on
+ * as it is read from the responder or script (complete == false) and
+ * closed by a last result with the outcome.
+ */
+struct	UpstreamResult {
+	int			clientFd;
+	short		errorCode;	// 0: `output` is (more of) the script's CGI output
+	bool		complete;	// false: more output follows
+	std::string	output;
+};
+
+#endif
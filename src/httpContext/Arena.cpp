@@ -0,0 +1,74 @@
+#include "Arena.hpp"
+#include "BufferPool.hpp"
+
+Arena::Arena() : _cur(NULL), _left(0), _used(0) { }
+
+Arena::Arena(const Arena& other) : _cur(NULL), _left(0), _used(0) {
+	(void)other;
+}
+
+Arena::~Arena() {
+	reset();
+}
+
+// disabled operator, it is in private
+Arena&	Arena::operator=(const Arena& other) {
+	(void)other;
+	return *this;
+}
+
+void*	Arena::allocate(size_t n) {
+	n = (n + ARENA_ALIGN - 1) & ~static_cast<size_t>(ARENA_ALIGN - 1);
+	if (n > _left)
+		grow(n);
+	void*	p = _cur;
+	_cur += n;
+	_left -= n;
+	_used += n;
+	return p;
+}
+
+const char*	Arena::copy(const char* data, size_t len) {
+	char*	p = static_cast<char*>(allocate(len + 1));
+
+	std::memcpy(p, data, len);
+	p[len] = '\0';
+	return p;
+}
+
+/**
+ * A new block: the first one of a request, or one more when it is full
+ * (at least twice the last one, and `n`). What is left of the full
+ * block stays unused until reset().
+ */
+void	Arena::grow(size_t n) {
+	std::string*	block = &_first;
+	size_t			size = ARENA_BLOCK;
+
+	if (_first.size() != 0) {
+		size = (_more.empty() ? _first.size() : _more.back().size()) * 2;
+		_more.push_back(std::string());
+		block = &_more.back();
+	}
+	if (size < n)
+		size = n;
+	BufferPool::reserve(*block, size);
+	block->resize(size);
+	_cur = &(*block)[0];
+	_left = size;
+}
+
+// All of it is gone: the blocks go back to the BufferPool
+void	Arena::reset() {
+	BufferPool::release(_first);
+	for (std::list<std::string>::iterator it = _more.begin(); it != _more.end(); ++it)
+		BufferPool::release(*it);
+	_more.clear();
+	_cur = NULL;
+	_left = 0;
+	_used = 0;
+}
+
+size_t	Arena::used() const {
+	return _used;
+}
@@ -0,0 +1,102 @@
+#ifndef ARENA_HPP
+# define ARENA_HPP
+
+# include "../../inc/Webserv.hpp"
+# include <cstddef>
+# include <list>
+# include <new>
+
+# define ARENA_BLOCK 4096		// first block, a BufferPool buffer
+# define ARENA_ALIGN 8
+
+/**
+ * Briefly: bump-pointer arena for what lives exactly one request.
+ *
+ * Owned by HttpContext and rewound by resetState(): allocate() moves a
+ * pointer, nothing is freed one by one. Blocks are BufferPool buffers,
+ * so a warm connection allocates nothing from the heap for them and an
+ * idle one holds none. Containers use it through ArenaAllocator.
+ */
+class	Arena {
+	public:
+		Arena();
+		Arena(const Arena& other);	// a new, empty arena: nothing in it is copied
+		~Arena();
+
+		void*		allocate(size_t n);
+		const char*	copy(const char* data, size_t len);	// NUL-terminated
+		void		reset();
+		size_t		used() const;
+
+	private:
+		Arena&	operator=(const Arena& other);
+
+		std::string				_first;
+		std::list<std::string>	_more;		// blocks after the first, one per overflow
+		char*					_cur;
+		size_t					_left;
+		size_t					_used;
+
+		void		grow(size_t n);
+};
+
+/**
+ * STL allocator over an Arena: deallocate() is a no-op, the memory goes
+ * with the next reset(). Without an arena (NULL) it is operator new.
+ * The container must be emptied before its arena is reset.
+ */
+template <typename T>
+class	ArenaAllocator {
+	public:
+		typedef T			value_type;
+		typedef T*			pointer;
+		typedef const T*	const_pointer;
+		typedef T&			reference;
+		typedef const T&	const_reference;
+		typedef size_t		size_type;
+		typedef std::ptrdiff_t	difference_type;
+
+		template <typename U>
+		struct	rebind {
+			typedef ArenaAllocator<U>	other;
+		};
+
+		explicit ArenaAllocator(Arena* arena = NULL) : _arena(arena) { }
+		template <typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) { }
+
+		pointer		allocate(size_type n, const void* = 0) {
+			if (_arena == NULL)
+				return static_cast<pointer>(::operator new(n * sizeof(T)));
+			return static_cast<pointer>(_arena->allocate(n * sizeof(T)));
+		}
+		void		deallocate(pointer p, size_type) {
+			if (_arena == NULL)
+				::operator delete(p);
+		}
+		void		construct(pointer p, const T& value) { new (p) T(value); }
+		void		destroy(pointer p) { p->~T(); }
+		pointer		address(reference r) const { return &r; }
+		const_pointer	address(const_reference r) const { return &r; }
+		size_type	max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+		Arena*		arena() const { return _arena; }
+
+	private:
+		Arena*	_arena;
+};
+
+template <typename T, typename U>
+bool	operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool	operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena() != b.arena();
+}
+
+// Response header fields, see Response::_headers
+typedef std::map<std::string, std::string, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, std::string> > >	HeaderMap;
+
+#endif
@@ -0,0 +1,103 @@
+#include "BufferPool.hpp"
+
+BufferPool::Class	BufferPool::_classes[POOL_CLASSES];
+
+// Sizes are set on first use: no static initialization order to rely on
+BufferPool::Class*	BufferPool::classes() {
+	if (_classes[0].stats.size == 0) {
+		for (size_t c = 0; c < POOL_CLASSES; ++c) {
+			std::memset(&_classes[c].stats, 0, sizeof(BufferPoolStats));
+			_classes[c].stats.size = static_cast<size_t>(POOL_MIN_CLASS) << (2 * c);
+		}
+	}
+	return _classes;
+}
+
+// Smallest class that holds `need` bytes, POOL_CLASSES when none does
+size_t	BufferPool::classFor(size_t need) {
+	Class*	cls = classes();
+	size_t	c = 0;
+
+	while (c < POOL_CLASSES && cls[c].stats.size < need)
+		c++;
+	return c;
+}
+
+// Largest class a buffer of this capacity can serve (at least POOL_MIN_CLASS)
+size_t	BufferPool::classOf(size_t capacity) {
+	Class*	cls = classes();
+	size_t	c = POOL_CLASSES - 1;
+
+	while (cls[c].stats.size > capacity)
+		c--;
+	return c;
+}
+
+/**
+ * Makes room for `need` bytes in `buf`. Nothing happens while it has the
+ * room or once `need` is past the largest class (std::string grows it
+ * from there); otherwise a buffer of the smallest class that fits
+ * replaces it, its bytes copied over, and the old one goes back.
+ */
+void	BufferPool::reserve(std::string& buf, size_t need) {
+	if (buf.capacity() >= need)
+		return;
+	size_t	c = classFor(need);
+	if (c == POOL_CLASSES)
+		return;
+	Class&			cls = classes()[c];
+	std::string		fresh;
+
+	cls.stats.acquires++;
+	if (!cls.free.empty()) {
+		fresh.swap(cls.free.back());
+		cls.free.pop_back();
+		cls.stats.free--;
+		cls.stats.hits++;
+	} else {
+		fresh.reserve(cls.stats.size);
+	}
+	cls.stats.inUse++;
+	if (cls.stats.inUse > cls.stats.inUseHighWater)
+		cls.stats.inUseHighWater = cls.stats.inUse;
+	fresh.append(buf);
+	release(buf);
+	buf.swap(fresh);
+}
+
+/**
+ * Takes the buffer back, leaving `buf` empty with no heap memory. It is
+ * kept for the class its capacity serves if that free list has room,
+ * freed otherwise, like strings too small to be the pool's.
+ */
+void	BufferPool::release(std::string& buf) {
+	if (buf.capacity() < POOL_MIN_CLASS) {
+		std::string().swap(buf);
+		return;
+	}
+	// grown past the largest class: it was handed out as one of those
+	size_t	c = buf.capacity() > POOL_MAX_KEEP ? POOL_CLASSES - 1 : classOf(buf.capacity());
+	Class&	cls = classes()[c];
+
+	if (cls.stats.inUse > 0)
+		cls.stats.inUse--;
+	if (buf.capacity() > POOL_MAX_KEEP || (cls.free.size() + 1) * cls.stats.size > POOL_MAX_FREE_BYTES) {
+		cls.stats.drops++;
+		std::string().swap(buf);
+		return;
+	}
+	buf.clear();
+	cls.free.push_back(std::string());
+	cls.free.back().swap(buf);
+	cls.stats.releases++;
+	cls.stats.free++;
+	if (cls.stats.free > cls.stats.freeHighWater)
+		cls.stats.freeHighWater = cls.stats.free;
+}
+
+void	BufferPool::getStats(BufferPoolStats stats[POOL_CLASSES]) {
+	Class*	cls = classes();
+
+	for (size_t c = 0; c < POOL_CLASSES; ++c)
+		stats[c] = cls[c].stats;
+}
@@ -0,0 +1,53 @@
+#ifndef BUFFERPOOL_HPP
+# define BUFFERPOOL_HPP
+
+# include "../../inc/Webserv.hpp"
+
+# define POOL_CLASSES 3				// 4 KB, 16 KB, 64 KB
+# define POOL_MIN_CLASS 4096
+# define POOL_MAX_KEEP 131072		// released buffers larger than this are freed
+# define POOL_MAX_FREE_BYTES 4194304	// idle bytes kept per class
+
+struct	BufferPoolStats {
+	size_t	size;			// capacity of the class's buffers
+	size_t	acquires;		// buffers asked for
+	size_t	hits;			// ... and taken from the free list
+	size_t	releases;		// buffers given back and kept
+	size_t	drops;			// given back and freed: free list full
+	size_t	free;			// buffers waiting in the free list
+	size_t	freeHighWater;
+	size_t	inUse;			// handed out and not given back
+	size_t	inUseHighWater;
+};
+
+/**
+ * Briefly: free lists of std::string I/O buffers in three size classes.
+ *
+ * Connection input, the request's header block and body and the
+ * response buffer grow through reserve() instead of reallocating on
+ * their own, and go back with release() when the connection is idle or
+ * closed, so a keep-alive connection holds close to nothing between
+ * requests and the next one reuses a warm buffer. Buffers are swapped
+ * in and out: nothing is copied unless a buffer outgrows its class.
+ * Bodies beyond the largest class grow as plain strings and are freed.
+ */
+class	BufferPool {
+	public:
+		static void		reserve(std::string& buf, size_t need);
+		static void		release(std::string& buf);
+		static void		getStats(BufferPoolStats stats[POOL_CLASSES]);
+
+	private:
+		struct	Class {
+			std::vector<std::string>	free;
+			BufferPoolStats				stats;
+		};
+
+		static Class	_classes[POOL_CLASSES];
+
+		static Class*	classes();
+		static size_t	classFor(size_t need);
+		static size_t	classOf(size_t capacity);
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "ByteScanner.hpp"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+# include <immintrin.h>
+# define SCANNER_X86 1
+#else
+# define SCANNER_X86 0
+#endif
+
+static const size_t	npos = std::string::npos;
+
+ByteScanner::ByteScanner() { }
+
+ByteScanner::~ByteScanner() { }
+
+/*
+ * tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." /
+ *         "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA      (RFC 9110, 5.6.2)
+ */
+bool	ByteScanner::isTokenChar(unsigned char c) {
+	static bool	table[256];
+	static bool	ready = false;
+
+	if (!ready) {
+		const char*	extra = "!#$%&'*+-.^_`|~";
+		for (int i = 0; i < 256; ++i)
+			table[i] = (i >= '0' && i <= '9') || (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z');
+		for (size_t i = 0; extra[i]; ++i)
+			table[static_cast<unsigned char>(extra[i])] = true;
+		ready = true;
+	}
+	return table[c];
+}
+
+// --- scalar --------------------------------------------------------------
+
+static size_t	scalarFindPattern(const char* data, size_t len, size_t from,
+					const char* pattern, size_t plen) {
+	size_t	i = from;
+
+	while (i + plen <= len) {
+		const void*	hit = std::memchr(data + i, pattern[0], len - plen + 1 - i);
+		if (hit == NULL)
+			return npos;
+		i = static_cast<const char*>(hit) - data;
+		if (std::memcmp(data + i + 1, pattern + 1, plen - 1) == 0)
+			return i;
+		++i;
+	}
+	return npos;
+}
+
+static size_t	scalarFindInvalid(const char* data, size_t len, size_t from) {
+	for (size_t i = from; i < len; ++i) {
+		if (!ByteScanner::isTokenChar(static_cast<unsigned char>(data[i])))
+			return i;
+	}
+	return npos;
+}
+
+#if SCANNER_X86
+
+// --- SSE2: 16 bytes per step -------------------------------------------
+
+/*
+ * Candidates are positions where both the first and the last byte of the
+ * pattern match (two loads per block, one compare each); the few that
+ * pass are confirmed with memcmp. For CRLF the filter is already exact.
+ */
+static size_t	sse2FindPattern(const char* data, size_t len, size_t from,
+					const char* pattern, size_t plen) {
+	const __m128i	first = _mm_set1_epi8(pattern[0]);
+	const __m128i	last = _mm_set1_epi8(pattern[plen - 1]);
+	size_t			i = from;
+
+	for (; i + 16 + plen - 1 <= len; i += 16) {
+		__m128i	head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i	tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + plen - 1));
+		int		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first),
+							_mm_cmpeq_epi8(tail, last)));
+		while (mask != 0) {
+			int	bit = __builtin_ctz(mask);
+			if (plen <= 2 || std::memcmp(data + i + bit + 1, pattern + 1, plen - 2) == 0)
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	return scalarFindPattern(data, len, i, pattern, plen);
+}
+
+// byte is outside "!".."~", or one of the separators "(),/:;<=>?@[\]{}
+static inline __m128i	sse2InvalidMask(__m128i b) {
+	__m128i	bad = _mm_or_si128(_mm_cmplt_epi8(b, _mm_set1_epi8(0x21)),	// CTL, SP, >= 0x80
+					_mm_cmpeq_epi8(b, _mm_set1_epi8(0x7F)));
+	bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8(0x39)),	// : ; < = > ? @
+					_mm_cmplt_epi8(b, _mm_set1_epi8(0x41))));
+	bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8(0x5A)),	// [ \ ]
+					_mm_cmplt_epi8(b, _mm_set1_epi8(0x5E))));
+	bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8(0x27)),	// ( )
+					_mm_cmplt_epi8(b, _mm_set1_epi8(0x2A))));
+	bad = _mm_or_si128(bad, _mm_cmpeq_epi8(b, _mm_set1_epi8('"')));
+	bad = _mm_or_si128(bad, _mm_cmpeq_epi8(b, _mm_set1_epi8(',')));
+	bad = _mm_or_si128(bad, _mm_cmpeq_epi8(b, _mm_set1_epi8('/')));
+	bad = _mm_or_si128(bad, _mm_cmpeq_epi8(b, _mm_set1_epi8('{')));
+	bad = _mm_or_si128(bad, _mm_cmpeq_epi8(b, _mm_set1_epi8('}')));
+	return bad;
+}
+
+static size_t	sse2FindInvalid(const char* data, size_t len, size_t from) {
+	size_t	i = from;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i	block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		int		mask = _mm_movemask_epi8(sse2InvalidMask(block));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return scalarFindInvalid(data, len, i);
+}
+
+// --- AVX2: 32 bytes per step, compiled for avx2 only in these functions ---
+
+__attribute__((target("avx2")))
+static size_t	avx2FindPattern(const char* data, size_t len, size_t from,
+					const char* pattern, size_t plen) {
+	const __m256i	first = _mm256_set1_epi8(pattern[0]);
+	const __m256i	last = _mm256_set1_epi8(pattern[plen - 1]);
+	size_t			i = from;
+
+	for (; i + 32 + plen - 1 <= len; i += 32) {
+		__m256i			head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i			tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + plen - 1));
+		unsigned int	mask = static_cast<unsigned int>(_mm256_movemask_epi8(
+							_mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+							_mm256_cmpeq_epi8(tail, last))));
+		while (mask != 0) {
+			int	bit = __builtin_ctz(mask);
+			if (plen <= 2 || std::memcmp(data + i + bit + 1, pattern + 1, plen - 2) == 0)
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	return sse2FindPattern(data, len, i, pattern, plen);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i	avx2Range(__m256i b, char above, char below) {
+	return _mm256_and_si256(_mm256_cmpgt_epi8(b, _mm256_set1_epi8(above)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8(below), b));
+}
+
+__attribute__((target("avx2")))
+static size_t	avx2FindInvalid(const char* data, size_t len, size_t from) {
+	size_t	i = from;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i	b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i	bad = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x21), b),
+						_mm256_cmpeq_epi8(b, _mm256_set1_epi8(0x7F)));
+		bad = _mm256_or_si256(bad, avx2Range(b, 0x39, 0x41));
+		bad = _mm256_or_si256(bad, avx2Range(b, 0x5A, 0x5E));
+		bad = _mm256_or_si256(bad, avx2Range(b, 0x27, 0x2A));
+		bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(b, _mm256_set1_epi8('"')));
+		bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(b, _mm256_set1_epi8(',')));
+		bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(b, _mm256_set1_epi8('/')));
+		bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(b, _mm256_set1_epi8('{')));
+		bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(b, _mm256_set1_epi8('}')));
+		unsigned int	mask = static_cast<unsigned int>(_mm256_movemask_epi8(bad));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return sse2FindInvalid(data, len, i);
+}
+
+#endif // SCANNER_X86
+
+// --- dispatch ------------------------------------------------------------
+
+static ByteScanner::e_level	detectLevel() {
+#if SCANNER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return ByteScanner::AVX2;
+	return ByteScanner::SSE2;
+#else
+	return ByteScanner::SCALAR;
+#endif
+}
+
+static ByteScanner::e_level	g_level = ByteScanner::SCALAR;
+static bool					g_detected = false;
+
+ByteScanner::e_level	ByteScanner::level() {
+	if (!g_detected) {
+		g_level = detectLevel();
+		g_detected = true;
+	}
+	return g_level;
+}
+
+bool	ByteScanner::setLevel(e_level wanted) {
+	if (wanted > detectLevel())
+		return false;
+	g_level = wanted;
+	g_detected = true;
+	return true;
+}
+
+const char*	ByteScanner::levelName(e_level lvl) {
+	switch (lvl) {
+		case AVX2: return "avx2";
+		case SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+static size_t	findPattern(const char* data, size_t len, size_t from,
+					const char* pattern, size_t plen) {
+	if (from >= len)
+		return npos;
+	switch (ByteScanner::level()) {
+#if SCANNER_X86
+		case ByteScanner::AVX2: return avx2FindPattern(data, len, from, pattern, plen);
+		case ByteScanner::SSE2: return sse2FindPattern(data, len, from, pattern, plen);
+#endif
+		default: return scalarFindPattern(data, len, from, pattern, plen);
+	}
+}
+
+size_t	ByteScanner::findCRLF(const char* data, size_t len, size_t from) {
+	return findPattern(data, len, from, "\r\n", 2);
+}
+
+size_t	ByteScanner::findHeaderEnd(const char* data, size_t len, size_t from) {
+	return findPattern(data, len, from, "\r\n\r\n", 4);
+}
+
+size_t	ByteScanner::findByte(const char* data, size_t len, size_t from, char c) {
+	return findPattern(data, len, from, &c, 1);
+}
+
+size_t	ByteScanner::findInvalidTokenChar(const char* data, size_t len, size_t from) {
+	if (from >= len)
+		return npos;
+	switch (level()) {
+#if SCANNER_X86
+		case AVX2: return avx2FindInvalid(data, len, from);
+		case SSE2: return sse2FindInvalid(data, len, from);
+#endif
+		default: return scalarFindInvalid(data, len, from);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef BYTESCANNER_HPP
+# define BYTESCANNER_HPP
+
+# include <cstddef>
+# include <string>
+
+/**
+ * Briefly: delimiter search for the request parser.
+ *
+ * Looks for CRLF, CRLFCRLF, single bytes (':' / LF) and bytes that are
+ * not allowed in an HTTP token, 16 (SSE2) or 32 (AVX2) bytes at a time.
+ * The widest implementation supported by the CPU is picked on first use;
+ * other platforms get the scalar loops. All functions return the index
+ * of the match in [from, len) or std::string::npos.
+ */
+class	ByteScanner {
+
+	public:
+		enum	e_level {
+			SCALAR,
+			SSE2,
+			AVX2
+		};
+
+		static size_t		findCRLF(const char* data, size_t len, size_t from);
+		static size_t		findHeaderEnd(const char* data, size_t len, size_t from);
+		static size_t		findByte(const char* data, size_t len, size_t from, char c);
+		static size_t		findInvalidTokenChar(const char* data, size_t len, size_t from);
+		static bool			isTokenChar(unsigned char c);
+
+		static e_level		level();
+		static bool			setLevel(e_level level); // for benchmarks, false if unsupported
+		static const char*	levelName(e_level level);
+
+	private:
+		ByteScanner();
+		~ByteScanner();
+};
+
+#endif
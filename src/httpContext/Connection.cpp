@@ -1,7 +1,10 @@
 #include "Connection.hpp"
+#include "BufferPool.hpp"
 
 Connection::Connection()
-    : _last_activity(time(NULL))
+    : _last_activity(time(NULL)),
+      _id(0),
+      _requests(0)
 { }
 
 Connection::~Connection() { }
@@ -28,17 +31,32 @@ int		Connection::getFd() const { return _fd; }
 
 void	Connection::setClientAddress(const sockaddr_in& client_address) {
 	_client_address = client_address;
+	_client_ip = ipv4_to_string(ntohl(client_address.sin_addr.s_addr));
 }
 
+void	Connection::setId(size_t id) { _id = id; }
+
+void	Connection::countRequest() { _requests++; }
+
 std::string &	Connection::getBuffer() {
 	return _request_buffer;
 }
 
+size_t	Connection::getBufferCapacity() const {
+	return _request_buffer.capacity();
+}
+
 const sockaddr_in &Connection::getClientAddress() const
 {
 	return _client_address;
 }
 
+const std::string &	Connection::getClientIp() const { return _client_ip; }
+
+size_t	Connection::getId() const { return _id; }
+
+size_t	Connection::getRequestCount() const { return _requests; }
+
 /**
  * Receives data from the client's socket and appends it to the internal request buffer.
  * Updates the last activity timestamp on each successful read.
@@ -52,6 +70,7 @@ ssize_t			Connection::receiveData() {
 	updateLastActivity();
 
 	if (nbytes > 0) {
+		BufferPool::reserve(_request_buffer, _request_buffer.size() + nbytes);
 		_request_buffer.append(buf, nbytes);
 	}
 	// debugging
@@ -23,11 +23,17 @@ class	Connection {
 		// setters
 		void	setFd(int fd);
 		void	setClientAddress(const sockaddr_in& client_address);
+		void	setId(size_t id);
+		void	countRequest();
 
 		// getters
 		int					getFd() const;
 		std::string &		getBuffer();
+		size_t				getBufferCapacity() const;
 		const sockaddr_in&	getClientAddress() const;
+		const std::string&	getClientIp() const;
+		size_t				getId() const;
+		size_t				getRequestCount() const;
 
 		ssize_t			receiveData();
 		
@@ -39,6 +45,9 @@ class	Connection {
 		struct sockaddr_in	_client_address;
 		std::string			_request_buffer;
 		time_t				_last_activity;
+		std::string			_client_ip;		// dotted form, made once per connection
+		size_t				_id;			// serial number since start, for the access log
+		size_t				_requests;		// requests begun on this connection
 };
 
 #endif
\ No newline at end of file
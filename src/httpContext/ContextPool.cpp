@@ -0,0 +1,50 @@
+#include "ContextPool.hpp"
+
+ContextPool::ContextPool() {
+	std::memset(&_stats, 0, sizeof(_stats));
+}
+
+ContextPool::~ContextPool() {
+	for (size_t i = 0; i < _free.size(); ++i)
+		delete _free[i];
+}
+
+// disabled, they are in private
+ContextPool::ContextPool(const ContextPool&) { }
+
+ContextPool&	ContextPool::operator=(const ContextPool&) {
+	return *this;
+}
+
+HttpContext*	ContextPool::acquire(const Connection& conn, Server& server) {
+	HttpContext*	ctx;
+
+	_stats.acquires++;
+	if (_free.empty()) {
+		ctx = new HttpContext(conn, server);
+	} else {
+		ctx = _free.back();
+		_free.pop_back();
+		ctx->reopen(conn, server);
+		_stats.reuses++;
+	}
+	if (++_stats.inUse > _stats.inUseHighWater)
+		_stats.inUseHighWater = _stats.inUse;
+	return ctx;
+}
+
+void	ContextPool::release(HttpContext* ctx) {
+	_stats.inUse--;
+	if (_free.size() >= CONTEXT_POOL_MAX_FREE) {
+		_stats.drops++;
+		delete ctx;
+		return;
+	}
+	ctx->recycle();
+	_free.push_back(ctx);
+}
+
+void	ContextPool::getStats(ContextPoolStats& out) const {
+	out = _stats;
+	out.free = _free.size();
+}
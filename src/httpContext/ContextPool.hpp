@@ -0,0 +1,45 @@
+#ifndef CONTEXTPOOL_HPP
+# define CONTEXTPOOL_HPP
+
+# include "../../inc/Webserv.hpp"
+# include "HttpContext.hpp"
+
+# define CONTEXT_POOL_MAX_FREE 1024		// idle slots kept after their connection closed
+
+struct	ContextPoolStats {
+	size_t	acquires;		// connections accepted
+	size_t	reuses;			// ... given a slot of a closed one
+	size_t	drops;			// slots freed on release: free list full
+	size_t	free;			// slots waiting for a connection
+	size_t	inUse;			// slots with an open connection
+	size_t	inUseHighWater;
+};
+
+/**
+ * Briefly: reusable HttpContext slots, one per open connection.
+ *
+ * An accepted connection takes a slot with acquire(): a closed
+ * connection's context rebound with HttpContext::reopen(), or a new one
+ * built in place, never copied. release() recycles it: the I/O buffers
+ * go back to the BufferPool, the rest (Request, Response and its
+ * strings, the arena) stays allocated for the next connection, so
+ * accepting under connection churn costs no construction.
+ */
+class	ContextPool {
+	public:
+		ContextPool();
+		~ContextPool();
+
+		HttpContext*	acquire(const Connection& conn, Server& server);
+		void			release(HttpContext* ctx);
+		void			getStats(ContextPoolStats& out) const;
+
+	private:
+		ContextPool(const ContextPool&);
+		ContextPool&	operator=(const ContextPool&);
+
+		std::vector<HttpContext*>	_free;
+		ContextPoolStats			_stats;
+};
+
+#endif
@@ -5,44 +5,77 @@ using std::cout;
 using std::endl;
 using std::string;
 
+bool	HttpContext::_shedLargeBodies = false;
+bool	HttpContext::_closingAll = false;
+
 // Parametic constructor
-HttpContext::HttpContext(Connection &conn, Server &server) :
+HttpContext::HttpContext(const Connection &conn, Server &server) :
 	_conn(conn),
-	_server_config(server),
+	_server_config(&server),
 	_request(),
-	_response(server),
+	_arena(),
+	_response(server, &_arena),
 	_state(REQUEST_LINE),
+	_scanFrom(0),
 	_expectedBodyLen(0),
 	_chunkState(READING_CHUNK_SIZE),
 	_chunkSize(0),
+	_trailerSize(0),
 	_accumulatedBodySize(0),
+	_bodyStreamed(false),
 	_responseBuffer(""),
 	_bytesSent(0),
+	_framing(FRAMING_BUFFERED),
+	_streaming(false),
+	_streamLeft(0),
+	_startTime(0),
+	_upstreamStart(0),
+	_upstreamTime(-1),
+	_bytesReceived(0),
+	_totalSent(0),
+	_headSize(0),
+	_logPending(false),
+	_peerClosed(false),
 	_draining(false),
 	_drainStart(0)
 { }
 
-// Copy constructor
-HttpContext::HttpContext(const HttpContext &other) :
-	_conn(other._conn),
-	_server_config(other._server_config),
-	_request(other._request),
-	_response(other._server_config),
-	_state(other._state),
-	_expectedBodyLen(other._expectedBodyLen),
-	_chunkState(other._chunkState),
-	_chunkSize(other._chunkSize),
-	_accumulatedBodySize(other._accumulatedBodySize),
-	_responseBuffer(other._responseBuffer),
-	_bytesSent(other._bytesSent),
-	_draining(other._draining),
-	_drainStart(other._drainStart)
-{ }
+// A closed connection's buffers go back to the pool
+HttpContext::~HttpContext() {
+	BufferPool::release(_conn.getBuffer());
+	BufferPool::release(_responseBuffer);
+	_request.releaseBuffers();
+}
+
+/**
+ * A pooled slot taken for a new connection (see ContextPool): the
+ * connection and its server are swapped in, the parser state is the
+ * one recycle() left. Nothing is allocated.
+ */
+void	HttpContext::reopen(const Connection &conn, Server &server) {
+	_conn = conn;
+	bindServer(server);
+}
+
+// Between two requests: the server of a newer configuration (SIGHUP)
+void	HttpContext::bindServer(Server &server) {
+	_server_config = &server;
+	_response.bindServer(server);
+}
 
-HttpContext::~HttpContext() {}
+/**
+ * The connection is closed and the slot goes back to the ContextPool:
+ * as after a request, and the input buffer is returned whatever is in it.
+ */
+void	HttpContext::recycle() {
+	resetState();
+	BufferPool::release(_conn.getBuffer());
+	stopDraining();
+	_peerClosed = false;
+}
 
 Connection	&HttpContext::connection() { return _conn; }
-Server		&HttpContext::server() { return _server_config; }
+Server		&HttpContext::server() { return *_server_config; }
 Request		&HttpContext::request() { return _request; }
 Response	&HttpContext::response() { return _response; }
 
@@ -57,6 +90,8 @@ void	HttpContext::requestParsingStateMachine()
 	string&	buf = connection().getBuffer();
 	bool	can_parse = true;
 
+	if (!buf.empty())
+		markRequestStart();
 	while (can_parse) {
 		switch (_state) {
 			case REQUEST_LINE: {
@@ -169,14 +204,14 @@ bool	HttpContext::validateHost()
 			}
 		}
 		// Check if the port matches the server's listening port
-		if (req_port != -1 && req_port != _server_config.getPort()) {
-			if (CTX_DEBUG) cerr << YELLOW << "Port mismatch. Request: " << req_port << ", Server: " << _server_config.getPort() << endl;
+		if (req_port != -1 && req_port != _server_config->getPort()) {
+			if (CTX_DEBUG) cerr << YELLOW << "Port mismatch. Request: " << req_port << ", Server: " << _server_config->getPort() << endl;
 			request().setUri("/" + req_hostname + request().getUri());
 			if (CTX_DEBUG) cerr << YELLOW << "New request URI is: " << request().getUri() << RESET << endl;
 			return false;
 		}
 		// Check if the hostname matches one of the server's names
-		const std::vector<std::string>&	server_names = _server_config.getServerNames();
+		const std::vector<std::string>&	server_names = _server_config->getServerNames();
 		bool							host_match = false;
 		for (size_t i = 0; i < server_names.size(); ++i) {
 			if (server_names[i] == req_hostname) {
@@ -195,19 +230,26 @@ bool	HttpContext::validateHost()
 	return true;
 }
 
+/**
+ * The request line is parsed in place from the connection buffer
+ * (HttpParser records spans), then consumed.
+ */
 bool	HttpContext::findAndParseReqLine(std::string &buf)
 {
-	size_t	pos = buf.find("\r\n");
+	size_t	pos = findLineEnd(buf);
+
+	// Ignore leading empty lines (user pressed Enter in telnet); the
+	// request line may already be behind them in the buffer
+	while (pos == 0) {
+		consume(buf, 2);
+		pos = findLineEnd(buf);
+	}
 	if (pos == string::npos)
 		return false;
 
-	string	line = buf.substr(0, pos);
-	buf.erase(0, pos + 2);
-	
-	// Ignore leading empty lines (user pressed Enter in telnet)
-	if (line.empty()) return false;
-
-	if (HttpParser::parseRequestLine(line, request()) == true) {
+	bool	parsed = HttpParser::parseRequestLine(buf.data(), pos, request());
+	consume(buf, pos + 2);
+	if (parsed == true) {
 		// Validate host from absolute URI if present
 		if (request().getHost().size() > 0) {
 			if (validateHost() == false) {
@@ -223,16 +265,30 @@ bool	HttpContext::findAndParseReqLine(std::string &buf)
 	}
 }
 
+/**
+ * A request without header fields ends right after the request line,
+ * so the buffer then starts with the empty line itself.
+ */
 bool	HttpContext::findAndParseHeaders(string &buf)
 {
-	size_t	pos = buf.find("\r\n\r\n");
-	if (pos == string::npos) {
-		return false;
+	size_t	blockLen;
+	size_t	consumed;
+
+	if (buf.compare(0, 2, "\r\n") == 0) {
+		blockLen = 0;
+		consumed = 2;
+	} else {
+		size_t	pos = findHeaderEnd(buf);
+		if (pos == string::npos) {
+			return false;
+		}
+		blockLen = pos;
+		consumed = pos + 4;
 	}
 
-	string	rawHeaders = buf.substr(0, pos);
-	buf.erase(0, pos + 4);
-	if (HttpParser::parseHeaders(rawHeaders, request()) == false) {
+	bool	parsed = HttpParser::parseHeaders(buf.data(), blockLen, request());
+	consume(buf, consumed);
+	if (parsed == false) {
 		_state = REQUEST_ERROR;
 		return false;
 	} else {
@@ -257,14 +313,16 @@ bool	HttpContext::isBodyToRead()
 	}
 
 	if (request().isTransferEncodingHeader()) {
-		if (request().getHeaderValue("transfer-encoding") != "chunked") {
+		if (request().getHeaderValue(Request::HDR_TRANSFER_ENCODING) != "chunked") {
 			_state = REQUEST_ERROR;
 			return false;
 		}
+		if (shedBody(std::numeric_limits<size_t>::max()))	// no length: counted as large
+			return false;
 		_state = READING_CHUNKED_BODY;
 		return true;
 	} else if (request().isContentLengthHeader()) {
-		const string&	cl = request().getHeaderValue("content-length");
+		const string&	cl = request().getHeaderValue(Request::HDR_CONTENT_LENGTH);
 		if (cl.empty()) {
 			_state = REQUEST_COMPLETE;
 			return false;
@@ -283,6 +341,8 @@ bool	HttpContext::isBodyToRead()
 			request().setStatusCode(413);
 			return false;
 		}
+		if (shedBody(contentLength))
+			return false;
 		if (contentLength == 0) {
 			_state = REQUEST_COMPLETE;
 			return false;
@@ -297,16 +357,19 @@ bool	HttpContext::isBodyToRead()
 	return false;
 }
 
+// Counts what arrived rather than the body's size: a streamed body is
+// taken out of the Request as it grows (setBodyStreamed)
 bool	HttpContext::findAndParseFixBody(std::string &buf)
 {
-	size_t			remaining = _expectedBodyLen - request().getBody().size();
+	size_t			remaining = _expectedBodyLen - _accumulatedBodySize;
 	const size_t	take = std::min(remaining, buf.size());
 	if (take == 0) { // need more data from socket
 		return false;
 	}
 	HttpParser::appendToBody(buf, take, request());
-	buf.erase(0, take);
-	if (request().getBody().size() == _expectedBodyLen)	{
+	_accumulatedBodySize += take;
+	consume(buf, take);
+	if (_accumulatedBodySize == _expectedBodyLen)	{
 		_state = REQUEST_COMPLETE;
 		return true;
 	} else {
@@ -315,65 +378,102 @@ bool	HttpContext::findAndParseFixBody(std::string &buf)
 }
 
 /**
- * track the accumulated body size during chunk processing
+ * Streaming chunked decoder (RFC 9112, 7.1).
+ *
+ * Chunk data is handed to the body as soon as it arrives, so the
+ * connection buffer never has to hold a whole chunk. The declared size
+ * is checked against client_max_body_size before any of its data is
+ * read. Chunk extensions are accepted and ignored, trailer fields are
+ * read and discarded. Size lines and the trailer section are bounded
+ * (MAX_CHUNK_LINE_SIZE, MAX_HEADER_BLOCK_SIZE).
+ *
+ * Returns true while it made progress and can be called again.
  */
 bool	HttpContext::chunkedBodyStateMachine(std::string &buf)
 {
 	if (_chunkState == READING_CHUNK_SIZE) {
-		size_t	pos = buf.find("\r\n");
+		size_t	pos = findLineEnd(buf);
 		if (pos == string::npos) { // wait more data
+			if (buf.size() > MAX_CHUNK_LINE_SIZE) {
+				_state = REQUEST_ERROR;
+				request().setStatusCode(400);
+			}
 			return false;
 		}
-		string	size_hex = buf.substr(0, pos);
-		// Parse Chunk Size: Convert the hexadecimal string to an integer (chunk_size).
-		if (!HttpParser::cpp98_hexaStrToInt(size_hex, _chunkSize)) {
-			cerr << "Chunked body. Invalid Hexadecimal size" << endl;
+		if (pos > MAX_CHUNK_LINE_SIZE
+			|| !HttpParser::parseChunkSizeLine(buf.data(), pos, _chunkSize)) {
+			if (CTX_DEBUG) cerr << "Chunked body. Invalid chunk size line" << endl;
 			_state = REQUEST_ERROR;
+			request().setStatusCode(400);
 			return false;
 		}
-		buf.erase(0, pos + 2); // Erase hex size and \r\n
-		if (_chunkSize == 0) { // End of body. Look for final \r\n
-			_chunkState = READING_CHUNK_TRAILER;
-		} else {
-			_chunkState = READING_CHUNK_DATA;
+		// Reject on the declared size, before any of the data is buffered
+		if (_chunkSize > 0 && (_chunkSize > std::numeric_limits<size_t>::max() - _accumulatedBodySize
+				|| !checkBodySizeLimit(_accumulatedBodySize + _chunkSize))) {
+			_state = REQUEST_ERROR;
+			request().setStatusCode(413);
+			return false;
 		}
+		consume(buf, pos + 2); // Erase size line and \r\n
+		_chunkState = (_chunkSize == 0) ? READING_CHUNK_TRAILER : READING_CHUNK_DATA;
 		return true;
 	}
 
 	if (_chunkState == READING_CHUNK_DATA) {
-		if (buf.size() < _chunkSize) { // Need more data for chunk body
+		const size_t	take = std::min(_chunkSize, buf.size());
+		if (take == 0) { // Need more data for chunk body
 			return false;
 		}
-		// Check if adding this chunk would exceed the limit
-		if (!checkBodySizeLimit(_accumulatedBodySize + _chunkSize)) {
+		HttpParser::appendToBody(buf, take, request());
+		_accumulatedBodySize += take;
+		_chunkSize -= take;
+		consume(buf, take);
+		if (_chunkSize == 0)
+			_chunkState = READING_CHUNK_CRLF;
+		return true;
+	}
+
+	if (_chunkState == READING_CHUNK_CRLF) {
+		if (buf.size() < 2) { // Need more data for \r\n
+			return false;
+		}
+		if (buf.compare(0, 2, "\r\n") != 0) {
 			_state = REQUEST_ERROR;
-			request().setStatusCode(413);
+			request().setStatusCode(400);
 			return false;
 		}
-
-		HttpParser::appendToBody(buf, _chunkSize, request());
-		_accumulatedBodySize += _chunkSize;
-		buf.erase(0, _chunkSize);
-		_chunkState = READING_CHUNK_TRAILER;
+		consume(buf, 2);
+		_chunkState = READING_CHUNK_SIZE;
 		return true;
 	}
 
 	if (_chunkState == READING_CHUNK_TRAILER) {
-		if (buf.size() < 2) { // Need more data for \r\n
+		size_t	pos = findLineEnd(buf);
+		if (pos == string::npos) {
+			if (_trailerSize + buf.size() > MAX_HEADER_BLOCK_SIZE) {
+				_state = REQUEST_ERROR;
+				request().setStatusCode(431);
+			}
+			return false;
+		}
+		if (pos == 0) { // empty line: end of the message
+			consume(buf, 2);
+			_state = REQUEST_COMPLETE;
 			return false;
 		}
-		if (buf.rfind("\r\n", 0) != 0) { // Check for \r\n at the start
+		_trailerSize += pos + 2;
+		if (_trailerSize > MAX_HEADER_BLOCK_SIZE) {
 			_state = REQUEST_ERROR;
+			request().setStatusCode(431);
 			return false;
 		}
-		buf.erase(0, 2);
-		if (_chunkSize == 0) {
-			_state = REQUEST_COMPLETE;
+		if (ByteScanner::findByte(buf.data(), pos, 0, ':') == string::npos) {
+			_state = REQUEST_ERROR;
+			request().setStatusCode(400);
 			return false;
-		} else {
-			_chunkState = READING_CHUNK_SIZE;
-			return true;
 		}
+		consume(buf, pos + 2);
+		return true;
 	}
 	return false;
 }
@@ -397,64 +497,239 @@ bool HttpContext::isRequestError() const {
 		return false;
 }
 
+/**
+ * Ready for the next request. Its buffers go back to the BufferPool, the
+ * input buffer too unless a pipelined request is in it: an idle
+ * keep-alive connection holds next to no memory.
+ */
 void	HttpContext::resetState() {
+	_request.releaseBuffers();
 	_request = Request();
 	response().reset();
-	connection().getBuffer().clear();
+	_arena.reset();
 	_state = REQUEST_LINE;
+	_scanFrom = 0;
 	_expectedBodyLen = 0;
 	_chunkState = READING_CHUNK_SIZE;
 	_chunkSize = 0;
-	_responseBuffer = "";
+	_trailerSize = 0;
+	_accumulatedBodySize = 0;
+	_bodyStreamed = false;
+	BufferPool::release(_responseBuffer);
+	if (_conn.getBuffer().empty())
+		BufferPool::release(_conn.getBuffer());
 	_bytesSent = 0;
+	_framing = FRAMING_BUFFERED;
+	_streaming = false;
+	_streamLeft = 0;
+	_startTime = 0;
+	_upstreamStart = 0;
+	_upstreamTime = -1;
+	_bytesReceived = 0;
+	_totalSent = 0;
+	_headSize = 0;
+	_logPending = false;
 }
 
+/**
+ * Serializes the response into _responseBuffer. The buffer comes from
+ * the BufferPool sized for head and body, so the head is written without
+ * reallocations (see HeaderWriter).
+ */
 void	HttpContext::buildResponseString()
 {
-	std::string			body = _response.getResponseBody();
+	const std::string&	body = _response.getResponseBody();
+	const size_t		size = HeaderWriter::estimateHeadSize(_response.getHeaders()) + body.size();
+
+	_responseBuffer.clear();
+	BufferPool::reserve(_responseBuffer, size);
+	_responseBuffer.reserve(size);	// past the largest class
+	_framing = FRAMING_BUFFERED;
+	appendHead();
+	_responseBuffer.append(body);
+	_bytesSent = 0;
+	_logPending = true;
+	if (RESP_DEBUG) cout << "buildResponseString(): " << _request.getMethod() << " " << _request.getUri() << endl;
+}
+
+// Status line, Date/Server, Connection, the framing header, the response's fields
+void	HttpContext::appendHead()
+{
 	short				status_code = _response.getStatusCode();
-	size_t				content_length = _response.getContentLength();
-	const std::string&	reason_phrase = _response.getReasonPhrase();
-	std::ostringstream	oss;
+	const HeaderMap&	headers = response().getHeaders();
+
+	static const string	http10 = "HTTP/1.0";
+	static const string	closeValue = "close";
+	static const string	chunkedValue = "chunked";
 
 	// 1. Status Line
-	string	version = _request.getVersion();
-	if (version.empty())
-		version = "HTTP/1.0";
-	oss << version << " " << status_code << " " << reason_phrase << "\r\n";
-	
-	// FIX: For error responses, always use Connection: close
-	string connectionValue = _request.getHeaderValue("connection");
-	if (status_code >= 400 || connectionValue.empty()) {
-		connectionValue = "close";
+	const string&	version = _request.getVersion().empty() ? http10 : _request.getVersion();
+	HeaderWriter::appendStatusLine(_responseBuffer, version, status_code, _response.getReasonPhrase());
+	HeaderWriter::appendDateAndServer(_responseBuffer);
+
+	// FIX: For error responses, always use Connection: close; same while the server stops
+	const string&	connectionValue = _request.getHeaderValue(Request::HDR_CONNECTION);
+	if (status_code >= 400 || connectionValue.empty() || _framing == FRAMING_CLOSE || _closingAll) {
+		HeaderWriter::appendHeader(_responseBuffer, HeaderWriter::CONNECTION, closeValue);
+	} else {
+		HeaderWriter::appendHeader(_responseBuffer, HeaderWriter::CONNECTION, connectionValue);
 	}
-	oss << "Connection: " << connectionValue << "\r\n";
 
 	// 2. Headers
-	oss << "Content-Length: " << content_length << "\r\n";
-	const std::map<string, string>&	headers = response().getHeaders();
-	for (std::map<string, string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+	if (_framing == FRAMING_CHUNKED)
+		HeaderWriter::appendHeader(_responseBuffer, HeaderWriter::TRANSFER_ENCODING, chunkedValue);
+	else if (_framing != FRAMING_CLOSE)
+		HeaderWriter::appendSizeHeader(_responseBuffer, HeaderWriter::CONTENT_LENGTH,
+			_response.getContentLength());
+	for (HeaderMap::const_iterator it = headers.begin(); it != headers.end(); ++it)
 	{
-		oss << it->first << ": " << it->second << "\r\n";
+		HeaderWriter::appendHeader(_responseBuffer, it->first, it->second);
 	}
 	// 3. Empty Line (End of headers)
-	oss << "\r\n";
-	oss << body;
+	HeaderWriter::appendEndOfHead(_responseBuffer);
+	_headSize = _responseBuffer.size();
+}
+
+/**
+ * Head of a streamed CGI response plus the body held so far; the rest
+ * follows through appendStreamBody() and finishStream(). The script's
+ * Content-Length is kept, otherwise HTTP/1.1 clients get chunked
+ * encoding and HTTP/1.0 ones a body that ends with the connection.
+ */
+void	HttpContext::startStreamedResponse()
+{
+	const std::string&	held = _response.getResponseBody();
 
-	setResponseBuffer(oss.str());
+	if (_response.hasCgiLength()) {
+		_framing = FRAMING_LENGTH;
+		_streamLeft = _response.getContentLength();
+	} else if (_request.getVersion() == "HTTP/1.1") {
+		_framing = FRAMING_CHUNKED;
+	} else {
+		_framing = FRAMING_CLOSE;
+	}
+	_responseBuffer.clear();
+	BufferPool::reserve(_responseBuffer, HeaderWriter::estimateHeadSize(_response.getHeaders()) + held.size() + 32);
+	appendHead();
+	_bytesSent = 0;
+	_streaming = true;
+	_logPending = true;
+	appendStreamBody(held.data(), held.size());
+	_response.startCgiStream();
+	if (RESP_DEBUG) cout << "startStreamedResponse(): " << _request.getMethod() << " " << _request.getUri() << endl;
+}
+
+// Only the unsent tail stays in the buffer, so it does not grow with the body
+void	HttpContext::appendStreamBody(const char* data, size_t len)
+{
+	if (_framing == FRAMING_LENGTH && len > _streamLeft)
+		len = _streamLeft; // more than the script announced
+	if (len == 0)
+		return;
+	if (_bytesSent > 0) {
+		_responseBuffer.erase(0, _bytesSent);
+		_bytesSent = 0;
+	}
+	BufferPool::reserve(_responseBuffer, _responseBuffer.size() + len + 32);	// 32: chunk framing
+	if (_framing == FRAMING_CHUNKED) {
+		HeaderWriter::appendChunkSize(_responseBuffer, len);
+		_responseBuffer.append(data, len);
+		_responseBuffer.append("\r\n", 2);
+		return;
+	}
+	_responseBuffer.append(data, len);
+	if (_framing == FRAMING_LENGTH)
+		_streamLeft -= len;
+}
+
+// Last chunk. False when the body fell short of its Content-Length
+bool	HttpContext::finishStream()
+{
+	_streaming = false;
+	if (_framing == FRAMING_CHUNKED)
+		_responseBuffer.append("0\r\n\r\n", 5);
+	return _framing != FRAMING_LENGTH || _streamLeft == 0;
+}
+
+bool	HttpContext::isStreaming() const {
+	return _streaming;
+}
+
+bool	HttpContext::closesAfterResponse() const {
+	return _framing == FRAMING_CLOSE;
+}
+
+void	HttpContext::setBodyStreamed() {
+	_bodyStreamed = true;
+}
+
+bool	HttpContext::isBodyStreamed() const {
+	return _bodyStreamed;
 }
 
 HttpContext::e_parse_state	HttpContext::getParserState() const {
 	return _state;
 }
 
+// Over memory_budget a large body is refused before any of it is read
+bool	HttpContext::shedBody(size_t contentLength) {
+	if (!_shedLargeBodies || contentLength < MEMORY_LARGE_BODY)
+		return false;
+	_state = REQUEST_ERROR;
+	request().setStatusCode(503);
+	Metrics::counters.bodiesShed++;
+	return true;
+}
+
+void	HttpContext::setShedLargeBodies(bool shed) {
+	_shedLargeBodies = shed;
+}
+
+// Set by ServerManager::stopAccepting(): no response keeps its connection
+void	HttpContext::setClosingAll(bool closing) {
+	_closingAll = closing;
+}
+
+/**
+ * Bytes this connection keeps on the heap: the read buffer, the request,
+ * the response and its send buffer. The receive buffer is one stack
+ * array reused for every read, so it is not counted here.
+ */
+size_t	HttpContext::memoryHeld() const {
+	return sizeof(HttpContext) + _conn.getBufferCapacity() + _request.memoryHeld()
+		+ _response.memoryHeld() + _responseBuffer.capacity();
+}
+
+e_memory_state	HttpContext::memoryState() const {
+	if (!_responseBuffer.empty() || _streaming)
+		return MEM_RESPONSE;
+	if (_response.isUpstreamPending())
+		return MEM_UPSTREAM;
+	if (_state == REQUEST_COMPLETE || _state == REQUEST_ERROR)
+		return MEM_RESPONSE;	// being answered
+	if (_state == READING_FIXED_BODY || _state == READING_CHUNKED_BODY)
+		return MEM_BODY;
+	if (_state == READING_HEADERS || (_state == REQUEST_LINE && _startTime != 0))
+		return MEM_HEADERS;
+	return MEM_IDLE;
+}
+
+// What the body still needs: the smallest finishes first when memory is short
+size_t	HttpContext::bodyBytesLeft() const {
+	if (_state == READING_FIXED_BODY)
+		return _expectedBodyLen - _accumulatedBodySize;
+	if (_state == READING_CHUNKED_BODY)
+		return std::numeric_limits<size_t>::max();
+	return 0;
+}
+
 // disabled operator, it is in private
 HttpContext&	HttpContext::operator=(const HttpContext &other) {
 	(void)other;
 	return *this;
 }
 
-std::string		HttpContext::getResponseBuffer() const {
+const std::string&	HttpContext::getResponseBuffer() const {
 	return _responseBuffer;
 }
 
@@ -474,10 +749,15 @@ void			HttpContext::setResponseBuffer(const std::string &buffer) {
 
 void			HttpContext::addBytesSent(size_t bytes) {
 	_bytesSent += bytes;
+	_totalSent += bytes;
 }
 
 bool			HttpContext::isResponseComplete() const {
-	return _bytesSent >= _responseBuffer.size();
+	return !_streaming && _bytesSent >= _responseBuffer.size();
+}
+
+size_t			HttpContext::getPendingBytes() const {
+	return _responseBuffer.size() - _bytesSent;
 }
 
 /**
@@ -487,7 +767,7 @@ bool			HttpContext::isResponseComplete() const {
  */
 bool	HttpContext::checkRequestLineSize(const std::string &buf)
 {
-	size_t	pos = buf.find("\r\n");
+	size_t	pos = findLineEnd(buf);
 	size_t	sizeToCheck;
 	
 	if (pos != string::npos) {
@@ -512,7 +792,10 @@ bool	HttpContext::checkRequestLineSize(const std::string &buf)
  */
 bool	HttpContext::checkHeaderBlockSize(const std::string &buf)
 {
-	size_t headerEnd = buf.find("\r\n\r\n");
+	if (buf.compare(0, 2, "\r\n") == 0)
+		return true; // no header fields, whatever follows is body
+
+	size_t headerEnd = findHeaderEnd(buf);
 	size_t sizeToCheck;
 	
 	if (headerEnd != string::npos) {
@@ -533,6 +816,43 @@ bool	HttpContext::checkHeaderBlockSize(const std::string &buf)
 	return true;
 }
 
+/**
+ * Delimiter search that resumes where the previous call stopped: while
+ * a request line or header block arrives in pieces, every recv() only
+ * scans the new bytes (plus the few that could start a split delimiter)
+ * instead of the whole buffer again. Once found, the position is kept,
+ * so the size check and the parser share a single scan.
+ */
+size_t	HttpContext::findLineEnd(const std::string &buf)
+{
+	size_t	pos = ByteScanner::findCRLF(buf.data(), buf.size(), _scanFrom);
+
+	if (pos != string::npos)
+		_scanFrom = pos;
+	else if (buf.size() > 1)
+		_scanFrom = buf.size() - 1;
+	return pos;
+}
+
+size_t	HttpContext::findHeaderEnd(const std::string &buf)
+{
+	size_t	pos = ByteScanner::findHeaderEnd(buf.data(), buf.size(), _scanFrom);
+
+	if (pos != string::npos)
+		_scanFrom = pos;
+	else if (buf.size() > 3)
+		_scanFrom = buf.size() - 3;
+	return pos;
+}
+
+// Drops parsed bytes from the front of the buffer; offsets start over.
+void	HttpContext::consume(std::string &buf, size_t n)
+{
+	buf.erase(0, n);
+	_bytesReceived += n;
+	_scanFrom = 0;
+}
+
 /**
  * - Check location-specific limit first
  * - Fall back to server-level limit
@@ -549,7 +869,7 @@ bool	HttpContext::checkBodySizeLimit(size_t contentLength)
 	if (matchedLocation && !matchedLocation->getClientMaxBodySize().empty()) {
 		maxBodySizeStr = matchedLocation->getClientMaxBodySize();
 	} else {
-		maxBodySizeStr = _server_config.getClientMaxBodySize();
+		maxBodySizeStr = _server_config->getClientMaxBodySize();
 	}
 	if (maxBodySizeStr.empty()) {
 		return true; 
@@ -563,7 +883,7 @@ bool	HttpContext::checkBodySizeLimit(size_t contentLength)
 // one method in two places?
 const Location* HttpContext::findMatchingLocation()
 {
-	const std::vector<Location>&	locations = _server_config.getLocations();
+	const std::vector<Location>&	locations = _server_config->getLocations();
 	const Location*					bestMatch = NULL;
 	size_t							bestMatchLen = 0;
 	
@@ -583,6 +903,52 @@ const Location* HttpContext::findMatchingLocation()
 	return bestMatch;
 }
 
+// The first bytes of a request are in; also counts it on the connection
+void	HttpContext::markRequestStart() {
+	if (_startTime != 0)
+		return;
+	_startTime = monotonic_time();
+	_conn.countRequest();
+	Metrics::counters.requestsStarted++;
+}
+
+void	HttpContext::markUpstreamStart() {
+	_upstreamStart = monotonic_time();
+}
+
+void	HttpContext::markUpstreamEnd() {
+	if (_upstreamStart != 0)
+		_upstreamTime = monotonic_time() - _upstreamStart;
+}
+
+double	HttpContext::getRequestStart() const { return _startTime; }
+
+double	HttpContext::getUpstreamTime() const { return _upstreamTime; }
+
+size_t	HttpContext::getBytesReceived() const { return _bytesReceived; }
+
+size_t	HttpContext::getTotalSent() const { return _totalSent; }
+
+size_t	HttpContext::getBodyBytesSent() const {
+	return _totalSent > _headSize ? _totalSent - _headSize : 0;
+}
+
+// True once per response: the access log line is due
+bool	HttpContext::takeLogPending() {
+	bool	pending = _logPending;
+
+	_logPending = false;
+	return pending;
+}
+
+void	HttpContext::setPeerClosed() {
+	_peerClosed = true;
+}
+
+bool	HttpContext::isPeerClosed() const {
+	return _peerClosed;
+}
+
 void	HttpContext::startDraining() {
 	_draining = true;
 	_drainStart = time(NULL);
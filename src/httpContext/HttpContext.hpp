@@ -7,7 +7,10 @@
 #include "../server/Server.hpp"
 #include "../server/Location.hpp"
 #include "../httpContext/Connection.hpp"
+#include "../response/HeaderWriter.hpp"
+#include "../server/Metrics.hpp"
 #include "HttpParser.hpp"
+#include "BufferPool.hpp"
 #include "PrintUtils.hpp"
 
 #include <sys/socket.h>
@@ -26,6 +29,8 @@
 
 #define MAX_REQUEST_LINE_SIZE 100      // 100 bytes for request line
 #define MAX_HEADER_BLOCK_SIZE 16384     // 16KB for all headers combined
+#define MAX_CHUNK_LINE_SIZE 1024        // chunk size line, extensions included
+#define MEMORY_LARGE_BODY 65536         // bodies from here on are shed over memory_budget
 
 /**
  * Briefly: HTTP (request) state + Request/Response
@@ -38,10 +43,13 @@ class HttpContext
 {
 
 	public:
-		HttpContext(Connection &conn, Server &server);
-		HttpContext(const HttpContext &other);
+		HttpContext(const Connection &conn, Server &server);
 		~HttpContext();
 
+		void	reopen(const Connection &conn, Server &server);
+		void	bindServer(Server &server);
+		void	recycle();
+
 		Connection &connection();
 		Server &server();
 		// static functions of HttpParser class
@@ -72,11 +80,45 @@ class HttpContext
 		e_parse_state	getParserState() const;
 
 		// response sending helpers
-		std::string getResponseBuffer() const;
+		const std::string&	getResponseBuffer() const;
 		size_t		getBytesSent() const;
 		void		setResponseBuffer(const std::string &buffer);
 		void		addBytesSent(size_t bytes);
 		bool		isResponseComplete() const;
+		size_t		getPendingBytes() const;
+
+		// streamed (CGI) responses, see ServerManager::streamUpstreamOutput()
+		void		startStreamedResponse();
+		void		appendStreamBody(const char* data, size_t len);
+		bool		finishStream();
+		bool		isStreaming() const;
+		bool		closesAfterResponse() const;
+
+		// request body handed on as it arrives (CGI stdin) instead of kept
+		void		setBodyStreamed();
+		bool		isBodyStreamed() const;
+
+		// access log: timing on the monotonic clock, byte counts
+		void		markRequestStart();
+		void		markUpstreamStart();
+		void		markUpstreamEnd();
+		double		getRequestStart() const;
+		double		getUpstreamTime() const;
+		size_t		getBytesReceived() const;
+		size_t		getTotalSent() const;
+		size_t		getBodyBytesSent() const;
+		bool		takeLogPending();
+
+		// memory accounting, see ServerManager::enforceMemoryBudget()
+		size_t			memoryHeld() const;
+		e_memory_state	memoryState() const;
+		size_t			bodyBytesLeft() const;
+		static void		setShedLargeBodies(bool shed);
+		static void		setClosingAll(bool closing);
+
+		// the client shut down its sending side after a complete request
+		void		setPeerClosed();
+		bool		isPeerClosed() const;
 
 		// Draining helpers (to safely close after error responses)
 		void		startDraining();
@@ -86,18 +128,25 @@ class HttpContext
 
 	private:
 		HttpContext();									  // no default construction
+		HttpContext(const HttpContext &other);			  // no copies: a slot of ContextPool
 		HttpContext &operator=(const HttpContext &other); // no assignment
 
 		Connection		_conn;
-		Server&			_server_config;
+		Server*			_server_config;
 		Request			_request;
+		Arena			_arena;		// dies with the request, see resetState()
 		Response		_response;
 		e_parse_state	_state;
+		size_t			_scanFrom; // buffer bytes already searched for the current delimiter
 
 		bool			validateHost();
 		bool			checkRequestLineSize(const std::string &buf);
    		bool			checkHeaderBlockSize(const std::string &buf);
+		size_t			findLineEnd(const std::string &buf);
+		size_t			findHeaderEnd(const std::string &buf);
+		void			consume(std::string &buf, size_t n);
 		bool			checkBodySizeLimit(size_t contentLength);
+		bool			shedBody(size_t contentLength);
 		const Location*	findMatchingLocation();
 
 		// body members
@@ -106,19 +155,47 @@ class HttpContext
 		{
 			READING_CHUNK_SIZE,
 			READING_CHUNK_DATA,
-			READING_CHUNK_TRAILER // For the final CRLF after a chunk
+			READING_CHUNK_CRLF,		// the CRLF closing a chunk's data
+			READING_CHUNK_TRAILER	// trailer fields after the last chunk, up to the empty line
 		};
 		e_chunk_state	_chunkState;
-		size_t			_chunkSize;
-		size_t			_accumulatedBodySize; // for chunk body
+		size_t			_chunkSize;		// bytes of the current chunk not received yet
+		size_t			_trailerSize;
+		size_t			_accumulatedBodySize; // body bytes received so far
+		bool			_bodyStreamed;	// Request::_body holds only what was not handed on yet
 
 		// For non-blocking response sending
 		std::string		_responseBuffer;
 		size_t			_bytesSent;
+		enum			e_body_framing
+		{
+			FRAMING_BUFFERED,	// the whole body is in the buffer
+			FRAMING_LENGTH,		// streamed, Content-Length set by the script
+			FRAMING_CHUNKED,	// streamed, Transfer-Encoding: chunked
+			FRAMING_CLOSE		// streamed, the body ends with the connection (HTTP/1.0)
+		};
+		e_body_framing	_framing;
+		bool			_streaming;		// more body follows
+		size_t			_streamLeft;	// FRAMING_LENGTH: body bytes still due
+
+		void			appendHead();
+
+		// access log
+		double			_startTime;		// first byte of the request, 0 before
+		double			_upstreamStart;
+		double			_upstreamTime;	// seconds with FastCGI / CGI, -1 without
+		size_t			_bytesReceived;	// request bytes taken off the connection buffer
+		size_t			_totalSent;		// response bytes sent, head included
+		size_t			_headSize;
+		bool			_logPending;	// a response started and is not logged yet
+		bool			_peerClosed;	// answered, then closed: no request follows
 
 		// Draining state
 		bool			_draining;
 		time_t			_drainStart;
+
+		static bool		_shedLargeBodies;	// over memory_budget: 503 for large bodies
+		static bool		_closingAll;		// the server stops: every response says Connection: close
 };
 
 #endif
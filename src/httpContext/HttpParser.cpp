@@ -1,4 +1,5 @@
 #include "HttpParser.hpp"
+#include "BufferPool.hpp"
 
 using std::cout;
 using std::cerr;
@@ -14,9 +15,65 @@ void	HttpParser::appendToBody(const std::string & buffer, const size_t n, Reques
 		return;
 	}
 	 // Assumes Request::getBody() returns a non-const std::string&
+	BufferPool::reserve(req.getBody(), req.getBody().size() + n);
 	req.getBody().append(buffer, 0, n);
 }
 
+static bool	isLineSpace(char c) {
+	return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+// CTL other than HTAB (RFC 9110, 5.5): NUL, CR, LF, ... and DEL
+static bool	hasControlChar(const char* data, size_t from, size_t to) {
+	for (size_t i = from; i < to; ++i) {
+		unsigned char	c = static_cast<unsigned char>(data[i]);
+		if ((c < 0x20 && c != '\t') || c == 0x7F)
+			return true;
+	}
+	return false;
+}
+
+static bool	spanStartsWith(const char* data, const HttpSpan& span, const char* prefix, size_t prefixLen) {
+	return span.len >= prefixLen && std::memcmp(data + span.off, prefix, prefixLen) == 0;
+}
+
+/**
+ * Single pass over the request line: records where method, URI and
+ * version are, without copying anything. Tokens are separated by
+ * whitespace, like the former `istringstream >>` split.
+ */
+void	HttpParser::scanRequestLine(const char* data, size_t len, RequestLineSpans& out) {
+	HttpSpan*	slots[3] = { &out.method, &out.uri, &out.version };
+	size_t		i = 0;
+
+	out.tokens = 0;
+	for (size_t t = 0; t < 3; ++t) {
+		slots[t]->off = 0;
+		slots[t]->len = 0;
+	}
+	while (i < len && out.tokens < 4) {
+		while (i < len && isLineSpace(data[i]))
+			++i;
+		if (i == len)
+			break;
+		size_t	start = i;
+		while (i < len && !isLineSpace(data[i]))
+			++i;
+		if (out.tokens < 3) {
+			slots[out.tokens]->off = start;
+			slots[out.tokens]->len = i - start;
+		}
+		++out.tokens;
+	}
+	// trailing whitespace after the version is not a valid request line either
+	if (out.tokens == 3 && out.version.off + out.version.len != len)
+		out.tokens = 4;
+}
+
+bool	HttpParser::parseRequestLine(const std::string& line, Request& req) {
+	return parseRequestLine(line.data(), line.size(), req);
+}
+
 /**
  * Parser for a request line of the request.
  * 
@@ -24,64 +81,70 @@ void	HttpParser::appendToBody(const std::string & buffer, const size_t n, Reques
  * uri.find("..") - a security check to prevent directory traversal attacks.
  * ".." is used to go up one directory. An attacker could craft a URI 
  * like passwd to try and access sensitive files outside of the 
- * web server's intended root directory.
+ * web server's intended root directory. Control characters (a NUL
+ * above all: CGI variables are NUL separated) make the target invalid.
  */
-bool HttpParser::parseRequestLine(const std::string& line, 
+bool HttpParser::parseRequestLine(const char* data, size_t len,
 									Request& req) {
 
-	std::istringstream	iss(line); 
-	std::string			method, uri, version;
-
-	// false if the stream iss fails to extract all three strings.
-	if (!(iss >> method >> uri >> version) || !iss.eof()) {
-		if (DEBUG_HTTP_PARSER) cout << "parseRequestLine().\nmethod: " << method << "\nuri: ";
-		if (DEBUG_HTTP_PARSER) cout << uri << "\nversion: " << version << endl;
-		if(method.size() != 0)
-			req.setMethod(method);
-		else
-			req.setMethod("");
-		if(uri.size() != 0) req.setUri(uri);
-		if(version.size() != 0) req.setVersion(version);
+	RequestLineSpans	spans;
+	scanRequestLine(data, len, spans);
+
+	// false if the line does not have exactly three tokens
+	if (spans.tokens != 3) {
+		if (DEBUG_HTTP_PARSER) cout << "parseRequestLine(). tokens: " << spans.tokens << endl;
+		req.setMethod(data + spans.method.off, spans.method.len);
+		if (spans.uri.len != 0) req.setUri(data + spans.uri.off, spans.uri.len);
+		if (spans.version.len != 0) req.setVersion(data + spans.version.off, spans.version.len);
+		req.setRequestLineFormatValid(false);
+		req.setStatusCode(400);
+		return false;
+	}
+	HttpSpan	uri = spans.uri;
+	if (hasControlChar(data, uri.off, uri.off + uri.len)) {
+		req.setMethod(data + spans.method.off, spans.method.len);
 		req.setRequestLineFormatValid(false);
 		req.setStatusCode(400);
 		return false;
 	}
 	// Handle absolute URI (e.g., GET http://localhost:8080/ HTTP/1.0)
-	if (uri.rfind("http://", 0) == 0) {
+	if (spanStartsWith(data, uri, "http://", 7)) {
 		if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine. http:// is found" << RESET << endl;
-		size_t	host_start = 7; // "http://" is 7 chars
-		size_t	path_start = uri.find("/", host_start);
-		
-		if (path_start != std::string::npos) {
-			std::string host = uri.substr(host_start, path_start - host_start);
-			req.setHost(host);
-			if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine. host: " << host << RESET << endl;
-			uri = uri.substr(path_start);
+		const char*	host_start = data + uri.off + 7; // "http://" is 7 chars
+		const char*	uri_end = data + uri.off + uri.len;
+		const char*	path_start = static_cast<const char*>(std::memchr(host_start, '/', uri_end - host_start));
+
+		if (path_start != NULL) {
+			req.setHost(std::string(host_start, path_start));
+			uri.len = uri_end - path_start;
+			uri.off = path_start - data;
 		} else {
 			// Case: GET http://localhost:8080 HTTP/1.0 (no trailing slash)
-			std::string host = uri.substr(host_start);
-			req.setHost(host);
-			if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine. host: " << host << RESET << endl;
-			uri = "/";
+			req.setHost(std::string(host_start, uri_end));
+			uri.len = 0;
 		}
+		if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine. host: " << req.getHost() << RESET << endl;
 	}
-	if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine:\nmethod: " << method << "\nuri: ";
-	if (DEBUG_HTTP_PARSER) cout << BLUE << uri << "\nversion: " << version << RESET << endl;
-	req.setMethod(method);
-	req.setUri(uri);
-	req.setVersion(version);
-	if (method != "GET" && method != "POST" && method != "DELETE") {
+	req.setMethod(data + spans.method.off, spans.method.len);
+	if (uri.len != 0)
+		req.setUri(data + uri.off, uri.len);
+	else
+		req.setUri("/", 1);
+	req.setVersion(data + spans.version.off, spans.version.len);
+	if (DEBUG_HTTP_PARSER) cout << BLUE << "parseRequestLine:\nmethod: " << req.getMethod() << "\nuri: ";
+	if (DEBUG_HTTP_PARSER) cout << BLUE << req.getUri() << "\nversion: " << req.getVersion() << RESET << endl;
+	if (req.getEnumMethod() == Request::INVALID) {
 		req.setRequestLineFormatValid(false);
-		req.setMethod("");
 		req.setStatusCode(405);
 		return false;
 	}
-	if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+	if (req.getVersion() != "HTTP/1.1" && req.getVersion() != "HTTP/1.0") {
 		req.setRequestLineFormatValid(false);
 		return false;
 	}
 	// Rudimentary URI check
-	if (uri.empty() || uri[0] != '/' || uri.find("..") != std::string::npos) {
+	const std::string&	path = req.getUri();
+	if (path.empty() || path[0] != '/' || path.find("..") != std::string::npos) {
 		if (DEBUG_HTTP_PARSER) cout << "parseRequestLine. URI check: invalid" << endl;
 		req.setRequestLineFormatValid(false);
 		return false;
@@ -90,73 +153,99 @@ bool HttpParser::parseRequestLine(const std::string& line,
 	return true;
 }
 
+bool	HttpParser::parseHeaders(const std::string& headersBlock, Request& req) {
+	return parseHeaders(headersBlock.data(), headersBlock.size(), req);
+}
+
 /**
  * @brief Parses a block of HTTP headers.
  * 
- * This function takes a string containing all header lines, splits them,
- * and parses each one individually. It normalizes header names to lowercase
- * to ensure case-insensitive handling.
+ * The block is copied once into the Request; each line is then split in
+ * a single pass into (offset, length) spans of name and value. Nothing is
+ * lowercased or copied here: lookups compare names case-insensitively
+ * and values are materialized on demand (see Request::getHeaderValue).
  * 
- * Line must end with a carriage return followed by a line feed (\r\n).
+ * Lines end with \r\n (a bare \n is tolerated). Whitespace around the
+ * name and around the value is not part of the spans; any other byte in
+ * the name that is not a token character, or a control character other
+ * than HTAB in the value, makes the request invalid.
+ * Line ends, colons and invalid name bytes are located by ByteScanner.
  * 
- * @param headersBlock The string containing the entire header section.
+ * @param data, len The entire header section, without the final empty line.
  * @param req The Request object to populate with headers.
  * @return true if all headers were parsed successfully, false otherwise.
  */
-bool	HttpParser::parseHeaders(const std::string& headersBlock,
+bool	HttpParser::parseHeaders(const char* data, size_t len,
 									Request& req) {
 	if (DEBUG_HTTP_PARSER) cout << "HttpParser::parseHeaders" << endl;
-	if (headersBlock.empty()) {
+	req.setRawHeaders(data, len);
+	if (len == 0) {
 		return true; // no headers, it's ok for GET. TODO for POST?
 	}
 
-	std::istringstream	iss(headersBlock);
-	std::string 		line;
+	const char*	raw = req.getRawHeaders().data();
+	size_t		pos = 0;
 
-	while(std::getline(iss, line)) {
+	while (pos < len) {
+		size_t	nl = ByteScanner::findByte(raw, len, pos, '\n');
+		size_t	lineEnd = (nl != string::npos) ? nl : len;
+		size_t	next = (nl != string::npos) ? nl + 1 : len;
 
 		// Handle potential carriage return at the end of the line
-		if (!line.empty() && line[line.length() - 1] == '\r') {
-			line.erase(line.length() - 1);
+		if (lineEnd > pos && raw[lineEnd - 1] == '\r')
+			--lineEnd;
+		if (lineEnd == pos) {
+			pos = next;
+			continue;
 		}
 
-		if(line.empty()) continue;
-
-		size_t	pos_colon = line.find(':');
-		if(pos_colon == std::string::npos) {
+		size_t	colon = ByteScanner::findByte(raw, lineEnd, pos, ':');
+		if (colon == string::npos) {
 			req.setHeadersFormatValid(false);
 			return false; // Malformed header line
 		}
-		string	name = line.substr(0, pos_colon);
-		string	value = line.substr(pos_colon +1);
-
-		//Trim leading whitespace from name
-		size_t start = name.find_first_not_of(" \t");
-		if (start != std::string::npos) {
-			name = name.substr(start);
-		}
-		//Trim trailing whitespace from name
-		size_t end = name.find_last_not_of(" \t");
-		if (end != std::string::npos) {
-			name = name.substr(0, end + 1);
-		}
-		// Normalize header name to lowercase
-		for (size_t i = 0; i < name.length(); ++i) {
-			name[i] = std::tolower(name[i]);
-		}
-		// Trim leading whitespace from value
-		start = value.find_first_not_of(" \t");
-		if (start != std::string::npos) {
-			value = value.substr(start);
-		}
-		if (name.empty()) {
+		HeaderField	field;
+		size_t		nameStart = pos;
+		size_t		nameEnd = colon;
+		size_t		valueStart = nameEnd + 1;
+		size_t		valueEnd = lineEnd;
+
+		// Trim whitespace around name and value
+		while (nameStart < nameEnd && (raw[nameStart] == ' ' || raw[nameStart] == '\t'))
+			++nameStart;
+		while (nameEnd > nameStart && (raw[nameEnd - 1] == ' ' || raw[nameEnd - 1] == '\t'))
+			--nameEnd;
+		while (valueStart < valueEnd && (raw[valueStart] == ' ' || raw[valueStart] == '\t'))
+			++valueStart;
+		while (valueEnd > valueStart && (raw[valueEnd - 1] == ' ' || raw[valueEnd - 1] == '\t'))
+			--valueEnd;
+		if (nameStart == nameEnd) {
+			req.setHeadersFormatValid(false);
 			return false; // Header name cannot be empty
 		}
-		if (name == "content-length" && !is_only_digits(value)) {
+		if (ByteScanner::findInvalidTokenChar(raw, nameEnd, nameStart) != string::npos) {
 			req.setHeadersFormatValid(false);
-			return false;
+			return false; // field-name must be a token (RFC 9110, 5.1)
+		}
+		if (hasControlChar(raw, valueStart, valueEnd)) {
+			req.setHeadersFormatValid(false);
+			return false; // no CTL in a field-value (RFC 9110, 5.5)
 		}
-		req.addHeader(name, value);
+		field.name.off = nameStart;
+		field.name.len = nameEnd - nameStart;
+		field.value.off = valueStart;
+		field.value.len = valueEnd - valueStart;
+		if (Request::classifyHeader(raw + nameStart, field.name.len) == Request::HDR_CONTENT_LENGTH) {
+			bool	digits = field.value.len != 0;
+			for (size_t i = valueStart; i < valueEnd && digits; ++i)
+				digits = (raw[i] >= '0' && raw[i] <= '9');
+			if (!digits) {
+				req.setHeadersFormatValid(false);
+				return false;
+			}
+		}
+		req.addHeaderField(field);
+		pos = next;
 	}
 	return true;
 }
@@ -200,6 +289,33 @@ bool	HttpParser::cpp98_hexaStrToInt(const std::string& s, size_t& out) {
 	return true;
 }
 
+/**
+ * chunk-size [ BWS ";" chunk-ext ] without the CRLF. The size must be
+ * hexadecimal and fit in size_t; the extensions are only checked for
+ * control characters and are otherwise ignored.
+ */
+bool	HttpParser::parseChunkSizeLine(const char* data, size_t len, size_t& out) {
+	size_t	digits = 0;
+
+	while (digits < len && std::isxdigit(static_cast<unsigned char>(data[digits])))
+		++digits;
+	if (digits == 0 || !cpp98_hexaStrToInt(string(data, digits), out))
+		return false;
+	size_t	i = digits;
+	while (i < len && (data[i] == ' ' || data[i] == '\t'))
+		++i;
+	if (i == len)
+		return true;
+	if (data[i] != ';')
+		return false;
+	for (; i < len; ++i) {
+		unsigned char	c = static_cast<unsigned char>(data[i]);
+		if ((c < 0x20 && c != '\t') || c == 0x7F)
+			return false;
+	}
+	return true;
+}
+
 // Generate Timestamp for a filename
 static string generateTimestamp() {
 	
@@ -4,11 +4,21 @@
 # include "../../inc/Webserv.hpp"
 # include "../request/Request.hpp"
 # include "PrintUtils.hpp"
+# include "ByteScanner.hpp"
 # include <limits> // C++98: for std::numeric_limits<size_t>::max()
 # include <cstdio>
+# include <strings.h> // strncasecmp
 
 #define DEBUG_HTTP_PARSER 0
 
+// Spans of the three request line tokens
+struct	RequestLineSpans {
+	HttpSpan	method;
+	HttpSpan	uri;
+	HttpSpan	version;
+	size_t		tokens; // how many whitespace separated tokens were found (max 4)
+};
+
 /**
  *  Stateless syntax helpers for HTTP request.
  */
@@ -18,10 +28,14 @@ class	HttpParser {
 		HttpParser();
 		~HttpParser();
 
+	static void			scanRequestLine(const char* data, size_t len, RequestLineSpans& out);
+	static bool			parseRequestLine(const char* data, size_t len, Request& req);
 	static bool			parseRequestLine(const std::string& line, Request& req);
+	static bool			parseHeaders(const char* data, size_t len, Request& req);
 	static bool			parseHeaders(const std::string& headersBlock, Request& req);
 	static void			appendToBody(const std::string & buffer, const size_t n, Request& req);
 	static bool			cpp98_hexaStrToInt(const std::string& s, size_t& out);
+	static bool			parseChunkSizeLine(const char* data, size_t len, size_t& out);
 	static bool			parseMultipartData(const std::string& reqBody, const std::string& boundary, 
 							std::string& filename, std::string& fileData);
 	static std::string	getExtensionStr(const std::string& filename);
@@ -38,8 +38,8 @@ class PrintUtils {
 
 	static void printRequestHeaders(const Request& req) {
 		std::cout << "--- Request Headers -----" << std::endl;
-		// Directly accesses the private _headers member of the Request class
-		for (std::map<std::string, std::string>::const_iterator it = req._headers.begin(); it != req._headers.end(); ++it) {
+		const std::map<std::string, std::string>	headers = req.getHeaders();
+		for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
 			std::cout << BLUE << "'" << it->first << "': '";
 			std::cout << it->second << "'" << RESET << std::endl;
 		}
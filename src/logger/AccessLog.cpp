@@ -0,0 +1,306 @@
+#include "AccessLog.hpp"
+#include "../httpContext/HttpContext.hpp"
+#include <sys/time.h>
+
+// Seconds with millisecond resolution, "0.004"
+static void appendSeconds(std::string &out, double sec)
+{
+	size_t ms = static_cast<size_t>(sec * 1000 + 0.5);
+	char frac[4];
+
+	append_number(out, ms / 1000);
+	frac[0] = '.';
+	frac[1] = '0' + ms / 100 % 10;
+	frac[2] = '0' + ms / 10 % 10;
+	frac[3] = '0' + ms % 10;
+	out.append(frac, 4);
+}
+
+// strftime() of the current second, redone only when the second changes
+static const std::string &timeString(bool iso)
+{
+	static time_t cachedAt[2] = { -1, -1 };
+	static std::string cached[2];
+	time_t now = std::time(0);
+
+	if (now != cachedAt[iso])
+	{
+		char buf[64];
+		struct tm tm;
+		localtime_r(&now, &tm);
+		size_t len = std::strftime(buf, sizeof(buf),
+			iso ? "%Y-%m-%dT%H:%M:%S%z" : "%d/%b/%Y:%H:%M:%S %z", &tm);
+		cached[iso].assign(buf, len);
+		if (iso && len >= 2)
+			cached[iso].insert(len - 2, 1, ':');	// +02:00, as ISO 8601 writes it
+		cachedAt[iso] = now;
+	}
+	return cached[iso];
+}
+
+AccessLogFormat::AccessLogFormat() : _escape(ESCAPE_DEFAULT) {}
+
+/**
+ * Splits `tmpl` into literal text and variables. Throws on an unknown
+ * variable, so a typo in the config stops the server at startup.
+ */
+void AccessLogFormat::compile(const std::string &tmpl, e_escape escape)
+{
+	static const struct
+	{
+		const char *name;
+		e_field field;
+	} fields[] = {
+		{ "remote_addr", F_REMOTE_ADDR },
+		{ "remote_port", F_REMOTE_PORT },
+		{ "time_local", F_TIME_LOCAL },
+		{ "time_iso8601", F_TIME_ISO8601 },
+		{ "msec", F_MSEC },
+		{ "request", F_REQUEST },
+		{ "request_method", F_REQUEST_METHOD },
+		{ "request_uri", F_REQUEST_URI },
+		{ "server_protocol", F_SERVER_PROTOCOL },
+		{ "status", F_STATUS },
+		{ "bytes_sent", F_BYTES_SENT },
+		{ "body_bytes_sent", F_BODY_BYTES_SENT },
+		{ "request_length", F_REQUEST_LENGTH },
+		{ "request_time", F_REQUEST_TIME },
+		{ "upstream_response_time", F_UPSTREAM_RESPONSE_TIME },
+		{ "connection", F_CONNECTION },
+		{ "connection_requests", F_CONNECTION_REQUESTS },
+		{ "host", F_HOST },
+		{ "server_port", F_SERVER_PORT },
+		{ "http_user_agent", F_HTTP_USER_AGENT },
+		{ "http_referer", F_HTTP_REFERER }
+	};
+	std::string literal;
+
+	_segments.clear();
+	_escape = escape;
+	for (size_t i = 0; i < tmpl.size();)
+	{
+		if (tmpl[i] != '$')
+		{
+			literal += tmpl[i++];
+			continue;
+		}
+		bool braced = i + 1 < tmpl.size() && tmpl[i + 1] == '{';
+		size_t start = i + (braced ? 2 : 1);
+		size_t end = start;
+		while (end < tmpl.size() && (std::isalnum(static_cast<unsigned char>(tmpl[end])) || tmpl[end] == '_'))
+			end++;
+		if (end == start || (braced && (end == tmpl.size() || tmpl[end] != '}')))
+			throw std::runtime_error("Invalid variable in log_format: " + tmpl.substr(i));
+		std::string name = tmpl.substr(start, end - start);
+		i = end + (braced ? 1 : 0);
+
+		Segment seg;
+		seg.literal = literal;
+		seg.field = F_NONE;
+		for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f)
+		{
+			if (name == fields[f].name)
+				seg.field = fields[f].field;
+		}
+		if (seg.field == F_NONE && name.compare(0, 5, "http_") == 0 && name.size() > 5)
+		{
+			// $http_x_forwarded_for: the x-forwarded-for request header
+			seg.field = F_HTTP_HEADER;
+			seg.arg = name.substr(5);
+			for (size_t c = 0; c < seg.arg.size(); ++c)
+				seg.arg[c] = seg.arg[c] == '_' ? '-' : std::tolower(static_cast<unsigned char>(seg.arg[c]));
+		}
+		if (seg.field == F_NONE)
+			throw std::runtime_error("Unknown variable in log_format: $" + name);
+		_segments.push_back(seg);
+		literal.clear();
+	}
+	if (!literal.empty() || _segments.empty())
+	{
+		Segment seg;
+		seg.literal = literal;
+		seg.field = F_NONE;
+		_segments.push_back(seg);
+	}
+}
+
+bool AccessLogFormat::empty() const
+{
+	return _segments.empty();
+}
+
+// Appends the line for the exchange of `ctx`, without the newline
+void AccessLogFormat::format(HttpContext &ctx, std::string &out) const
+{
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		out += _segments[i].literal;
+		if (_segments[i].field != F_NONE)
+			appendField(out, _segments[i], ctx);
+	}
+}
+
+// "combined" is nginx's default format, "json" holds every field
+bool AccessLogFormat::builtin(const std::string &name, AccessLogFormat &out)
+{
+	if (name == "combined")
+		out.compile("$remote_addr - - [$time_local] \"$request\" $status $body_bytes_sent"
+			" \"$http_referer\" \"$http_user_agent\"", ESCAPE_DEFAULT);
+	else if (name == "json")
+		out.compile("{\"time\":\"$time_iso8601\",\"remote_addr\":\"$remote_addr\","
+			"\"remote_port\":$remote_port,\"connection\":$connection,"
+			"\"connection_requests\":$connection_requests,\"host\":\"$host\","
+			"\"method\":\"$request_method\",\"uri\":\"$request_uri\","
+			"\"protocol\":\"$server_protocol\",\"status\":$status,"
+			"\"request_length\":$request_length,\"bytes_sent\":$bytes_sent,"
+			"\"body_bytes_sent\":$body_bytes_sent,\"request_time\":$request_time,"
+			"\"upstream_response_time\":\"$upstream_response_time\","
+			"\"http_referer\":\"$http_referer\",\"http_user_agent\":\"$http_user_agent\"}",
+			ESCAPE_JSON);
+	else
+		return false;
+	return true;
+}
+
+/**
+ * Text from the request goes through here. Missing values are "-", or
+ * empty in JSON (inside quotes in the template).
+ */
+void AccessLogFormat::appendValue(std::string &out, const char *data, size_t len) const
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	if (len == 0)
+	{
+		if (_escape == ESCAPE_DEFAULT)
+			out += '-';
+		return;
+	}
+	for (size_t i = 0; i < len; ++i)
+	{
+		unsigned char c = static_cast<unsigned char>(data[i]);
+		if (_escape == ESCAPE_JSON)
+		{
+			if (c == '"' || c == '\\')
+			{
+				out += '\\';
+				out += c;
+			}
+			else if (c < 0x20)
+			{
+				out += "\\u00";
+				out += hex[c >> 4];
+				out += hex[c & 15];
+			}
+			else
+				out += c;
+		}
+		else if (c == '"' || c == '\\' || c < 0x20 || c >= 0x7f)
+		{
+			out += "\\x";
+			out += hex[c >> 4];
+			out += hex[c & 15];
+		}
+		else
+			out += c;
+	}
+}
+
+void AccessLogFormat::appendValue(std::string &out, const std::string &value) const
+{
+	appendValue(out, value.data(), value.size());
+}
+
+void AccessLogFormat::appendField(std::string &out, const Segment &seg, HttpContext &ctx) const
+{
+	const Request &req = ctx.request();
+	const Connection &conn = ctx.connection();
+
+	switch (seg.field)
+	{
+	case F_REMOTE_ADDR:
+		out += conn.getClientIp();
+		break;
+	case F_REMOTE_PORT:
+		append_number(out, ntohs(conn.getClientAddress().sin_port));
+		break;
+	case F_TIME_LOCAL:
+		out += timeString(false);
+		break;
+	case F_TIME_ISO8601:
+		out += timeString(true);
+		break;
+	case F_MSEC:
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		appendSeconds(out, tv.tv_sec + tv.tv_usec / 1e6);
+		break;
+	}
+	case F_REQUEST:
+		if (req.getMethod().empty())
+		{
+			appendValue(out, "", 0);
+			break;
+		}
+		appendValue(out, req.getMethod());
+		out += ' ';
+		appendValue(out, req.getUri());
+		out += ' ';
+		appendValue(out, req.getVersion());
+		break;
+	case F_REQUEST_METHOD:
+		appendValue(out, req.getMethod());
+		break;
+	case F_REQUEST_URI:
+		appendValue(out, req.getUri());
+		break;
+	case F_SERVER_PROTOCOL:
+		appendValue(out, req.getVersion());
+		break;
+	case F_STATUS:
+		append_number(out, ctx.response().getStatusCode());
+		break;
+	case F_BYTES_SENT:
+		append_number(out, ctx.getTotalSent());
+		break;
+	case F_BODY_BYTES_SENT:
+		append_number(out, ctx.getBodyBytesSent());
+		break;
+	case F_REQUEST_LENGTH:
+		append_number(out, ctx.getBytesReceived());
+		break;
+	case F_REQUEST_TIME:
+		appendSeconds(out, ctx.getRequestStart() == 0 ? 0 : monotonic_time() - ctx.getRequestStart());
+		break;
+	case F_UPSTREAM_RESPONSE_TIME:
+		if (ctx.getUpstreamTime() < 0)
+			appendValue(out, "", 0);
+		else
+			appendSeconds(out, ctx.getUpstreamTime());
+		break;
+	case F_CONNECTION:
+		append_number(out, conn.getId());
+		break;
+	case F_CONNECTION_REQUESTS:
+		append_number(out, conn.getRequestCount());
+		break;
+	case F_HOST:
+		appendValue(out, req.getHeaderValue(Request::HDR_HOST));
+		break;
+	case F_SERVER_PORT:
+		append_number(out, ctx.server().getPort());
+		break;
+	case F_HTTP_USER_AGENT:
+		appendValue(out, req.getHeaderValue(Request::HDR_USER_AGENT));
+		break;
+	case F_HTTP_REFERER:
+		appendValue(out, req.getHeaderValue(Request::HDR_REFERER));
+		break;
+	case F_HTTP_HEADER:
+		appendValue(out, req.getHeaderValue(seg.arg));
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include "../../inc/Webserv.hpp"
+
+class HttpContext;
+
+/**
+ * Briefly: a log_format, compiled once, that turns a finished exchange
+ * into one access log line.
+ *
+ * The template is nginx style: text with $variables ("$status",
+ * "$request_time", "$http_x_forwarded_for", ...). compile() splits it
+ * into segments once; each variable is looked up in a fixed field table
+ * at that point and keeps only its index, so writing a line is a walk
+ * over the segments with a switch per variable. Values are escaped for
+ * a quoted log field (" and \ and control bytes as \xHH), or for a JSON
+ * string with escape=json. Missing values print as "-".
+ *
+ * Built in: "combined" (nginx's default) and "json" (every field, one
+ * JSON object per line).
+ */
+class AccessLogFormat
+{
+public:
+	enum e_escape
+	{
+		ESCAPE_DEFAULT,
+		ESCAPE_JSON
+	};
+
+	AccessLogFormat();
+
+	void compile(const std::string &tmpl, e_escape escape);
+	void format(HttpContext &ctx, std::string &out) const;
+	bool empty() const;
+
+	static bool builtin(const std::string &name, AccessLogFormat &out);
+
+private:
+	enum e_field
+	{
+		F_NONE,			// literal text only
+		F_REMOTE_ADDR,
+		F_REMOTE_PORT,
+		F_TIME_LOCAL,
+		F_TIME_ISO8601,
+		F_MSEC,
+		F_REQUEST,
+		F_REQUEST_METHOD,
+		F_REQUEST_URI,
+		F_SERVER_PROTOCOL,
+		F_STATUS,
+		F_BYTES_SENT,
+		F_BODY_BYTES_SENT,
+		F_REQUEST_LENGTH,
+		F_REQUEST_TIME,
+		F_UPSTREAM_RESPONSE_TIME,
+		F_CONNECTION,
+		F_CONNECTION_REQUESTS,
+		F_HOST,
+		F_SERVER_PORT,
+		F_HTTP_USER_AGENT,
+		F_HTTP_REFERER,
+		F_HTTP_HEADER	// $http_<name>, the name is the segment's arg
+	};
+
+	struct Segment
+	{
+		std::string literal;	// written before the field
+		e_field field;
+		std::string arg;
+	};
+
+	std::vector<Segment> _segments;
+	e_escape _escape;
+
+	void appendValue(std::string &out, const char *data, size_t len) const;
+	void appendValue(std::string &out, const std::string &value) const;
+	void appendField(std::string &out, const Segment &seg, HttpContext &ctx) const;
+};
+
+#endif
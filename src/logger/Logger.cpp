@@ -1,51 +1,39 @@
 #include "Logger.hpp"
+#include <fcntl.h>
+#include <sys/uio.h>
 
-std::ofstream Logger::_logFile;
-std::string Logger::_filename;
+Logger::Ring Logger::_file = { -1, {0}, 0, 0 };
+Logger::Ring Logger::_console = { STDOUT_FILENO, {0}, 0, 0 };
+std::vector<Logger::Ring *> Logger::_accessLogs;
+std::map<std::string, int> Logger::_accessLogPaths;
+std::string Logger::_line;
+size_t Logger::_dropped = 0;
+
+// Lines still buffered when main() returns or exit() is called
+static void flushAtExit()
+{
+	Logger::flush();
+	Logger::closeAccessLogs();
+}
 
 void Logger::init(const std::string &filename)
 {
-	_filename = filename;
-	_logFile.open(filename.c_str(), std::ios::app);
-	if (!_logFile.is_open())
+	_file.fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (_file.fd == -1)
 	{
 		std::cerr << "Error: Could not open log file: " << filename << std::endl;
 	}
+	_line.reserve(512);
+	std::atexit(flushAtExit);
 }
 
 void Logger::log(LogLevel level, const std::string &message)
 {
 	if (!IS_LOGGER_ENABLED)
 		return;
-	std::string timestamp = getTimestamp();
-	std::string levelStr = levelToString(level);
-	std::string logMsg = "[" + timestamp + "] [" + levelStr + "] " + message;
-
-	if (_logFile.is_open())
-	{
-		_logFile << logMsg << std::endl;
-	}
-
-	std::string colorCode;
-	switch (level)
-	{
-	case LOG_INFO:
-		colorCode = GREEN;
-		break;
-	case LOG_WARNING:
-		colorCode = YELLOW;
-		break;
-	case LOG_ERROR:
-		colorCode = RED;
-		break;
-	case LOG_REQUEST:
-		colorCode = BLUE;
-		break;
-	default:
-		colorCode = RESET;
-		break;
-	}
-	std::cout << colorCode << logMsg << RESET << std::endl;
+	startLine(levelToString(level));
+	_line += message;
+	emit(levelColor(level), level == LOG_ERROR);
 }
 
 void Logger::logErrno(LogLevel level, const std::string &message)
@@ -61,43 +49,236 @@ void Logger::logErrno(LogLevel level, const std::string &message)
 	}
 }
 
+/**
+ * The status code is colored in the file too, as it always was:
+ * `tail -f webserv.log` shows the same as the console.
+ */
 void Logger::logRequest(const std::string &clientIp, const std::string &method, const std::string &uri, int statusCode, size_t bytesSent)
 {
 	if (!IS_LOGGER_ENABLED)
 		return;
-	std::string statusCodeColor;
+	const char *statusCodeColor = "";
 	if (statusCode >= 200 && statusCode < 300)
 		statusCodeColor = GREEN;
 	else if (statusCode >= 300 && statusCode < 400)
 		statusCodeColor = YELLOW;
 	else if (statusCode >= 400)
 		statusCodeColor = RED;
-	std::string timestamp = getTimestamp();
-	std::stringstream ss;
-	ss << "[" << timestamp << "] [REQUEST] "
-	   << clientIp << " - "
-	   << "\"" << method << " " << uri << "\" "
-	   << statusCodeColor << statusCode << RESET << " "
-	   << "- " << bytesSent << " bytes sent";
+	startLine("REQUEST");
+	_line += clientIp;
+	_line += " - \"";
+	_line += method;
+	_line += ' ';
+	_line += uri;
+	_line += "\" ";
+	_line += statusCodeColor;
+	append_number(_line, statusCode);
+	_line += RESET " - ";
+	append_number(_line, bytesSent);
+	_line += " bytes sent";
+	emit(BLUE, false);
+}
+
+/**
+ * An access log file, shared by the servers that name the same path.
+ * Returns the `log` for logAccess(), -1 if the file cannot be opened.
+ */
+int Logger::openAccessLog(const std::string &path)
+{
+	std::map<std::string, int>::iterator it = _accessLogPaths.find(path);
+	if (it != _accessLogPaths.end())
+		return it->second;
+	int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		logErrno(LOG_ERROR, "Could not open access log " + path);
+		return -1;
+	}
+	Ring *ring = new Ring;
+	ring->fd = fd;
+	ring->head = 0;
+	ring->size = 0;
+	_accessLogs.push_back(ring);
+	_accessLogPaths[path] = _accessLogs.size() - 1;
+	return _accessLogs.size() - 1;
+}
 
-	std::string logMsg = ss.str();
+// After the last flush(): the access log rings are heap-allocated
+void Logger::closeAccessLogs()
+{
+	for (size_t i = 0; i < _accessLogs.size(); ++i)
+	{
+		close(_accessLogs[i]->fd);
+		delete _accessLogs[i];
+	}
+	_accessLogs.clear();
+	_accessLogPaths.clear();
+}
+
+// One line, the newline is added here
+void Logger::logAccess(int log, const std::string &line)
+{
+	if (log < 0 || static_cast<size_t>(log) >= _accessLogs.size())
+		return;
+	Ring &ring = *_accessLogs[log];
+	if (!makeRoom(ring, line.size() + 1))
+	{
+		_dropped++;
+		return;
+	}
+	push(ring, line.data(), line.size());
+	push(ring, "\n", 1);
+	if (!LOG_ASYNC)
+		drain(ring);
+}
 
-	if (_logFile.is_open())
+// Writes out everything buffered; called by the poll() loop and at exit
+void Logger::flush()
+{
+	drain(_file);
+	drain(_console);
+	for (size_t i = 0; i < _accessLogs.size(); ++i)
+		drain(*_accessLogs[i]);
+	if (_dropped)
 	{
-		_logFile << logMsg << std::endl;
+		size_t dropped = _dropped;
+		_dropped = 0;
+		startLine("WARNING");
+		append_number(_line, dropped);
+		_line += " log lines dropped: log buffer full";
+		emit(YELLOW, false);	// not urgent: that would flush() again
+		drain(_file);
+		drain(_console);
 	}
-	std::cout << BLUE << logMsg << RESET << std::endl;
 }
 
-std::string Logger::getTimestamp()
+// "[timestamp] [LEVEL] " into _line, which is reused for every line
+void Logger::startLine(const char *level)
+{
+	_line.clear();
+	_line += '[';
+	_line += getTimestamp();
+	_line += "] [";
+	_line += level;
+	_line += "] ";
+}
+
+// Queues _line on both outputs; the console copy is colored
+void Logger::emit(const char *color, bool urgent)
 {
+	size_t need = _line.size() + 1;
+	size_t needColored = need + std::strlen(color) + sizeof(RESET) - 1;
+	bool toFile = _file.fd != -1 && makeRoom(_file, need);
+	bool toConsole = makeRoom(_console, needColored);
+
+	if ((_file.fd != -1 && !toFile) || !toConsole)
+		_dropped++;
+	_line += '\n';
+	if (toFile)
+		push(_file, _line.data(), _line.size());
+	if (toConsole)
+	{
+		push(_console, color, std::strlen(color));
+		push(_console, _line.data(), _line.size() - 1);
+		push(_console, RESET "\n", sizeof(RESET));
+	}
+	if (urgent || !LOG_ASYNC)
+		flush();
+}
+
+/**
+ * Whether `need` more bytes fit in the ring, after writing it out unless
+ * LOG_DROP_WHEN_FULL. A line that does not fit is dropped whole, never
+ * queued in part: an output that cannot keep up (EAGAIN) loses lines,
+ * not the ends of them. A line longer than the whole buffer fits an
+ * empty ring; push() writes it out in pieces.
+ */
+bool Logger::makeRoom(Ring &ring, size_t need)
+{
+	if (ring.size + need <= LOG_BUFFER_SIZE)
+		return true;
+	if (LOG_DROP_WHEN_FULL)
+		return false;
+	drain(ring);
+	return ring.size + need <= LOG_BUFFER_SIZE || ring.size == 0;
+}
+
+// A line longer than the whole buffer goes out in pieces
+void Logger::push(Ring &ring, const char *data, size_t len)
+{
+	while (len)
+	{
+		if (ring.size == LOG_BUFFER_SIZE)
+			drain(ring);
+		if (ring.size == LOG_BUFFER_SIZE)
+			return;
+		size_t tail = (ring.head + ring.size) % LOG_BUFFER_SIZE;
+		size_t end = tail < ring.head ? ring.head : LOG_BUFFER_SIZE;
+		size_t chunk = std::min(len, end - tail);
+		std::memcpy(ring.data + tail, data, chunk);
+		ring.size += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * Both parts of the ring in one writev(). A console that cannot keep up
+ * (EAGAIN, a stopped pager) keeps its bytes for the next flush; any
+ * other error drops them, there is nowhere to report it.
+ */
+void Logger::drain(Ring &ring)
+{
+	int savedErrno = errno;
+
+	while (ring.size && ring.fd != -1)
+	{
+		struct iovec iov[2];
+		int count = 1;
+		size_t first = std::min(ring.size, (size_t)LOG_BUFFER_SIZE - ring.head);
+
+		iov[0].iov_base = ring.data + ring.head;
+		iov[0].iov_len = first;
+		if (first < ring.size)
+		{
+			iov[1].iov_base = ring.data;
+			iov[1].iov_len = ring.size - first;
+			count = 2;
+		}
+		ssize_t written = writev(ring.fd, iov, count);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (written <= 0)
+			written = ring.size;
+		ring.head = (ring.head + written) % LOG_BUFFER_SIZE;
+		ring.size -= written;
+	}
+	if (!ring.size)
+		ring.head = 0;
+	errno = savedErrno;
+}
+
+// Formatted once per second, not once per line
+const std::string &Logger::getTimestamp()
+{
+	static time_t cachedAt = -1;
+	static std::string cached;
 	std::time_t now = std::time(0);
-	char buf[80];
-	std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
-	return std::string(buf);
+
+	if (now != cachedAt)
+	{
+		char buf[80];
+		struct tm tm;
+		std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm));
+		cached = buf;
+		cachedAt = now;
+	}
+	return cached;
 }
 
-std::string Logger::levelToString(LogLevel level)
+const char *Logger::levelToString(LogLevel level)
 {
 	switch (level)
 	{
@@ -113,3 +294,20 @@ std::string Logger::levelToString(LogLevel level)
 		return "UNKNOWN";
 	}
 }
+
+const char *Logger::levelColor(LogLevel level)
+{
+	switch (level)
+	{
+	case LOG_INFO:
+		return GREEN;
+	case LOG_WARNING:
+		return YELLOW;
+	case LOG_ERROR:
+		return RED;
+	case LOG_REQUEST:
+		return BLUE;
+	default:
+		return RESET;
+	}
+}
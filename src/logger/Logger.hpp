@@ -4,8 +4,13 @@
 #include "../../inc/Webserv.hpp"
 #include <cerrno>
 #include <cstring>
+#include <map>
+#include <vector>
 
 #define IS_LOGGER_ENABLED 1
+#define LOG_ASYNC 1				// lines wait in a buffer until Logger::flush(), see below
+#define LOG_BUFFER_SIZE 262144	// bytes buffered per output (file, console)
+#define LOG_DROP_WHEN_FULL 0	// full buffer: 1 drops the line, 0 writes the buffer out first
 // colors
 #define RESET "\033[0m"
 #define RED "\033[31m"
@@ -21,6 +26,20 @@ enum LogLevel
 	LOG_REQUEST
 };
 
+/**
+ * Briefly: log lines to webserv.log and, colored, to the console.
+ *
+ * With LOG_ASYNC a line is formatted straight into a ring buffer per
+ * output and written later, in large batches: ServerManager calls
+ * flush() once per loop iteration, before it goes back to poll(). The
+ * server has one thread, so nothing has to be locked. LOG_ERROR lines,
+ * a full buffer (unless LOG_DROP_WHEN_FULL) and flush() at exit write
+ * right away. The timestamp is formatted at most once per second.
+ *
+ * Access logs (the access_log directive) are more outputs of the same
+ * kind: openAccessLog() once per file, logAccess() per finished request
+ * with a line formatted by AccessLogFormat.
+ */
 class Logger
 {
 public:
@@ -28,17 +47,39 @@ public:
 	static void log(LogLevel level, const std::string &message);
 	static void logErrno(LogLevel level, const std::string &message);
 	static void logRequest(const std::string &clientIp, const std::string &method, const std::string &uri, int statusCode, size_t bytesSent);
+	static int openAccessLog(const std::string &path);
+	static void logAccess(int log, const std::string &line);
+	static void closeAccessLogs();
+	static void flush();
 
 private:
 	Logger();
 	Logger(const Logger &);
 	Logger &operator=(const Logger &);
 
-	static std::ofstream _logFile;
-	static std::string _filename;
+	struct Ring
+	{
+		int		fd;
+		char	data[LOG_BUFFER_SIZE];
+		size_t	head;	// next byte to write out
+		size_t	size;	// bytes waiting
+	};
 
-	static std::string getTimestamp();
-	static std::string levelToString(LogLevel level);
+	static Ring _file;
+	static Ring _console;
+	static std::vector<Ring *> _accessLogs;
+	static std::map<std::string, int> _accessLogPaths;
+	static std::string _line;
+	static size_t _dropped;
+
+	static const std::string &getTimestamp();
+	static const char *levelToString(LogLevel level);
+	static const char *levelColor(LogLevel level);
+	static void startLine(const char *level);
+	static void emit(const char *color, bool urgent);
+	static bool makeRoom(Ring &ring, size_t need);
+	static void push(Ring &ring, const char *data, size_t len);
+	static void drain(Ring &ring);
 };
 
 #endif
@@ -8,17 +8,22 @@
 static ServerManager*	g_server_manager = NULL;
 
 /**
- * Note: Same scenario for all three signals. It' a fall-through 
- * in C/C++ switch statements. When there is no break; between cases,
- * they all execute the same code.
+ * Note: Same scenario for all five signals. It's a fall-through in
+ * C/C++ switch statements: with no break; between cases, they all run
+ * the same code. The signal is handed to the poll() loop
+ * (ServerManager::notifySignal()), which drains and stops on SIGINT,
+ * SIGTERM and SIGQUIT (at once on a second one), reloads the
+ * configuration on SIGHUP and hands over to a new binary on SIGUSR2.
  */
 void	signalHandler(int signal_num) {
 	switch (signal_num) {
 		case SIGINT:
 		case SIGTERM:
 		case SIGQUIT:
+		case SIGHUP:
+		case SIGUSR2:
 			if (g_server_manager) {
-				g_server_manager->requestShutdown();
+				g_server_manager->notifySignal(signal_num);
 			}
 			break;
 		default:
@@ -33,23 +38,24 @@ int		main(int ac, char **argv) {
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
 	signal(SIGQUIT, signalHandler);
+	signal(SIGHUP, signalHandler);
+	signal(SIGUSR2, signalHandler);
 
     Logger::init("webserv.log");
     Logger::log(LOG_INFO, "Webserv started");
 	
-	Config			config;
 	ServerManager	server_manager;
 
 	// Set global pointer for signal handler access
 	g_server_manager = &server_manager;
+	server_manager.setCommandLine(argv);
 
 	try {
 		if (ac <= 2) {
 			// if no config file provided, use default config file
 			std::string	config_file = (ac == 1 ? "configs/default.conf" : argv[1]);
-			// parse config file and save parsed data
-			config.parse(config_file);
-			server_manager.setupServers(config.getServerConfigs());
+			// parse config file and listen; SIGHUP parses it again
+			server_manager.loadConfig(config_file);
 			server_manager.runServers();
 
         } else {
@@ -1,4 +1,5 @@
 #include "Request.hpp"
+#include "../httpContext/BufferPool.hpp"
 
 Request::Request() :
 	_validFormatReqLine(false),
@@ -6,20 +7,23 @@ Request::Request() :
 	_method(INVALID),
 	_bodyChunked(false),
 	_statusCode(0)
-{ }
+{
+	clearKnown();
+}
 
 Request::~Request() { }
 
 void Request::setMethod(const std::string &method) {
-	if (method.size() == 0) {
-		_method = INVALID;
-		return;
-	}
-	if (method == "GET") {
+	setMethod(method.data(), method.size());
+}
+
+// Classifies the method straight from the request line bytes
+void	Request::setMethod(const char *data, size_t len) {
+	if (len == 3 && std::memcmp(data, "GET", 3) == 0) {
 		_method = GET;
-	} else if (method == "POST") {
+	} else if (len == 4 && std::memcmp(data, "POST", 4) == 0) {
 		_method = POST;
-	} else if (method == "DELETE") {
+	} else if (len == 6 && std::memcmp(data, "DELETE", 6) == 0) {
 		_method = DELETE;
 	} else {
 		_method = INVALID;
@@ -30,17 +34,103 @@ void	Request::setUri(const std::string &uri) {
 	_uri = uri;
 }
 
+void	Request::setUri(const char *data, size_t len) {
+	_uri.assign(data, len);
+}
+
 void	Request::setVersion(const std::string &version) {
 	_httpVersion = version;
 }
 
+void	Request::setVersion(const char *data, size_t len) {
+	_httpVersion.assign(data, len);
+}
+
 void	Request::addHeader(const std::string &key, const std::string &value) {
-	_headers[key] = value;
+	HeaderField	field;
+
+	field.name.off = _rawHeaders.size();
+	field.name.len = key.size();
+	_rawHeaders.append(key);
+	field.value.off = _rawHeaders.size();
+	field.value.len = value.size();
+	_rawHeaders.append(value);
+	addHeaderField(field);
+}
+
+// Keeps one copy of the header block; HttpParser records the field spans
+void	Request::setRawHeaders(const char *data, size_t len) {
+	BufferPool::reserve(_rawHeaders, len);
+	_rawHeaders.assign(data, len);
+	_fields.clear();
+	_values.clear();
+	_valueReady.clear();
+	clearKnown();
+}
+
+void	Request::addHeaderField(const HeaderField &field) {
+	KnownHeader	id = classifyHeader(_rawHeaders.data() + field.name.off, field.name.len);
+
+	if (id != HDR_OTHER)
+		_known[id] = _fields.size();
+	_fields.push_back(field);
+	_values.push_back(std::string());
+	_valueReady.push_back(0);
+}
+
+void	Request::clearKnown() {
+	for (size_t i = 0; i < HDR_COUNT; ++i)
+		_known[i] = std::string::npos;
+}
+
+/**
+ * Maps a header name (any case) to its KnownHeader slot: the length
+ * picks at most two candidates (three at length 6, told apart by the
+ * first letter), one strncasecmp confirms.
+ */
+Request::KnownHeader	Request::classifyHeader(const char *name, size_t len) {
+	switch (len) {
+		case 4:
+			if (strncasecmp(name, "host", 4) == 0) return HDR_HOST;
+			break;
+		case 6:
+			switch (name[0] | 0x20) {
+				case 'c':
+					if (strncasecmp(name, "cookie", 6) == 0) return HDR_COOKIE;
+					break;
+				case 'a':
+					if (strncasecmp(name, "accept", 6) == 0) return HDR_ACCEPT;
+					break;
+				case 'e':
+					if (strncasecmp(name, "expect", 6) == 0) return HDR_EXPECT;
+					break;
+			}
+			break;
+		case 7:
+			if (strncasecmp(name, "referer", 7) == 0) return HDR_REFERER;
+			break;
+		case 10:
+			if (strncasecmp(name, "connection", 10) == 0) return HDR_CONNECTION;
+			if (strncasecmp(name, "user-agent", 10) == 0) return HDR_USER_AGENT;
+			break;
+		case 12:
+			if (strncasecmp(name, "content-type", 12) == 0) return HDR_CONTENT_TYPE;
+			break;
+		case 14:
+			if (strncasecmp(name, "content-length", 14) == 0) return HDR_CONTENT_LENGTH;
+			break;
+		case 17:
+			if (strncasecmp(name, "transfer-encoding", 17) == 0) return HDR_TRANSFER_ENCODING;
+			break;
+		default:
+			break;
+	}
+	return HDR_OTHER;
 }
 
 // Set default Connection header based on HTTP version if not present
 void	Request::ifConnNotPresent() {
-	if (getHeaderValue("connection").empty()) {
+	if (getHeaderValue(HDR_CONNECTION).empty()) {
 		if (getVersion() == "HTTP/1.1") {
 			addHeader("connection", "keep-alive");
 		} else {
@@ -103,45 +193,111 @@ const std::string&	Request::getUri() const {
 	return _uri;
 }
 
-std::string Request::getVersion() const {
+const std::string&	Request::getVersion() const {
 	return _httpVersion;
 }
 
+// Materializes every header into a map with lowercase names
 std::map<std::string, std::string>	Request::getHeaders() const {
-	return _headers;
+	std::map<std::string, std::string>	headers;
+
+	for (size_t i = 0; i < _fields.size(); ++i) {
+		std::string	name(_rawHeaders, _fields[i].name.off, _fields[i].name.len);
+		for (size_t j = 0; j < name.size(); ++j)
+			name[j] = std::tolower(static_cast<unsigned char>(name[j]));
+		headers[name] = getHeaderValue(name);
+	}
+	return headers;
+}
+
+const std::string&	Request::getRawHeaders() const {
+	return _rawHeaders;
+}
+
+const std::vector<HeaderField>&	Request::getHeaderFields() const {
+	return _fields;
+}
+
+// The header block and the body back to the BufferPool, before the Request goes
+void	Request::releaseBuffers() {
+	BufferPool::release(_rawHeaders);
+	BufferPool::release(_body);
+}
+
+// Heap bytes of the request: strings by capacity, the field index, the values asked for
+size_t	Request::memoryHeld() const {
+	size_t	held = _uri.capacity() + _httpVersion.capacity() + _rawHeaders.capacity()
+		+ _body.capacity() + _host.capacity()
+		+ _fields.capacity() * sizeof(HeaderField) + _valueReady.capacity()
+		+ _values.capacity() * sizeof(std::string);
+
+	for (size_t i = 0; i < _values.size(); ++i)
+		held += _values[i].capacity();
+	return held;
+}
+
+/**
+ * Index of the last field whose name matches (case-insensitive), so a
+ * repeated header behaves like the former map: the last one wins.
+ * Returns _fields.size() when absent.
+ */
+size_t	Request::findField(const std::string &lowerName) const {
+	for (size_t i = _fields.size(); i-- > 0; ) {
+		const HttpSpan&	name = _fields[i].name;
+		if (name.len != lowerName.size())
+			continue;
+		const char*	raw = _rawHeaders.data() + name.off;
+		size_t		j = 0;
+		while (j < name.len && std::tolower(static_cast<unsigned char>(raw[j])) == lowerName[j])
+			++j;
+		if (j == name.len)
+			return i;
+	}
+	return _fields.size();
 }
 
 // checks if the key "content-length" is present
 bool	Request::isContentLengthHeader() const {
-	if (_headers.find("content-length") == _headers.end())
-		return false;
-	else
-		return true;
+	return hasHeader(HDR_CONTENT_LENGTH);
 }
 
 // checks if the key "transfer-encoding" is present
 bool	Request::isTransferEncodingHeader() const {
-	if (_headers.find("transfer-encoding") == _headers.end())
-		return false;
-	else
-		return true;
+	return hasHeader(HDR_TRANSFER_ENCODING);
 }
 
-/**
- * Warning: header map is case‑normalized so parameter must be lowercase to
- * retrieve a value.
- */
-const std::string&	Request::getHeaderValue(const std::string header_name) const {
-	
+bool	Request::hasHeader(KnownHeader id) const {
+	return _known[id] != std::string::npos;
+}
+
+// The value is copied out of the raw header block on first access.
+const std::string&	Request::fieldValue(size_t i) const {
 	static const std::string	empty = "";
-	std::map<std::string, std::string>::const_iterator it;
 
-	it = _headers.find(header_name);
-	if (it == _headers.end()) {
+	if (i >= _fields.size())
 		return empty;
-	} else {
-		return it->second;
+	if (!_valueReady[i]) {
+		_values[i].assign(_rawHeaders, _fields[i].value.off, _fields[i].value.len);
+		_valueReady[i] = 1;
 	}
+	return _values[i];
+}
+
+// O(1): no name comparison, the slot was filled while parsing
+const std::string&	Request::getHeaderValue(KnownHeader id) const {
+	return fieldValue(_known[id]);
+}
+
+/**
+ * Warning: parameter must be lowercase to retrieve a value.
+ * Known names go through the table, anything else is searched.
+ */
+const std::string&	Request::getHeaderValue(const std::string &header_name) const {
+	KnownHeader	id = classifyHeader(header_name.data(), header_name.size());
+
+	if (id != HDR_OTHER)
+		return fieldValue(_known[id]);
+	return fieldValue(findField(header_name));
 }
 
 std::string&		Request::getBody() {
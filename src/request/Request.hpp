@@ -2,9 +2,22 @@
 # define REQUEST_HPP
 
 #include "../../inc/Webserv.hpp"
+#include <strings.h> // strncasecmp
 
 class	PrintUtils;
 
+// (offset, length) of a token inside the buffer it was parsed from
+struct	HttpSpan {
+	size_t	off;
+	size_t	len;
+};
+
+// One header line: name and value spans into Request's raw header block
+struct	HeaderField {
+	HttpSpan	name;
+	HttpSpan	value;
+};
+
 // Data object that holds parsed request
 class	Request {
 	friend class PrintUtils;
@@ -20,14 +33,35 @@ class	Request {
 			INVALID
 		};
 
+		// Header fields the server itself looks at, classified once at parse time
+		enum KnownHeader {
+			HDR_HOST,
+			HDR_CONNECTION,
+			HDR_CONTENT_LENGTH,
+			HDR_CONTENT_TYPE,
+			HDR_TRANSFER_ENCODING,
+			HDR_REFERER,
+			HDR_USER_AGENT,
+			HDR_COOKIE,
+			HDR_ACCEPT,
+			HDR_EXPECT,
+			HDR_COUNT,
+			HDR_OTHER = HDR_COUNT
+		};
+
 		// setters
 		void	setRequestLineFormatValid(bool value);
 		void	setHeadersFormatValid(bool value);
 		void	setHost(const std::string &host);
 		void	setMethod(const std::string &method);
+		void	setMethod(const char *data, size_t len);
 		void	setUri(const std::string &uri);
+		void	setUri(const char *data, size_t len);
 		void	setVersion(const std::string &version);
+		void	setVersion(const char *data, size_t len);
 		void	addHeader(const std::string &key, const std::string &value);
+		void	setRawHeaders(const char *data, size_t len);
+		void	addHeaderField(const HeaderField &field);
 		void	ifConnNotPresent();
 		void	setBody(const std::string &body);
 		void	setChunked(bool value);
@@ -42,11 +76,18 @@ class	Request {
 		MethodType			getEnumMethod() const { return _method;}
 		std::string&		getUri();
 		const std::string&	getUri() const;
-		std::string			getVersion() const;
+		const std::string&	getVersion() const;
 		std::string&		getBody();
 		const std::string&	getBody() const;
 		std::map<std::string, std::string>	getHeaders() const;
-		const std::string &	getHeaderValue(const std::string header_name) const;
+		const std::string &	getHeaderValue(const std::string &header_name) const;
+		const std::string &	getHeaderValue(KnownHeader id) const;
+		bool				hasHeader(KnownHeader id) const;
+		static KnownHeader	classifyHeader(const char *name, size_t len);
+		const std::string &	getRawHeaders() const;
+		const std::vector<HeaderField>&	getHeaderFields() const;
+		size_t				memoryHeld() const;
+		void				releaseBuffers();
 		const std::string &	getHost() const;
 		short				getStatusCode() const;
 
@@ -56,11 +97,22 @@ class	Request {
 		MethodType					_method;
 		std::string					_uri;
 		std::string					_httpVersion;
-		std::map<std::string, std::string>	_headers;
+		// Header block as received; _fields index into it and values are
+		// copied out into _values only when someone asks for them.
+		std::string					_rawHeaders;
+		std::vector<HeaderField>	_fields;
+		mutable std::vector<std::string>	_values;
+		mutable std::vector<char>	_valueReady;
+		// _fields index of the last occurrence of each known header
+		size_t						_known[HDR_COUNT];
 		std::string					_body;
 		bool						_bodyChunked;
 		std::string					_host;
 		short						_statusCode;
+
+		size_t						findField(const std::string &lowerName) const;
+		const std::string &			fieldValue(size_t i) const;
+		void						clearKnown();
 };
 
 #endif
@@ -0,0 +1,182 @@
+#include "HeaderWriter.hpp"
+
+using std::string;
+
+static const char	g_connection[] = "Connection: ";
+static const char	g_content_length[] = "Content-Length: ";
+static const char	g_transfer_encoding[] = "Transfer-Encoding: ";
+
+const HeaderWriter::Name	HeaderWriter::CONNECTION = { g_connection, sizeof(g_connection) - 1 };
+const HeaderWriter::Name	HeaderWriter::CONTENT_LENGTH = { g_content_length, sizeof(g_content_length) - 1 };
+const HeaderWriter::Name	HeaderWriter::TRANSFER_ENCODING = { g_transfer_encoding, sizeof(g_transfer_encoding) - 1 };
+
+// Status codes the server produces itself (see generateStatusMessage())
+static const short	g_known_codes[] = {
+	200, 201, 204, 300, 301, 303, 400, 401, 403, 404, 405,
+	409, 413, 414, 415, 431, 500, 501, 502, 503, 504
+};
+static const size_t	g_known_count = sizeof(g_known_codes) / sizeof(g_known_codes[0]);
+
+HeaderWriter::HeaderWriter() { }
+
+HeaderWriter::~HeaderWriter() { }
+
+// helper. Writes the decimal digits of value without a stream
+static void	appendUnsigned(string& out, size_t value)
+{
+	char	digits[24];
+	size_t	pos = sizeof(digits);
+
+	do {
+		digits[--pos] = static_cast<char>('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+	out.append(digits + pos, sizeof(digits) - pos);
+}
+
+static string	buildStatusLine(const char* version, short statusCode, const char* reason)
+{
+	string	line(version);
+
+	line += ' ';
+	appendUnsigned(line, static_cast<size_t>(statusCode));
+	line += ' ';
+	line += reason;
+	line += "\r\n";
+	return line;
+}
+
+/**
+ * Returns the prebuilt "HTTP/1.x CODE Reason\r\n" line, or NULL when
+ * the version or the code is not one we keep a line for.
+ * The table is filled on first use: index 0 is HTTP/1.0, index 1 HTTP/1.1.
+ */
+const string*	HeaderWriter::cachedStatusLine(const string& version, short statusCode)
+{
+	static string	lines[2][g_known_count];
+	static bool		initialized = false;
+
+	if (!initialized) {
+		for (size_t i = 0; i < g_known_count; ++i) {
+			const char*	reason = generateStatusMessage(g_known_codes[i]);
+			lines[0][i] = buildStatusLine("HTTP/1.0", g_known_codes[i], reason);
+			lines[1][i] = buildStatusLine("HTTP/1.1", g_known_codes[i], reason);
+		}
+		initialized = true;
+	}
+
+	int	v;
+	if (version == "HTTP/1.1")
+		v = 1;
+	else if (version == "HTTP/1.0")
+		v = 0;
+	else
+		return NULL;
+	for (size_t i = 0; i < g_known_count; ++i) {
+		if (g_known_codes[i] == statusCode)
+			return &lines[v][i];
+	}
+	return NULL;
+}
+
+/**
+ * Upper bound of the head size, used to reserve the response buffer
+ * once instead of letting it grow while appending.
+ */
+size_t	HeaderWriter::estimateHeadSize(const HeaderMap& headers)
+{
+	// status line + Date/Server + Connection + Content-Length + final CRLF
+	size_t	size = 64 + 64 + 32 + 40 + 2;
+
+	for (HeaderMap::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		size += it->first.size() + it->second.size() + 4;
+	return size;
+}
+
+void	HeaderWriter::appendStatusLine(string& out, const string& version,
+			short statusCode, const string& reasonPhrase)
+{
+	const string*	line = cachedStatusLine(version, statusCode);
+	if (line) {
+		out.append(*line);
+		return;
+	}
+	out.append(version);
+	out += ' ';
+	appendUnsigned(out, static_cast<size_t>(statusCode));
+	out += ' ';
+	out.append(reasonPhrase);
+	out.append("\r\n", 2);
+}
+
+/**
+ * "Date: <IMF-fixdate>\r\nServer: webserv/1.0\r\n", rebuilt only when
+ * the second changes.
+ */
+const string&	HeaderWriter::dateAndServer(time_t now)
+{
+	static string	cached;
+	static time_t	cachedAt = static_cast<time_t>(-1);
+
+	if (now != cachedAt) {
+		struct tm	gmt;
+		char		date[64];
+
+		gmtime_r(&now, &gmt);
+		size_t	len = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+		cached.clear();
+		cached.append("Date: ", 6);
+		cached.append(date, len);
+		cached.append("\r\nServer: " SERVER_SOFTWARE "\r\n");
+		cachedAt = now;
+	}
+	return cached;
+}
+
+void	HeaderWriter::appendDateAndServer(string& out)
+{
+	out.append(dateAndServer(time(NULL)));
+}
+
+// name.str already contains ": "
+void	HeaderWriter::appendHeader(string& out, const Name& name, const string& value)
+{
+	out.append(name.str, name.len);
+	out.append(value);
+	out.append("\r\n", 2);
+}
+
+void	HeaderWriter::appendHeader(string& out, const string& name, const string& value)
+{
+	out.append(name);
+	out.append(": ", 2);
+	out.append(value);
+	out.append("\r\n", 2);
+}
+
+void	HeaderWriter::appendSizeHeader(string& out, const Name& name, size_t value)
+{
+	out.append(name.str, name.len);
+	appendUnsigned(out, value);
+	out.append("\r\n", 2);
+}
+
+void	HeaderWriter::appendEndOfHead(string& out)
+{
+	out.append("\r\n", 2);
+}
+
+// chunk-size line of Transfer-Encoding: chunked (hex digits, CRLF)
+void	HeaderWriter::appendChunkSize(string& out, size_t size)
+{
+	static const char	hex[] = "0123456789abcdef";
+	char				digits[24];
+	size_t				pos = sizeof(digits);
+
+	do {
+		digits[--pos] = hex[size & 0xF];
+		size >>= 4;
+	} while (size != 0);
+	out.append(digits + pos, sizeof(digits) - pos);
+	out.append("\r\n", 2);
+}
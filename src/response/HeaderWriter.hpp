@@ -0,0 +1,49 @@
+#ifndef HEADERWRITER_HPP
+# define HEADERWRITER_HPP
+
+# include "../../inc/Webserv.hpp"
+# include "../httpContext/Arena.hpp"
+
+# define SERVER_SOFTWARE "webserv/1.0"
+
+/**
+ * Briefly: response head serializer.
+ *
+ * Appends the status line and header fields straight into the
+ * (preallocated) response buffer. Status lines are built once per
+ * status code and HTTP version, the Date/Server pair is regenerated
+ * at most once per second.
+ */
+class	HeaderWriter {
+
+	public:
+		// known header name, including the ": " separator
+		struct	Name {
+			const char*	str;
+			size_t		len;
+		};
+		static const Name	CONNECTION;
+		static const Name	CONTENT_LENGTH;
+		static const Name	TRANSFER_ENCODING;
+
+		static size_t		estimateHeadSize(const HeaderMap& headers);
+		static void			appendStatusLine(std::string& out, const std::string& version,
+								short statusCode, const std::string& reasonPhrase);
+		static void			appendDateAndServer(std::string& out);
+		static void			appendHeader(std::string& out, const Name& name,
+								const std::string& value);
+		static void			appendHeader(std::string& out, const std::string& name,
+								const std::string& value);
+		static void			appendSizeHeader(std::string& out, const Name& name, size_t value);
+		static void			appendEndOfHead(std::string& out);
+		static void			appendChunkSize(std::string& out, size_t size);
+		static const std::string&	dateAndServer(time_t now);
+
+	private:
+		HeaderWriter();
+		~HeaderWriter();
+
+		static const std::string*	cachedStatusLine(const std::string& version, short statusCode);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Response.hpp"
+#include "../httpContext/BufferPool.hpp"
 
 using std::cerr;
 using std::cout;
@@ -6,13 +7,22 @@ using std::endl;
 using std::string;
 
 // Parametric constructor
-Response::Response(Server &server)
-	: _server_config(server),
+Response::Response(Server &server, Arena* arena)
+	: _server_config(&server),
 	  _request(0),
 	  _statusCode(200),
 	  _reasonPhrase(generateStatusMessage(200)),
 	  _contentLength(0),
-	  _loc(0)
+	  _headers(std::less<string>(), HeaderMap::allocator_type(arena)),
+	  _loc(0),
+	  _upstreamKind(UPSTREAM_NONE),
+	  _upstreamLimit(0),
+	  _cgiState(CGI_HEAD),
+	  _cgiScanned(0),
+	  _cgiHasLength(false),
+	  _cgiHeldSince(0),
+	  _cgiCacheTtl(-1),
+	  _metricsPending(false)
 { }
 
 Response &Response::operator=(const Response &other) {
@@ -33,6 +43,9 @@ Response::~Response() {}
 // call after parsing
 void	Response::bindRequest(const Request &req) {	_request = &req; }
 
+// a pooled HttpContext taken for a connection of another server
+void	Response::bindServer(Server &server) { _server_config = &server; }
+
 void	Response::fillResponse(short statusCode, const string &bodyContent)
 {
 	_statusCode = statusCode;
@@ -56,10 +69,15 @@ void	Response::generateResponse() {
 		return; // Response is already filled by the validation function
 	}
 
-	_path = constructPath(_loc);
-	if (_path.empty())
+	if (_loc->isMetrics()) {
+		_metricsPending = true;
 		return;
-	
+	}
+	if (!constructPath(_loc))
+		return;
+	if (tryPassFastcgi())
+		return;
+
 	if (getRequest()->getEnumMethod() == Request::GET) {
 		generateResponseGet();
 	} else if (getRequest()->getEnumMethod() == Request::POST) {
@@ -67,9 +85,9 @@ void	Response::generateResponse() {
 	} else if (getRequest()->getEnumMethod() == Request::DELETE) {
 		generateResponseDelete();
 	} else if (getRequest()->getEnumMethod() == Request::INVALID) {
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	} else {
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	}
 }
 
@@ -89,7 +107,7 @@ void	Response::generateResponseGet()
 	PathType	pathType = getPathType(_path);
 	if (pathType == NOT_EXIST) {
 		if (DEBUG) cout << RED << "Path not found: " << _path << RESET << endl;
-		fillResponse(404, getErrorPageContent(404));
+		fillError(404);
 		return;
 	}
 	if (pathType == DIRECTORY_PATH) {
@@ -123,11 +141,11 @@ void	Response::generateResponseGet()
 					return;
 				}
 				if (DEBUG) cout << RED << "Autoindex generation failed." << RESET << endl;
-				fillResponse(500, getErrorPageContent(500));
+				fillError(500);
 				return;
 			} else {
 				if (DEBUG) cout << RED << "Directory access forbidden (no index, autoindex off2)" << RESET << endl;
-				fillResponse(403, getErrorPageContent(403));
+				fillError(403);
 				return;
 			}
 		}
@@ -136,21 +154,45 @@ void	Response::generateResponseGet()
 		return;
 
 	if (DEBUG) cout << BLUE << "Serving file: " << _path << RESET << endl;
-	std::ifstream	file(_path.c_str());
-	if (!file.is_open()) {
+	if (!readFile(_path)) {
 		if (DEBUG) cout << RED << "File not found: " << _path << RESET << endl;
-		fillResponse(404, getErrorPageContent(404));
+		fillError(404);
 		return;
 	}
+	_headers["Content-Type"] = getMimeType(_path);
+	_contentLength = _responseBody.size();
+}
 
-	string	contentType = getMimeType(_path);
-	_headers["Content-Type"] = contentType;
+/**
+ * The whole file into _responseBody, sized once from fstat() in a
+ * BufferPool buffer: no stream, no intermediate copy.
+ */
+bool	Response::readFile(const string& path)
+{
+	int			fd = open(path.c_str(), O_RDONLY);
+	struct stat	st;
 
-	std::ostringstream	ss;
-	ss << file.rdbuf();
-	_responseBody = ss.str();
-	_contentLength = _responseBody.size();
-	file.close();
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	size_t	size = static_cast<size_t>(st.st_size);
+	size_t	got = 0;
+
+	_responseBody.clear();
+	BufferPool::reserve(_responseBody, size);
+	_responseBody.resize(size);
+	while (got < size) {
+		ssize_t	n = read(fd, &_responseBody[got], size - got);
+		if (n <= 0)
+			break;		// shrunk meanwhile: what was there
+		got += n;
+	}
+	close(fd);
+	_responseBody.resize(got);
+	return true;
 }
 
 string	Response::buildCreatedResponse(const string& uri, const string &filename) {
@@ -188,14 +230,14 @@ void	Response::generateResponsePost()
 		string	dirPath = _path.substr(0, path_separator);
 		if (!isDirectory(dirPath)) {
 			if (D_POST) cout << RED << "Upload directory does not exist: " << dirPath << RESET << endl;
-			fillResponse(409, getErrorPageContent(409));
+			fillError(409);
 			return;
 		}
 	}
 
-	const string&	contentType = getRequest()->getHeaderValue("content-type");
+	const string&	contentType = getRequest()->getHeaderValue(Request::HDR_CONTENT_TYPE);
 	if (contentType.empty()) {
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 		return;
 	}
 	
@@ -206,7 +248,7 @@ void	Response::generateResponsePost()
 		std::ofstream	file(_path.c_str(), std::ios::binary);
 		if (!file.is_open()) {
 			if (D_POST) cout << RED << "Could not open file for writing: " << _path << RESET << endl;
-			fillResponse(500, getErrorPageContent(500));
+			fillError(500);
 			return;
 		}
 		file << getRequest()->getBody();
@@ -225,11 +267,11 @@ void	Response::generateResponsePost()
 		// Parse multipart data to extract the file
 		string	filename, fileData;
 
-		string	boundary = HttpParser::extractBoundary(getRequest()->getHeaderValue("content-type"));
+		string	boundary = HttpParser::extractBoundary(getRequest()->getHeaderValue(Request::HDR_CONTENT_TYPE));
 		if (HttpParser::parseMultipartData(getRequest()->getBody(), boundary, filename, fileData))
 		{
 			if (!HttpParser::isExtensionAllowed(filename)) {
-				fillResponse(415, getErrorPageContent(415));
+				fillError(415);
 				return;
 			}
 			string	uploadPath = _path;
@@ -240,7 +282,7 @@ void	Response::generateResponsePost()
 			std::ofstream	file(uploadPath.c_str(), std::ios::binary);
 			if (!file.is_open()) {
 				if (D_POST) cout << RED << "POST. Could not open file for writing: " << uploadPath << RESET << endl;
-				fillResponse(500, getErrorPageContent(500));
+				fillError(500);
 				return;
 			}
 			file << fileData;
@@ -250,7 +292,7 @@ void	Response::generateResponsePost()
 
 			// Go back to the form page (the Referer)
 			string	redirectTo;
-			string	referer = getRequest()->getHeaderValue("referer");
+			string	referer = getRequest()->getHeaderValue(Request::HDR_REFERER);
 			if (!referer.empty()) { 		// extract of path from "http://host/path?..."
 				size_t	pos = referer.find("://");
 				if (pos != string::npos)
@@ -272,16 +314,16 @@ void	Response::generateResponsePost()
 			// TO DELETE _headers["Location"] = "/uploads/uploads.html"; // Redirect back to the form
 			return;
 		} else {
-			fillResponse(400, getErrorPageContent(400));
+			fillError(400);
 			return;
 		}
 	} else if (contentType.find("application/x-www-form-urlencoded") != string::npos) {
 		// --- Form Data Logic ---
 		// For example, parse "name=Maryna&city=Kyiv"
-		fillResponse(501, getErrorPageContent(501)); // Not Implemented yet
+		fillError(501); // Not Implemented yet
 	} else {
 		// --- Unsupported Type Logic ---
-		fillResponse(415, getErrorPageContent(415));
+		fillError(415);
 	}
 }
 
@@ -294,20 +336,20 @@ void	Response::generateResponseDelete()
 	PathType pathType = getPathType(_path);
 	if (pathType == NOT_EXIST) {
 		if (D_POST) cout << RED << "Resource not found: " << _path << RESET << endl;
-		fillResponse(404, getErrorPageContent(404));
+		fillError(404);
 		return;
 	}
 	// Don't allow deleting directories (optional, depends on your requirements)
 	if (pathType == DIRECTORY_PATH) {
 		if (D_POST) cout << RED << "Cannot delete directory: " << _path << RESET << endl;
-		fillResponse(403, getErrorPageContent(403)); // Forbidden
+		fillError(403); // Forbidden
 		return;
 	}
 
 	// Attempt to delete the file
 	if (std::remove(_path.c_str()) != 0) { // Deletion failed (permission denied, etc.)
 		if (D_POST) cout << RED << "Failed to delete file: " << _path << RESET << endl;
-		fillResponse(403, getErrorPageContent(403)); // Forbidden
+		fillError(403); // Forbidden
 		return;
 	}
 	if (D_POST) cout << GREEN << "File deleted successfully: " << _path << RESET << endl;
@@ -339,7 +381,7 @@ const Location*	Response::matchPathToLocation()
 {
 	if (!getRequest()) return NULL;
 
-	const std::vector<Location>&	locations = _server_config.getLocations();
+	const std::vector<Location>&	locations = _server_config->getLocations();
 	const Location*					bestMatch = NULL;
 	size_t							bestMatchLen = 0;
 
@@ -389,8 +431,8 @@ const Location*	Response::matchPathToLocation()
 // returns the index file name for the matched location or an empty string if none found
 string	Response::getIndexFromLocation()
 {
-	for (std::vector<Location>::const_iterator it = _server_config.getLocations().begin();
-		 it != _server_config.getLocations().end(); ++it)
+	for (std::vector<Location>::const_iterator it = _server_config->getLocations().begin();
+		 it != _server_config->getLocations().end(); ++it)
 	{
 		if (DEBUG) {
 			cout << "Checking location for index: " << it->getPath() << endl;
@@ -405,7 +447,7 @@ string	Response::getIndexFromLocation()
 	return "";
 }
 
-Response::PathType Response::getPathType(string const path)
+Response::PathType Response::getPathType(const string& path)
 {
 	struct stat	buffer;
 	int			result;
@@ -431,26 +473,30 @@ void	Response::badRequest() {
 	short requestStatusCode = getRequest()->getStatusCode();
 	if (requestStatusCode == 400) {
 		if (DEBUG) cout << RED << "Response. Bad Request" << RESET << endl;
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	} else if (requestStatusCode == 405) {
 		if (DEBUG) cout << RED << "Response. Not Allowed" << RESET << endl;
-		fillResponse(405, getErrorPageContent(405));
+		fillError(405);
 	} else if (requestStatusCode == 413) {
 		if (DEBUG) cout << RED << "Response. Payload Too Large" << RESET << endl;
-		fillResponse(413, getErrorPageContent(413));
+		fillError(413);
 	} else if (requestStatusCode == 414) {
 		if (DEBUG) cout << RED << "Response. URI Too Long" << RESET << endl;
-		fillResponse(414, getErrorPageContent(414));
+		fillError(414);
 	} else if (requestStatusCode == 431) {
 		if (DEBUG) cout << RED << "Response. Request Header Fields Too Large" << RESET << endl;
-		fillResponse(431, getErrorPageContent(431));
+		fillError(431);
+	} else if (requestStatusCode == 503) {
+		// a large body while the server is over its memory_budget
+		fillError(503);
+		_headers["Retry-After"] = toString(RETRY_AFTER_SEC);
 	} else if (getRequest()->getRequestLineFormatValid() == false) {
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	} else if (getRequest()->getHeadersFormatValid() == false) {
 		if (DEBUG) cout << RED << "Response. Bad request. Invalid headers" << RESET << endl; 
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	} else {
-		fillResponse(400, getErrorPageContent(400));
+		fillError(400);
 	}
 }
 
@@ -473,15 +519,22 @@ const Location*	Response::validateRequestAndGetLocation() {
 	const Location*	loc = matchPathToLocation();
 	if (!loc) {
 		if (DEBUG) cout << RED << "Resource not found: " << getRequest()->getUri() << RESET << endl;
-		fillResponse(404, getErrorPageContent(404));
+		fillError(404);
 		return NULL;
 	}
 
 	// Check for redirection
 	int	code = loc->getReturnCode();
 	if (code != 0) {
-		fillResponse(code, "<html><body><h1>" + toString(code) + " " +
-						generateStatusMessage(code) + "</h1></body></html>");
+		const char	digits[] = { char('0' + code / 100), char('0' + code / 10 % 10), char('0' + code % 10), ' ' };
+		_statusCode = code;
+		_reasonPhrase = generateStatusMessage(code);
+		BufferPool::reserve(_responseBody, 64 + _reasonPhrase.size());
+		_responseBody.assign("<html><body><h1>");
+		_responseBody.append(digits, sizeof(digits));
+		_responseBody.append(_reasonPhrase);
+		_responseBody.append("</h1></body></html>");
+		_contentLength = _responseBody.size();
 		_headers["Location"] = loc->getReturnUrl();
 		_headers["Content-Type"] = "text/html";
 		return NULL;
@@ -490,7 +543,7 @@ const Location*	Response::validateRequestAndGetLocation() {
 	const std::vector<string>&	allowed = loc->getAllowedMethods();
 	if (allowed.empty()) {
 		if (DEBUG) cout << RED << "No methods allowed for this location." << RESET << endl;
-		fillResponse(405, getErrorPageContent(405));
+		fillError(405);
 		return NULL;
 	}
 	bool	methodAllowed = false;
@@ -502,7 +555,7 @@ const Location*	Response::validateRequestAndGetLocation() {
 	}
 	if (!methodAllowed) {
 		if (DEBUG) cout << RED << "Method " << getRequest()->getMethod() << " not allowed for this location." << RESET << endl;
-		fillResponse(405, getErrorPageContent(405));
+		fillError(405);
 		return NULL;
 	}
 	
@@ -516,43 +569,40 @@ const Location*	Response::validateRequestAndGetLocation() {
  * strips query strings from the URI, and combines them into a full path.
  * Returns a 500 error if no root is configured.
  * 
+ * The path is built in _path itself, no temporaries.
+ *
  * @param loc Pointer to the matched Location
- * @param uri Reference to store the cleaned URI (query string removed)
- * @return The constructed file system path, or empty string on error
+ * @return true, false on error (_path left empty)
  */
-string		Response::constructPath(const Location* loc) {
+bool		Response::constructPath(const Location* loc) {
 	if (DEBUG) cout << ORANGE << "Constructing Path..." << RESET << endl;
 	// Determine root
-	string			root;
-	const string&	locationRoot = loc->getRoot();
-	if (!locationRoot.empty())
-		root = loc->getRoot();
-	else 
-		root = _server_config.getRoot();
+	const string&	root = loc->getRoot().empty() ? _server_config->getRoot() : loc->getRoot();
 	// Safety check: root must be configured
 	if (root.empty()) {
 		if (DEBUG) cout << RED << "Configuration error: No root directive found" << RESET << endl;
-		fillResponse(500, getErrorPageContent(500));
-		return "";
+		fillError(500);
+		_path.clear();
+		return false;
 	}
 	// Strip query string from URI
-	string		uri = getRequest()->getUri();
-	size_t		queryPos = uri.find('?');
-	if (queryPos != string::npos) {
-		uri = uri.substr(0, queryPos);
-	}
-	string	path = root + uri;
-	
+	const string&	uri = getRequest()->getUri();
+	size_t			uriLen = uri.find('?');
+	if (uriLen == string::npos)
+		uriLen = uri.size();
+	_path.assign(root);
+	_path.append(uri, 0, uriLen);
+
 	if (DEBUG) cout << YELLOW << "Using root: " << root << RESET << endl;
-	if (DEBUG) cout << YELLOW << "Using URI: " << uri << RESET << endl;
-	if (DEBUG) cout << GREEN << "Resolved path: " << path << RESET << endl;
-	
-	return path;
+	if (DEBUG) cout << GREEN << "Resolved path: " << _path << RESET << endl;
+	return true;
 }
 
 
 const Request*	Response::getRequest() { return _request; }
 
+const Location*	Response::getLocation() const { return _loc; }
+
 short			Response::getStatusCode() const { return _statusCode; }
 
 size_t			Response::getContentLength() const { return _contentLength; }
@@ -566,10 +616,10 @@ const string&	Response::getReasonPhrase() const {
 }
 
 Server&			Response::getServerConfig() {
-	return _server_config;
+	return *_server_config;
 }
 
-const std::map<string, string>&	Response::getHeaders() const {
+const HeaderMap&	Response::getHeaders() const {
 	return _headers;
 }
 
@@ -578,70 +628,215 @@ void			Response::reset()
 {
 	_request = 0;
 	fillResponse(200, "");
-	_headers.clear();
+	BufferPool::release(_responseBody);
+	_headers.clear();		// before HttpContext resets the arena under it
 	_path.clear();
 	_loc = 0;
+	_upstreamKind = UPSTREAM_NONE;
+	_upstreamAddress.clear();
+	_upstreamParams.clear();
+	_upstreamEnv.clear();
+	_upstreamGroup.clear();
+	_upstreamLimit = 0;
+	_cgiState = CGI_HEAD;
+	string().swap(_cgiHead);
+	_cgiScanned = 0;
+	_cgiHasLength = false;
+	_cgiHeldSince = 0;
+	_cgiCacheTtl = -1;
+	_metricsPending = false;
 }
 
-string			Response::getErrorPageContent(int code)
+// Heap bytes of the body, the CGI head and the upstream request
+size_t			Response::memoryHeld() const {
+	return _responseBody.capacity() + _cgiHead.capacity() + finalResponseContent.capacity()
+		+ _upstreamEnv.capacity();
+}
+
+bool			Response::isUpstreamPending() const {
+	return _upstreamKind != UPSTREAM_NONE;
+}
+
+Response::UpstreamKind	Response::getUpstreamKind() const {
+	return _upstreamKind;
+}
+
+const string&	Response::getUpstreamScript() const {
+	return _path;
+}
+
+const string&	Response::getUpstreamAddress() const {
+	return _upstreamAddress;
+}
+
+const std::map<string, string>&	Response::getUpstreamParams() const {
+	return _upstreamParams;
+}
+
+const string&	Response::getUpstreamEnv() const {
+	return _upstreamEnv;
+}
+
+const string&	Response::getUpstreamGroup() const {
+	return _upstreamGroup;
+}
+
+size_t			Response::getUpstreamLimit() const {
+	return _upstreamLimit;
+}
+
+// "port/path" of the matched location: CGI limits and cache zones
+string			Response::locationId() const {
+	if (!_loc)
+		return "";
+	return toString(_server_config->getPort()) + _loc->getPath();
+}
+
+/**
+ * Called once the FastCGI responder or CGI script answered (errorCode 0)
+ * or failed: 500 script error, 502 unreachable/broken, 503 overloaded,
+ * 504 timeout.
+ */
+void			Response::finishUpstream(short errorCode, const string &output)
+{
+	_upstreamKind = UPSTREAM_NONE;
+	if (errorCode != 0) {
+		fillError(errorCode);
+		if (errorCode == 503)
+			_headers["Retry-After"] = toString(RETRY_AFTER_SEC);
+		return;
+	}
+	if (!output.empty())
+		appendCgiOutput(output);
+	if (!finishCgiOutput())
+		fillError(502);
+}
+
+/**
+ * Key of a CGI GET in a location with cgi_cache_ttl: listen address and
+ * location (two server blocks never share an entry), method, Host, URI
+ * (with its query) and the cgi_cache_vary request headers. Empty when
+ * the answer is not to be cached.
+ */
+string			Response::cacheKey() const
+{
+	if (!_loc || _loc->getCgiCacheTtl() == 0 || !_request
+			|| _request->getEnumMethod() != Request::GET)
+		return "";
+	string	host = _request->getHeaderValue(Request::HDR_HOST);
+	for (size_t i = 0; i < host.size(); ++i)
+		host[i] = std::tolower(host[i]);
+
+	string	key = _server_config->getHost() + ":" + locationId() + " GET " + host + " " + _request->getUri();
+	const std::vector<string>&	vary = _loc->getCgiCacheVary();
+	for (size_t i = 0; i < vary.size(); ++i)
+		key += "\n" + vary[i] + ": " + _request->getHeaderValue(vary[i]);
+	return key;
+}
+
+size_t			Response::cacheMaxSize() const
+{
+	if (!_loc || _loc->getCgiCacheMaxSize() == 0)
+		return CGI_CACHE_SIZE;
+	return _loc->getCgiCacheMaxSize();
+}
+
+// Seconds the finished CGI answer may be cached, 0: not at all
+time_t			Response::getCgiCacheTtl() const
+{
+	if (!_loc || _loc->getCgiCacheTtl() == 0 || _statusCode != 200 || _cgiCacheTtl == 0)
+		return 0;
+	if (_cgiCacheTtl > 0)
+		return _cgiCacheTtl;
+	return _loc->getCgiCacheTtl();
+}
+
+// A cache hit: the stored answer instead of running the script
+void			Response::serveCached(const CachedResponse& entry, time_t now)
 {
-	const std::map<int, string>&			errorPages = _server_config.getErrorPages();
+	_upstreamKind = UPSTREAM_NONE;
+	fillResponse(entry.statusCode, entry.body);
+	_headers.clear();
+	_headers.insert(entry.headers.begin(), entry.headers.end());
+	_headers["Age"] = toString(now - entry.stored);
+}
+
+bool			Response::isMetricsPending() const {
+	return _metricsPending;
+}
+
+void			Response::serveMetrics(const string& body)
+{
+	_metricsPending = false;
+	fillResponse(200, body);
+	_headers["Content-Type"] = "text/plain; version=0.0.4; charset=utf-8";
+}
+
+// The configured page of `code` into _responseBody, false if none
+bool			Response::readErrorPage(int code)
+{
+	const std::map<int, string>&			errorPages = _server_config->getErrorPages();
 	std::map<int, string>::const_iterator	it = errorPages.find(code);
 
-	if (it != errorPages.end()) {
-		std::ifstream	file(it->second.c_str());
-		if (file.is_open())
-		{
-			std::ostringstream	ss;
-			
-			ss << file.rdbuf();
-			_headers["Content-Type"] = "text/html";
-			return ss.str();
-		}
-	}
+	if (it == errorPages.end() || !readFile(it->second))
+		return false;
+	_headers["Content-Type"] = "text/html";
+	return true;
+}
 
-	int	defaultError = 500;
-	return getErrorPageContent(defaultError);
+/**
+ * An error status with its page read straight into the body: the page
+ * of `statusCode`, else the one of 500, else a built-in 500 page.
+ */
+void			Response::fillError(short statusCode)
+{
+	_statusCode = statusCode;
+	_reasonPhrase = generateStatusMessage(_statusCode);
+	if (!readErrorPage(statusCode) && (statusCode == 500 || !readErrorPage(500)))
+		_responseBody = "<html><body><h1>500 Internal Server Error</h1></body></html>";
+	_contentLength = _responseBody.size();
+}
+
+string			Response::getErrorPageContent(int code)
+{
+	if (!readErrorPage(code) && (code == 500 || !readErrorPage(500)))
+		return "<html><body><h1>500 Internal Server Error</h1></body></html>";
+	string	page;
+	page.swap(_responseBody);
+	return page;
 }
 
 string			Response::getMimeType(const string &filePath)
 {
+	static const char*	types[][2] = {
+		{ ".jpg", "image/jpeg" }, { ".jpeg", "image/jpeg" }, { ".png", "image/png" },
+		{ ".gif", "image/gif" }, { ".ico", "image/x-icon" }, { ".html", "text/html" },
+		{ ".htm", "text/html" }, { ".css", "text/css" }, { ".js", "application/javascript" },
+		{ ".txt", "text/plain" }, { ".svg", "image/svg+xml" }
+	};
 	size_t	dotPos = filePath.find_last_of('.');
 	if (dotPos == string::npos) {
 		return "application/octet-stream";
 	}
 
-	string extension = filePath.substr(dotPos);
-
-	// Convert to lowercase
-	for (size_t i = 0; i < extension.length(); ++i) {
-		extension[i] = std::tolower(extension[i]);
-	}
-
-	if (extension == ".jpg" || extension == ".jpeg") {
-		return "image/jpeg";
-	} else if (extension == ".png") {
-		return "image/png";
-	} else if (extension == ".gif") {
-		return "image/gif";
-	} else if (extension == ".ico") {
-		return "image/x-icon";
-	} else if (extension == ".html" || extension == ".htm") {
-		return "text/html";
-	} else if (extension == ".css") {
-		return "text/css";
-	} else if (extension == ".js") {
-		return "application/javascript";
-	} else if (extension == ".txt") {
-		return "text/plain";
-	} else if (extension == ".svg") {
-		return "image/svg+xml";
+	// Convert to lowercase, on the stack: no extension we know is longer
+	char	extension[8];
+	size_t	len = filePath.size() - dotPos;
+	if (len >= sizeof(extension))
+		return "application/octet-stream";
+	for (size_t i = 0; i < len; ++i)
+		extension[i] = std::tolower(filePath[dotPos + i]);
+	extension[len] = '\0';
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+		if (std::strcmp(extension, types[i][0]) == 0)
+			return types[i][1];
 	}
 	return "application/octet-stream";
 }
 
 /**
- * Returns true if the request was handled by CGI (success or error response set)
+ * Returns true if the request goes to CGI (the response is completed later)
  * Returns false if not a CGI request or script not found (caller should proceed)
  * 
  * - Extract extension from request path
@@ -656,48 +851,201 @@ bool		Response::tryServeCgi()
 	size_t	dotPos = _path.find_last_of('.');
 	if (dotPos == string::npos)
 		return false;
-	string	ext = _path.substr(dotPos + 1);
-
-	std::map<string, string>::const_iterator	it = cgiMap.find(ext);
+	std::map<string, string>::const_iterator	it = cgiMap.begin();
+	while (it != cgiMap.end() && _path.compare(dotPos + 1, string::npos, it->first) != 0)
+		++it;
 	if (it == cgiMap.end())
 		return false;
 	if (getPathType(_path) != FILE_PATH)
 		return false;
 	if (DEBUG) cout << GREEN << "Executing CGI: " << _path << RESET << endl;
-	try {
-		CgiHandler	cgi(*this, _path, it->second);
-		string		output = cgi.executeCgi();
-		cout << "cgi output: " << output << endl;
-		if (!applyCgiOutput(output)) {
-			fillResponse(502, getErrorPageContent(502)); // 502 Bad Gateway
-		}
-		return true; // Request handled (success or 502)
-	} catch (std::exception &e) {
-		if (DEBUG) cout << RED << "CGI execution failed: " << e.what() << RESET << endl;
-		fillResponse(500, getErrorPageContent(500));
-		return true; // Request handled (with 500)
-	}
-}
-
-bool		Response::applyCgiOutput(const std::string &output) {
-	if (output.empty())
-		return false; // invalid CGI response
-	// Separate Headers and Body from CGI output
-	size_t	headerEnd = output.find("\r\n\r\n");
-	if (headerEnd == string::npos)
-		headerEnd = output.find("\n\n");
-	if (headerEnd == string::npos) { // No headers found, treat entire output as body
-		fillResponse(200, output);
+	// Runs in CgiPool; finishUpstream() completes the response (502 if
+	// the output is unusable)
+	_upstreamEnv.clear();
+	CgiHandler::buildEnvBlock(*this, _path, _upstreamEnv);
+	_upstreamAddress = it->second;
+	_upstreamKind = UPSTREAM_CGI;
+	_upstreamLimit = _loc->getCgiMaxConcurrent();
+	if (_upstreamLimit > 0)
+		_upstreamGroup = locationId();
+	return true;
+}
+
+/**
+ * Called once the headers of a POST are in and its Content-Length body
+ * is still arriving. If generateResponse() would end up in tryServeCgi(),
+ * the CGI request is prepared now so the script starts right away and
+ * reads the body as it comes; otherwise nothing is touched and the
+ * request is answered once complete, as usual.
+ */
+bool			Response::prepareStreamedCgi()
+{
+	if (!getRequest() || getRequest()->getEnumMethod() != Request::POST)
+		return false;
+	const Location*	loc = matchPathToLocation();
+	if (!loc || loc->getReturnCode() != 0 || loc->getCgi().empty() || !loc->getFastcgiPass().empty())
+		return false;
+	const std::vector<string>&	allowed = loc->getAllowedMethods();
+	if (std::find(allowed.begin(), allowed.end(), getRequest()->getMethod()) == allowed.end())
+		return false;
+	if (loc->getRoot().empty() && _server_config->getRoot().empty())
+		return false;
+	_loc = loc;
+	constructPath(loc);
+	if (tryServeCgi())
 		return true;
+	_loc = 0;
+	_path.clear();
+	return false;
+}
+
+/**
+ * A location with fastcgi_pass hands every request to the responder:
+ * the parameters are the CGI meta-variables (CgiHandler::buildEnv) and
+ * the script is whatever the URI maps to under the location's root.
+ * ServerManager sends it; the response is completed in finishUpstream().
+ */
+bool		Response::tryPassFastcgi()
+{
+	if (_loc->getFastcgiPass().empty())
+		return false;
+	_upstreamParams.clear();
+	CgiHandler::buildEnv(*this, _path, _upstreamParams);
+	_upstreamAddress = _loc->getFastcgiPass();
+	_upstreamKind = UPSTREAM_FASTCGI;
+	return true;
+}
+
+
+/**
+ * CGI output as it arrives (all of it at once for FastCGI). The header
+ * block is parsed as soon as its empty line is in; the body after it is
+ * held in _responseBody until startCgiStream() or finishUpstream().
+ * Returns true once the held body is due for streaming.
+ */
+bool		Response::appendCgiOutput(const string &data)
+{
+	if (_cgiState == CGI_HEAD) {
+		_cgiHead.append(data);
+		size_t	bodyStart = findCgiHeadEnd();
+		if (bodyStart == string::npos) {
+			if (_cgiHead.size() <= CGI_HEAD_MAX)
+				return false;
+			_responseBody.swap(_cgiHead); // no headers found, treat entire output as body
+		} else {
+			parseCgiHead(bodyStart);
+			_responseBody.assign(_cgiHead, bodyStart, string::npos);
+		}
+		string().swap(_cgiHead);
+		_cgiState = CGI_BODY_HELD;
+	} else {
+		_responseBody.append(data);
 	}
+	if (_statusCode >= 400)
+		_responseBody.clear(); // replaced by the error page anyway
+	if (_cgiHeldSince == 0 && !_responseBody.empty())
+		_cgiHeldSince = time(NULL);
+	return isCgiStreamDue(time(NULL));
+}
 
-	string	headers = output.substr(0, headerEnd);
-	string	body    = output.substr(headerEnd + ((output[headerEnd] == '\r') ? 4 : 2));
-	if (DEBUG) cout << "CGI. Output headers:\n" << headers << endl;
-	std::istringstream	iss(headers);
-	std::string			line;
+/**
+ * Until the script exited its status can still turn the response into
+ * a 500, so a small body is held; one of CGI_STREAM_MIN bytes, or one
+ * that waited CGI_STREAM_DELAY_SEC, is sent as it comes instead.
+ */
+bool		Response::isCgiStreamDue(time_t now) const
+{
+	if (_cgiState != CGI_BODY_HELD || _statusCode >= 400 || _responseBody.empty())
+		return false;
+	return _responseBody.size() >= CGI_STREAM_MIN || now - _cgiHeldSince > CGI_STREAM_DELAY_SEC;
+}
+
+bool		Response::hasCgiLength() const {
+	return _cgiHasLength;
+}
+
+// The head and the held body went to the client, the rest bypasses us
+void		Response::startCgiStream()
+{
+	_cgiState = CGI_STREAMING;
+	string().swap(_responseBody);
+}
+
+// Offset of the body: just after the first empty line (LF or CRLF line ends)
+size_t		Response::findCgiHeadEnd()
+{
+	size_t	nl = _cgiHead.find('\n', _cgiScanned);
+
+	while (nl != string::npos) {
+		size_t	next = nl + 1;
+		if (next < _cgiHead.size() && _cgiHead[next] == '\r')
+			++next;
+		if (next >= _cgiHead.size()) {
+			_cgiScanned = nl; // decided by the next piece of output
+			return string::npos;
+		}
+		if (_cgiHead[next] == '\n')
+			return next + 1;
+		nl = _cgiHead.find('\n', nl + 1);
+	}
+	_cgiScanned = _cgiHead.size();
+	return string::npos;
+}
+
+// Cache-Control: seconds of s-maxage or max-age, 0 for no-store,
+// no-cache or private, -1 when it says nothing about it
+static long	cacheControlTtl(const string& value)
+{
+	std::istringstream	iss(value);
+	string				item;
+	long				maxAge = -1;
+	long				sharedMaxAge = -1;
+
+	while (std::getline(iss, item, ',')) {
+		size_t	start = item.find_first_not_of(" \t");
+		if (start == string::npos)
+			continue;
+		item.erase(0, start);
+		for (size_t i = 0; i < item.size(); ++i)
+			item[i] = std::tolower(item[i]);
+		if (item.compare(0, 8, "no-store") == 0 || item.compare(0, 8, "no-cache") == 0
+				|| item.compare(0, 7, "private") == 0)
+			return 0;
+		if (item.compare(0, 8, "max-age=") == 0)
+			maxAge = std::atol(item.c_str() + 8);
+		else if (item.compare(0, 9, "s-maxage=") == 0)
+			sharedMaxAge = std::atol(item.c_str() + 9);
+	}
+	return sharedMaxAge >= 0 ? sharedMaxAge : maxAge;
+}
+
+// Expires: seconds from now; a date that cannot be read is in the past
+static long	expiresTtl(const string& value)
+{
+	struct tm	tm;
+
+	std::memset(&tm, 0, sizeof(tm));
+	if (strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == NULL)
+		return 0;
+	long	ttl = static_cast<long>(timegm(&tm) - time(NULL));
+	return ttl > 0 ? ttl : 0;
+}
+
+/**
+ * Status goes into the status line; Content-Length is kept for the
+ * framing and Transfer-Encoding dropped, the server frames the body.
+ * Cache-Control, Expires, Set-Cookie and Vary: * decide _cgiCacheTtl.
+ */
+void		Response::parseCgiHead(size_t headLen)
+{
+	std::istringstream	iss(_cgiHead.substr(0, headLen));
+	string				line;
 	int					statusCode = 200;
-	
+	long				controlTtl = -1;
+	long				expiresAt = -1;
+	bool				uncacheable = false;
+
+	if (DEBUG) cout << "CGI. Output headers:\n" << iss.str() << endl;
 	while (std::getline(iss, line)) {
 		if (!line.empty() && line[line.length() - 1] == '\r') {
 			line.erase(line.length() - 1);
@@ -712,21 +1060,53 @@ bool		Response::applyCgiOutput(const std::string &output) {
 			// Trim whitespace
 			while (!value.empty() && (value[0] == ' ' || value[0] == '\t'))
 				value.erase(0, 1);
-			if (key == "Status" || key == "status" || key == "STATUS") {
+			if (strcasecmp(key.c_str(), "Status") == 0) {
 				std::istringstream	statusIss(value);
 				int					tempCode;
 				if (statusIss >> tempCode)
 					statusCode = tempCode;
 			}
+			else if (strcasecmp(key.c_str(), "Content-Length") == 0) {
+				std::istringstream	lengthIss(value);
+				size_t				length;
+				if (lengthIss >> length) {
+					_contentLength = length;
+					_cgiHasLength = true;
+				}
+			}
+			else if (strcasecmp(key.c_str(), "Transfer-Encoding") == 0)
+				continue;
 			else if (!key.empty()) { // Store other headers
+				if (strcasecmp(key.c_str(), "Cache-Control") == 0)
+					controlTtl = cacheControlTtl(value);
+				else if (strcasecmp(key.c_str(), "Expires") == 0)
+					expiresAt = expiresTtl(value);
+				else if (strcasecmp(key.c_str(), "Set-Cookie") == 0
+						|| (strcasecmp(key.c_str(), "Vary") == 0 && value == "*"))
+					uncacheable = true;
 				_headers[key] = value;
 			}
 		}
 	}
-	if (statusCode >= 400) {
-		fillResponse(statusCode, getErrorPageContent(statusCode));
+	_cgiCacheTtl = uncacheable ? 0 : (controlTtl >= 0 ? controlTtl : expiresAt);
+	_statusCode = statusCode;
+	_reasonPhrase = generateStatusMessage(_statusCode);
+}
+
+// The script ended before its response was streamed: answer in one piece
+bool		Response::finishCgiOutput()
+{
+	if (_cgiState == CGI_HEAD) {
+		if (_cgiHead.empty())
+			return false; // invalid CGI response
+		fillResponse(200, _cgiHead); // no headers found, treat entire output as body
+		string().swap(_cgiHead);
+		return true;
+	}
+	if (_statusCode >= 400) {
+		fillError(_statusCode);
 		return true;
 	}
-	fillResponse(statusCode, body);
+	_contentLength = _responseBody.size();
 	return true;
 }
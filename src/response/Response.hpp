@@ -6,6 +6,8 @@
 #include "../../inc/Webserv.hpp"
 #include "../httpContext/HttpParser.hpp"
 #include "../cgi/CgiHandler.hpp"
+#include "ResponseCache.hpp"
+#include "../httpContext/Arena.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -20,13 +22,19 @@
 #define YELLOW "\033[33m"
 #define ORANGE "\033[38;5;208m"
 
+#define CGI_HEAD_MAX 16384		// CGI output without a header block by then is all body
+#define CGI_STREAM_MIN 16384	// held CGI body that is streamed without waiting for the exit
+#define CGI_STREAM_DELAY_SEC 1	// ... or held for longer than this
+#define RETRY_AFTER_SEC 5		// Retry-After of a 503 from an overloaded CGI / FastCGI upstream
+
 class	Response
 {
 	public:
-		Response(Server &server);
+		Response(Server &server, Arena* arena = NULL);
 		~Response();
 
 		void			bindRequest(const Request &req);
+		void			bindServer(Server &server);
 		void			badRequest();
 		void			generateResponse();
 		void			generateResponseGet();
@@ -35,16 +43,56 @@ class	Response
 		
 		const Location*	matchPathToLocation();
 		void			fillResponse(short statusCode, const std::string &bodyContent);
+		void			fillError(short statusCode);
 		std::string		getErrorPageContent(int code);
 
 		const Request*		getRequest();
+		const Location*		getLocation() const;
 		short				getStatusCode() const;
 		size_t				getContentLength() const;
 		const std::string&	getResponseBody() const;
 		const std::string&	getReasonPhrase() const;
 		Server&				getServerConfig();
 		void				reset();
-		const std::map<std::string, std::string>&	getHeaders() const;
+		const HeaderMap&	getHeaders() const;
+		size_t				memoryHeld() const;
+		static std::string	getMimeType(const std::string &filePath);
+
+		enum UpstreamKind
+		{
+			UPSTREAM_NONE,
+			UPSTREAM_FASTCGI,	// address: "unix:/path" or "host:port"
+			UPSTREAM_CGI		// address: the interpreter, script: _path, env block
+		};
+
+		// FastCGI / CGI: prepared by generateResponse(), completed by ServerManager
+		bool				isUpstreamPending() const;
+		UpstreamKind		getUpstreamKind() const;
+		const std::string&	getUpstreamAddress() const;
+		const std::string&	getUpstreamScript() const;
+		const std::map<std::string, std::string>&	getUpstreamParams() const;
+		const std::string&	getUpstreamEnv() const;
+		const std::string&	getUpstreamGroup() const;
+		std::string			locationId() const;
+		size_t				getUpstreamLimit() const;
+		void				finishUpstream(short errorCode, const std::string &output);
+		bool				prepareStreamedCgi();
+
+		// CGI micro-cache, see ResponseCache
+		std::string			cacheKey() const;
+		size_t				cacheMaxSize() const;
+		time_t				getCgiCacheTtl() const;
+		void				serveCached(const CachedResponse& entry, time_t now);
+
+		// a location with `metrics on;`: ServerManager renders the body
+		bool				isMetricsPending() const;
+		void				serveMetrics(const std::string& body);
+
+		// CGI output as it arrives, see ServerManager::streamUpstreamOutput()
+		bool				appendCgiOutput(const std::string &data);
+		bool				isCgiStreamDue(time_t now) const;
+		bool				hasCgiLength() const;
+		void				startCgiStream();
 
 		std::string		finalResponseContent;
 
@@ -60,7 +108,7 @@ class	Response
 		Response(const Response &);
 		Response &operator=(const Response &other);
 
-		Server&				_server_config;
+		Server*				_server_config;
 		const Request*		_request;
 
 		short				_statusCode;
@@ -68,20 +116,44 @@ class	Response
 		size_t				_contentLength;
 		std::string			_responseBody;
 		std::string			_resourcePath;
-		std::map<std::string, std::string>	_headers;
+		HeaderMap			_headers;		// nodes in the HttpContext request arena
 		std::string			_path;
 		const Location*		_loc;
+		UpstreamKind		_upstreamKind;
+		std::string			_upstreamAddress;
+		std::map<std::string, std::string>	_upstreamParams;	// FastCGI
+		std::string			_upstreamEnv;						// CGI, see CgiHandler::buildEnvBlock
+		std::string			_upstreamGroup;						// CGI: "port/location" with a cgi_max_concurrent
+		size_t				_upstreamLimit;						// its cgi_max_concurrent, 0: none
+
+		enum CgiOutputState
+		{
+			CGI_HEAD,		// script header block incomplete, kept in _cgiHead
+			CGI_BODY_HELD,	// head parsed, body kept in _responseBody
+			CGI_STREAMING	// head sent, the body goes out as it arrives
+		};
+		CgiOutputState		_cgiState;
+		std::string			_cgiHead;
+		size_t				_cgiScanned;	// _cgiHead bytes searched for the empty line
+		bool				_cgiHasLength;	// the script set Content-Length (_contentLength)
+		time_t				_cgiHeldSince;	// first held body byte
+		long				_cgiCacheTtl;	// from Cache-Control / Expires: -1 unstated, 0 not cacheable
+		bool				_metricsPending;
 
 		// main responces methods
 		const Location*		validateRequestAndGetLocation();
-		std::string			constructPath(const Location* loc);
+		bool				constructPath(const Location* loc);
 		bool				tryServeCgi();
-		bool				applyCgiOutput(const std::string &output);
+		bool				tryPassFastcgi();
+		size_t				findCgiHeadEnd();
+		void				parseCgiHead(size_t headLen);
+		bool				finishCgiOutput();
 
 		// helpers
 		std::string			getIndexFromLocation();
-		PathType			getPathType(std::string const path);
-		static std::string	getMimeType(const std::string &filePath);
+		PathType			getPathType(const std::string& path);
+		bool				readFile(const std::string& path);
+		bool				readErrorPage(int code);
 		std::string			buildCreatedResponse(const std::string& uri, const std::string&filename);
 
 };
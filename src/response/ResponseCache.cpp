@@ -0,0 +1,166 @@
+#include "ResponseCache.hpp"
+
+using std::string;
+using std::map;
+using std::vector;
+
+ResponseCache::ResponseCache() {
+	std::memset(&_stats, 0, sizeof(_stats));
+}
+
+ResponseCache::~ResponseCache() { }
+
+// A fresh entry, or NULL (an expired one is dropped on the way)
+const CachedResponse*	ResponseCache::lookup(const string& key, time_t now) {
+	map<string, CachedResponse>::iterator	it = _entries.find(key);
+
+	if (it != _entries.end() && it->second.expires <= now) {
+		erase(it);
+		it = _entries.end();
+	}
+	if (it == _entries.end()) {
+		_stats.misses++;
+		return NULL;
+	}
+	_stats.hits++;
+	return &it->second;
+}
+
+/**
+ * Keeps an answer for `ttl` seconds. The zone's oldest entries are
+ * dropped until it fits in zoneMax; one larger than that is not kept.
+ */
+void	ResponseCache::store(const string& key, const string& zone, size_t zoneMax,
+						short statusCode, const HeaderMap& headers,
+						const string& body, time_t now, time_t ttl) {
+	map<string, CachedResponse>::iterator	old = _entries.find(key);
+	if (old != _entries.end())
+		erase(old);
+
+	CachedResponse	entry;
+	entry.statusCode = statusCode;
+	entry.headers.insert(headers.begin(), headers.end());
+	entry.stored = now;
+	entry.expires = now + ttl;
+	entry.zone = zone;
+	size_t	size = entrySize(key, entry) + body.size();
+	if (size > zoneMax)
+		return;
+
+	Zone&	z = _zones[zone];
+	while (z.bytes + size > zoneMax && !z.order.empty()) {
+		_stats.evictions++;
+		erase(_entries.find(z.order.front()));
+	}
+	CachedResponse&	stored = _entries[key];
+	stored = entry;
+	stored.body = body;
+	stored.order = z.order.insert(z.order.end(), key);
+	z.bytes += size;
+	_stats.stores++;
+	_stats.entries++;
+	_stats.bytes += size;
+	if (CACHE_DEBUG) std::cout << "cache: stored " << key << " for " << ttl << "s" << std::endl;
+}
+
+/**
+ * A miss about to run the script. Returns true if this client is the
+ * one to run it, false if it joined the request already running.
+ */
+bool	ResponseCache::beginFill(const string& key, int clientFd) {
+	map<string, Fill>::iterator	it = _fills.find(key);
+
+	_fillOf[clientFd] = key;
+	if (it != _fills.end()) {
+		it->second.waiters.push_back(clientFd);
+		_stats.coalesced++;
+		return false;
+	}
+	_fills[key].leader = clientFd;
+	return true;
+}
+
+/**
+ * The script of `clientFd` is done (or streams, which is not cached):
+ * hands out the key and the clients that waited for it. Nothing if
+ * `clientFd` ran no fill.
+ */
+void	ResponseCache::endFill(int clientFd, string& key, vector<int>& waiters) {
+	map<int, string>::iterator	of = _fillOf.find(clientFd);
+
+	key.clear();
+	waiters.clear();
+	if (of == _fillOf.end())
+		return;
+	map<string, Fill>::iterator	it = _fills.find(of->second);
+	if (it == _fills.end() || it->second.leader != clientFd)
+		return;
+	key = it->first;
+	waiters.swap(it->second.waiters);
+	for (size_t w = 0; w < waiters.size(); ++w)
+		_fillOf.erase(waiters[w]);
+	_fillOf.erase(of);
+	_fills.erase(it);
+}
+
+/**
+ * The client is gone. A waiter just leaves; for a leader the first
+ * waiter takes over and is returned: its script has to run now.
+ */
+int		ResponseCache::leave(int clientFd) {
+	map<int, string>::iterator	of = _fillOf.find(clientFd);
+
+	if (of == _fillOf.end())
+		return -1;
+	map<string, Fill>::iterator	it = _fills.find(of->second);
+	_fillOf.erase(of);
+	if (it == _fills.end())
+		return -1;
+	Fill&	fill = it->second;
+	if (fill.leader != clientFd) {
+		fill.waiters.erase(std::remove(fill.waiters.begin(), fill.waiters.end(), clientFd),
+			fill.waiters.end());
+		return -1;
+	}
+	if (fill.waiters.empty()) {
+		_fills.erase(it);
+		return -1;
+	}
+	fill.leader = fill.waiters.front();
+	fill.waiters.erase(fill.waiters.begin());
+	return fill.leader;
+}
+
+void	ResponseCache::purgeExpired(time_t now) {
+	for (map<string, CachedResponse>::iterator it = _entries.begin(); it != _entries.end(); ) {
+		map<string, CachedResponse>::iterator	next = it;
+		++next;
+		if (it->second.expires <= now)
+			erase(it);
+		it = next;
+	}
+}
+
+void	ResponseCache::getStats(ResponseCacheStats& out) const {
+	out = _stats;
+}
+
+void	ResponseCache::erase(map<string, CachedResponse>::iterator it) {
+	size_t	size = entrySize(it->first, it->second) + it->second.body.size();
+	Zone&	z = _zones[it->second.zone];
+
+	z.order.erase(it->second.order);
+	z.bytes -= size;
+	_stats.entries--;
+	_stats.bytes -= size;
+	_entries.erase(it);
+}
+
+// Key and headers count towards the zone's size, roughly
+size_t	ResponseCache::entrySize(const string& key, const CachedResponse& entry) {
+	size_t	size = key.size() + entry.zone.size();
+
+	for (map<string, string>::const_iterator h = entry.headers.begin(); h != entry.headers.end(); ++h)
+		size += h->first.size() + h->second.size();
+	return size;
+}
@@ -0,0 +1,88 @@
+#ifndef RESPONSECACHE_HPP
+# define RESPONSECACHE_HPP
+
+# include "../../inc/Webserv.hpp"
+# include "../httpContext/Arena.hpp"
+# include <list>
+
+# define CACHE_DEBUG 0
+
+# define CGI_CACHE_SIZE 1048576		// bytes per location without cgi_cache_max_size
+
+// A stored CGI answer, see Response::serveCached()
+struct	CachedResponse {
+	short								statusCode;
+	std::map<std::string, std::string>	headers;
+	std::string							body;
+	time_t								stored;
+	time_t								expires;
+	std::string							zone;
+	std::list<std::string>::iterator	order;	// in its zone's insertion order
+};
+
+struct	ResponseCacheStats {
+	size_t	hits;
+	size_t	misses;
+	size_t	coalesced;	// misses that waited for another request's script
+	size_t	stores;
+	size_t	evictions;	// dropped for room before they expired
+	size_t	entries;
+	size_t	bytes;
+};
+
+/**
+ * Briefly: micro-cache for CGI responses, served by the poll() loop.
+ *
+ * Locations with cgi_cache_ttl keep the 200 answers of their scripts to
+ * GET requests, keyed by method, Host, URI and the request headers named
+ * in cgi_cache_vary (Response::cacheKey()). How long an answer stays is
+ * decided by Response::getCgiCacheTtl(): the script's Cache-Control or
+ * Expires, else the location's TTL. Each location (a zone) holds at most
+ * cgi_cache_max_size bytes; the oldest entries make room.
+ *
+ * Coalescing: the first miss for a key runs the script (beginFill()),
+ * later misses join it and wait. ServerManager answers them from the
+ * stored entry once the script is done, or lets each run its own script
+ * when the answer could not be stored (endFill()).
+ */
+class	ResponseCache {
+
+	public:
+		ResponseCache();
+		~ResponseCache();
+
+		const CachedResponse*	lookup(const std::string& key, time_t now);
+		void	store(const std::string& key, const std::string& zone, size_t zoneMax,
+					short statusCode, const HeaderMap& headers,
+					const std::string& body, time_t now, time_t ttl);
+		bool	beginFill(const std::string& key, int clientFd);
+		void	endFill(int clientFd, std::string& key, std::vector<int>& waiters);
+		int		leave(int clientFd);
+		void	purgeExpired(time_t now);
+		void	getStats(ResponseCacheStats& out) const;
+
+	private:
+		ResponseCache(const ResponseCache&);
+		ResponseCache&	operator=(const ResponseCache&);
+
+		struct	Zone {
+			size_t					bytes;
+			std::list<std::string>	order;	// keys, oldest first
+		};
+
+		struct	Fill {
+			int					leader;		// the client whose script runs
+			std::vector<int>	waiters;
+		};
+
+		std::map<std::string, CachedResponse>	_entries;
+		std::map<std::string, Zone>				_zones;
+		std::map<std::string, Fill>				_fills;
+		std::map<int, std::string>				_fillOf;	// leader or waiter -> key
+		ResponseCacheStats						_stats;
+
+		void	erase(std::map<std::string, CachedResponse>::iterator it);
+		static size_t	entrySize(const std::string& key, const CachedResponse& entry);
+};
+
+#endif
@@ -1,12 +1,36 @@
 #include "Config.hpp"
+#include "../httpContext/HttpParser.hpp"
 
-Config::Config() {}
+Config::Config() : _cgiMaxConcurrent(0), _memoryBudget(0), _shutdownTimeout(0) {}
 Config::~Config() {}
 
 std::vector<Server> &Config::getServerConfigs() {
 	return _servers;
 }
 
+size_t	Config::getCgiMaxConcurrent() const {
+	return _cgiMaxConcurrent;
+}
+
+size_t	Config::getMemoryBudget() const {
+	return _memoryBudget;
+}
+
+size_t	Config::getShutdownTimeout() const {
+	return _shutdownTimeout;
+}
+
+// "cgi_max_concurrent N", "cgi_cache_ttl N", "shutdown_timeout N": a positive number
+static size_t	parsePositive(const std::string &directive, std::vector<std::string> &tokens)
+{
+	if (tokens.empty() || !is_only_digits(tokens.back()) || atoi(tokens.back().c_str()) <= 0)
+		throw std::runtime_error("Invalid " + directive + ": "
+			+ (tokens.empty() ? std::string("") : tokens.back()));
+	size_t	value = static_cast<size_t>(atoi(tokens.back().c_str()));
+	tokens.pop_back();
+	return value;
+}
+
 // Tokenizer: Converts the raw configuration string into a vector of tokens.
 std::vector<std::string> Config::tokenize(const std::string &content)
 {
@@ -24,6 +48,15 @@ std::vector<std::string> Config::tokenize(const std::string &content)
 				i++;
 			continue;
 		}
+		// Quoted strings are one token without the quotes (log_format)
+		if (content[i] == '\'' || content[i] == '"') {
+			size_t	close = content.find(content[i], i + 1);
+			if (close == std::string::npos)
+				throw std::runtime_error("Unterminated quoted string in config");
+			tokens.push_back(content.substr(i + 1, close - i - 1));
+			i = close + 1;
+			continue;
+		}
 		// Handle special characters as separate tokens
 		if (std::string("{};[],").find(content[i]) != std::string::npos) {
 			tokens.push_back(std::string(1, content[i]));
@@ -62,6 +95,30 @@ void	Config::parse(const std::string &config_file)
 			Server server;
 			parseServer(server, tokens);
 			_servers.push_back(server);
+		} else if (tokens.back() == "cgi_max_concurrent") {
+			// outside server blocks: the CGI pool is shared
+			tokens.pop_back();
+			_cgiMaxConcurrent = parsePositive("cgi_max_concurrent", tokens);
+			if (!tokens.empty() && tokens.back() == ";")
+				tokens.pop_back();
+		} else if (tokens.back() == "memory_budget") {
+			// all connections of all servers, see ServerManager::enforceMemoryBudget()
+			tokens.pop_back();
+			_memoryBudget = tokens.empty() ? 0 : HttpParser::parseSizeString(tokens.back());
+			if (_memoryBudget == 0)
+				throw std::runtime_error("Invalid memory_budget");
+			tokens.pop_back();
+			if (!tokens.empty() && tokens.back() == ";")
+				tokens.pop_back();
+		} else if (tokens.back() == "shutdown_timeout") {
+			// seconds in-flight requests get on SIGINT/SIGTERM, see ServerManager::beginShutdown()
+			tokens.pop_back();
+			_shutdownTimeout = parsePositive("shutdown_timeout", tokens);
+			if (!tokens.empty() && tokens.back() == ";")
+				tokens.pop_back();
+		} else if (tokens.back() == "log_format") {
+			tokens.pop_back();
+			parseLogFormat(tokens);
 		} else {
 			throw std::runtime_error("Unexpected token outside server block: " + tokens.back());
 		}
@@ -69,6 +126,7 @@ void	Config::parse(const std::string &config_file)
 	if (_servers.empty()) {
 		throw std::runtime_error("No server blocks found in configuration file.");
 	}
+	resolveAccessLogs();
 	if (CONF_DEBUG) std::cout << "Configuration '" << config_file << "' parsed successfully." << std::endl;
 	if (CONF_DEBUG) {
 		for (size_t i = 0; i < _servers.size(); ++i) {
@@ -85,7 +143,8 @@ static bool	isDirective(const std::string &token)
 	static const char *directives[] = {
 		"listen", "host", "server_name", "error_page", "client_max_body_size",
 		"location", "methods", "allow_methods", "index", "root",
-		"autoindex", "return", "cgi", "alias", "}"};
+		"autoindex", "return", "cgi", "alias", "fastcgi_pass", "cgi_max_concurrent",
+		"cgi_cache_ttl", "cgi_cache_max_size", "cgi_cache_vary", "access_log", "metrics", "}"};
 	for (size_t i = 0; i < sizeof(directives) / sizeof(directives[0]); ++i)
 	{
 		if (token == directives[i])
@@ -133,6 +192,55 @@ static std::vector<std::string>	parseValues(std::vector<std::string> &tokens)
 	return values;
 }
 
+/**
+ * log_format name [escape=default|json] 'text with $variables' ...;
+ * The quoted parts are joined, as in nginx. Top level only.
+ */
+void	Config::parseLogFormat(std::vector<std::string> &tokens)
+{
+	if (tokens.empty() || tokens.back() == ";")
+		throw std::runtime_error("Invalid log_format: missing name");
+	std::string	name = tokens.back();
+	tokens.pop_back();
+
+	AccessLogFormat::e_escape	escape = AccessLogFormat::ESCAPE_DEFAULT;
+	if (!tokens.empty() && tokens.back().compare(0, 7, "escape=") == 0) {
+		if (tokens.back() == "escape=json")
+			escape = AccessLogFormat::ESCAPE_JSON;
+		else if (tokens.back() != "escape=default")
+			throw std::runtime_error("Invalid log_format escape: " + tokens.back());
+		tokens.pop_back();
+	}
+	std::string	tmpl;
+	while (!tokens.empty() && tokens.back() != ";") {
+		tmpl += tokens.back();
+		tokens.pop_back();
+	}
+	if (tokens.empty())
+		throw std::runtime_error("Expected ';' after log_format " + name);
+	tokens.pop_back();
+	if (tmpl.empty())
+		throw std::runtime_error("Invalid log_format: empty format " + name);
+	_logFormats[name].compile(tmpl, escape);
+}
+
+// access_log names a log_format: a top-level one, else a built-in one
+void	Config::resolveAccessLogs()
+{
+	for (size_t i = 0; i < _servers.size(); ++i) {
+		if (_servers[i].getAccessLog().empty())
+			continue;
+		const std::string&	name = _servers[i].getAccessLogFormatName();
+		std::map<std::string, AccessLogFormat>::const_iterator	it = _logFormats.find(name);
+		AccessLogFormat		format;
+		if (it != _logFormats.end())
+			format = it->second;
+		else if (!AccessLogFormat::builtin(name, format))
+			throw std::runtime_error("Unknown log_format in access_log: " + name);
+		_servers[i].setAccessLogFormat(format);
+	}
+}
+
 // Parses a server block from the token stream.
 void	Config::parseServer(Server &server, std::vector<std::string> &tokens)
 {
@@ -191,6 +299,15 @@ void	Config::parseServer(Server &server, std::vector<std::string> &tokens)
 		} else if (directive == "client_max_body_size" || directive == "client_body_buffer_size") {
 			server.setClientMaxBodySize(tokens.back());
 			tokens.pop_back();
+		} else if (directive == "access_log") {
+			// access_log path [format]; or access_log off;
+			std::vector<std::string> values = parseValues(tokens);
+			if (values.empty() || values.size() > 2)
+				throw std::runtime_error("Invalid access_log directive");
+			if (values[0] == "off")
+				server.setAccessLog("", "");
+			else
+				server.setAccessLog(values[0], values.size() == 2 ? values[1] : "combined");
 		} else if (directive == "location")	{
 			Location	location;
 
@@ -259,6 +376,44 @@ void	Config::parseLocation(Location &location, std::vector<std::string> &tokens,
 		} else if (directive == "client_max_body_size" || directive == "client_body_buffer_size") {
 			location.setClientMaxBodySize(tokens.back());
 			tokens.pop_back();
+		} else if (directive == "fastcgi_pass") {
+			// unix:/path/to.sock or host:port
+			std::string address = tokens.back();
+			tokens.pop_back();
+			size_t colonPos = address.rfind(':');
+			if (address.compare(0, 5, "unix:") == 0) {
+				if (address.size() <= 5)
+					throw std::runtime_error("Invalid fastcgi_pass address: " + address);
+			} else if (colonPos == std::string::npos || colonPos == 0
+					|| !is_only_digits(address.substr(colonPos + 1))
+					|| atoi(address.substr(colonPos + 1).c_str()) <= 0
+					|| atoi(address.substr(colonPos + 1).c_str()) > 65535) {
+				throw std::runtime_error("Invalid fastcgi_pass address: " + address);
+			}
+			location.setFastcgiPass(address);
+		} else if (directive == "cgi_max_concurrent") {
+			location.setCgiMaxConcurrent(parsePositive(directive, tokens));
+		} else if (directive == "cgi_cache_ttl") {
+			location.setCgiCacheTtl(parsePositive(directive, tokens));
+		} else if (directive == "cgi_cache_max_size") {
+			size_t	bytes = tokens.empty() ? 0 : HttpParser::parseSizeString(tokens.back());
+			if (bytes == 0)
+				throw std::runtime_error("Invalid cgi_cache_max_size");
+			location.setCgiCacheMaxSize(bytes);
+			tokens.pop_back();
+		} else if (directive == "metrics") {
+			std::string	value = tokens.empty() ? "" : tokens.back();
+			if (value != "on" && value != "off")
+				throw std::runtime_error("Invalid metrics: " + value);
+			location.setMetrics(value == "on");
+			tokens.pop_back();
+		} else if (directive == "cgi_cache_vary") {
+			std::vector<std::string> headers = parseValues(tokens);
+			for (size_t i = 0; i < headers.size(); ++i) {
+				for (size_t c = 0; c < headers[i].size(); ++c) // Request looks names up in lower case
+					headers[i][c] = std::tolower(headers[i][c]);
+				location.addCgiCacheVary(headers[i]);
+			}
 		} else if (directive == "location") {
 			// Nested location
 			Location nestedLoc;
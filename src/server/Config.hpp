@@ -12,6 +12,9 @@ class Config
 		~Config();
 		void					parse(const std::string &config_file);
 		std::vector<Server>&	getServerConfigs();
+		size_t					getCgiMaxConcurrent() const;
+		size_t					getMemoryBudget() const;
+		size_t					getShutdownTimeout() const;
 
 	private:
 		std::string					_config_file;
@@ -19,6 +22,10 @@ class Config
 		std::vector<Server>			_servers; // parsed servers
 		std::map<long, Server *>	_sockets;
 		std::vector<int>			_ready;
+		size_t						_cgiMaxConcurrent; // top-level cgi_max_concurrent, 0: not set
+		size_t						_memoryBudget;     // top-level memory_budget, 0: not set
+		size_t						_shutdownTimeout;  // top-level shutdown_timeout (s), 0: not set
+		std::map<std::string, AccessLogFormat>	_logFormats; // top-level log_format, by name
 
 		std::vector<std::string>	tokenize(const std::string &config_file);
 
@@ -28,6 +35,8 @@ class Config
 		// void parseLocationDirective(Location& location, const std::vector<std::string>& tokens, size_t& i);
 		// std::vector<std::string> parseArray(const std::vector<std::string>& tokens, size_t& i);
 		void	parseServer(Server &server, std::vector<std::string> &tokens);
+		void	parseLogFormat(std::vector<std::string> &tokens);
+		void	resolveAccessLogs();
 		void	parseLocation(Location &location, std::vector<std::string> &tokens, const Server &server);
 };
 
@@ -1,6 +1,7 @@
 #include "Location.hpp"
 
-Location::Location() : _autoindex(false), _return_code(0) {}
+Location::Location() : _autoindex(false), _return_code(0), _cgi_max_concurrent(0),
+	_cgi_cache_ttl(0), _cgi_cache_max_size(0), _metrics(false), _metrics_slot(0) {}
 
 Location::~Location() {}
 
@@ -34,6 +35,38 @@ void	Location::setClientMaxBodySize(const std::string& size) {
 	_client_max_body_size = size;
 }
 
+void	Location::setFastcgiPass(const std::string& address) {
+	_fastcgi_pass = address;
+}
+
+void	Location::setCgiEnv(const std::string& block) {
+	_cgi_env = block;
+}
+
+void	Location::setCgiMaxConcurrent(size_t max) {
+	_cgi_max_concurrent = max;
+}
+
+void	Location::setCgiCacheTtl(size_t seconds) {
+	_cgi_cache_ttl = seconds;
+}
+
+void	Location::setCgiCacheMaxSize(size_t bytes) {
+	_cgi_cache_max_size = bytes;
+}
+
+void	Location::addCgiCacheVary(const std::string& header) {
+	_cgi_cache_vary.push_back(header);
+}
+
+void	Location::setMetrics(bool on) {
+	_metrics = on;
+}
+
+void	Location::setMetricsSlot(size_t slot) {
+	_metrics_slot = slot;
+}
+
 const std::string&	Location::getPath() const { return _path; }
 const std::string&	Location::getRoot() const { return _root; }
 const std::string&	Location::getAlias() const { return _alias; }
@@ -62,6 +95,38 @@ const std::string&				Location::getClientMaxBodySize() const {
 	return _client_max_body_size;
 }
 
+const std::string&				Location::getFastcgiPass() const {
+	return _fastcgi_pass;
+}
+
+const std::string&				Location::getCgiEnv() const {
+	return _cgi_env;
+}
+
+size_t							Location::getCgiMaxConcurrent() const {
+	return _cgi_max_concurrent;
+}
+
+size_t							Location::getCgiCacheTtl() const {
+	return _cgi_cache_ttl;
+}
+
+size_t							Location::getCgiCacheMaxSize() const {
+	return _cgi_cache_max_size;
+}
+
+const std::vector<std::string>&	Location::getCgiCacheVary() const {
+	return _cgi_cache_vary;
+}
+
+bool	Location::isMetrics() const {
+	return _metrics;
+}
+
+size_t	Location::getMetricsSlot() const {
+	return _metrics_slot;
+}
+
 void Location::print() const {
     std::cout << "    Location: " << _path << std::endl;
     if (!_root.empty()) std::cout << "      root: " << _root << std::endl;
@@ -75,6 +140,9 @@ void Location::print() const {
     }
     if (!_index.empty()) std::cout << "      index: " << _index << std::endl;
     if (!_client_max_body_size.empty()) std::cout << "      client_max_body_size: " << _client_max_body_size << std::endl;
+    if (!_fastcgi_pass.empty()) std::cout << "      fastcgi_pass: " << _fastcgi_pass << std::endl;
+    if (_cgi_max_concurrent) std::cout << "      cgi_max_concurrent: " << _cgi_max_concurrent << std::endl;
+    if (_cgi_cache_ttl) std::cout << "      cgi_cache_ttl: " << _cgi_cache_ttl << std::endl;
     std::cout << "      autoindex: " << (_autoindex ? "on" : "off") << std::endl;
     if (_return_code != 0) {
         std::cout << "      return: " << _return_code << " " << _return_url << std::endl;
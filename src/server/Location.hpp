@@ -19,6 +19,14 @@ class Location {
 		void	addLocation(const Location& location);
 		void	setAlias(const std::string& alias);
 		void	setClientMaxBodySize(const std::string& size);
+		void	setFastcgiPass(const std::string& address);
+		void	setCgiEnv(const std::string& block);
+		void	setCgiMaxConcurrent(size_t max);
+		void	setCgiCacheTtl(size_t seconds);
+		void	setCgiCacheMaxSize(size_t bytes);
+		void	setMetrics(bool on);
+		void	setMetricsSlot(size_t slot);
+		void	addCgiCacheVary(const std::string& header);
 
 		// Getters
 		const std::vector<std::string>&				getAllowedMethods() const;
@@ -32,6 +40,14 @@ class Location {
 		int					getReturnCode() const;
 		const std::string&	getReturnUrl() const;
 		const std::string&	getClientMaxBodySize() const;
+		const std::string&	getFastcgiPass() const;
+		const std::string&	getCgiEnv() const;
+		size_t				getCgiMaxConcurrent() const;
+		size_t				getCgiCacheTtl() const;
+		size_t				getCgiCacheMaxSize() const;
+		const std::vector<std::string>&	getCgiCacheVary() const;
+		bool				isMetrics() const;
+		size_t				getMetricsSlot() const;
 		
 		void print() const;
 
@@ -48,6 +64,14 @@ class Location {
 		std::map<std::string, std::string>	_cgi;
 		std::vector<Location>		_locations;
 		std::string					_client_max_body_size;
+		std::string					_fastcgi_pass; // "unix:/path" or "host:port"
+		std::string					_cgi_env; // request-independent CGI variables, "NAME=value\0..."
+		size_t						_cgi_max_concurrent; // scripts of this location at once, 0: no own limit
+		size_t						_cgi_cache_ttl; // seconds a CGI answer is cached, 0: not cached
+		size_t						_cgi_cache_max_size; // bytes, 0: CGI_CACHE_SIZE
+		std::vector<std::string>	_cgi_cache_vary; // request headers that are part of the cache key
+		bool						_metrics; // answers with the Prometheus metrics (metrics on;)
+		size_t						_metrics_slot; // latency histogram, see Metrics::addLocation()
 };
 
 #endif
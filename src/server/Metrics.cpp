@@ -0,0 +1,130 @@
+#include "Metrics.hpp"
+
+MetricsCounters					Metrics::counters;
+std::vector<Metrics::Histogram>	Metrics::_histograms;
+
+// Upper bound of bucket b in seconds: 0.001 * 2^b
+static double	bucketBound(size_t b) {
+	return 0.001 * static_cast<double>(1UL << b);
+}
+
+// Returns the histogram slot for a location; slot 0 is "no location"
+size_t	Metrics::addLocation(const std::string& name) {
+	Histogram	h;
+
+	std::memset(h.buckets, 0, sizeof(h.buckets));
+	h.sum = 0;
+	h.count = 0;
+	if (_histograms.empty()) {
+		h.location = "-";
+		_histograms.push_back(h);
+	}
+	for (size_t i = 1; i < _histograms.size(); ++i) {
+		if (_histograms[i].location == name)
+			return i;	// registered again by a reload: the same series
+	}
+	h.location = name;
+	_histograms.push_back(h);
+	return _histograms.size() - 1;
+}
+
+void	Metrics::observe(size_t slot, double seconds) {
+	if (slot >= _histograms.size())
+		return;
+	Histogram&	h = _histograms[slot];
+	size_t		b = 0;
+
+	while (b < METRICS_BUCKETS && seconds > bucketBound(b))
+		b++;
+	h.buckets[b]++;
+	h.sum += seconds;
+	h.count++;
+}
+
+const char*	Metrics::memoryStateName(e_memory_state state) {
+	static const char*	names[MEM_STATES] = { "idle", "headers", "body", "upstream", "response" };
+
+	return names[state];
+}
+
+void	Metrics::appendHeader(std::string& out, const char* name, const char* type,
+			const char* help) {
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+// name{labels} value; `labels` is `key="value",...` or empty
+void	Metrics::appendSample(std::string& out, const char* name,
+			const std::string& labels, double value) {
+	std::ostringstream	oss;
+
+	oss.precision(15);
+	oss << value;
+	out += name;
+	if (!labels.empty()) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += ' ';
+	out += oss.str();
+	out += '\n';
+}
+
+void	Metrics::render(std::string& out) {
+	appendHeader(out, "webserv_connections_accepted_total", "counter", "Client connections accepted.");
+	appendSample(out, "webserv_connections_accepted_total", "", counters.connectionsAccepted);
+	appendHeader(out, "webserv_connections_closed_total", "counter", "Client connections closed.");
+	appendSample(out, "webserv_connections_closed_total", "", counters.connectionsClosed);
+	appendHeader(out, "webserv_idle_timeouts_total", "counter", "Connections closed after 30 s without traffic.");
+	appendSample(out, "webserv_idle_timeouts_total", "", counters.idleTimeouts);
+	appendHeader(out, "webserv_drain_closes_total", "counter", "Connections closed while draining after an error response.");
+	appendSample(out, "webserv_drain_closes_total", "", counters.drainCloses);
+	appendHeader(out, "webserv_memory_pauses_total", "counter", "Connections no longer read because memory_budget was crossed.");
+	appendSample(out, "webserv_memory_pauses_total", "", counters.memoryPauses);
+	appendHeader(out, "webserv_memory_shed_bodies_total", "counter", "Large request bodies answered 503 over memory_budget.");
+	appendSample(out, "webserv_memory_shed_bodies_total", "", counters.bodiesShed);
+	appendHeader(out, "webserv_received_bytes_total", "counter", "Bytes read from clients.");
+	appendSample(out, "webserv_received_bytes_total", "", counters.bytesReceived);
+	appendHeader(out, "webserv_sent_bytes_total", "counter", "Bytes sent to clients.");
+	appendSample(out, "webserv_sent_bytes_total", "", counters.bytesSent);
+	appendHeader(out, "webserv_requests_started_total", "counter", "Requests whose first byte arrived.");
+	appendSample(out, "webserv_requests_started_total", "", counters.requestsStarted);
+
+	appendHeader(out, "webserv_responses_total", "counter", "Responses sent, by status code.");
+	for (size_t s = 0; s < METRICS_STATUS_MAX; ++s) {
+		if (counters.responses[s])
+			appendSample(out, "webserv_responses_total", "status=\"" + toString(s) + "\"",
+				counters.responses[s]);
+	}
+	appendHeader(out, "webserv_parse_errors_total", "counter", "Requests rejected by the parser, by status code.");
+	for (size_t s = 0; s < METRICS_STATUS_MAX; ++s) {
+		if (counters.parseErrors[s])
+			appendSample(out, "webserv_parse_errors_total", "status=\"" + toString(s) + "\"",
+				counters.parseErrors[s]);
+	}
+
+	appendHeader(out, "webserv_request_duration_seconds", "histogram",
+		"First request byte to last response byte, by location.");
+	for (size_t i = 0; i < _histograms.size(); ++i) {
+		const Histogram&	h = _histograms[i];
+		const std::string	location = "location=\"" + h.location + "\"";
+		size_t				cumulative = 0;
+
+		for (size_t b = 0; b <= METRICS_BUCKETS; ++b) {
+			cumulative += h.buckets[b];
+			std::string	le = b < METRICS_BUCKETS ? toString(bucketBound(b)) : "+Inf";
+			appendSample(out, "webserv_request_duration_seconds_bucket",
+				location + ",le=\"" + le + "\"", cumulative);
+		}
+		appendSample(out, "webserv_request_duration_seconds_sum", location, h.sum);
+		appendSample(out, "webserv_request_duration_seconds_count", location, h.count);
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef METRICS_HPP
+# define METRICS_HPP
+
+# include "../../inc/Webserv.hpp"
+
+# define METRICS_BUCKETS 15		// request duration: 1 ms, 2 ms, 4 ms ... 16.384 s, then +Inf
+# define METRICS_STATUS_MAX 600
+
+// What a connection's memory is held for, see HttpContext::memoryState()
+enum	e_memory_state {
+	MEM_IDLE,		// keep-alive, nothing buffered
+	MEM_HEADERS,	// request line and header block arriving
+	MEM_BODY,		// request body arriving
+	MEM_UPSTREAM,	// request in, waiting for CGI / FastCGI
+	MEM_RESPONSE,	// response being sent
+	MEM_STATES
+};
+
+// Plain counters, bumped where things happen: Metrics::counters.bytesSent += n
+struct	MetricsCounters {
+	size_t	connectionsAccepted;
+	size_t	connectionsClosed;
+	size_t	requestsStarted;
+	size_t	bytesReceived;
+	size_t	bytesSent;
+	size_t	drainCloses;		// closed while discarding the body after an error response
+	size_t	idleTimeouts;
+	size_t	memoryPauses;		// reads stopped on a connection over memory_budget
+	size_t	bodiesShed;			// large bodies answered 503 over memory_budget
+	size_t	responses[METRICS_STATUS_MAX];		// by status code, once sent
+	size_t	parseErrors[METRICS_STATUS_MAX];	// rejected requests: 400, 413, 414, 431
+};
+
+/**
+ * Briefly: the server's counters and latency histograms, in Prometheus
+ * text format for a location with `metrics on;`.
+ *
+ * The poll() loop is the only writer, so updates are plain increments
+ * on the static `counters`. Each location gets a histogram slot when the
+ * servers are set up (addLocation(), Location::getMetricsSlot()); slot 0
+ * counts requests that matched no location. Buckets are fixed and
+ * doubling, so observe() needs no allocation and no lookup.
+ *
+ * render() writes what is counted here; ServerManager adds the gauges it
+ * owns (connections, CGI pool, response cache) with appendHeader() and
+ * appendSample().
+ */
+class	Metrics {
+
+	public:
+		static MetricsCounters	counters;
+
+		static size_t	addLocation(const std::string& name);
+		static void		observe(size_t slot, double seconds);
+		static void		render(std::string& out);
+		static const char*	memoryStateName(e_memory_state state);
+		static void		appendHeader(std::string& out, const char* name, const char* type,
+							const char* help);
+		static void		appendSample(std::string& out, const char* name,
+							const std::string& labels, double value);
+
+	private:
+		Metrics();
+
+		struct	Histogram {
+			std::string	location;
+			size_t		buckets[METRICS_BUCKETS + 1];	// not cumulative, the last is +Inf
+			double		sum;
+			size_t		count;
+		};
+
+		static std::vector<Histogram>	_histograms;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "Server.hpp"
+#include "../cgi/CgiHandler.hpp"
+#include "Metrics.hpp"
 
 Server::Server() {
 	_port = 8080;
@@ -9,6 +11,7 @@ Server::Server() {
 	_index = "index.html";
 	_error_pages[404] = "/var/www/errors/404.html";
 	_client_max_body_size = "1m";
+	_access_log_id = -1;
 	_listen_fd = -1;
 }
 
@@ -21,6 +24,10 @@ Server::Server(const Server& other)
 	  _error_pages(other._error_pages),
 	  _locations(other._locations),
 	  _client_max_body_size(other._client_max_body_size),
+	  _access_log(other._access_log),
+	  _access_log_format(other._access_log_format),
+	  _access_log_compiled(other._access_log_compiled),
+	  _access_log_id(other._access_log_id),
 	  _server_address(other._server_address),
 	  _listen_fd(other._listen_fd)
 { }
@@ -31,7 +38,42 @@ Server::~Server() {
 	}
 }
 
-int	Server::setupServer() {
+/** The request-independent CGI variables of every location, built once. */
+void	Server::prepareCgiEnv() {
+	for (size_t i = 0; i < _locations.size(); ++i) {
+		std::string	block;
+		CgiHandler::buildStaticEnv(*this, &_locations[i], block);
+		_locations[i].setCgiEnv(block);
+	}
+}
+
+// A latency histogram per location, named "port/path"
+void	Server::registerMetrics() {
+	for (size_t i = 0; i < _locations.size(); ++i)
+		_locations[i].setMetricsSlot(Metrics::addLocation(toString(_port) + _locations[i].getPath()));
+}
+
+// A server with access_log keeps its file open for the whole run
+void	Server::openAccessLog() {
+	if (!_access_log.empty() && _access_log_id == -1)
+		_access_log_id = Logger::openAccessLog(_access_log);
+}
+
+/**
+ * Opens, binds and listens on host:port, or with `listenFd` adopts a
+ * socket already listening there (the previous configuration's, see
+ * ServerManager::applyConfig()): nothing is rebound, no connection in
+ * its backlog is lost.
+ */
+int	Server::setupServer(int listenFd) {
+	if (listenFd != -1) {
+		_listen_fd = listenFd;
+		_server_address.sin_family = AF_INET;
+		_server_address.sin_addr.s_addr = inet_addr(_host.c_str());
+		_server_address.sin_port = htons(_port);
+		Logger::log(LOG_INFO, "Server keeps listening on " + _host + ":" + toString(_port));
+		return 0;
+	}
 	_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
 	if (_listen_fd == -1) {
 		Logger::logErrno(LOG_ERROR, "Failed to create socket");
@@ -71,6 +113,14 @@ int	Server::setupServer() {
 	return 0;
 }
 
+// The listening socket is handed on (or closed by the caller), not closed with this Server
+int	Server::releaseListenFd() {
+	int	fd = _listen_fd;
+
+	_listen_fd = -1;
+	return fd;
+}
+
 void	Server::setPort(int port) {
 	_port = port;
 }
@@ -98,6 +148,13 @@ void	Server::setClientMaxBodySize(const std::string& size) {
 void	Server::addAllowedMethod(const std::string& method) {
 	_allowed_methods.push_back(method);
 }
+void	Server::setAccessLog(const std::string& path, const std::string& format) {
+	_access_log = path;
+	_access_log_format = format;
+}
+void	Server::setAccessLogFormat(const AccessLogFormat& format) {
+	_access_log_compiled = format;
+}
 
 int Server::getPort() const {
 	return _port;
@@ -139,6 +196,18 @@ std::string			Server::getRoot() const {
 const std::string&	Server::getIndex() const {
 	return _index;
 }
+const std::string&	Server::getAccessLog() const {
+	return _access_log;
+}
+const std::string&	Server::getAccessLogFormatName() const {
+	return _access_log_format;
+}
+const AccessLogFormat&	Server::getAccessLogFormat() const {
+	return _access_log_compiled;
+}
+int					Server::getAccessLogId() const {
+	return _access_log_id;
+}
 
 void	Server::print() const {
 	std::cout << "Server Configuration:" << std::endl;
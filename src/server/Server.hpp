@@ -3,6 +3,7 @@
 
 # include "../../inc/Webserv.hpp"
 # include "Location.hpp"
+# include "../logger/AccessLog.hpp"
 
 # include <sys/types.h>		// socket(), bind(), listen()
 # include <sys/socket.h>	// socket(), bind(), listen()
@@ -17,7 +18,11 @@ class	Server {
 		Server(const Server& other);
 		~Server();
 		
-		int		setupServer();
+		int		setupServer(int listenFd = -1);
+		int		releaseListenFd();
+		void	prepareCgiEnv();
+		void	openAccessLog();
+		void	registerMetrics();
 		
 		// Setters
 		void	setPort(int port);
@@ -29,6 +34,8 @@ class	Server {
 		void	addLocation(const Location& location);
 		void	setClientMaxBodySize(const std::string& size);
 		void	addAllowedMethod(const std::string& method);
+		void	setAccessLog(const std::string& path, const std::string& format);
+		void	setAccessLogFormat(const AccessLogFormat& format);
 		
 		// Getters
 		size_t								getLocationCount() const;
@@ -43,6 +50,10 @@ class	Server {
 		const std::string&					getHost() const;
 		std::string							getRoot() const;
 		const std::string&					getIndex() const;
+		const std::string&					getAccessLog() const;
+		const std::string&					getAccessLogFormatName() const;
+		const AccessLogFormat&				getAccessLogFormat() const;
+		int									getAccessLogId() const;
 		
 		void print() const;
 
@@ -56,6 +67,10 @@ class	Server {
 		std::vector<Location>		_locations;
 		std::string					_client_max_body_size; // unsigned long
 		std::vector<std::string>	_allowed_methods;
+		std::string					_access_log;		// file, empty: none
+		std::string					_access_log_format;	// log_format name
+		AccessLogFormat				_access_log_compiled;
+		int							_access_log_id;		// Logger::logAccess(), -1: none
 		struct sockaddr_in			_server_address;
 		int							_listen_fd;
 };
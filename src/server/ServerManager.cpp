@@ -8,9 +8,25 @@ using std::vector;
 using std::cout;
 using std::endl;
 
-ServerManager::ServerManager() : shutdown(false) {}
+ServerManager::ServerManager() : _current(NULL), shutdown(false), _reloadRequested(false),
+	_upgradeRequested(false), _upgradePid(-1), _upgradePipe(-1), _drainDeadline(0),
+	_stopping(false), _shutdownTimeout(SHUTDOWN_TIMEOUT_SEC), _drainReported(0), _drainReportTime(0),
+	_memoryBudget(0), _connectionCount(0) {
+	_signalPipe[0] = -1;
+	_signalPipe[1] = -1;
+}
 
-ServerManager::~ServerManager() {}
+// After cleanup(): the configurations, their listeners already closed
+ServerManager::~ServerManager() {
+	for (std::list<ConfigSnapshot*>::iterator it = _retired.begin(); it != _retired.end(); ++it) {
+		delete (*it)->config;
+		delete *it;
+	}
+	if (_current) {
+		delete _current->config;
+		delete _current;
+	}
+}
 
 // Checker for the main server loop
 bool		ServerManager::isShutdownRequested() const {
@@ -22,26 +38,439 @@ void		ServerManager::requestShutdown() {
 	shutdown = true;
 }
 
+// Top-level cgi_max_concurrent; CGI_MAX_CONCURRENT when not set
+void		ServerManager::setCgiMaxConcurrent(size_t max) {
+	_cgiPool.setMaxConcurrent(max ? max : CGI_MAX_CONCURRENT);
+}
+
+// Top-level memory_budget; 0 (not set) never pauses nor sheds
+void		ServerManager::setMemoryBudget(size_t bytes) {
+	_memoryBudget = bytes;
+}
+
+// Top-level shutdown_timeout; SHUTDOWN_TIMEOUT_SEC when not set
+void		ServerManager::setShutdownTimeout(size_t seconds) {
+	_shutdownTimeout = seconds ? static_cast<time_t>(seconds) : SHUTDOWN_TIMEOUT_SEC;
+}
+
 /**
- * After each server's listening socket is successfully created, 
- * it is immediately registered for polling.
+ * Parses the configuration file and starts listening. A parse error is
+ * thrown: at start there is nothing to fall back on.
  */
-void		ServerManager::setupServers(vector<Server> & server_configs ) {
-	//_servers = server_configs;
-	for (vector<Server>::iterator it = server_configs.begin(); 
-			it != server_configs.end(); it++) {
-		//socket setup
-		//bind socket
-		if (it->setupServer() == -1) {
-			// You can add error handling logic here. For example, stop 
-			// all servers from running or just ignore this one.
+void		ServerManager::loadConfig(const string& config_file) {
+	Config*	config = new Config();
+
+	try {
+		config->parse(config_file);
+	} catch (...) {
+		delete config;
+		throw;
+	}
+	_configFile = config_file;
+	openSignalPipe();
+	takeInheritedListeners();
+	applyConfig(config);
+}
+
+// argv of this process: a binary upgrade (SIGUSR2) runs argv[0] with it
+void		ServerManager::setCommandLine(char** argv) {
+	_argv.clear();
+	for (size_t i = 0; argv[i] != NULL; ++i)
+		_argv.push_back(argv[i]);
+}
+
+/**
+ * SIGHUP, run by the loop between two poll() calls: the configuration
+ * file again. One that does not parse leaves the running configuration
+ * as it is.
+ */
+void		ServerManager::reload() {
+	Config*	config = new Config();
+
+	Logger::log(LOG_INFO, "SIGHUP: reloading " + _configFile);
+	try {
+		config->parse(_configFile);
+	} catch (const std::exception& e) {
+		Logger::log(LOG_ERROR, "Reload failed, configuration unchanged: " + string(e.what()));
+		delete config;
+		return;
+	}
+	applyConfig(config);
+	startCgiPool();		// launchers for extensions new in this configuration
+}
+
+/**
+ * Makes `config` the snapshot new connections are served by. A listener
+ * whose host:port is still configured is handed to the new Server as is
+ * (see Server::setupServer()), the others are opened or closed. The
+ * connections of the previous snapshot finish their request on it: idle
+ * keep-alive ones move over now, busy ones after their response (see
+ * moveToCurrentConfig()), and it is freed with its last connection.
+ */
+void		ServerManager::applyConfig(Config* config) {
+	ConfigSnapshot*		previous = _current;
+	map<int, Server*>	listeners;	// the previous snapshot's, by fd
+
+	listeners.swap(_map_servers);
+	_current = new ConfigSnapshot();
+	_current->config = config;
+	_current->generation = previous ? previous->generation + 1 : 1;
+	_current->connections = 0;
+	setCgiMaxConcurrent(config->getCgiMaxConcurrent());
+	setMemoryBudget(config->getMemoryBudget());
+	setShutdownTimeout(config->getShutdownTimeout());
+
+	vector<Server>&	servers = config->getServerConfigs();
+	for (vector<Server>::iterator it = servers.begin(); it != servers.end(); ++it) {
+		int		inherited = -1;
+		bool	polled = false;		// the previous snapshot's: already in _pfds
+		for (map<int, Server*>::iterator l = listeners.begin(); l != listeners.end(); ++l) {
+			if (l->second->getPort() == it->getPort() && l->second->getHost() == it->getHost()) {
+				inherited = l->second->releaseListenFd();
+				polled = true;
+				listeners.erase(l);
+				break;
+			}
+		}
+		map<string, int>::iterator	h = _inherited.find(it->getHost() + ":" + toString(it->getPort()));
+		if (inherited == -1 && h != _inherited.end()) {
+			inherited = h->second;	// from the binary this one replaces
+			_inherited.erase(h);
+		}
+		if (it->setupServer(inherited) == -1) {
 			std::cerr << "Error setting up a server. Skipping it." << endl;
-		} else {
-			// Add listener to set of pollfd-s
+			continue;
+		}
+		it->prepareCgiEnv();
+		it->openAccessLog();
+		it->registerMetrics();
+		// Add listener to set of pollfd-s
+		if (!polled)
 			addToPfds(_pfds, it->getListenFd());
-			_map_servers[it->getListenFd()] = &(*it);
+		_map_servers[it->getListenFd()] = &(*it);
+	}
+	for (map<int, Server*>::iterator l = listeners.begin(); l != listeners.end(); ++l) {
+		Logger::log(LOG_INFO, "Server stops listening on " + l->second->getHost() + ":"
+			+ toString(l->second->getPort()));
+		size_t	i = findPfd(l->first);
+		if (i != _pfds.size())
+			delFromPfds(i);
+		close(l->second->releaseListenFd());
+	}
+	for (map<string, int>::iterator h = _inherited.begin(); h != _inherited.end(); ++h) {
+		Logger::log(LOG_INFO, "Inherited listener " + h->first + " is not configured, closed");
+		close(h->second);
+	}
+	_inherited.clear();
+	if (previous == NULL)
+		return;
+	Logger::log(LOG_INFO, "Configuration " + toString(_current->generation) + " loaded, "
+		+ toString(_map_servers.size()) + " listener(s); " + toString(previous->connections)
+		+ " connection(s) open under configuration " + toString(previous->generation));
+	if (previous->connections == 0) {
+		delete previous->config;
+		delete previous;
+		return;
+	}
+	_retired.push_back(previous);
+
+	vector<int>	idle;
+	for (map<int, HttpContext*>::iterator it = _contexts.begin(); it != _contexts.end(); ++it) {
+		if (it->second->memoryState() == MEM_IDLE && !it->second->isDraining())
+			idle.push_back(it->first);
+	}
+	for (size_t c = 0; c < idle.size(); ++c) {
+		if (!moveToCurrentConfig(*_contexts[idle[c]], idle[c]))
+			removeClient(idle[c], findPfd(idle[c]));
+	}
+}
+
+/**
+ * A connection between two requests joins the current snapshot: the
+ * server listening on its address now. False when none does any more.
+ */
+bool		ServerManager::moveToCurrentConfig(HttpContext& ctx, int fd) {
+	map<int, ConfigSnapshot*>::iterator	s = _snapshotOf.find(fd);
+	if (s == _snapshotOf.end() || s->second == _current)
+		return true;
+
+	Server*	server = NULL;
+	for (map<int, Server*>::iterator l = _map_servers.begin(); l != _map_servers.end(); ++l) {
+		if (l->second->getPort() == ctx.server().getPort() && l->second->getHost() == ctx.server().getHost()) {
+			server = l->second;
+			break;
 		}
 	}
+	if (server == NULL)
+		return false;
+	ctx.bindServer(*server);
+	leaveSnapshot(fd);
+	_snapshotOf[fd] = _current;
+	_current->connections++;
+	return true;
+}
+
+// A connection is closed or moved: a replaced snapshot goes with its last one
+void		ServerManager::leaveSnapshot(int fd) {
+	map<int, ConfigSnapshot*>::iterator	s = _snapshotOf.find(fd);
+	if (s == _snapshotOf.end())
+		return;
+
+	ConfigSnapshot*	snapshot = s->second;
+	_snapshotOf.erase(s);
+	if (--snapshot->connections > 0 || snapshot == _current)
+		return;
+	_retired.remove(snapshot);
+	Logger::log(LOG_INFO, "Configuration " + toString(snapshot->generation)
+		+ " released: its last connection is closed");
+	delete snapshot->config;
+	delete snapshot;
+}
+
+/**
+ * Signals reach the loop through a pipe (the self-pipe trick): the
+ * handler only writes the signal number, handleSignals() reads it while
+ * the loop polls, and a reload then runs between two poll() calls with
+ * no state half-updated.
+ */
+void		ServerManager::openSignalPipe() {
+	if (pipe(_signalPipe) == -1) {
+		Logger::logErrno(LOG_ERROR, "Signal pipe");
+		_signalPipe[0] = -1;
+		_signalPipe[1] = -1;
+		return;
+	}
+	for (int e = 0; e < 2; ++e) {
+		fcntl(_signalPipe[e], F_SETFL, fcntl(_signalPipe[e], F_GETFL, 0) | O_NONBLOCK);
+		fcntl(_signalPipe[e], F_SETFD, FD_CLOEXEC);
+	}
+	addToPfds(_pfds, _signalPipe[0]);
+}
+
+// Called from the signal handler: async-signal-safe, write() only
+void		ServerManager::notifySignal(int signum) {
+	const int	saved = errno;
+	const char	c = static_cast<char>(signum);
+
+	if (_signalPipe[1] == -1) {
+		if (signum != SIGHUP)
+			shutdown = true;
+		return;
+	}
+	ssize_t	n = write(_signalPipe[1], &c, 1);
+	(void)n;
+	errno = saved;
+}
+
+void		ServerManager::handleSignals() {
+	char	sigs[64];
+	ssize_t	n;
+
+	while ((n = read(_signalPipe[0], sigs, sizeof(sigs))) > 0) {
+		for (ssize_t s = 0; s < n; ++s) {
+			if (sigs[s] == SIGHUP)
+				_reloadRequested = true;
+			else if (sigs[s] == SIGUSR2)
+				_upgradeRequested = true;
+			else
+				beginShutdown(sigs[s]);
+		}
+	}
+}
+
+/**
+ * Started by a binary upgrade: the listening sockets of the old binary,
+ * "host:port=fd;..." in UPGRADE_LISTEN_ENV. applyConfig() adopts those
+ * still configured and closes the others.
+ */
+void		ServerManager::takeInheritedListeners() {
+	const char*	env = getenv(UPGRADE_LISTEN_ENV);
+	if (env == NULL)
+		return;
+
+	std::istringstream	list(env);
+	string				entry;
+	while (std::getline(list, entry, ';')) {
+		size_t	eq = entry.rfind('=');
+		if (eq == string::npos)
+			continue;
+		int	fd = std::atoi(entry.c_str() + eq + 1);
+		if (fd > 2)
+			_inherited[entry.substr(0, eq)] = fd;
+	}
+	unsetenv(UPGRADE_LISTEN_ENV);
+	Logger::log(LOG_INFO, "Binary upgrade: " + toString(_inherited.size()) + " listener(s) inherited");
+}
+
+// The new binary listens: its predecessor may stop accepting (checkUpgrade())
+void		ServerManager::notifyUpgradeReady() {
+	const char*	env = getenv(UPGRADE_READY_ENV);
+	if (env == NULL)
+		return;
+
+	int		fd = std::atoi(env);
+	ssize_t	n = write(fd, "1", 1);
+	(void)n;
+	close(fd);
+	unsetenv(UPGRADE_READY_ENV);
+	Logger::log(LOG_INFO, "Binary upgrade: listening, the old server drains");
+}
+
+/**
+ * SIGUSR2: runs argv[0] (a new build put in place of the running one)
+ * with the same arguments. It inherits the listening sockets and nothing
+ * else, accepts on them as soon as it is up, alongside this server, and
+ * reports it through a pipe. Then this server stops accepting and
+ * drains (checkUpgrade()); no connection is refused meanwhile.
+ */
+void		ServerManager::startUpgrade() {
+	if (_upgradePid != -1 || _drainDeadline != 0 || _argv.empty()) {
+		Logger::log(LOG_WARNING, "Binary upgrade: already started, or the server is stopping");
+		return;
+	}
+	int		ready[2];
+	if (pipe(ready) == -1) {
+		Logger::logErrno(LOG_ERROR, "Binary upgrade: pipe");
+		return;
+	}
+	string	listeners;
+	for (map<int, Server*>::iterator l = _map_servers.begin(); l != _map_servers.end(); ++l)
+		listeners += l->second->getHost() + ":" + toString(l->second->getPort()) + "=" + toString(l->first) + ";";
+	vector<char*>	args;
+	for (size_t a = 0; a < _argv.size(); ++a)
+		args.push_back(const_cast<char*>(_argv[a].c_str()));
+	args.push_back(NULL);
+
+	Logger::flush();	// or the child would hold buffered lines
+	pid_t	pid = fork();
+	if (pid == -1) {
+		Logger::logErrno(LOG_ERROR, "Binary upgrade: fork");
+		close(ready[0]);
+		close(ready[1]);
+		return;
+	}
+	if (pid == 0) {
+		long	max_fd = sysconf(_SC_OPEN_MAX);
+		if (max_fd == -1) max_fd = 1024;
+		for (int fd = 3; fd < max_fd; ++fd) {
+			if (fd != ready[1] && !isListener(fd))
+				close(fd);
+		}
+		setenv(UPGRADE_LISTEN_ENV, listeners.c_str(), 1);
+		setenv(UPGRADE_READY_ENV, toString(ready[1]).c_str(), 1);
+		execv(args[0], &args[0]);
+		_exit(127);
+	}
+	close(ready[1]);
+	fcntl(ready[0], F_SETFL, O_NONBLOCK);
+	fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+	_upgradePipe = ready[0];
+	_upgradePid = pid;
+	addToPfds(_pfds, _upgradePipe);
+	Logger::log(LOG_INFO, "Binary upgrade: started " + _argv[0] + ", pid " + toString(pid));
+}
+
+/**
+ * Once per loop while a new binary starts: a byte on its pipe means it
+ * listens, end of file that it gave up before (this server goes on).
+ * One that gave up is reaped without waiting, on a later call if it has
+ * not exited yet: it may have closed the pipe and still run.
+ */
+void		ServerManager::checkUpgrade() {
+	for (size_t p = 0; p < _upgradeFailed.size(); ) {
+		pid_t	done = waitpid(_upgradeFailed[p], NULL, WNOHANG);
+		if (done == _upgradeFailed[p] || (done == -1 && errno == ECHILD))
+			_upgradeFailed.erase(_upgradeFailed.begin() + p);
+		else
+			++p;
+	}
+	if (_upgradePipe == -1)
+		return;
+	char	c;
+	ssize_t	n = read(_upgradePipe, &c, 1);
+	if (n == -1)
+		return;		// nothing yet
+
+	delFromPfds(findPfd(_upgradePipe));
+	close(_upgradePipe);
+	_upgradePipe = -1;
+	if (n == 1) {
+		Logger::log(LOG_INFO, "Binary upgrade: pid " + toString(_upgradePid) + " is listening; draining "
+			+ toString(_contexts.size()) + " connection(s), " + toString(UPGRADE_DRAIN_SEC) + " s at most");
+		stopAccepting(UPGRADE_DRAIN_SEC);
+	} else {
+		Logger::log(LOG_ERROR, "Binary upgrade: pid " + toString(_upgradePid)
+			+ " gave up before listening, still serving");
+		_upgradeFailed.push_back(_upgradePid);
+	}
+	_upgradePid = -1;
+}
+
+/**
+ * The server winds down: its listeners are closed (a new binary keeps
+ * its own copies), idle keep-alive connections too, the others after
+ * their response (finishExchange()), including one accepted but with
+ * no request yet. runServers() returns when none is
+ * left, or `grace` seconds from now.
+ */
+void		ServerManager::stopAccepting(time_t grace) {
+	_drainDeadline = time(NULL) + grace;
+	_drainReported = _contexts.size();
+	HttpContext::setClosingAll(true);
+	for (map<int, Server*>::iterator l = _map_servers.begin(); l != _map_servers.end(); ++l) {
+		delFromPfds(findPfd(l->first));
+		close(l->second->releaseListenFd());
+	}
+	_map_servers.clear();
+
+	// keep-alive between two requests; one just accepted waits for its first
+	vector<int>	idle;
+	for (map<int, HttpContext*>::iterator it = _contexts.begin(); it != _contexts.end(); ++it) {
+		if (it->second->memoryState() == MEM_IDLE && !it->second->isDraining()
+				&& it->second->connection().getRequestCount() > 0)
+			idle.push_back(it->first);
+	}
+	for (size_t c = 0; c < idle.size(); ++c)
+		removeClient(idle[c], findPfd(idle[c]));
+}
+
+/**
+ * SIGINT, SIGTERM, SIGQUIT: a staged stop. No new connection, idle ones
+ * closed, every next response says Connection: close; requests and CGI
+ * scripts in flight get shutdown_timeout seconds to finish, then
+ * cleanup() closes what is left. A second signal stops right away.
+ */
+void		ServerManager::beginShutdown(int signum) {
+	if (_stopping) {
+		Logger::log(LOG_WARNING, "Signal " + toString(signum) + " again: stopping now, "
+			+ toString(_contexts.size()) + " connection(s) cut");
+		requestShutdown();
+		return;
+	}
+	_stopping = true;
+	Logger::log(LOG_INFO, "Signal " + toString(signum) + ": graceful shutdown, "
+		+ toString(_contexts.size()) + " connection(s) open, " + toString(_shutdownTimeout) + " s at most");
+	if (_drainDeadline == 0)
+		stopAccepting(_shutdownTimeout);
+	else	// already draining after a binary upgrade
+		_drainDeadline = std::min(_drainDeadline, time(NULL) + _shutdownTimeout);
+}
+
+// Once per loop while draining: the connections left, at most once a second
+void		ServerManager::reportDrain() {
+	const time_t	now = time(NULL);
+
+	if (_drainDeadline == 0 || isShutdownRequested()
+			|| _contexts.size() == _drainReported || now == _drainReportTime)
+		return;
+	_drainReported = _contexts.size();
+	_drainReportTime = now;
+	Logger::log(LOG_INFO, "Draining: " + toString(_drainReported) + " connection(s) left, "
+		+ toString(_drainDeadline > now ? _drainDeadline - now : 0) + " s to go");
+}
+
+bool		ServerManager::isDrained() const {
+	return _drainDeadline != 0 && (_contexts.empty() || time(NULL) >= _drainDeadline);
 }
 
 /**
@@ -54,22 +483,43 @@ void		ServerManager::setupServers(vector<Server> & server_configs ) {
  * isShutdownRequested() method checks for the incoming signals
  */
 void	ServerManager::runServers() {
-	while (!isShutdownRequested()) {
+	startCgiPool();
+	notifyUpgradeReady();
+	while (!isShutdownRequested() && !isDrained()) {
+		Logger::flush();	// the lines of the last iteration, in one write
 		int	poll_count = poll(&_pfds[0], _pfds.size(), 1000);  // 1 second maximum time to wait
 		if (poll_count == -1) {
-			if (errno == EINTR) { // a signal occurred
-				Logger::logErrno(LOG_ERROR, "Poll error");
+			if (errno == EINTR) // a signal occurred: the signal pipe has it
 				continue;
-			}
 			Logger::logErrno(LOG_ERROR, "Poll error");
 			break;
 		}
 		if (poll_count > 0)
 			processConnections();
+		if (_reloadRequested && !isShutdownRequested() && _drainDeadline == 0) {
+			_reloadRequested = false;
+			reload();
+		}
+		if (_upgradeRequested && !isShutdownRequested()) {
+			_upgradeRequested = false;
+			startUpgrade();
+		}
+		checkUpgrade();
+		reportDrain();
 		checkTimeouts();
+		enforceMemoryBudget();
+		finishUpstreamRequests();
+		syncUpstreamPfds();
+	}
+	if (!isShutdownRequested() && isDrained()) {
+		if (!_contexts.empty())
+			Logger::log(LOG_WARNING, "Drain deadline: closing " + toString(_contexts.size()) + " connection(s)");
+		else
+			Logger::log(LOG_INFO, "Drained: every connection finished");
 	}
 	cleanup();
 	Logger::log(LOG_INFO, "Webserv stopped");
+	Logger::flush();
 }
 
 /** 
@@ -86,7 +536,20 @@ void	ServerManager::runServers() {
 */
 void	ServerManager::processConnections() {
 	for (size_t i = 0; i < _pfds.size(); ) {
-		
+		if (_pfds[i].fd == _signalPipe[0] || _pfds[i].fd == _upgradePipe) {
+			if (_pfds[i].fd == _signalPipe[0] && _pfds[i].revents)
+				handleSignals();
+			i++;	// the upgrade pipe is read by checkUpgrade()
+			continue;
+		}
+		if (_pfds[i].revents && _upstreamFds.count(_pfds[i].fd)) {
+			if (_fastcgi.owns(_pfds[i].fd))
+				_fastcgi.handleEvent(_pfds[i].fd, _pfds[i].revents);
+			else
+				_cgiPool.handleEvent(_pfds[i].fd, _pfds[i].revents);
+			i++;
+			continue;
+		}
 		if (_pfds[i].revents & POLLERR) {
 			handleErrorRevent(_pfds[i].fd, i);
 			continue;
@@ -145,12 +608,14 @@ void	ServerManager::handleNewConnection(int listener) {
 	conn.setFd(newfd);
 	conn.setClientAddress(remoteaddr);
 
+	conn.setId(++_connectionCount);
+	Metrics::counters.connectionsAccepted++;
+
 	Server*		server = _map_servers[listener];
-	_contexts.insert(std::make_pair(newfd, HttpContext(conn, *server)));
+	_contexts[newfd] = _contextPool.acquire(conn, *server);
+	_snapshotOf[newfd] = _current;
+	_current->connections++;
 
-	uint32_t	ip = ntohl(remoteaddr.sin_addr.s_addr);
-	std::string	ip_str = ipv4_to_string(ip);
-		
 	Logger::log(LOG_INFO, "New connection on socket " + toString(newfd) + " by listener " + toString(server->getListenFd()));
 	// " accepted from " + ip_str + 
 }
@@ -175,14 +640,14 @@ void	ServerManager::handleNewConnection(int listener) {
 void	ServerManager::handleClientData(size_t i) {
 	const int fd = _pfds[i].fd;
 	// Find HttpContext
-	map<int, HttpContext>::iterator it = _contexts.find(fd);
+	map<int, HttpContext*>::iterator it = _contexts.find(fd);
 	if (it == _contexts.end()) {
 		Logger::logErrno(LOG_ERROR, "No context found for fd " + toString(fd));
 		close(fd);
 		delFromPfds(i);
 		return ;
 	}
-	HttpContext& ctx = it->second;
+	HttpContext& ctx = *it->second;
 	// For correct 413 Payload Too Large page
 	if (ctx.isDraining()) {
 		char tmp[8192];
@@ -190,11 +655,13 @@ void	ServerManager::handleClientData(size_t i) {
 		for (;;) {
 			ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
 			if (n > 0) {
+				Metrics::counters.bytesReceived += n;
 				ctx.connection().updateLastActivity();
 				continue;
 			}
 			if (n == 0) {
 				Logger::log(LOG_INFO, "Peer closed during drain on fd " + toString(fd));
+				Metrics::counters.drainCloses++;
 				removeClient(fd, i);
 				return;
 			}
@@ -202,32 +669,418 @@ void	ServerManager::handleClientData(size_t i) {
 		}
 		if (ctx.hasDrainTimedOut(time(NULL), 1)) {
 			Logger::log(LOG_INFO, "Drain timeout; closing fd " + toString(fd));
+			Metrics::counters.drainCloses++;
 			removeClient(fd, i);
 		}
 		return;
 	}
 
 	ssize_t nbytes = ctx.connection().receiveData();
+	if (nbytes == 0 && (ctx.isRequestComplete() || ctx.isRequestError())) {
+		// shutdown(SHUT_WR) after the request: it still waits for the answer
+		ctx.setPeerClosed();
+		_pfds[i].events &= ~POLLIN;
+		return;
+	}
 	if (nbytes == 0) { handleClientHungup(fd, i); return; }
 	if (nbytes < 0) { handleClientError(fd, i); return; }
+	Metrics::counters.bytesReceived += nbytes;
+	processRequestData(ctx, i);
+}
 
+/**
+ * Runs the parser over what the connection has buffered and acts on the
+ * result. Also called by finishExchange() when the buffer already holds
+ * (part of) the next request.
+ */
+void	ServerManager::processRequestData(HttpContext& ctx, size_t i) {
 	ctx.requestParsingStateMachine();
+	if (ctx.isBodyStreamed()) {
+		streamRequestBody(ctx, i);
+		return;
+	}
+	if (ctx.getParserState() == HttpContext::READING_FIXED_BODY && startStreamedCgi(ctx, i))
+		return;
 	if (ctx.isRequestComplete() || ctx.isRequestError()) {
 		ctx.response().bindRequest(ctx.request());
 		if (ctx.isRequestError()) ctx.response().badRequest();
 		else ctx.response().generateResponse();
-		ctx.buildResponseString();
-		_pfds[i].events |= POLLOUT;
-		Logger::logRequest(
-			ipv4_to_string(ntohl(ctx.connection().getClientAddress().sin_addr.s_addr)),
-			ctx.request().getMethod(),
-			ctx.request().getUri(),
-			ctx.response().getStatusCode(),
-			ctx.response().getContentLength()
-		);
+		if (ctx.isRequestError() && ctx.response().getStatusCode() < METRICS_STATUS_MAX)
+			Metrics::counters.parseErrors[ctx.response().getStatusCode()]++;
+		if (ctx.response().isMetricsPending()) {
+			string	body;
+			renderMetrics(body);
+			ctx.response().serveMetrics(body);
+		}
+		if (ctx.response().isUpstreamPending()) {
+			if (!lookupCache(ctx, i))
+				submitUpstream(ctx, i);
+			return;
+		}
+		sendResponse(ctx, i);
 	}
 }
 
+// FastCGI / CGI answers later (finishUpstreamRequests); until then only
+// a hangup or an error is of interest on this socket
+void	ServerManager::submitUpstream(HttpContext& ctx, size_t i) {
+	const int		fd = _pfds[i].fd;
+	const Response&	resp = ctx.response();
+
+	ctx.markUpstreamStart();
+	if (resp.getUpstreamKind() == Response::UPSTREAM_FASTCGI)
+		_fastcgi.submit(fd, resp.getUpstreamAddress(),
+			resp.getUpstreamParams(), ctx.request().getBody());
+	else
+		_cgiPool.submit(fd, resp.getUpstreamAddress(), resp.getUpstreamScript(),
+			resp.getUpstreamEnv(), ctx.request().getBody(), true,
+			resp.getUpstreamGroup(), resp.getUpstreamLimit());
+	_pfds[i].events = 0;
+}
+
+/**
+ * CGI GETs of a location with cgi_cache_ttl. A fresh entry is answered
+ * from memory right away; on a miss the request either runs the script
+ * (returns false) or waits for the one already running for the same key.
+ */
+bool	ServerManager::lookupCache(HttpContext& ctx, size_t i) {
+	Response&	resp = ctx.response();
+
+	if (resp.getUpstreamKind() != Response::UPSTREAM_CGI)
+		return false;
+	string	key = resp.cacheKey();
+	if (key.empty())
+		return false;
+	const CachedResponse*	hit = _cache.lookup(key, time(NULL));
+	if (hit != NULL) {
+		resp.serveCached(*hit, time(NULL));
+		sendResponse(ctx, i);
+		return true;
+	}
+	if (_cache.beginFill(key, _pfds[i].fd))
+		return false;
+	_pfds[i].events = 0;
+	return true;
+}
+
+/**
+ * The script run for a cache miss is done: its answer is stored if it
+ * may be, and the requests that waited for it are answered from it. A
+ * streamed or uncacheable answer (resp NULL or a TTL of 0) lets each of
+ * them run the script itself.
+ */
+void	ServerManager::finishFill(int fd, const Response* resp) {
+	string			key;
+	vector<int>		waiters;
+	const time_t	now = time(NULL);
+
+	_cache.endFill(fd, key, waiters);
+	if (key.empty())
+		return;
+	if (resp != NULL && resp->getCgiCacheTtl() > 0)
+		_cache.store(key, resp->locationId(), resp->cacheMaxSize(), resp->getStatusCode(),
+			resp->getHeaders(), resp->getResponseBody(), now, resp->getCgiCacheTtl());
+	for (size_t w = 0; w < waiters.size(); ++w) {
+		map<int, HttpContext*>::iterator	it = _contexts.find(waiters[w]);
+		size_t							i = findPfd(waiters[w]);
+		if (it == _contexts.end() || i == _pfds.size())
+			continue;
+		const CachedResponse*	hit = _cache.lookup(key, now);
+		if (hit != NULL) {
+			it->second->response().serveCached(*hit, now);
+			sendResponse(*it->second, i);
+		} else {
+			submitUpstream(*it->second, i);
+		}
+	}
+}
+
+void	ServerManager::sendResponse(HttpContext& ctx, size_t i) {
+	ctx.buildResponseString();
+	_pfds[i].events |= POLLIN | POLLOUT;
+}
+
+/**
+ * The exchange is over: its last byte is sent, or the client is gone
+ * halfway. One REQUEST line in webserv.log and, with access_log, one in
+ * the server's own format and file. Once per response.
+ */
+void	ServerManager::logResponse(HttpContext& ctx) {
+	if (!ctx.takeLogPending())
+		return;
+	const short		status = ctx.response().getStatusCode();
+	const Location*	loc = ctx.response().getLocation();
+	if (status >= 0 && status < METRICS_STATUS_MAX)
+		Metrics::counters.responses[status]++;
+	Metrics::observe(loc ? loc->getMetricsSlot() : 0, monotonic_time() - ctx.getRequestStart());
+	Logger::logRequest(
+		ctx.connection().getClientIp(),
+		ctx.request().getMethod(),
+		ctx.request().getUri(),
+		ctx.response().getStatusCode(),
+		ctx.getBodyBytesSent()
+	);
+	const Server&	server = ctx.server();
+	if (server.getAccessLogId() != -1) {
+		_accessLine.clear();
+		server.getAccessLogFormat().format(ctx, _accessLine);
+		Logger::logAccess(server.getAccessLogId(), _accessLine);
+	}
+}
+
+/**
+ * FastCGI / CGI output and answers (or failures) of this iteration:
+ * CGI output is streamed as it comes, a finished request completes its
+ * response and switches the client to POLLOUT.
+ * Clients that went away in the meantime were cancelled in removeClient.
+ */
+void	ServerManager::finishUpstreamRequests() {
+	vector<UpstreamResult>	done;
+
+	_fastcgi.takeFinished(done);
+	_cgiPool.takeFinished(done);
+	for (size_t r = 0; r < done.size(); ++r) {
+		map<int, HttpContext*>::iterator	it = _contexts.find(done[r].clientFd);
+		size_t							i = findPfd(done[r].clientFd);
+		if (it == _contexts.end() || i == _pfds.size())
+			continue;
+		HttpContext&	ctx = *it->second;
+		if (done[r].complete)
+			ctx.markUpstreamEnd();
+		if (!done[r].complete) {
+			streamUpstreamOutput(ctx, i, done[r].output);
+		} else if (ctx.isStreaming()) {
+			endStream(ctx, i, done[r].errorCode);
+		} else {
+			ctx.response().finishUpstream(done[r].errorCode, done[r].output);
+			sendResponse(ctx, i);
+			finishFill(done[r].clientFd, &ctx.response());
+		}
+	}
+	resumeBodyReads();
+}
+
+/**
+ * More output of a CGI script or FastCGI responder. The Response holds
+ * it until the head is parsed and the body is worth streaming
+ * (Response::isCgiStreamDue); from then on it goes straight to the
+ * client. Reading the upstream pauses while the client is
+ * CGI_STREAM_BUFFER bytes behind.
+ */
+void	ServerManager::streamUpstreamOutput(HttpContext& ctx, size_t i, const string& data) {
+	if (ctx.isStreaming()) {
+		ctx.appendStreamBody(data.data(), data.size());
+		updateClientEvents(ctx, i);
+		throttleUpstream(ctx, _pfds[i].fd);
+	} else if (ctx.response().appendCgiOutput(data)) {
+		startStream(ctx, i);
+	}
+}
+
+void	ServerManager::startStream(HttpContext& ctx, size_t i) {
+	finishFill(_pfds[i].fd, NULL); // a streamed answer is not cached
+	ctx.startStreamedResponse();
+	updateClientEvents(ctx, i);
+	throttleUpstream(ctx, _pfds[i].fd);
+}
+
+void	ServerManager::throttleUpstream(const HttpContext& ctx, int fd) {
+	bool	behind = ctx.getPendingBytes() >= CGI_STREAM_BUFFER;
+
+	_cgiPool.throttle(fd, behind);
+	_fastcgi.throttle(fd, behind);
+}
+
+/**
+ * The script behind a streamed response is done. The status line went
+ * out long ago, so a failure (exit status, timeout, body shorter than
+ * its Content-Length) can only show as a connection closed early.
+ */
+void	ServerManager::endStream(HttpContext& ctx, size_t i, short errorCode) {
+	const int	fd = _pfds[i].fd;
+
+	if (errorCode != 0 || !ctx.finishStream()) {
+		Logger::log(LOG_WARNING, "CGI failed after its response started ("
+			+ toString(errorCode) + "); closing socket " + toString(fd));
+		removeClient(fd, i);
+		return;
+	}
+	if (ctx.isResponseComplete())
+		finishExchange(ctx, i); // the body ended with the script, nothing left to send
+	else
+		updateClientEvents(ctx, i);
+}
+
+/**
+ * A POST to a CGI script whose Content-Length body is still arriving:
+ * the script starts now and reads the body as it comes in
+ * (streamRequestBody), so an upload is processed while it is received
+ * and never held in full.
+ */
+bool	ServerManager::startStreamedCgi(HttpContext& ctx, size_t i) {
+	Response&	resp = ctx.response();
+
+	resp.bindRequest(ctx.request());
+	if (!resp.prepareStreamedCgi())
+		return false;
+	ctx.setBodyStreamed();
+	ctx.markUpstreamStart();
+	_cgiPool.submit(_pfds[i].fd, resp.getUpstreamAddress(), resp.getUpstreamScript(),
+		resp.getUpstreamEnv(), ctx.request().getBody(), false,
+		resp.getUpstreamGroup(), resp.getUpstreamLimit());
+	ctx.request().getBody().clear();
+	updateClientEvents(ctx, i);
+	return true;
+}
+
+// What the parser added to a streamed body goes on to the script
+void	ServerManager::streamRequestBody(HttpContext& ctx, size_t i) {
+	string&	body = ctx.request().getBody();
+
+	if (!body.empty() || ctx.isRequestComplete())
+		_cgiPool.feedBody(_pfds[i].fd, body, ctx.isRequestComplete());
+	body.clear();
+	if (ctx.isRequestComplete() && !ctx.getResponseBuffer().empty() && ctx.isResponseComplete())
+		finishExchange(ctx, i); // answered before the whole body was in
+	else
+		updateClientEvents(ctx, i);
+}
+
+/**
+ * Events of a client whose request is with a CGI script: POLLIN while a
+ * streamed body is arriving and the script keeps up with it, POLLOUT
+ * while response bytes wait. A client paused for the body is picked up
+ * again by resumeBodyReads().
+ */
+void	ServerManager::updateClientEvents(HttpContext& ctx, size_t i) {
+	const int	fd = _pfds[i].fd;
+	short		events = 0;
+
+	if (ctx.isBodyStreamed() && !ctx.isRequestComplete() && !_memoryPaused.count(fd)) {
+		if (_cgiPool.bodyBacklog(fd) < CGI_STREAM_BUFFER)
+			events |= POLLIN;
+		else
+			_bodyPaused.insert(fd);
+	}
+	if (ctx.getPendingBytes() > 0)
+		events |= POLLOUT;
+	_pfds[i].events = events;
+}
+
+void	ServerManager::resumeBodyReads() {
+	for (std::set<int>::iterator it = _bodyPaused.begin(); it != _bodyPaused.end(); ) {
+		const int	fd = *it;
+		if (_cgiPool.bodyBacklog(fd) >= CGI_STREAM_BUFFER) {
+			++it;
+			continue;
+		}
+		_bodyPaused.erase(it++);
+		map<int, HttpContext*>::iterator	ctx = _contexts.find(fd);
+		size_t							i = findPfd(fd);
+		if (ctx != _contexts.end() && i != _pfds.size())
+			updateClientEvents(*ctx->second, i);
+	}
+}
+
+/**
+ * The response is out: close, or wait for the next request. A streamed
+ * request body that is not all in yet is read (and dropped) first, the
+ * rest of it cannot be told apart from a next request otherwise.
+ */
+void	ServerManager::finishExchange(HttpContext& ctx, size_t i) {
+	const int	fd = _pfds[i].fd;
+
+	logResponse(ctx);
+	if (ctx.isBodyStreamed() && !ctx.isRequestComplete()) {
+		_pfds[i].events = POLLIN;
+		return;
+	}
+	if (ctx.isPeerClosed()) {
+		Logger::log(LOG_INFO, "Client closed its side. Closing socket " + toString(fd));
+		removeClient(fd, i);
+	} else if (ctx.request().getHeaderValue(Request::HDR_CONNECTION) == "close"
+			|| ctx.closesAfterResponse()) {
+		Logger::log(LOG_INFO, "Connection: close. Closing socket " + toString(fd));
+		removeClient(fd, i);
+	} else if (_drainDeadline != 0) {
+		Logger::log(LOG_INFO, "Server draining. Closing socket " + toString(fd));
+		removeClient(fd, i);
+	} else if (!moveToCurrentConfig(ctx, fd)) {
+		Logger::log(LOG_INFO, "Listener removed by a reload. Closing socket " + toString(fd));
+		removeClient(fd, i);
+	} else {
+		_pfds[i].events = POLLIN;
+		ctx.resetState();
+		if (!ctx.connection().getBuffer().empty())
+			processRequestData(ctx, i); // came in with the end of a streamed body
+	}
+}
+
+/**
+ * Mirrors the FastCGI client's and the CGI pool's descriptors into
+ * _pfds: new ones are added, events are refreshed, closed ones removed.
+ * Runs between two poll() calls, so no index used by
+ * processConnections() moves under it.
+ */
+void	ServerManager::syncUpstreamPfds() {
+	map<int, short>	wanted;
+
+	_fastcgi.pollEvents(wanted);
+	_cgiPool.pollEvents(wanted);
+	if (wanted.empty() && _upstreamFds.empty()) {
+		_fastcgi.reapClosed();
+		_cgiPool.reapClosed();
+		return;
+	}
+	for (size_t i = 0; i < _pfds.size(); ) {
+		if (_upstreamFds.count(_pfds[i].fd)) {
+			map<int, short>::iterator	w = wanted.find(_pfds[i].fd);
+			if (w == wanted.end()) {
+				_upstreamFds.erase(_pfds[i].fd);
+				delFromPfds(i);
+				continue;
+			}
+			_pfds[i].events = w->second;
+			wanted.erase(w);
+		}
+		i++;
+	}
+	for (map<int, short>::iterator w = wanted.begin(); w != wanted.end(); ++w) {
+		addToPfds(_pfds, w->first);
+		_pfds.back().events = w->second;
+		_upstreamFds.insert(w->first);
+	}
+	_fastcgi.reapClosed();
+	_cgiPool.reapClosed();
+}
+
+/**
+ * Every extension any location runs as CGI gets its launchers now,
+ * before the first client: see CgiPool.
+ */
+void	ServerManager::startCgiPool() {
+	std::set<string>	extensions;
+
+	for (map<int, Server*>::iterator s = _map_servers.begin(); s != _map_servers.end(); ++s) {
+		const vector<Location>&	locations = s->second->getLocations();
+		for (size_t l = 0; l < locations.size(); ++l) {
+			const map<string, string>&	cgi = locations[l].getCgi();
+			for (map<string, string>::const_iterator it = cgi.begin(); it != cgi.end(); ++it)
+				extensions.insert(it->first);
+		}
+	}
+	_cgiPool.start(extensions);
+	syncUpstreamPfds();
+}
+
+size_t	ServerManager::findPfd(int fd) const {
+	for (size_t i = 0; i < _pfds.size(); ++i) {
+		if (_pfds[i].fd == fd)
+			return i;
+	}
+	return _pfds.size();
+}
+
 /**
  * Handle POLLOUT event - send response data when socket is ready
  * 
@@ -256,22 +1109,27 @@ void	ServerManager::handleClientData(size_t i) {
  */
 void	ServerManager::handleClientWrite(size_t i) {
 	const int fd = _pfds[i].fd;
-	map<int, HttpContext>::iterator it = _contexts.find(fd);
+	map<int, HttpContext*>::iterator it = _contexts.find(fd);
 	if (it == _contexts.end()) {
 		Logger::logErrno(LOG_ERROR, "No context found for fd " + toString(fd));
 		close(fd);
 		delFromPfds(i);
 		return;
 	}
-	HttpContext& ctx = it->second;
+	HttpContext& ctx = *it->second;
 
 	const string& buffer = ctx.getResponseBuffer();
 	size_t already_sent = ctx.getBytesSent();
+	if (buffer.size() <= already_sent && ctx.isStreaming()) {
+		updateClientEvents(ctx, i); // all sent, the script is due to write more
+		return;
+	}
 	if (buffer.size() <= already_sent) {
 		//TO DO: describe: stop POLLOUT
 		_pfds[i].events &= ~POLLOUT;
 		//TO DO: describe: keep POLLIN
 		_pfds[i].events = POLLIN;
+		logResponse(ctx);
 		ctx.resetState();
 		return;
 	}
@@ -291,7 +1149,13 @@ void	ServerManager::handleClientWrite(size_t i) {
 	}
 	ctx.connection().updateLastActivity();
 	ctx.addBytesSent(static_cast<size_t>(bytes_sent));
+	Metrics::counters.bytesSent += bytes_sent;
 
+	if (ctx.isStreaming()) {
+		updateClientEvents(ctx, i);
+		throttleUpstream(ctx, fd);
+		return;
+	}
 	if (ctx.isResponseComplete()) {
 		short	statusCode = ctx.response().getStatusCode();
 		if (statusCode >= 400) {
@@ -300,16 +1164,11 @@ void	ServerManager::handleClientWrite(size_t i) {
 			// TO DO: describe: keep POLLIN
 			_pfds[i].events |= POLLIN;
 			ctx.startDraining();
+			logResponse(ctx);
 			Logger::log(LOG_INFO, "Begin draining after error response: " + toString(statusCode));
 			return;
 		}
-		if (ctx.request().getHeaderValue("connection") == "close") {
-			Logger::log(LOG_INFO, "Connection: close. Closing socket " + toString(fd));
-			removeClient(fd, i);
-		} else {
-			_pfds[i].events = POLLIN;
-			ctx.resetState();
-		}
+		finishExchange(ctx, i);
 	}
 }
 
@@ -358,14 +1217,161 @@ void	ServerManager::delFromPfds(size_t index) {
 
 /** close/erase logic */
 void	ServerManager::removeClient(int fd, size_t i) {
+	map<int, HttpContext*>::iterator	ctx = _contexts.find(fd);
+	if (ctx != _contexts.end())
+		logResponse(*ctx->second); // gone before the response was all out
+	_fastcgi.cancel(fd);
+	_cgiPool.cancel(fd);
+	_bodyPaused.erase(fd);
+	_memoryPaused.erase(fd);
 	close(fd);
-	_contexts.erase(fd);
+	Metrics::counters.connectionsClosed++;
+	if (ctx != _contexts.end()) {
+		_contextPool.release(ctx->second);
+		_contexts.erase(ctx);
+	}
+	leaveSnapshot(fd);
 	delFromPfds(i);
+
+	// it ran the script for a cache miss: the next waiter runs it now
+	int		next = _cache.leave(fd);
+	if (next != -1) {
+		map<int, HttpContext*>::iterator	it = _contexts.find(next);
+		size_t							j = findPfd(next);
+		if (it != _contexts.end() && j != _pfds.size())
+			submitUpstream(*it->second, j);
+	}
+}
+
+/**
+ * Body for a `metrics on;` location: the Metrics counters and
+ * histograms, then the gauges and counters of what ServerManager owns.
+ */
+void	ServerManager::renderMetrics(string& out) {
+	Metrics::render(out);
+	Metrics::appendHeader(out, "webserv_connections_active", "gauge", "Client connections open now.");
+	Metrics::appendSample(out, "webserv_connections_active", "", _contexts.size());
+
+	size_t	memory[MEM_STATES] = { 0 };
+	for (map<int, HttpContext*>::const_iterator it = _contexts.begin(); it != _contexts.end(); ++it)
+		memory[it->second->memoryState()] += it->second->memoryHeld();
+	Metrics::appendHeader(out, "webserv_memory_bytes", "gauge", "Bytes held by client connections, by what they are doing.");
+	for (size_t s = 0; s < MEM_STATES; ++s)
+		Metrics::appendSample(out, "webserv_memory_bytes",
+			string("state=\"") + Metrics::memoryStateName(static_cast<e_memory_state>(s)) + "\"", memory[s]);
+	Metrics::appendHeader(out, "webserv_memory_budget_bytes", "gauge", "memory_budget, 0 when not set.");
+	Metrics::appendSample(out, "webserv_memory_budget_bytes", "", _memoryBudget);
+	Metrics::appendHeader(out, "webserv_memory_paused_connections", "gauge", "Connections not read until memory is back under the budget.");
+	Metrics::appendSample(out, "webserv_memory_paused_connections", "", _memoryPaused.size());
+
+	map<string, CgiPoolStats>	pool;
+	_cgiPool.getStats(pool);
+	static const struct {
+		const char*	name;
+		const char*	type;
+		const char*	help;
+		size_t CgiPoolStats::*	field;
+	} cgi[] = {
+		{ "webserv_cgi_workers", "gauge", "CGI launchers alive.", &CgiPoolStats::workers },
+		{ "webserv_cgi_idle_workers", "gauge", "CGI launchers waiting for a script.", &CgiPoolStats::idle },
+		{ "webserv_cgi_queued", "gauge", "CGI requests waiting for a launcher.", &CgiPoolStats::queued },
+		{ "webserv_cgi_scripts_total", "counter", "CGI scripts started.", &CgiPoolStats::dispatched },
+		{ "webserv_cgi_spawns_total", "counter", "CGI launchers forked.", &CgiPoolStats::spawned },
+		{ "webserv_cgi_timeouts_total", "counter", "CGI scripts killed after CGI_TIMEOUT_SEC.", &CgiPoolStats::timeouts },
+		{ "webserv_cgi_rejected_total", "counter", "CGI requests answered 503.", &CgiPoolStats::rejected }
+	};
+	for (size_t m = 0; m < sizeof(cgi) / sizeof(cgi[0]); ++m) {
+		Metrics::appendHeader(out, cgi[m].name, cgi[m].type, cgi[m].help);
+		for (map<string, CgiPoolStats>::const_iterator it = pool.begin(); it != pool.end(); ++it)
+			Metrics::appendSample(out, cgi[m].name, "ext=\"" + it->first + "\"", it->second.*cgi[m].field);
+	}
+
+	ResponseCacheStats	cache;
+	_cache.getStats(cache);
+	static const struct {
+		const char*	name;
+		const char*	type;
+		const char*	help;
+		size_t ResponseCacheStats::*	field;
+	} cached[] = {
+		{ "webserv_cache_hits_total", "counter", "CGI answers served from the cache.", &ResponseCacheStats::hits },
+		{ "webserv_cache_misses_total", "counter", "Cache lookups that found nothing fresh.", &ResponseCacheStats::misses },
+		{ "webserv_cache_coalesced_total", "counter", "Misses that waited for another request's script.", &ResponseCacheStats::coalesced },
+		{ "webserv_cache_stores_total", "counter", "CGI answers put in the cache.", &ResponseCacheStats::stores },
+		{ "webserv_cache_evictions_total", "counter", "Entries dropped for room before they expired.", &ResponseCacheStats::evictions },
+		{ "webserv_cache_entries", "gauge", "Entries in the cache.", &ResponseCacheStats::entries },
+		{ "webserv_cache_bytes", "gauge", "Bytes held by the cache.", &ResponseCacheStats::bytes }
+	};
+	for (size_t m = 0; m < sizeof(cached) / sizeof(cached[0]); ++m) {
+		Metrics::appendHeader(out, cached[m].name, cached[m].type, cached[m].help);
+		Metrics::appendSample(out, cached[m].name, "", cache.*cached[m].field);
+	}
+
+	BufferPoolStats	buffers[POOL_CLASSES];
+	BufferPool::getStats(buffers);
+	static const struct {
+		const char*	name;
+		const char*	type;
+		const char*	help;
+		size_t BufferPoolStats::*	field;
+	} pooled[] = {
+		{ "webserv_buffer_pool_acquires_total", "counter", "I/O buffers asked for, by size class.", &BufferPoolStats::acquires },
+		{ "webserv_buffer_pool_hits_total", "counter", "I/O buffers reused from the free list.", &BufferPoolStats::hits },
+		{ "webserv_buffer_pool_releases_total", "counter", "I/O buffers given back and kept.", &BufferPoolStats::releases },
+		{ "webserv_buffer_pool_drops_total", "counter", "I/O buffers given back and freed.", &BufferPoolStats::drops },
+		{ "webserv_buffer_pool_free", "gauge", "I/O buffers in the free list.", &BufferPoolStats::free },
+		{ "webserv_buffer_pool_free_high_water", "gauge", "Most I/O buffers in the free list at once.", &BufferPoolStats::freeHighWater },
+		{ "webserv_buffer_pool_in_use", "gauge", "I/O buffers held by connections.", &BufferPoolStats::inUse },
+		{ "webserv_buffer_pool_in_use_high_water", "gauge", "Most I/O buffers held by connections at once.", &BufferPoolStats::inUseHighWater }
+	};
+	for (size_t m = 0; m < sizeof(pooled) / sizeof(pooled[0]); ++m) {
+		Metrics::appendHeader(out, pooled[m].name, pooled[m].type, pooled[m].help);
+		for (size_t c = 0; c < POOL_CLASSES; ++c)
+			Metrics::appendSample(out, pooled[m].name, "size=\"" + toString(buffers[c].size) + "\"",
+				buffers[c].*pooled[m].field);
+	}
+
+	ContextPoolStats	slots;
+	_contextPool.getStats(slots);
+	Metrics::appendHeader(out, "webserv_context_pool_acquires_total", "counter", "Connection contexts handed out.");
+	Metrics::appendSample(out, "webserv_context_pool_acquires_total", "", slots.acquires);
+	Metrics::appendHeader(out, "webserv_context_pool_reuses_total", "counter", "Connection contexts reused from a closed connection.");
+	Metrics::appendSample(out, "webserv_context_pool_reuses_total", "", slots.reuses);
+	Metrics::appendHeader(out, "webserv_context_pool_free", "gauge", "Connection contexts waiting for a connection.");
+	Metrics::appendSample(out, "webserv_context_pool_free", "", slots.free);
 }
 
 void	ServerManager::cleanup() {
 	cout << "Closing all connections..." << endl;
+	_fastcgi.closeAll();
+	_cgiPool.closeAll();
+
+	ResponseCacheStats	cache;
+	_cache.getStats(cache);
+	if (cache.hits + cache.misses > 0)
+		Logger::log(LOG_INFO, "Response cache: " + toString(cache.hits) + " hits, "
+			+ toString(cache.misses) + " misses (" + toString(cache.coalesced) + " coalesced), "
+			+ toString(cache.stores) + " stored, " + toString(cache.evictions) + " evicted");
+
+	BufferPoolStats	buffers[POOL_CLASSES];
+	BufferPool::getStats(buffers);
+	for (size_t c = 0; c < POOL_CLASSES; ++c) {
+		if (buffers[c].acquires == 0)
+			continue;
+		Logger::log(LOG_INFO, "Buffer pool " + toString(buffers[c].size / 1024) + " KB: "
+			+ toString(buffers[c].hits) + "/" + toString(buffers[c].acquires) + " reused, "
+			+ toString(buffers[c].inUseHighWater) + " in use at most, "
+			+ toString(buffers[c].freeHighWater) + " free at most");
+	}
+	ContextPoolStats	slots;
+	_contextPool.getStats(slots);
+	Logger::log(LOG_INFO, "Context pool: " + toString(slots.reuses) + "/" + toString(slots.acquires)
+		+ " connections reused a slot, " + toString(slots.inUseHighWater) + " open at most");
 	for (size_t i = 0; i < _pfds.size(); ++i) {
+		if (_upstreamFds.count(_pfds[i].fd))
+			continue;
+		if (isListener(_pfds[i].fd))
+			_map_servers[_pfds[i].fd]->releaseListenFd();	// closed here, not by its Server
 		if (close(_pfds[i].fd) == -1) {
 			Logger::logErrno(LOG_ERROR, "Error closing fd " + toString(_pfds[i].fd));
 		}
@@ -373,7 +1379,18 @@ void	ServerManager::cleanup() {
 	string message = "Cleared " + toString(_pfds.size()) + " pfds and " + toString(_contexts.size()) + " contexts";
 	Logger::log(LOG_INFO, message);
 	_pfds.clear();
+	for (map<int, HttpContext*>::iterator it = _contexts.begin(); it != _contexts.end(); ++it)
+		_contextPool.release(it->second);
 	_contexts.clear();
+	_snapshotOf.clear();
+	_map_servers.clear();
+	if (_upgradePipe != -1)
+		_upgradePipe = -1;	// in _pfds, closed above
+	if (_signalPipe[1] != -1) {
+		int	fd = _signalPipe[1];
+		_signalPipe[1] = -1;
+		close(fd);
+	}
 }
 
 /**
@@ -404,20 +1421,117 @@ void	ServerManager::checkTimeouts()
 	{
 		int	fd = _pfds[i].fd;
 		if (!isListener(fd)) {
-			map<int, HttpContext>::iterator	it = _contexts.find(fd);
+			map<int, HttpContext*>::iterator	it = _contexts.find(fd);
 
 			if (it != _contexts.end()) {
-				 if (it->second.connection().hasTimedOut(timeout)) {
+				 // not read over memory_budget: its silence is ours, not the client's
+				 if (!_memoryPaused.count(fd) && it->second->connection().hasTimedOut(timeout)) {
 					 Logger::log(LOG_INFO, "Connection timed out on socket " + toString(fd));
+					 Metrics::counters.idleTimeouts++;
 					 removeClient(fd, i);
 					 continue; 
-				 } else if ((it->second.isDraining() && it->second.hasDrainTimedOut(time(NULL), 1))) {
+				 } else if ((it->second->isDraining() && it->second->hasDrainTimedOut(time(NULL), 1))) {
 					Logger::log(LOG_INFO, "Drain timeout; closing fd " + toString(fd));
+					Metrics::counters.drainCloses++;
 					removeClient(fd, i);
 					continue;
+				} else if (it->second->response().isCgiStreamDue(time(NULL))) {
+					startStream(*it->second, i); // a slow script's body waited long enough
 				}
 			}
 		}
 		i++;
 	}
+	_fastcgi.checkTimeouts(time(NULL));
+	_cgiPool.checkTimeouts(time(NULL));
+	_cache.purgeExpired(time(NULL));
+}
+
+/**
+ * memory_budget: once per loop, the bytes all connections hold (see
+ * HttpContext::memoryHeld()) against the budget. Over it, new large
+ * bodies are answered 503 and the heaviest connections still sending
+ * their request are no longer read, until the total is back under
+ * MEMORY_RESUME_PERCENT of the budget. Responses are never held back:
+ * sending them is what frees memory.
+ */
+void	ServerManager::enforceMemoryBudget() {
+	if (_memoryBudget == 0)
+		return;
+	size_t	held = 0;
+	for (map<int, HttpContext*>::const_iterator it = _contexts.begin(); it != _contexts.end(); ++it)
+		held += it->second->memoryHeld();
+
+	if (held > _memoryBudget) {
+		HttpContext::setShedLargeBodies(true);
+		pauseHeaviest(held - _memoryBudget * MEMORY_RESUME_PERCENT / 100);
+	} else if (held < _memoryBudget * MEMORY_RESUME_PERCENT / 100) {
+		HttpContext::setShedLargeBodies(false);
+		resumeMemoryPaused();
+	}
+}
+
+/**
+ * Stops reading the connections holding the most, until they account
+ * for `excess` bytes. The request closest to complete is kept reading,
+ * or read again if it was paused, so at least one of them can finish
+ * and give its memory back.
+ */
+void	ServerManager::pauseHeaviest(size_t excess) {
+	vector<std::pair<size_t, int> >	heavy;
+	int								finisher = -1;
+	size_t							finisherLeft = 0;
+
+	for (map<int, HttpContext*>::const_iterator it = _contexts.begin(); it != _contexts.end(); ++it) {
+		const e_memory_state	state = it->second->memoryState();
+		const size_t			held = it->second->memoryHeld();
+		if ((state != MEM_HEADERS && state != MEM_BODY) || held < MEMORY_PAUSE_MIN)
+			continue;
+		if (finisher == -1 || it->second->bodyBytesLeft() < finisherLeft) {
+			finisher = it->first;
+			finisherLeft = it->second->bodyBytesLeft();
+		}
+		if (_memoryPaused.count(it->first))
+			excess -= std::min(excess, held);
+		else
+			heavy.push_back(std::make_pair(held, it->first));
+	}
+	if (finisher != -1 && _memoryPaused.count(finisher))
+		resumeRead(finisher); // all the others are paused: nothing would ever finish
+	std::sort(heavy.rbegin(), heavy.rend());
+	for (size_t h = 0; h < heavy.size() && excess > 0; ++h) {
+		size_t	i = findPfd(heavy[h].second);
+		if (heavy[h].second == finisher || i == _pfds.size())
+			continue;
+		// not read at all: whether the client is gone or only half-closed
+		// after its last byte, the read path finds out once reads resume
+		_pfds[i].events &= ~POLLIN;
+		_memoryPaused.insert(heavy[h].second);
+		Metrics::counters.memoryPauses++;
+		excess -= std::min(excess, heavy[h].first);
+		Logger::log(LOG_INFO, "Memory budget: pausing reads on socket " + toString(heavy[h].second)
+			+ " holding " + toString(heavy[h].first) + " bytes");
+	}
+}
+
+void	ServerManager::resumeMemoryPaused() {
+	std::set<int>	paused(_memoryPaused);
+
+	for (std::set<int>::iterator it = paused.begin(); it != paused.end(); ++it)
+		resumeRead(*it);
+}
+
+// One connection paused over memory_budget is read again
+void	ServerManager::resumeRead(int fd) {
+	map<int, HttpContext*>::iterator	ctx = _contexts.find(fd);
+	size_t							i = findPfd(fd);
+
+	_memoryPaused.erase(fd);
+	if (ctx == _contexts.end() || i == _pfds.size())
+		return;
+	ctx->second->connection().updateLastActivity();	// the idle timeout starts again
+	if (ctx->second->isBodyStreamed())
+		updateClientEvents(*ctx->second, i);
+	else
+		_pfds[i].events |= POLLIN;
 }
@@ -3,20 +3,45 @@
 
 #include "../../inc/Webserv.hpp"
 #include "Server.hpp"
+#include "Config.hpp"
 #include "../httpContext/Connection.hpp"
 #include "../httpContext/HttpContext.hpp"
+#include "../httpContext/ContextPool.hpp"
+#include "../cgi/FastCgiClient.hpp"
+#include "../cgi/CgiPool.hpp"
 
 #include <poll.h>
+#include <list>
+
+#define MEMORY_PAUSE_MIN 65536		// connections holding less are never paused
+#define MEMORY_RESUME_PERCENT 90	// paused reads resume under this share of memory_budget
+#define UPGRADE_DRAIN_SEC 30		// after a binary upgrade, the old server's connections get this long
+#define SHUTDOWN_TIMEOUT_SEC 10		// shutdown_timeout when not set
+#define UPGRADE_LISTEN_ENV "WEBSERV_LISTEN_FDS"		// "host:port=fd;..." handed to the new binary
+#define UPGRADE_READY_ENV "WEBSERV_UPGRADE_READY"	// pipe the new binary writes once it listens
 
 #define GREEN "\033[32m"
 #define RESET "\033[0m"
 
+// A parsed configuration and the client connections accepted under it
+struct	ConfigSnapshot {
+	Config*	config;
+	size_t	generation;		// 1 at start, +1 per reload
+	size_t	connections;
+};
+
 class	ServerManager {
 	public:
 		ServerManager();
 		~ServerManager();
 
-		void	setupServers(std::vector<Server>& server_configs);
+		void	loadConfig(const std::string& config_file);
+		void	reload();
+		void	notifySignal(int signum);
+		void	setCommandLine(char** argv);
+		void	setCgiMaxConcurrent(size_t max);
+		void	setMemoryBudget(size_t bytes);
+		void	setShutdownTimeout(size_t seconds);
 		void	runServers();
 		void	removeClient(int fd, size_t i);
 		bool	isShutdownRequested() const;
@@ -25,20 +50,84 @@ class	ServerManager {
 	private:
 		std::vector<pollfd>			_pfds;
 		std::map<int, Server*>		_map_servers;
-		std::map<int, HttpContext>	_contexts;
+		std::map<int, HttpContext*>	_contexts;		// slots of _contextPool
+		std::string					_configFile;
+		ConfigSnapshot*				_current;		// new connections get its servers
+		std::list<ConfigSnapshot*>	_retired;		// replaced, with connections still open
+		std::map<int, ConfigSnapshot*>	_snapshotOf;	// client fd -> the snapshot it was accepted under
+		int							_signalPipe[2];	// the signal handler writes, the loop reads
+		ContextPool					_contextPool;
 		volatile bool				shutdown;
+		bool						_reloadRequested;	// SIGHUP read, reload() before the next poll()
+		bool						_upgradeRequested;	// SIGUSR2 read, startUpgrade() before the next poll()
+		std::vector<std::string>	_argv;				// to exec the new binary with
+		pid_t						_upgradePid;		// the new binary, until it is up or gone
+		int							_upgradePipe;		// ... its readiness pipe, read end
+		std::vector<pid_t>			_upgradeFailed;		// new binaries that gave up, reaped once they exit
+		std::map<std::string, int>	_inherited;			// listeners from the old binary, by host:port
+		time_t						_drainDeadline;		// 0, or: not accepting, closing at this time
+		bool						_stopping;			// SIGINT/SIGTERM/SIGQUIT read: draining, a second one stops now
+		time_t						_shutdownTimeout;	// shutdown_timeout
+		size_t						_drainReported;		// connections left at the last progress line
+		time_t						_drainReportTime;	// ... and when it was logged
+		FastCgiClient				_fastcgi;
+		CgiPool						_cgiPool;
+		std::set<int>				_upstreamFds; // FastCGI sockets, CGI launchers and pipes in _pfds
+		std::set<int>				_bodyPaused;  // clients not read: their CGI is behind on the body
+		size_t						_memoryBudget;	// memory_budget, 0: no limit
+		std::set<int>				_memoryPaused;	// clients not read: over memory_budget
+		ResponseCache				_cache;
+		size_t						_connectionCount; // accepted so far, numbers the connections
+		std::string					_accessLine;      // reused for each access log line
 		
 		void	addToPfds(std::vector<pollfd>& pfds, int newfd);
 		void	delFromPfds(size_t index);
 		void	processConnections();
+		void	applyConfig(Config* config);
+		bool	moveToCurrentConfig(HttpContext& ctx, int fd);
+		void	leaveSnapshot(int fd);
+		void	openSignalPipe();
+		void	handleSignals();
+		void	takeInheritedListeners();
+		void	notifyUpgradeReady();
+		void	startUpgrade();
+		void	checkUpgrade();
+		void	stopAccepting(time_t grace);
+		bool	isDrained() const;
+		void	beginShutdown(int signum);
+		void	reportDrain();
 		void	handleNewConnection(int listener);
 		void	handleClientData(size_t i);
+		void	processRequestData(HttpContext& ctx, size_t i);
 		void	handleClientWrite(size_t i);
 		void	handleErrorRevent(int fd, size_t i);
 		void	handleClientError(int fd, size_t i);
 		void	handleClientHungup(int fd, size_t i);
 		bool	isListener(int fd);
 		void	checkTimeouts();
+		void	enforceMemoryBudget();
+		void	pauseHeaviest(size_t excess);
+		void	resumeMemoryPaused();
+		void	resumeRead(int fd);
+		void	startCgiPool();
+		void	sendResponse(HttpContext& ctx, size_t i);
+		void	submitUpstream(HttpContext& ctx, size_t i);
+		bool	lookupCache(HttpContext& ctx, size_t i);
+		void	finishFill(int fd, const Response* resp);
+		void	logResponse(HttpContext& ctx);
+		void	renderMetrics(std::string& out);
+		void	finishUpstreamRequests();
+		void	streamUpstreamOutput(HttpContext& ctx, size_t i, const std::string& data);
+		void	startStream(HttpContext& ctx, size_t i);
+		void	throttleUpstream(const HttpContext& ctx, int fd);
+		void	endStream(HttpContext& ctx, size_t i, short errorCode);
+		bool	startStreamedCgi(HttpContext& ctx, size_t i);
+		void	streamRequestBody(HttpContext& ctx, size_t i);
+		void	updateClientEvents(HttpContext& ctx, size_t i);
+		void	resumeBodyReads();
+		void	finishExchange(HttpContext& ctx, size_t i);
+		void	syncUpstreamPfds();
+		size_t	findPfd(int fd) const;
 		void	cleanup();
 };
 
@@ -23,6 +23,7 @@ const char *generateStatusMessage(short status_code)
 	case 500: return "Internal Server Error";
 	case 501: return "Not Implemented";
 	case 502: return "Bad Gateway";
+	case 503: return "Service Unavailable";
 	case 504: return "Gateway Timeout";
 	default: return "Unknown Status";
 	}
@@ -132,4 +133,24 @@ bool	is_only_digits(const std::string& str) {
             return false;
     }
     return true;
-}
\ No newline at end of file
+}
+
+// Seconds on CLOCK_MONOTONIC: durations that a clock change cannot skew
+double	monotonic_time() {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+// Decimal digits of n, without a stringstream
+void	append_number(std::string& out, size_t n) {
+	char	buf[24];
+	size_t	i = sizeof(buf);
+
+	do {
+		buf[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	out.append(buf + i, sizeof(buf) - i);
+}
@@ -26,5 +26,7 @@ std::string	toString(const T val)
 
 std::string	ipv4_to_string(uint32_t ip);
 bool		is_only_digits(const std::string& str);
+double		monotonic_time();
+void		append_number(std::string& out, size_t n);
 
 #endif
@@ -0,0 +1,51 @@
+#ifndef BENCH_HPP
+# define BENCH_HPP
+
+# include <cstdio>
+# include <ctime>
+# include <string>
+
+/**
+ * Briefly: self-contained microbenchmark helper (C++98, no deps).
+ *
+ * Bench::run() calls the functor once to warm up, then `iterations`
+ * times, and prints the mean cost per call. Functors return a size_t
+ * that is folded into a volatile sink so the work cannot be optimized
+ * away.
+ */
+class	Bench {
+
+	public:
+		static double	nowNs() {
+			struct timespec	ts;
+
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return static_cast<double>(ts.tv_sec) * 1e9 + static_cast<double>(ts.tv_nsec);
+		}
+
+		static void		consume(size_t value) {
+			static volatile size_t	sink = 0;
+			sink = sink + value;
+		}
+
+		template <typename F>
+		static double	run(const char* name, size_t iterations, F& fn) {
+			consume(fn());
+			double	start = nowNs();
+			for (size_t i = 0; i < iterations; ++i)
+				consume(fn());
+			double	nsPerOp = (nowNs() - start) / static_cast<double>(iterations);
+			std::printf("%-48s %10lu iters %12.1f ns/op\n", name,
+				static_cast<unsigned long>(iterations), nsPerOp);
+			return nsPerOp;
+		}
+
+		static void		header(const char* title) {
+			std::printf("\n== %s ==\n", title);
+		}
+
+	private:
+		Bench();
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * Heap allocations per request, phase by phase, on one keep-alive
+ * context as ServerManager drives it: parse, generateResponse() (static
+ * file, 404, CGI, redirect), buildResponseString(), resetState().
+ *
+ * Global operator new/delete are replaced in this binary to count; the
+ * figures are allocations, not bytes. Run from the repository root
+ * (files are served from www/web).
+ */
+#include "Bench.hpp"
+#include "../../src/httpContext/HttpContext.hpp"
+#include <new>
+
+using std::string;
+
+namespace {
+
+size_t	g_allocations = 0;
+
+struct	Request_ {
+	const char*	name;
+	const char*	raw;
+};
+
+const Request_	kRequests[] = {
+	{ "GET static file", "GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+		"Accept: text/html,application/xhtml+xml;q=0.9,*/*;q=0.8\r\n"
+		"Accept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\n"
+		"Connection: keep-alive\r\n\r\n" },
+	{ "GET missing (404)", "GET /no/such/page.html HTTP/1.1\r\nHost: localhost:8080\r\n"
+		"Connection: keep-alive\r\n\r\n" },
+	{ "GET CGI (env built)", "GET /cgi-bin/test.py?name=bench&n=1 HTTP/1.1\r\nHost: localhost:8080\r\n"
+		"Accept: */*\r\nConnection: keep-alive\r\n\r\n" },
+	{ "GET redirect (301)", "GET /old-page HTTP/1.1\r\nHost: localhost:8080\r\n"
+		"Connection: keep-alive\r\n\r\n" }
+};
+
+Server	makeServer() {
+	Server		server;
+	Location	root, cgi, old;
+
+	server.setPort(8080);
+	server.addServerName("localhost");
+	server.setRoot("www/web");
+	server.setClientMaxBodySize("1m");
+	server.addErrorPage(404, "www/error_pages/404.html");
+	root.setPath("/");
+	root.addAllowedMethod("GET");
+	root.setIndex("index.html");
+	cgi.setPath("/cgi-bin");
+	cgi.addAllowedMethod("GET");
+	cgi.addCgi("py", "/usr/bin/python3");
+	old.setPath("/old-page");
+	old.setReturn(301, "/new-page");
+	server.addLocation(root);
+	server.addLocation(cgi);
+	server.addLocation(old);
+	server.prepareCgiEnv();
+	return server;
+}
+
+// Allocations of each phase, summed over `rounds` requests
+struct	Phases {
+	size_t	parse, generate, build, reset;
+	Phases() : parse(0), generate(0), build(0), reset(0) { }
+};
+
+void	oneRequest(HttpContext& ctx, const string& raw, Phases& p) {
+	size_t	mark = g_allocations;
+
+	string&	buf = ctx.connection().getBuffer();
+
+	BufferPool::reserve(buf, buf.size() + raw.size());	// as Connection::receiveData()
+	buf.append(raw);
+	ctx.requestParsingStateMachine();
+	p.parse += g_allocations - mark;
+	mark = g_allocations;
+	ctx.response().bindRequest(ctx.request());
+	ctx.response().generateResponse();
+	p.generate += g_allocations - mark;
+	mark = g_allocations;
+	ctx.buildResponseString();
+	p.build += g_allocations - mark;
+	mark = g_allocations;
+	ctx.resetState();
+	p.reset += g_allocations - mark;
+}
+
+struct	Timed {
+	HttpContext&	ctx;
+	const string&	raw;
+	Phases			phases;
+	Timed(HttpContext& c, const string& r) : ctx(c), raw(r) { }
+
+	size_t	operator()() {
+		oneRequest(ctx, raw, phases);
+		return ctx.getBytesSent();
+	}
+};
+
+} // namespace
+
+void*	operator new(size_t size) throw(std::bad_alloc) {
+	g_allocations++;
+	void*	p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void	operator delete(void* p) throw() {
+	std::free(p);
+}
+
+int	main() {
+	const size_t	rounds = 1000;
+	Server			server = makeServer();
+	Connection		conn;
+	HttpContext		ctx(conn, server);
+
+	Bench::header("heap allocations per request, warm keep-alive context");
+	std::printf("%-24s %8s %8s %8s %8s %8s\n", "", "parse", "generate", "build", "reset", "total");
+	for (size_t r = 0; r < sizeof(kRequests) / sizeof(kRequests[0]); ++r) {
+		const string	raw = kRequests[r].raw;
+		Phases			warm, p;
+
+		oneRequest(ctx, raw, warm);
+		for (size_t i = 0; i < rounds; ++i)
+			oneRequest(ctx, raw, p);
+		if (ctx.response().getStatusCode() == 0) {
+			std::printf("%s: no response\n", kRequests[r].name);
+			return 1;
+		}
+		std::printf("%-24s %8.1f %8.1f %8.1f %8.1f %8.1f\n", kRequests[r].name,
+			p.parse / double(rounds), p.generate / double(rounds), p.build / double(rounds),
+			p.reset / double(rounds), (p.parse + p.generate + p.build + p.reset) / double(rounds));
+	}
+
+	Bench::header("whole request, parse to reset");
+	for (size_t r = 0; r < sizeof(kRequests) / sizeof(kRequests[0]); ++r) {
+		const string	raw = kRequests[r].raw;
+		Timed			timed(ctx, raw);
+		Bench::run(kRequests[r].name, 20000, timed);
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * Delimiter scanning: std::string::find against ByteScanner at every
+ * level the CPU supports, on a large header block, on a header block
+ * that arrives in small recv() pieces and on many small pipelined
+ * requests sitting in one buffer.
+ */
+#include "Bench.hpp"
+#include "../../src/httpContext/ByteScanner.hpp"
+
+using std::string;
+
+namespace {
+
+string	largeHeaderBlock() {
+	string	block("GET /gallery/gallery.html HTTP/1.1\r\nHost: localhost:8080\r\n");
+
+	for (int i = 0; block.size() < 12000; ++i) {
+		char	line[160];
+		std::snprintf(line, sizeof(line),
+			"X-Forwarded-Trace-%d: 8f14e45fceea167a5a36dedd4bea2543;sampled=1;parent=%08x\r\n", i, i * 7919);
+		block += line;
+	}
+	return block + "\r\n";
+}
+
+string	pipelinedRequests(size_t count) {
+	string	buf;
+
+	for (size_t i = 0; i < count; ++i)
+		buf += "GET / HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n";
+	return buf;
+}
+
+struct	FindHeaderEnd {
+	const string&	buf;
+	bool			simd;
+	FindHeaderEnd(const string& b, bool s) : buf(b), simd(s) { }
+
+	size_t	operator()() {
+		if (!simd)
+			return buf.find("\r\n\r\n");
+		return ByteScanner::findHeaderEnd(buf.data(), buf.size(), 0);
+	}
+};
+
+/*
+ * The header block grows by `piece` bytes per recv(). Previously the
+ * size check and the parser each searched the whole buffer again; now
+ * the search resumes where the last one stopped (HttpContext::_scanFrom).
+ */
+struct	IncrementalArrival {
+	const string&	full;
+	size_t			piece;
+	bool			resume;
+	string			buf;
+	IncrementalArrival(const string& f, size_t p, bool r) : full(f), piece(p), resume(r) { }
+
+	size_t	operator()() {
+		size_t	from = 0;
+		size_t	pos = string::npos;
+
+		buf.clear();
+		for (size_t off = 0; off < full.size() && pos == string::npos; off += piece) {
+			buf.append(full, off, piece);
+			if (!resume) {
+				pos = buf.find("\r\n\r\n");	// checkHeaderBlockSize
+				pos = buf.find("\r\n\r\n");	// findAndParseHeaders
+				continue;
+			}
+			pos = ByteScanner::findHeaderEnd(buf.data(), buf.size(), from);
+			from = (pos != string::npos) ? pos : (buf.size() > 3 ? buf.size() - 3 : 0);
+		}
+		return pos;
+	}
+};
+
+struct	WalkLines {
+	const string&	buf;
+	bool			simd;
+	WalkLines(const string& b, bool s) : buf(b), simd(s) { }
+
+	size_t	operator()() {
+		size_t	lines = 0;
+		size_t	pos = 0;
+
+		while (true) {
+			size_t	end = simd ? ByteScanner::findCRLF(buf.data(), buf.size(), pos)
+							: buf.find("\r\n", pos);
+			if (end == string::npos)
+				break;
+			pos = end + 2;
+			++lines;
+		}
+		return lines;
+	}
+};
+
+struct	ValidateNames {
+	const string&	names;
+	explicit ValidateNames(const string& n) : names(n) { }
+
+	size_t	operator()() {
+		return ByteScanner::findInvalidTokenChar(names.data(), names.size(), 0);
+	}
+};
+
+void	runLevels(const char* what, FindHeaderEnd& fn) {
+	for (int lvl = ByteScanner::SCALAR; lvl <= ByteScanner::AVX2; ++lvl) {
+		if (!ByteScanner::setLevel(static_cast<ByteScanner::e_level>(lvl)))
+			continue;
+		char	name[64];
+		std::snprintf(name, sizeof(name), "%s (%s)", what,
+			ByteScanner::levelName(static_cast<ByteScanner::e_level>(lvl)));
+		Bench::run(name, 20000, fn);
+	}
+}
+
+} // namespace
+
+int	main() {
+	const ByteScanner::e_level	best = ByteScanner::level();
+	string						block = largeHeaderBlock();
+	string						pipelined = pipelinedRequests(1000);
+	string						names;
+
+	for (int i = 0; i < 256; ++i)
+		names += "Sec-Fetch-Mode";
+
+	std::printf("scanner level: %s\n", ByteScanner::levelName(best));
+
+	Bench::header("find end of a 12 KB header block");
+	FindHeaderEnd	stdFind(block, false);
+	FindHeaderEnd	scanFind(block, true);
+	double			before = Bench::run("std::string::find (previous)", 20000, stdFind);
+	runLevels("ByteScanner::findHeaderEnd", scanFind);
+	ByteScanner::setLevel(best);
+	std::printf("speedup: %.2fx\n", before / Bench::run("ByteScanner::findHeaderEnd", 20000, scanFind));
+
+	Bench::header("12 KB header block arriving in 256 byte reads");
+	IncrementalArrival	rescan(block, 256, false);
+	IncrementalArrival	resume(block, 256, true);
+	before = Bench::run("rescan from 0, twice per read (previous)", 2000, rescan);
+	std::printf("speedup: %.2fx\n", before / Bench::run("resumed ByteScanner search", 2000, resume));
+
+	Bench::header("1000 pipelined requests, walk every CRLF");
+	WalkLines	stdWalk(pipelined, false);
+	WalkLines	scanWalk(pipelined, true);
+	before = Bench::run("std::string::find (previous)", 2000, stdWalk);
+	std::printf("speedup: %.2fx\n", before / Bench::run("ByteScanner::findCRLF", 2000, scanWalk));
+
+	Bench::header("token check over 3.5 KB of header names");
+	ValidateNames	validate(names);
+	for (int lvl = ByteScanner::SCALAR; lvl <= ByteScanner::AVX2; ++lvl) {
+		if (!ByteScanner::setLevel(static_cast<ByteScanner::e_level>(lvl)))
+			continue;
+		Bench::run(ByteScanner::levelName(static_cast<ByteScanner::e_level>(lvl)), 20000, validate);
+	}
+	ByteScanner::setLevel(best);
+	return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * Starting a CGI script: fork() + execve() (previous CgiHandler) against
+ * posix_spawn() (CgiPool's launchers), from a small process and from one
+ * with a large, touched heap like a busy server. Also the environment:
+ * std::map + one new[] per variable (previous getEnvArray) against the
+ * precomputed per-location block plus the per-request variables.
+ */
+#include "Bench.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using std::string;
+
+extern char**	environ;
+
+namespace {
+
+const char*	g_argv[] = { "/bin/true", NULL };
+
+struct	ForkExec {
+	size_t	operator()() {
+		pid_t	pid = fork();
+		if (pid == 0) {
+			execve(g_argv[0], const_cast<char**>(g_argv), environ);
+			_exit(127);
+		}
+		int	status;
+		waitpid(pid, &status, 0);
+		return static_cast<size_t>(status);
+	}
+};
+
+struct	PosixSpawn {
+	size_t	operator()() {
+		pid_t	pid;
+		int		status = 0;
+		if (posix_spawn(&pid, g_argv[0], NULL, NULL, const_cast<char**>(g_argv), environ) == 0)
+			waitpid(pid, &status, 0);
+		return static_cast<size_t>(status);
+	}
+};
+
+const char*	g_vars[][2] = {
+	{ "GATEWAY_INTERFACE", "CGI/1.1" }, { "SERVER_SOFTWARE", "webserv/1.0" },
+	{ "REDIRECT_STATUS", "200" }, { "SERVER_NAME", "www.example.com" },
+	{ "SERVER_PORT", "8080" }, { "DOCUMENT_ROOT", "www/web" },
+	{ "REQUEST_METHOD", "GET" }, { "SCRIPT_FILENAME", "www/web/cgi-bin/test.py" },
+	{ "SERVER_PROTOCOL", "HTTP/1.1" }, { "SCRIPT_NAME", "/cgi-bin/test.py" },
+	{ "PATH_INFO", "/cgi-bin/test.py" }, { "QUERY_STRING", "name=John&age=25" },
+	{ "HTTP_HOST", "localhost:8080" }, { "HTTP_USER_AGENT", "Mozilla/5.0 (X11; Linux x86_64)" },
+	{ "HTTP_ACCEPT", "text/html,application/xhtml+xml" }, { "HTTP_ACCEPT_LANGUAGE", "en-US,en;q=0.5" },
+	{ "HTTP_ACCEPT_ENCODING", "gzip, deflate" }, { "HTTP_CONNECTION", "keep-alive" },
+	{ "HTTP_COOKIE", "session=8f14e45fceea167a5a36dedd4bea2543" }
+};
+const size_t	g_varCount = sizeof(g_vars) / sizeof(g_vars[0]);
+const size_t	g_staticCount = 6;
+
+// previous: setupEnv() into a map, getEnvArray(), freeEnvArray()
+struct	MapEnv {
+	size_t	operator()() {
+		std::map<string, string>	env;
+		for (size_t i = 0; i < g_varCount; ++i)
+			env[g_vars[i][0]] = g_vars[i][1];
+		char**	arr = new char*[env.size() + 1];
+		size_t	n = 0;
+		for (std::map<string, string>::const_iterator it = env.begin(); it != env.end(); ++it) {
+			string	element = it->first + "=" + it->second;
+			arr[n] = new char[element.size() + 1];
+			std::strcpy(arr[n++], element.c_str());
+		}
+		arr[n] = NULL;
+		size_t	len = std::strlen(arr[0]);
+		for (size_t i = 0; arr[i]; ++i)
+			delete[] arr[i];
+		delete[] arr;
+		return len;
+	}
+};
+
+// now: static block copied, request variables appended, envp points into it
+struct	BlockEnv {
+	string				staticBlock;
+	std::vector<char*>	envp;
+	BlockEnv() {
+		for (size_t i = 0; i < g_staticCount; ++i)
+			staticBlock.append(g_vars[i][0]).append("=").append(g_vars[i][1]).push_back('\0');
+	}
+	size_t	operator()() {
+		string	block;
+		block.reserve(staticBlock.size() + 512);
+		block += staticBlock;
+		for (size_t i = g_staticCount; i < g_varCount; ++i)
+			block.append(g_vars[i][0]).append("=").append(g_vars[i][1]).push_back('\0');
+		envp.clear();
+		for (size_t i = 0; i < block.size(); i += std::strlen(&block[i]) + 1)
+			envp.push_back(&block[i]);
+		envp.push_back(NULL);
+		return envp.size();
+	}
+};
+
+void	spawnRound(const char* label) {
+	ForkExec	forkExec;
+	PosixSpawn	spawn;
+	char		name[96];
+
+	std::snprintf(name, sizeof(name), "fork+execve, %s (previous)", label);
+	double	before = Bench::run(name, 300, forkExec);
+	std::snprintf(name, sizeof(name), "posix_spawn, %s", label);
+	std::printf("speedup: %.2fx\n", before / Bench::run(name, 300, spawn));
+}
+
+} // namespace
+
+int	main() {
+	Bench::header("spawn /bin/true and wait, small process (CGI launcher)");
+	spawnRound("small process");
+
+	// a server that grew: 512 MB of touched heap (connection tables,
+	// caches) in 4 KB pages, as a fragmented malloc heap ends up
+	size_t	heapSize = 512UL * 1024 * 1024;
+	void*	heap = mmap(NULL, heapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (heap == MAP_FAILED)
+		return 1;
+	madvise(heap, heapSize, MADV_NOHUGEPAGE);
+	std::memset(heap, 1, heapSize);
+	Bench::header("spawn /bin/true and wait, 512 MB server heap");
+	spawnRound("512 MB heap");
+	munmap(heap, heapSize);
+
+	Bench::header("CGI environment of one request (19 variables)");
+	MapEnv		mapEnv;
+	BlockEnv	blockEnv;
+	double		before = Bench::run("map + new[] per variable (previous)", 200000, mapEnv);
+	std::printf("speedup: %.2fx\n", before / Bench::run("precomputed block + request variables", 200000, blockEnv));
+	return 0;
+}
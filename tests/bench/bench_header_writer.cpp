@@ -0,0 +1,88 @@
+/**
+ * Response head serialization: the previous std::ostringstream path
+ * against HeaderWriter appending into a reused buffer.
+ */
+#include "Bench.hpp"
+#include "../../src/response/HeaderWriter.hpp"
+
+using std::string;
+
+namespace {
+
+struct	Fixture {
+	HeaderMap					headers;
+	string						body;
+	string						version;
+	string						reason;
+	string						connection;
+	short						status;
+
+	Fixture() : body(2048, 'x'), version("HTTP/1.1"), reason("OK"),
+		connection("keep-alive"), status(200) {
+		headers["Content-Type"] = "text/html";
+		headers["Location"] = "/index.html";
+	}
+};
+
+// the former HttpContext::buildResponseString()
+struct	OstreamPath {
+	const Fixture&	f;
+	explicit OstreamPath(const Fixture& fx) : f(fx) { }
+
+	size_t	operator()() {
+		std::ostringstream	oss;
+
+		oss << f.version << " " << f.status << " " << f.reason << "\r\n";
+		oss << "Connection: " << f.connection << "\r\n";
+		oss << "Content-Length: " << f.body.size() << "\r\n";
+		for (HeaderMap::const_iterator it = f.headers.begin(); it != f.headers.end(); ++it)
+			oss << it->first << ": " << it->second << "\r\n";
+		oss << "\r\n";
+		oss << f.body;
+		string	out = oss.str();
+		return out.size();
+	}
+};
+
+struct	WriterPath {
+	const Fixture&	f;
+	string			out; // survives between calls like HttpContext::_responseBuffer
+	explicit WriterPath(const Fixture& fx) : f(fx) { }
+
+	size_t	operator()() {
+		out.clear();
+		out.reserve(HeaderWriter::estimateHeadSize(f.headers) + f.body.size());
+		HeaderWriter::appendStatusLine(out, f.version, f.status, f.reason);
+		HeaderWriter::appendDateAndServer(out);
+		HeaderWriter::appendHeader(out, HeaderWriter::CONNECTION, f.connection);
+		HeaderWriter::appendSizeHeader(out, HeaderWriter::CONTENT_LENGTH, f.body.size());
+		for (HeaderMap::const_iterator it = f.headers.begin(); it != f.headers.end(); ++it)
+			HeaderWriter::appendHeader(out, it->first, it->second);
+		HeaderWriter::appendEndOfHead(out);
+		out.append(f.body);
+		return out.size();
+	}
+};
+
+struct	DatePath {
+	size_t	operator()() {
+		return HeaderWriter::dateAndServer(time(NULL)).size();
+	}
+};
+
+} // namespace
+
+int	main() {
+	const size_t	iterations = 200000;
+	Fixture			fixture;
+	OstreamPath		ostreamPath(fixture);
+	WriterPath		writerPath(fixture);
+	DatePath		datePath;
+
+	Bench::header("response head serialization (2 KB body)");
+	double	before = Bench::run("ostringstream (previous)", iterations, ostreamPath);
+	double	after = Bench::run("HeaderWriter (reused buffer)", iterations, writerPath);
+	Bench::run("cached Date/Server lookup", iterations, datePath);
+	std::printf("speedup: %.2fx\n", before / after);
+	return 0;
+}
@@ -0,0 +1,240 @@
+/**
+ * The per-request hot path, one function at a time, as it is now: a
+ * baseline for changes to the parser, the response builder and location
+ * matching. Inputs are fixed so runs on different commits compare.
+ *
+ * requestParsingStateMachine() is fed the same requests whole and split
+ * into reads of a few bytes, the way slow clients and fuzzers send them.
+ * matchPathToLocation() runs against 1 to 1000 locations.
+ */
+#include "Bench.hpp"
+#include "../../src/httpContext/HttpContext.hpp"
+
+using std::string;
+
+namespace {
+
+const char*	kGetRequest =
+	"GET /images/gallery/photo.png HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+	"Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Connection: keep-alive\r\n"
+	"Referer: http://localhost:8080/gallery/\r\n"
+	"Sec-Fetch-Dest: image\r\n"
+	"Sec-Fetch-Mode: no-cors\r\n"
+	"Sec-Fetch-Site: same-origin\r\n"
+	"\r\n";
+
+// 16 KB in 1 KB chunks
+string	chunkedPost() {
+	string	req = "POST /upload/data.txt HTTP/1.1\r\n"
+		"Host: localhost:8080\r\n"
+		"Content-Type: text/plain\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n";
+	for (int i = 0; i < 16; ++i)
+		req += "400\r\n" + string(1024, 'a' + i) + "\r\n";
+	return req + "0\r\n\r\n";
+}
+
+Server	makeServer(size_t locations) {
+	Server	server;
+
+	server.setPort(8080);
+	server.addServerName("localhost");
+	server.setClientMaxBodySize("1m");
+	for (size_t i = 0; i < locations; ++i) {
+		Location	loc;
+		loc.setPath(i == 0 ? "/" : "/section" + toString(i));
+		server.addLocation(loc);
+	}
+	return server;
+}
+
+struct	RequestLine {
+	const string&	data;
+	size_t			len;
+	explicit RequestLine(const string& d) : data(d), len(d.find("\r\n")) { }
+
+	size_t	operator()() {
+		Request	req;
+		return HttpParser::parseRequestLine(data.data(), len, req) + req.getUri().size();
+	}
+};
+
+struct	Headers {
+	const string&	data;
+	size_t			start, len;
+	explicit Headers(const string& d) : data(d), start(d.find("\r\n") + 2),
+		len(d.find("\r\n\r\n") - start) { }
+
+	size_t	operator()() {
+		Request	req;
+		return HttpParser::parseHeaders(data.data() + start, len, req);
+	}
+};
+
+struct	HexSize {
+	const char*	sizes[4];
+	HexSize() {
+		sizes[0] = "0";
+		sizes[1] = "400";
+		sizes[2] = "1fffe";
+		sizes[3] = "FFFFFFF";
+	}
+
+	size_t	operator()() {
+		size_t	total = 0, out;
+		for (size_t i = 0; i < 4; ++i) {
+			HttpParser::cpp98_hexaStrToInt(sizes[i], out);
+			total += out;
+		}
+		return total;
+	}
+};
+
+struct	Multipart {
+	string	body, boundary;
+	explicit Multipart(size_t size) : boundary("----WebKitFormBoundary7MA4YWxkTrZu0gW") {
+		body = "--" + boundary + "\r\n"
+			"Content-Disposition: form-data; name=\"file\"; filename=\"photo.png\"\r\n"
+			"Content-Type: image/png\r\n\r\n" + string(size, 'p') + "\r\n--" + boundary + "--\r\n";
+	}
+
+	size_t	operator()() {
+		string	filename, data;
+		HttpParser::parseMultipartData(body, boundary, filename, data);
+		return data.size();
+	}
+};
+
+// One request through a keep-alive context, `split` bytes per read (0: whole)
+struct	StateMachine {
+	HttpContext&	ctx;
+	const string&	request;
+	size_t			split;
+	StateMachine(HttpContext& c, const string& r, size_t s) : ctx(c), request(r), split(s) { }
+
+	size_t	operator()() {
+		string&	buf = ctx.connection().getBuffer();
+		size_t	step = split ? split : request.size();
+
+		for (size_t off = 0; off < request.size(); off += step) {
+			buf.append(request, off, step);
+			ctx.requestParsingStateMachine();
+		}
+		size_t	done = ctx.isRequestComplete();
+		ctx.resetState();
+		return done;
+	}
+};
+
+struct	BuildResponse {
+	HttpContext&	ctx;
+	explicit BuildResponse(HttpContext& c) : ctx(c) { }
+
+	size_t	operator()() {
+		ctx.buildResponseString();
+		return ctx.getResponseBuffer().size();
+	}
+};
+
+struct	MatchLocation {
+	Response&	response;
+	explicit MatchLocation(Response& r) : response(r) { }
+
+	size_t	operator()() {
+		return response.matchPathToLocation() != NULL;
+	}
+};
+
+struct	MimeType {
+	const char*	paths[6];
+	MimeType() {
+		paths[0] = "/index.html";
+		paths[1] = "/images/photo.PNG";
+		paths[2] = "/static/app.js";
+		paths[3] = "/favicon.ico";
+		paths[4] = "/download/archive.tar.gz";
+		paths[5] = "/README";
+	}
+
+	size_t	operator()() {
+		size_t	total = 0;
+		for (size_t i = 0; i < 6; ++i)
+			total += Response::getMimeType(paths[i]).size();
+		return total;
+	}
+};
+
+} // namespace
+
+int	main() {
+	const string	get = kGetRequest;
+	const string	post = chunkedPost();
+
+	Bench::header("HttpParser on a 600 byte browser request");
+	RequestLine		requestLine(get);
+	Headers			headers(get);
+	HexSize			hex;
+	Bench::run("parseRequestLine", 1000000, requestLine);
+	Bench::run("parseHeaders (10 fields)", 500000, headers);
+	Bench::run("cpp98_hexaStrToInt x4", 1000000, hex);
+
+	Bench::header("parseMultipartData");
+	Multipart		small(1024), large(512 * 1024);
+	Bench::run("1 KB file part", 200000, small);
+	Bench::run("512 KB file part", 2000, large);
+
+	Bench::header("requestParsingStateMachine, one request per call");
+	Server			server = makeServer(2);
+	Connection		conn;
+	HttpContext		ctx(conn, server);
+	const size_t	splits[] = { 0, 1460, 64, 7, 1 };
+	for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+		string			name = splits[i] ? toString(splits[i]) + " byte reads" : "whole";
+		StateMachine	getReq(ctx, get, splits[i]);
+		StateMachine	postReq(ctx, post, splits[i]);
+		size_t			iterations = splits[i] == 1 ? 2000 : 50000;
+		if (!getReq() || !postReq()) {
+			std::printf("request not complete with %s\n", name.c_str());
+			return 1;
+		}
+		Bench::run(("GET, " + name).c_str(), iterations, getReq);
+		Bench::run(("16 KB chunked POST, " + name).c_str(), iterations / 10, postReq);
+	}
+
+	Bench::header("buildResponseString");
+	const size_t	bodies[] = { 0, 2048, 65536 };
+	for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); ++i) {
+		ctx.connection().getBuffer() = get;
+		ctx.requestParsingStateMachine();
+		ctx.response().bindRequest(ctx.request());
+		ctx.response().fillResponse(200, string(bodies[i], 'b'));
+		BuildResponse	build(ctx);
+		Bench::run((toString(bodies[i]) + " byte body").c_str(), 200000, build);
+		ctx.resetState();
+	}
+
+	Bench::header("matchPathToLocation, deepest URI matches the last location");
+	const size_t	counts[] = { 1, 10, 100, 1000 };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+		Server		many = makeServer(counts[i]);
+		Request		req;
+		string		line = "GET /section" + toString(counts[i] - 1) + "/page.html HTTP/1.1";
+		HttpParser::parseRequestLine(line, req);
+		Response	response(many);
+		response.bindRequest(req);
+		MatchLocation	match(response);
+		Bench::run((toString(counts[i]) + " locations").c_str(), counts[i] >= 1000 ? 20000 : 500000, match);
+	}
+
+	Bench::header("getMimeType");
+	MimeType		mime;
+	Bench::run("6 paths", 1000000, mime);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Access log lines: the previous ofstream/cout path (std::endl, one
+ * write per line and output) against Logger's buffer, flushed every
+ * 64 lines like a busy poll() iteration. Both write to a file in /tmp
+ * and to a console that is /dev/null while they run.
+ */
+#include "Bench.hpp"
+#include "../../src/logger/Logger.hpp"
+#include <fcntl.h>
+
+using std::string;
+
+namespace {
+
+const char*	kFile = "/tmp/webserv_bench.log";
+
+// the former Logger::logRequest()
+struct	OstreamPath {
+	std::ofstream	file;
+	explicit OstreamPath(const char* path) : file(path, std::ios::app) { }
+
+	size_t	operator()() {
+		std::time_t	now = std::time(0);
+		char		buf[80];
+		std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+		std::stringstream	ss;
+		ss << "[" << string(buf) << "] [REQUEST] " << "127.0.0.1" << " - "
+		   << "\"" << "GET" << " " << "/index.html" << "\" "
+		   << GREEN << 200 << RESET << " " << "- " << 1024 << " bytes sent";
+		string	line = ss.str();
+		file << line << std::endl;
+		std::cout << BLUE << line << RESET << std::endl;
+		return line.size();
+	}
+};
+
+struct	LoggerPath {
+	size_t	n;
+	LoggerPath() : n(0) { }
+
+	size_t	operator()() {
+		Logger::logRequest("127.0.0.1", "GET", "/index.html", 200, 1024);
+		if (++n % 64 == 0)
+			Logger::flush();
+		return n;
+	}
+};
+
+// Bench::run() with the console muted; the result is printed afterwards
+template <typename F>
+double	muted(size_t iterations, F& fn) {
+	int		console = dup(STDOUT_FILENO);
+	int		devnull = open("/dev/null", O_WRONLY);
+
+	std::cout.flush();
+	dup2(devnull, STDOUT_FILENO);
+	fn();
+	double	start = Bench::nowNs();
+	for (size_t i = 0; i < iterations; ++i)
+		Bench::consume(fn());
+	double	nsPerOp = (Bench::nowNs() - start) / static_cast<double>(iterations);
+	std::cout.flush();
+	Logger::flush();
+	dup2(console, STDOUT_FILENO);
+	close(console);
+	close(devnull);
+	return nsPerOp;
+}
+
+} // namespace
+
+int	main() {
+	const size_t	iterations = 200000;
+
+	unlink(kFile);
+	Logger::init(kFile);
+	OstreamPath		ostreamPath(kFile);
+	LoggerPath		loggerPath;
+
+	Bench::header("request log line (file + console)");
+	double	before = muted(iterations, ostreamPath);
+	double	after = muted(iterations, loggerPath);
+	std::printf("%-48s %10lu iters %12.1f ns/op\n", "ofstream + cout, endl (previous)",
+		static_cast<unsigned long>(iterations), before);
+	std::printf("%-48s %10lu iters %12.1f ns/op\n", "Logger buffer, flush per 64 lines",
+		static_cast<unsigned long>(iterations), after);
+	std::printf("speedup: %.2fx\n", before / after);
+	unlink(kFile);
+	return 0;
+}
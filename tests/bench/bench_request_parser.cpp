@@ -0,0 +1,224 @@
+/**
+ * Request line + header parsing: the previous istringstream/getline/map
+ * parser against the span parser, on header sets captured from common
+ * clients. Also reports heap allocations per request, and the cost of
+ * the header lookups a request goes through after parsing.
+ */
+#include "Bench.hpp"
+#include "../../src/httpContext/HttpParser.hpp"
+
+#include <new>
+#include <cstdlib>
+
+using std::string;
+
+// the counting operator new below pairs with free(); GCC cannot see that
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+# pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static size_t	g_allocations = 0;
+
+void*	operator new(size_t size) throw(std::bad_alloc) {
+	++g_allocations;
+	void*	p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void	operator delete(void* p) throw() {
+	std::free(p);
+}
+
+namespace {
+
+const char*	g_chrome =
+	"GET /gallery/gallery.html?page=2 HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"Connection: keep-alive\r\n"
+	"sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+	"sec-ch-ua-mobile: ?0\r\n"
+	"sec-ch-ua-platform: \"Linux\"\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+	"Sec-Fetch-Site: same-origin\r\n"
+	"Sec-Fetch-Mode: navigate\r\n"
+	"Sec-Fetch-User: ?1\r\n"
+	"Sec-Fetch-Dest: document\r\n"
+	"Referer: http://localhost:8080/index.html\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Accept-Language: en-US,en;q=0.9,uk;q=0.8\r\n"
+	"Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; _ga=GA1.1.1234567890.1700000000\r\n"
+	"\r\n";
+
+const char*	g_firefox =
+	"GET /about HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"DNT: 1\r\n"
+	"Connection: keep-alive\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"Sec-Fetch-Dest: document\r\n"
+	"Sec-Fetch-Mode: navigate\r\n"
+	"Sec-Fetch-Site: none\r\n"
+	"Sec-Fetch-User: ?1\r\n"
+	"Priority: u=1\r\n"
+	"\r\n";
+
+const char*	g_curl =
+	"GET / HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"User-Agent: curl/8.5.0\r\n"
+	"Accept: */*\r\n"
+	"\r\n";
+
+// the parser before spans, kept here as the baseline
+bool	legacyParseRequestLine(const string& line, string& method, string& uri, string& version) {
+	std::istringstream	iss(line);
+	if (!(iss >> method >> uri >> version) || !iss.eof())
+		return false;
+	return true;
+}
+
+bool	legacyParseHeaders(const string& block, std::map<string, string>& headers) {
+	std::istringstream	iss(block);
+	string				line;
+
+	while (std::getline(iss, line)) {
+		if (!line.empty() && line[line.length() - 1] == '\r')
+			line.erase(line.length() - 1);
+		if (line.empty())
+			continue;
+		size_t	pos_colon = line.find(':');
+		if (pos_colon == string::npos)
+			return false;
+		string	name = line.substr(0, pos_colon);
+		string	value = line.substr(pos_colon + 1);
+		size_t	start = name.find_first_not_of(" \t");
+		if (start != string::npos)
+			name = name.substr(start);
+		size_t	end = name.find_last_not_of(" \t");
+		if (end != string::npos)
+			name = name.substr(0, end + 1);
+		for (size_t i = 0; i < name.length(); ++i)
+			name[i] = std::tolower(name[i]);
+		start = value.find_first_not_of(" \t");
+		if (start != string::npos)
+			value = value.substr(start);
+		headers[name] = value;
+	}
+	return true;
+}
+
+// what HttpContext did: substr the line and the block out of the buffer
+struct	LegacyParse {
+	string	raw;
+	explicit LegacyParse(const char* r) : raw(r) { }
+
+	size_t	operator()() {
+		string						method, uri, version;
+		std::map<string, string>	headers;
+		size_t						lineEnd = raw.find("\r\n");
+		size_t						headEnd = raw.find("\r\n\r\n");
+		string						line = raw.substr(0, lineEnd);
+		string						block = raw.substr(lineEnd + 2, headEnd - lineEnd - 2);
+
+		legacyParseRequestLine(line, method, uri, version);
+		legacyParseHeaders(block, headers);
+		return headers.size() + headers["connection"].size();
+	}
+};
+
+struct	SpanParse {
+	string	raw;
+	Request	req;
+	explicit SpanParse(const char* r) : raw(r) { }
+
+	size_t	operator()() {
+		size_t	lineEnd = raw.find("\r\n");
+		size_t	headEnd = raw.find("\r\n\r\n");
+
+		req = Request();
+		HttpParser::parseRequestLine(raw.data(), lineEnd, req);
+		HttpParser::parseHeaders(raw.data() + lineEnd + 2, headEnd - lineEnd - 2, req);
+		return req.getHeaderFields().size() + req.getHeaderValue("connection").size();
+	}
+};
+
+// the lookups done per request: body detection, keep-alive, Response, CGI
+struct	MapLookups {
+	std::map<string, string>	headers;
+	explicit MapLookups(const char* raw) {
+		string	block(raw);
+		legacyParseHeaders(block.substr(block.find("\r\n") + 2), headers);
+	}
+
+	size_t	operator()() {
+		static const string	names[] = { "transfer-encoding", "content-length",
+			"connection", "content-type", "connection", "referer" };
+		size_t				found = 0;
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+			std::map<string, string>::const_iterator	it = headers.find(names[i]);
+			if (it != headers.end())
+				found += it->second.size();
+		}
+		return found;
+	}
+};
+
+struct	KnownLookups {
+	SpanParse	parsed;
+	explicit KnownLookups(const char* raw) : parsed(raw) { parsed(); }
+
+	size_t	operator()() {
+		static const Request::KnownHeader	ids[] = { Request::HDR_TRANSFER_ENCODING,
+			Request::HDR_CONTENT_LENGTH, Request::HDR_CONNECTION, Request::HDR_CONTENT_TYPE,
+			Request::HDR_CONNECTION, Request::HDR_REFERER };
+		size_t								found = 0;
+		for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); ++i)
+			found += parsed.req.getHeaderValue(ids[i]).size();
+		return found;
+	}
+};
+
+template <typename F>
+double	allocationsPerCall(F& fn) {
+	const size_t	calls = 1000;
+	fn();
+	size_t			before = g_allocations;
+	for (size_t i = 0; i < calls; ++i)
+		fn();
+	return static_cast<double>(g_allocations - before) / calls;
+}
+
+void	compare(const char* title, const char* raw) {
+	const size_t	iterations = 100000;
+	LegacyParse		legacy(raw);
+	SpanParse		spans(raw);
+
+	Bench::header(title);
+	double	before = Bench::run("istringstream + map (previous)", iterations, legacy);
+	double	after = Bench::run("span parser", iterations, spans);
+	std::printf("speedup: %.2fx, allocations/request: %.1f -> %.1f\n", before / after,
+		allocationsPerCall(legacy), allocationsPerCall(spans));
+
+	MapLookups		mapLookups(raw);
+	KnownLookups	knownLookups(raw);
+	before = Bench::run("6 lookups, std::map (previous)", iterations, mapLookups);
+	after = Bench::run("6 lookups, KnownHeader table", iterations, knownLookups);
+	std::printf("speedup: %.2fx\n", before / after);
+}
+
+} // namespace
+
+int	main() {
+	compare("Chrome navigation (16 headers)", g_chrome);
+	compare("Firefox navigation (13 headers)", g_firefox);
+	compare("curl (3 headers)", g_curl);
+	return 0;
+}
@@ -0,0 +1,742 @@
+/**
+ * Load generator for a running webserv (configs/default.conf by default).
+ *
+ * Closed loop: each of `connections` clients sends a request, waits for
+ * the whole response and sends the next one, for `duration` seconds per
+ * scenario. One thread, epoll, non-blocking sockets, so the client costs
+ * little next to the server it measures. Latency runs from the first
+ * byte sent (from connect() without keep-alive) to the last byte read.
+ *
+ * The server's CPU time and RSS come from /proc/<pid> (the webserv whose
+ * parent is not a webserv, i.e. not a CGI launcher, unless --pid says).
+ * Results go to stdout, or --out, as JSON; a summary goes to stderr.
+ *
+ *   make loadgen && ./webserv configs/default.conf &
+ *   ./build/bench/loadgen --label $(git rev-parse --short HEAD) --out before.json
+ */
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace {
+
+const size_t	kLargeFileSize = 4 * 1024 * 1024;
+const size_t	kUploadSize = 64 * 1024;
+const size_t	kUploadChunk = 16 * 1024;
+const double	kRequestTimeout = 10.0;
+const double	kSampleEvery = 0.1;
+
+double	now() {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+struct	Options {
+	string	host;
+	int		port;
+	double	duration;
+	int		pid;
+	string	www;
+	string	only;
+	string	label;
+	string	out;
+	size_t	idle;
+
+	Options() : host("127.0.0.1"), port(8080), duration(5), pid(0), www("www"), idle(10000) { }
+};
+
+enum	e_body { BODY_NONE, BODY_CHUNKED, BODY_MULTIPART };
+
+struct	Scenario {
+	const char*	name;
+	const char*	method;
+	const char*	path;
+	int			connections;
+	bool		keepAlive;
+	e_body		body;
+	bool		idle;		// hold Options::idle silent connections meanwhile
+};
+
+const Scenario	kScenarios[] = {
+	{ "static_small", "GET", "/index.html", 64, true, BODY_NONE, false },
+	{ "static_small_close", "GET", "/index.html", 64, false, BODY_NONE, false },
+	{ "static_large", "GET", "/bench-large.bin", 8, true, BODY_NONE, false },
+	{ "upload_chunked", "POST", "/uploaded_images/bench-chunked.txt", 16, true, BODY_CHUNKED, false },
+	{ "upload_multipart", "POST", "/uploaded_images/", 16, true, BODY_MULTIPART, false },
+	{ "cgi", "GET", "/cgi-bin/test.py", 16, true, BODY_NONE, false },
+	{ "idle_10k", "GET", "/index.html", 64, true, BODY_NONE, true }
+};
+
+/**
+ * Just enough HTTP/1.1 response framing to know where a response ends:
+ * Content-Length, chunked or until close. Bodies are counted, not kept.
+ */
+class	ResponseParser {
+
+	public:
+		ResponseParser() { reset(); }
+
+		void	reset() {
+			_state = HEAD;
+			_head.clear();
+			_line.clear();
+			_remaining = 0;
+			status = 0;
+			serverCloses = false;
+			failed = false;
+		}
+
+		bool	done() const { return _state == DONE; }
+		bool	untilClose() const { return _state == BODY_EOF; }
+
+		// Returns true once the response is complete
+		bool	feed(const char* data, size_t n) {
+			size_t	i = 0;
+
+			while (i < n && _state != DONE && !failed) {
+				if (_state == HEAD) {
+					size_t	before = _head.size();
+					_head.append(data + i, n - i);
+					size_t	end = _head.find("\r\n\r\n", before < 3 ? 0 : before - 3);
+					if (end == string::npos) {
+						failed = _head.size() > 65536;
+						i = n;
+						continue;
+					}
+					i += end + 4 - before;
+					_head.resize(end + 4);
+					parseHead();
+				} else if (_state == BODY_LENGTH || _state == CHUNK_DATA) {
+					size_t	take = std::min(_remaining, n - i);
+					i += take;
+					_remaining -= take;
+					if (_remaining == 0)
+						_state = _state == BODY_LENGTH ? DONE : CHUNK_CRLF;
+				} else if (_state == BODY_EOF) {
+					i = n;
+				} else {
+					const char*	nl = static_cast<const char*>(std::memchr(data + i, '\n', n - i));
+					size_t		len = nl ? nl - (data + i) + 1 : n - i;
+					_line.append(data + i, len);
+					i += len;
+					if (nl)
+						endLine();
+				}
+			}
+			return _state == DONE;
+		}
+
+		int		status;
+		bool	serverCloses;
+		bool	failed;
+
+	private:
+		enum	e_state { HEAD, BODY_LENGTH, BODY_EOF, CHUNK_SIZE, CHUNK_DATA, CHUNK_CRLF,
+					TRAILER, DONE };
+
+		void	parseHead() {
+			std::istringstream	in(_head);
+			string				line, version;
+			bool				chunked = false;
+			long				length = -1;
+
+			std::getline(in, line);
+			std::istringstream	first(line);
+			first >> version >> status;
+			while (std::getline(in, line) && line != "\r") {
+				size_t	colon = line.find(':');
+				if (colon == string::npos)
+					continue;
+				string	name = line.substr(0, colon);
+				string	value = line.substr(colon + 1);
+				for (size_t c = 0; c < name.size(); ++c)
+					name[c] = std::tolower(static_cast<unsigned char>(name[c]));
+				for (size_t c = 0; c < value.size(); ++c)
+					value[c] = std::tolower(static_cast<unsigned char>(value[c]));
+				if (name == "content-length")
+					length = std::atol(value.c_str());
+				else if (name == "transfer-encoding")
+					chunked = value.find("chunked") != string::npos;
+				else if (name == "connection")
+					serverCloses = value.find("close") != string::npos;
+			}
+			if (status < 200 || status == 204 || status == 304 || length == 0)
+				_state = DONE;
+			else if (chunked)
+				_state = CHUNK_SIZE;
+			else if (length > 0) {
+				_remaining = static_cast<size_t>(length);
+				_state = BODY_LENGTH;
+			} else
+				_state = BODY_EOF;
+		}
+
+		void	endLine() {
+			if (_state == CHUNK_SIZE) {
+				_remaining = std::strtoul(_line.c_str(), NULL, 16);
+				_state = _remaining ? CHUNK_DATA : TRAILER;
+			} else if (_state == CHUNK_CRLF)
+				_state = CHUNK_SIZE;
+			else if (_state == TRAILER && (_line == "\r\n" || _line == "\n"))
+				_state = DONE;
+			_line.clear();
+		}
+
+		e_state	_state;
+		string	_head;
+		string	_line;
+		size_t	_remaining;
+};
+
+struct	ServerSample {
+	double	cpuSec;
+	long	rssKb;
+};
+
+bool	sampleServer(int pid, ServerSample& out) {
+	char	path[64];
+	string	line;
+
+	std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	std::ifstream	stat(path);
+	if (!std::getline(stat, line))
+		return false;
+	size_t	paren = line.rfind(')');
+	std::istringstream	fields(line.substr(paren + 2));
+	string				skip;
+	unsigned long		utime = 0, stime = 0;
+	for (int f = 3; f < 14; ++f)	// state .. cmajflt
+		fields >> skip;
+	fields >> utime >> stime;
+	out.cpuSec = static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+
+	std::snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	std::ifstream	status(path);
+	out.rssKb = 0;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmRSS:") == 0)
+			out.rssKb = std::atol(line.c_str() + 6);
+	}
+	return true;
+}
+
+// The webserv process that is not a child of another webserv
+int		findServerPid() {
+	std::map<int, int>	ppids;
+	DIR*				proc = opendir("/proc");
+	struct dirent*		entry;
+
+	if (!proc)
+		return 0;
+	while ((entry = readdir(proc)) != NULL) {
+		int		pid = std::atoi(entry->d_name);
+		if (pid <= 0)
+			continue;
+		string	path = string("/proc/") + entry->d_name + "/stat";
+		std::ifstream	stat(path.c_str());
+		string			line;
+		if (!std::getline(stat, line) || line.find("(webserv)") == string::npos)
+			continue;
+		std::istringstream	fields(line.substr(line.rfind(')') + 2));
+		string				state;
+		int					ppid = 0;
+		fields >> state >> ppid;
+		ppids[pid] = ppid;
+	}
+	closedir(proc);
+	for (std::map<int, int>::iterator it = ppids.begin(); it != ppids.end(); ++it) {
+		if (ppids.find(it->second) == ppids.end())
+			return it->first;
+	}
+	return 0;
+}
+
+struct	Result {
+	const Scenario*			scenario;
+	double					elapsed;
+	size_t					errors;
+	size_t					bytesIn;
+	std::vector<double>		latencies;	// seconds, one per completed request
+	std::map<int, size_t>	statuses;
+	ServerSample			start, end;
+	long					rssPeakKb;
+	size_t					idleOpen;	// established before the run, still open after it
+	double					idleRampUp;
+
+	double	percentile(double q) const {
+		if (latencies.empty())
+			return 0;
+		size_t	i = static_cast<size_t>(q * latencies.size());
+		return latencies[std::min(i, latencies.size() - 1)];
+	}
+};
+
+class	LoadGen {
+
+	public:
+		LoadGen(const Options& opt) : _opt(opt), _epoll(epoll_create(1)), _pid(opt.pid) {
+			std::memset(&_addr, 0, sizeof(_addr));
+			_addr.sin_family = AF_INET;
+			_addr.sin_port = htons(opt.port);
+			inet_pton(AF_INET, opt.host.c_str(), &_addr.sin_addr);
+			if (!_pid)
+				_pid = findServerPid();
+		}
+
+		~LoadGen() { close(_epoll); }
+
+		int		pid() const { return _pid; }
+
+		void	run(const Scenario& sc, Result& res);
+
+	private:
+		enum	e_state { CONNECTING, SENDING, READING };
+
+		struct	Client {
+			int				fd;
+			e_state			state;
+			size_t			sent;
+			double			started;
+			ResponseParser	parser;
+		};
+
+		int		openSocket() {
+			int		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			int		one = 1;
+
+			if (fd == -1)
+				return -1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			if (connect(fd, reinterpret_cast<const sockaddr*>(&_addr), sizeof(_addr)) == -1
+					&& errno != EINPROGRESS) {
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+
+		void	watch(Client& c, int op, unsigned events) {
+			struct epoll_event	ev;
+
+			ev.events = events;
+			ev.data.ptr = &c;
+			epoll_ctl(_epoll, op, c.fd, &ev);
+		}
+
+		void	startRequest(Client& c) {
+			if (c.fd == -1) {
+				c.fd = openSocket();
+				c.started = now();
+				c.state = CONNECTING;
+				if (c.fd == -1) {
+					_res->errors++;
+					return;
+				}
+				watch(c, EPOLL_CTL_ADD, EPOLLOUT);
+				return;
+			}
+			c.started = now();
+			c.state = SENDING;
+			c.sent = 0;
+			c.parser.reset();
+			send(c);
+		}
+
+		void	drop(Client& c) {
+			if (c.fd != -1)
+				close(c.fd);
+			c.fd = -1;
+		}
+
+		void	fail(Client& c) {
+			_res->errors++;
+			drop(c);
+			if (_running)
+				startRequest(c);
+		}
+
+		void	send(Client& c) {
+			while (c.sent < _request.size()) {
+				ssize_t	n = ::send(c.fd, _request.data() + c.sent, _request.size() - c.sent, MSG_NOSIGNAL);
+				if (n > 0) {
+					c.sent += n;
+					continue;
+				}
+				if (n == -1 && errno == EAGAIN) {
+					watch(c, EPOLL_CTL_MOD, EPOLLOUT);
+					return;
+				}
+				fail(c);
+				return;
+			}
+			c.state = READING;
+			watch(c, EPOLL_CTL_MOD, EPOLLIN);
+		}
+
+		void	complete(Client& c) {
+			_res->latencies.push_back(now() - c.started);
+			_res->statuses[c.parser.status]++;
+			if (!_sc->keepAlive || c.parser.serverCloses)
+				drop(c);
+			if (_running)
+				startRequest(c);
+		}
+
+		void	read(Client& c) {
+			char	buf[65536];
+
+			for (;;) {
+				ssize_t	n = recv(c.fd, buf, sizeof(buf), 0);
+				if (n > 0) {
+					_res->bytesIn += n;
+					if (c.parser.feed(buf, n)) {
+						complete(c);
+						return;
+					}
+					if (c.parser.failed) {
+						fail(c);
+						return;
+					}
+					continue;
+				}
+				if (n == -1 && errno == EAGAIN)
+					return;
+				if (n == 0 && c.parser.untilClose()) {
+					drop(c);
+					complete(c);
+					return;
+				}
+				fail(c);
+				return;
+			}
+		}
+
+		void	handle(Client& c, unsigned events) {
+			if (c.state == CONNECTING) {
+				int			err = 0;
+				socklen_t	len = sizeof(err);
+				getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+				if (err || (events & EPOLLERR)) {
+					fail(c);
+					return;
+				}
+				c.state = SENDING;
+				c.sent = 0;
+				c.parser.reset();
+				send(c);
+			} else if (c.state == SENDING)
+				send(c);
+			else
+				read(c);
+		}
+
+		void	buildRequest(const Scenario& sc);
+		void	openIdle(std::vector<int>& fds, Result& res);
+
+		const Options&		_opt;
+		int					_epoll;
+		int					_pid;
+		sockaddr_in			_addr;
+		string				_request;
+		const Scenario*		_sc;
+		Result*				_res;
+		bool				_running;
+};
+
+void	LoadGen::buildRequest(const Scenario& sc) {
+	std::ostringstream	req;
+	string				payload(kUploadSize, 'x');
+
+	req << sc.method << " " << sc.path << " HTTP/1.1\r\n"
+		<< "Host: " << _opt.host << ":" << _opt.port << "\r\n"
+		<< "User-Agent: webserv-loadgen\r\n"
+		<< "Connection: " << (sc.keepAlive ? "keep-alive" : "close") << "\r\n";
+	if (sc.body == BODY_CHUNKED) {
+		req << "Content-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n";
+		for (size_t off = 0; off < payload.size(); off += kUploadChunk)
+			req << std::hex << kUploadChunk << std::dec << "\r\n"
+				<< payload.substr(off, kUploadChunk) << "\r\n";
+		req << "0\r\n\r\n";
+	} else if (sc.body == BODY_MULTIPART) {
+		const string	boundary = "loadgen-boundary";
+		string			body = "--" + boundary + "\r\n"
+			"Content-Disposition: form-data; name=\"file\"; filename=\"bench-multipart.png\"\r\n"
+			"Content-Type: image/png\r\n\r\n" + payload + "\r\n--" + boundary + "--\r\n";
+		req << "Content-Type: multipart/form-data; boundary=" << boundary << "\r\n"
+			<< "Content-Length: " << body.size() << "\r\n\r\n" << body;
+	} else
+		req << "\r\n";
+	_request = req.str();
+}
+
+/**
+ * Opens Options::idle connections that never send anything, a few
+ * hundred connects in flight at a time, and waits until they are
+ * established (or 60 s).
+ */
+void	LoadGen::openIdle(std::vector<int>& fds, Result& res) {
+	const size_t	inFlight = 256;
+	int				ep = epoll_create(1);
+	size_t			pending = 0;
+	double			start = now();
+	struct epoll_event	events[256];
+
+	while ((fds.size() < _opt.idle || pending) && now() - start < 60) {
+		while (fds.size() < _opt.idle && pending < inFlight) {
+			int		fd = openSocket();
+			if (fd == -1)
+				break;
+			struct epoll_event	ev;
+			ev.events = EPOLLOUT;
+			ev.data.fd = fd;
+			epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+			fds.push_back(fd);
+			pending++;
+		}
+		int		n = epoll_wait(ep, events, 256, 100);
+		for (int i = 0; i < n; ++i) {
+			int			err = 0;
+			socklen_t	len = sizeof(err);
+			getsockopt(events[i].data.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			epoll_ctl(ep, EPOLL_CTL_DEL, events[i].data.fd, NULL);
+			pending--;
+			if (err)
+				res.errors++;
+		}
+		if (n == 0 && fds.size() < _opt.idle && pending == 0)
+			break;	// out of fds
+	}
+	close(ep);
+	res.idleRampUp = now() - start;
+}
+
+void	LoadGen::run(const Scenario& sc, Result& res) {
+	std::vector<int>	idle;
+	std::vector<Client>	clients(sc.connections);
+	struct epoll_event	events[256];
+
+	buildRequest(sc);
+	_sc = &sc;
+	_res = &res;
+	res.scenario = &sc;
+	res.errors = 0;
+	res.bytesIn = 0;
+	res.idleOpen = 0;
+	res.idleRampUp = 0;
+	if (sc.idle)
+		openIdle(idle, res);
+
+	sampleServer(_pid, res.start);
+	res.rssPeakKb = res.start.rssKb;
+	_running = true;
+	for (size_t i = 0; i < clients.size(); ++i) {
+		clients[i].fd = -1;
+		startRequest(clients[i]);
+	}
+	double	begin = now();
+	double	lastSample = begin;
+	double	deadline = begin + _opt.duration;
+	while (now() < deadline) {
+		int		n = epoll_wait(_epoll, events, 256, 50);
+		for (int i = 0; i < n; ++i)
+			handle(*static_cast<Client*>(events[i].data.ptr), events[i].events);
+		double	t = now();
+		for (size_t i = 0; i < clients.size(); ++i) {
+			if (clients[i].fd != -1 && t - clients[i].started > kRequestTimeout)
+				fail(clients[i]);
+			else if (clients[i].fd == -1)
+				startRequest(clients[i]);	// connect() failed, try again
+		}
+		if (t - lastSample >= kSampleEvery) {
+			ServerSample	s;
+			if (sampleServer(_pid, s))
+				res.rssPeakKb = std::max(res.rssPeakKb, s.rssKb);
+			lastSample = t;
+		}
+	}
+	_running = false;
+	res.elapsed = now() - begin;
+	sampleServer(_pid, res.end);
+	res.rssPeakKb = std::max(res.rssPeakKb, res.end.rssKb);
+	for (size_t i = 0; i < clients.size(); ++i)
+		drop(clients[i]);
+
+	for (size_t i = 0; i < idle.size(); ++i) {
+		char	c;
+		if (recv(idle[i], &c, 1, MSG_DONTWAIT) == -1 && errno == EAGAIN)
+			res.idleOpen++;
+		close(idle[i]);
+	}
+	std::sort(res.latencies.begin(), res.latencies.end());
+}
+
+void	writeJson(std::ostream& out, const Options& opt, int pid, const std::vector<Result>& results) {
+	out << "{\n  \"label\": \"" << opt.label << "\",\n"
+		<< "  \"target\": \"" << opt.host << ":" << opt.port << "\",\n"
+		<< "  \"server_pid\": " << pid << ",\n"
+		<< "  \"duration_s\": " << opt.duration << ",\n"
+		<< "  \"scenarios\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result&	r = results[i];
+		size_t			done = r.latencies.size();
+		double			mean = 0;
+		for (size_t l = 0; l < done; ++l)
+			mean += r.latencies[l];
+		mean = done ? mean / done : 0;
+
+		out << (i ? ",\n" : "\n") << "    {\n"
+			<< "      \"name\": \"" << r.scenario->name << "\",\n"
+			<< "      \"connections\": " << r.scenario->connections << ",\n"
+			<< "      \"keep_alive\": " << (r.scenario->keepAlive ? "true" : "false") << ",\n"
+			<< "      \"requests\": " << done << ",\n"
+			<< "      \"errors\": " << r.errors << ",\n"
+			<< "      \"statuses\": {";
+		for (std::map<int, size_t>::const_iterator it = r.statuses.begin(); it != r.statuses.end(); ++it)
+			out << (it == r.statuses.begin() ? "" : ", ") << "\"" << it->first << "\": " << it->second;
+		out << "},\n"
+			<< "      \"req_per_s\": " << done / r.elapsed << ",\n"
+			<< "      \"mb_per_s\": " << r.bytesIn / r.elapsed / 1e6 << ",\n"
+			<< "      \"latency_ms\": {\"mean\": " << mean * 1e3
+			<< ", \"p50\": " << r.percentile(0.5) * 1e3
+			<< ", \"p99\": " << r.percentile(0.99) * 1e3
+			<< ", \"p999\": " << r.percentile(0.999) * 1e3
+			<< ", \"max\": " << (done ? r.latencies.back() * 1e3 : 0) << "},\n"
+			<< "      \"server\": {\"cpu_pct\": " << (r.end.cpuSec - r.start.cpuSec) / r.elapsed * 100
+			<< ", \"rss_kb_start\": " << r.start.rssKb
+			<< ", \"rss_kb_peak\": " << r.rssPeakKb
+			<< ", \"rss_kb_end\": " << r.end.rssKb << "}";
+		if (r.scenario->idle)
+			out << ",\n      \"idle\": {\"requested\": " << opt.idle
+				<< ", \"open\": " << r.idleOpen
+				<< ", \"ramp_up_s\": " << r.idleRampUp << "}";
+		out << "\n    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+void	writeSummary(const Result& r) {
+	size_t	done = r.latencies.size();
+
+	std::fprintf(stderr, "%-20s %9.0f req/s  p50 %8.3f  p99 %8.3f  p999 %8.3f ms  "
+		"%5lu err  cpu %5.1f%%  rss %ld kB\n", r.scenario->name, done / r.elapsed,
+		r.percentile(0.5) * 1e3, r.percentile(0.99) * 1e3, r.percentile(0.999) * 1e3,
+		static_cast<unsigned long>(r.errors),
+		(r.end.cpuSec - r.start.cpuSec) / r.elapsed * 100, r.rssPeakKb);
+}
+
+// Files the scenarios need or leave behind, relative to --www
+void	prepareFiles(const Options& opt) {
+	string			path = opt.www + "/web/bench-large.bin";
+	std::ofstream	large(path.c_str(), std::ios::binary);
+	string			block(65536, 'L');
+
+	for (size_t n = 0; n < kLargeFileSize; n += block.size())
+		large << block;
+}
+
+// Multipart uploads are saved as <timestamp>_bench-multipart.png
+void	removeFiles(const Options& opt) {
+	const string	uploads = opt.www + "/uploaded_images/";
+	const string	suffix = "_bench-multipart.png";
+	DIR*			dir = opendir(uploads.c_str());
+	struct dirent*	entry;
+
+	unlink((opt.www + "/web/bench-large.bin").c_str());
+	unlink((uploads + "bench-chunked.txt").c_str());
+	while (dir && (entry = readdir(dir)) != NULL) {
+		string	name = entry->d_name;
+		if (name.size() > suffix.size()
+				&& name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+			unlink((uploads + name).c_str());
+	}
+	if (dir)
+		closedir(dir);
+}
+
+int		usage(const char* argv0) {
+	std::fprintf(stderr, "usage: %s [--host ip] [--port n] [--duration s] [--pid n]\n"
+		"  [--www dir] [--idle n] [--scenario name] [--label text] [--out file.json]\n"
+		"scenarios:", argv0);
+	for (size_t i = 0; i < sizeof(kScenarios) / sizeof(kScenarios[0]); ++i)
+		std::fprintf(stderr, " %s", kScenarios[i].name);
+	std::fprintf(stderr, "\n");
+	return 2;
+}
+
+}
+
+int		main(int argc, char** argv) {
+	Options	opt;
+
+	for (int i = 1; i < argc; ++i) {
+		string	arg = argv[i];
+		if (i + 1 >= argc)
+			return usage(argv[0]);
+		string	value = argv[++i];
+		if (arg == "--host") opt.host = value;
+		else if (arg == "--port") opt.port = std::atoi(value.c_str());
+		else if (arg == "--duration") opt.duration = std::atof(value.c_str());
+		else if (arg == "--pid") opt.pid = std::atoi(value.c_str());
+		else if (arg == "--www") opt.www = value;
+		else if (arg == "--idle") opt.idle = std::atol(value.c_str());
+		else if (arg == "--scenario") opt.only = value;
+		else if (arg == "--label") opt.label = value;
+		else if (arg == "--out") opt.out = value;
+		else return usage(argv[0]);
+	}
+
+	// Room for the idle connections
+	struct rlimit	rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	LoadGen				gen(opt);
+	std::vector<Result>	results;
+	if (!gen.pid())
+		std::fprintf(stderr, "webserv process not found, server CPU/RSS will be 0 (--pid)\n");
+	prepareFiles(opt);
+	for (size_t i = 0; i < sizeof(kScenarios) / sizeof(kScenarios[0]); ++i) {
+		if (!opt.only.empty() && opt.only != kScenarios[i].name)
+			continue;
+		results.push_back(Result());
+		gen.run(kScenarios[i], results.back());
+		writeSummary(results.back());
+	}
+	removeFiles(opt);
+	if (results.empty())
+		return usage(argv[0]);
+
+	if (opt.out.empty())
+		writeJson(std::cout, opt, gen.pid(), results);
+	else {
+		std::ofstream	out(opt.out.c_str());
+		writeJson(out, opt, gen.pid(), results);
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Minimal FastCGI responder used by test_fastcgi.py.
+
+Listens on a unix socket, serves every connection in its own thread and
+keeps it open when the web server sets FCGI_KEEP_CONN. The answer echoes
+what the responder saw, so the test can check params, body and which
+connection served the request:
+
+    pid=<pid> conn=<n> method=<REQUEST_METHOD> script=<SCRIPT_NAME>
+    query=<QUERY_STRING> body=<stdin>
+
+Paths ending in /missing answer "Status: 404 Not Found", /slow sleeps
+for a second before answering, /stream answers 4 pieces of 32 KB
+("0..." to "3..."), one per second, each in its own STDOUT record.
+
+Usage: python3 tests/fastcgi_responder.py /tmp/webserv_fcgi.sock
+"""
+
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_KEEP_CONN = 1
+
+conn_counter = [0]
+counter_lock = threading.Lock()
+
+
+def read_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def read_record(sock):
+    header = read_exact(sock, 8)
+    if header is None:
+        return None
+    _, rtype, req_id, clen, plen, _ = struct.unpack("!BBHHBB", header)
+    content = read_exact(sock, clen + plen)
+    if content is None:
+        return None
+    return rtype, req_id, content[:clen]
+
+
+def write_record(sock, rtype, req_id, content):
+    for off in range(0, max(len(content), 1), 65535):
+        part = content[off:off + 65535]
+        pad = (8 - len(part) % 8) % 8
+        sock.sendall(struct.pack("!BBHHBB", 1, rtype, req_id, len(part), pad, 0)
+                     + part + b"\0" * pad)
+
+
+def parse_params(data):
+    params = {}
+    i = 0
+    while i < len(data):
+        lens = []
+        for _ in range(2):
+            if data[i] & 0x80:
+                lens.append(struct.unpack("!I", data[i:i + 4])[0] & 0x7FFFFFFF)
+                i += 4
+            else:
+                lens.append(data[i])
+                i += 1
+        name = data[i:i + lens[0]].decode()
+        i += lens[0]
+        params[name] = data[i:i + lens[1]].decode(errors="replace")
+        i += lens[1]
+    return params
+
+
+def serve(sock):
+    with counter_lock:
+        conn_counter[0] += 1
+        conn_id = conn_counter[0]
+    keep = True
+    while keep:
+        rec = read_record(sock)
+        if rec is None:
+            break
+        rtype, req_id, content = rec
+        if rtype != FCGI_BEGIN_REQUEST:
+            continue
+        keep = bool(content[2] & FCGI_KEEP_CONN)
+        params_raw, body = b"", b""
+        while True:
+            rec = read_record(sock)
+            if rec is None:
+                sock.close()
+                return
+            rtype, _, content = rec
+            if rtype == FCGI_PARAMS:
+                params_raw += content
+            elif rtype == FCGI_STDIN:
+                if not content:
+                    break
+                body += content
+        params = parse_params(params_raw)
+        script = params.get("SCRIPT_NAME", "")
+        if script.endswith("/stream"):
+            write_record(sock, FCGI_STDOUT, req_id, b"Content-Type: text/plain\r\n\r\n")
+            for i in range(4):
+                if i:
+                    time.sleep(1)
+                write_record(sock, FCGI_STDOUT, req_id, str(i).encode() * 32768)
+            write_record(sock, FCGI_STDOUT, req_id, b"")
+            write_record(sock, FCGI_END_REQUEST, req_id, struct.pack("!IB3x", 0, 0))
+            continue
+        if script.endswith("/slow"):
+            time.sleep(1)
+        status = "Status: 404 Not Found\r\n" if script.endswith("/missing") else ""
+        text = "pid=%d conn=%d method=%s script=%s query=%s body=%s" % (
+            os.getpid(), conn_id, params.get("REQUEST_METHOD", ""), script,
+            params.get("QUERY_STRING", ""), body.decode(errors="replace"))
+        out = (status + "Content-Type: text/plain\r\n\r\n" + text).encode()
+        write_record(sock, FCGI_STDOUT, req_id, out)
+        write_record(sock, FCGI_STDOUT, req_id, b"")
+        write_record(sock, FCGI_END_REQUEST, req_id, struct.pack("!IB3x", 0, 0))
+    sock.close()
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "/tmp/webserv_fcgi.sock"
+    if os.path.exists(path):
+        os.unlink(path)
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(path)
+    server.listen(64)
+    while True:
+        client, _ = server.accept()
+        threading.Thread(target=serve, args=(client,), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
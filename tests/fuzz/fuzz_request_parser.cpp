@@ -0,0 +1,316 @@
+/**
+ * Fuzz target for HttpContext::requestParsingStateMachine().
+ *
+ * Each input is a byte stream a client could send on one keep-alive
+ * connection. It is fed in reads split at pseudo-random points (seeded
+ * from the input, so a crash replays), and after every read:
+ *
+ * - the connection buffer stays bounded by the parser's limits
+ *   (MAX_REQUEST_LINE_SIZE, MAX_HEADER_BLOCK_SIZE, MAX_CHUNK_LINE_SIZE)
+ *   plus the read just appended, and bodies by client_max_body_size;
+ * - the parse state only moves forward within a request, and the parser
+ *   never waits for a request line or header block it already holds;
+ * - a complete request is reset with resetState() like ServerManager
+ *   does, and nothing of it leaks into the next one: a reference request
+ *   parsed afterwards comes out as it does on a fresh context.
+ *
+ * An input that takes longer than FUZZ_BUDGET_MS (+ FUZZ_BUDGET_MS_PER_KB)
+ * aborts too, so quadratic paths show up as crashes with their input.
+ *
+ * `make fuzz` builds it with libFuzzer when clang++ is there, otherwise
+ * with FUZZ_STANDALONE: a small driver that replays files and mutates
+ * the seed corpus (tests/fuzz/corpus) at random.
+ */
+#include "../../src/httpContext/HttpContext.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#define FUZZ_BUDGET_MS 200
+#define FUZZ_BUDGET_MS_PER_KB 20
+#define FUZZ_MAX_BODY 4096		// client_max_body_size of the fuzzed server
+
+using std::string;
+
+namespace {
+
+void	fail(const char* what, const HttpContext& ctx) {
+	std::fprintf(stderr, "fuzz: %s (parser state %d)\n", what, static_cast<int>(ctx.getParserState()));
+	std::abort();
+}
+
+double	nowMs() {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// xorshift32, seeded from the input
+struct	Rng {
+	unsigned	s;
+	explicit Rng(const unsigned char* data, size_t size) : s(2166136261u) {
+		for (size_t i = 0; i < size; ++i)
+			s = (s ^ data[i]) * 16777619u;
+		if (!s)
+			s = 1;
+	}
+
+	unsigned	next() {
+		s ^= s << 13;
+		s ^= s >> 17;
+		s ^= s << 5;
+		return s;
+	}
+
+	// Mostly tiny reads, sometimes a whole segment
+	size_t		readSize() {
+		unsigned	r = next();
+		if (r % 8 == 0)
+			return 1 + r / 8 % 4096;
+		return 1 + r / 8 % 8;
+	}
+};
+
+Server&	fuzzServer() {
+	static Server	server;
+	static bool		ready = false;
+
+	if (!ready) {
+		Location	root;
+		Location	upload;
+		root.setPath("/");
+		upload.setPath("/upload");
+		upload.setClientMaxBodySize("64");
+		server.setPort(8080);
+		server.addServerName("localhost");
+		server.setClientMaxBodySize(toString(FUZZ_MAX_BODY));
+		server.addLocation(root);
+		server.addLocation(upload);
+		ready = true;
+	}
+	return server;
+}
+
+// Nothing of the previous request may survive resetState()
+void	checkReset(HttpContext& ctx) {
+	const Request&	req = ctx.request();
+
+	if (ctx.getParserState() != HttpContext::REQUEST_LINE || !req.getMethod().empty()
+			|| !req.getUri().empty() || !req.getBody().empty() || !req.getHeaderFields().empty()
+			|| ctx.isBodyStreamed() || ctx.getBytesReceived() != 0 || ctx.getBytesSent() != 0
+			|| !ctx.getResponseBuffer().empty() || ctx.response().getLocation() != NULL
+			|| ctx.response().isUpstreamPending() || ctx.response().getStatusCode() != 200)
+		fail("state left over after resetState()", ctx);
+}
+
+/**
+ * After a reset with an empty buffer: a fixed POST must parse exactly
+ * as on a new context (a leaked body length or chunk state would not).
+ */
+void	checkReference(HttpContext& ctx) {
+	static const string	reference = "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+		"Content-Length: 5\r\n\r\nhello";
+	string&				buf = ctx.connection().getBuffer();
+
+	buf = reference;
+	ctx.requestParsingStateMachine();
+	if (!ctx.isRequestComplete() || ctx.request().getBody() != "hello"
+			|| ctx.request().getUri() != "/echo" || !buf.empty())
+		fail("reference request parsed differently after resetState()", ctx);
+	ctx.resetState();
+}
+
+size_t	bufferBound(HttpContext::e_parse_state state, size_t lastRead) {
+	if (state == HttpContext::REQUEST_LINE)
+		return MAX_REQUEST_LINE_SIZE + 2 + lastRead;
+	if (state == HttpContext::READING_CHUNKED_BODY)
+		return MAX_HEADER_BLOCK_SIZE + MAX_CHUNK_LINE_SIZE + 4 + lastRead;
+	return MAX_HEADER_BLOCK_SIZE + 4 + lastRead;
+}
+
+// Progress: it only stops when it needs more bytes
+bool	waitsForWhatItHas(HttpContext::e_parse_state state, const string& buf) {
+	if (state == HttpContext::REQUEST_LINE)
+		return buf.find("\r\n") != string::npos;
+	if (state == HttpContext::READING_HEADERS)
+		return buf.compare(0, 2, "\r\n") == 0 || buf.find("\r\n\r\n") != string::npos;
+	return false;
+}
+
+void	runOne(const unsigned char* data, size_t size) {
+	Connection		conn;
+	HttpContext		ctx(conn, fuzzServer());
+	string&			buf = ctx.connection().getBuffer();
+	Rng				rng(data, size);
+	const double	start = nowMs();
+	size_t			off = 0;
+	int				lastState = HttpContext::REQUEST_LINE;
+
+	while (off < size) {
+		size_t	len = std::min(rng.readSize(), size - off);
+		buf.append(reinterpret_cast<const char*>(data) + off, len);
+		off += len;
+		for (;;) {
+			ctx.requestParsingStateMachine();
+			HttpContext::e_parse_state	state = ctx.getParserState();
+			if (static_cast<int>(state) < lastState)
+				fail("parse state went backwards", ctx);
+			lastState = state;
+			if (state == HttpContext::REQUEST_ERROR)
+				return;		// ServerManager answers and closes
+			if (ctx.request().getBody().size() > FUZZ_MAX_BODY)
+				fail("body over client_max_body_size", ctx);
+			if (state != HttpContext::REQUEST_COMPLETE) {
+				if (buf.size() > bufferBound(state, len))
+					fail("connection buffer over the parser's limits", ctx);
+				if (waitsForWhatItHas(state, buf))
+					fail("parser stopped with its delimiter in the buffer", ctx);
+				break;
+			}
+			ctx.resetState();
+			checkReset(ctx);
+			lastState = HttpContext::REQUEST_LINE;
+			if (buf.empty()) {
+				checkReference(ctx);
+				break;
+			}
+		}
+	}
+	double	budget = FUZZ_BUDGET_MS + FUZZ_BUDGET_MS_PER_KB * (size / 1024.0);
+	if (nowMs() - start > budget) {
+		std::fprintf(stderr, "fuzz: %lu bytes took %.1f ms, budget %.1f ms\n",
+			static_cast<unsigned long>(size), nowMs() - start, budget);
+		std::abort();
+	}
+}
+
+} // namespace
+
+extern "C" int	LLVMFuzzerTestOneInput(const unsigned char* data, size_t size) {
+	runOne(data, size);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+# include <dirent.h>
+# include <sys/stat.h>
+# include <fstream>
+# include <sstream>
+# include <vector>
+
+# define FUZZ_LAST_INPUT "build/fuzz/last-input"	// the input being run, kept if it crashes
+
+namespace {
+
+bool	readFile(const string& path, string& out) {
+	std::ifstream		in(path.c_str(), std::ios::binary);
+	std::ostringstream	ss;
+
+	if (!in)
+		return false;
+	ss << in.rdbuf();
+	out = ss.str();
+	return true;
+}
+
+// Files of a directory, or the file itself
+void	collect(const string& path, std::vector<string>& inputs) {
+	struct stat	st;
+	string		data;
+
+	if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		DIR*			dir = opendir(path.c_str());
+		struct dirent*	entry;
+		while (dir && (entry = readdir(dir)) != NULL) {
+			if (entry->d_name[0] != '.')
+				collect(path + "/" + entry->d_name, inputs);
+		}
+		if (dir)
+			closedir(dir);
+	} else if (readFile(path, data))
+		inputs.push_back(data);
+}
+
+// One of a few structure-aware edits, or a random byte
+void	mutate(string& in, const std::vector<string>& seeds) {
+	static const char*	tokens[] = { "\r\n", "\r\n\r\n", ":", " ", "0\r\n\r\n",
+		"Transfer-Encoding: chunked\r\n", "Content-Length: 99999999999\r\n",
+		"ffffffffffffffff\r\n", ";ext=1", "\n", "Host: localhost:8080\r\n" };
+	size_t				pos = in.empty() ? 0 : std::rand() % (in.size() + 1);
+
+	switch (std::rand() % 6) {
+		case 0:
+			if (!in.empty())
+				in[pos % in.size()] = static_cast<char>(std::rand());
+			break;
+		case 1:
+			in.insert(pos, tokens[std::rand() % (sizeof(tokens) / sizeof(tokens[0]))]);
+			break;
+		case 2:
+			in.erase(pos, std::rand() % 16);
+			break;
+		case 3:		// repeat a slice
+			if (!in.empty()) {
+				size_t	from = std::rand() % in.size();
+				string	slice = in.substr(from, 1 + std::rand() % 64);
+				for (int n = std::rand() % 64; n > 0; --n)
+					in.insert(pos, slice);
+			}
+			break;
+		case 4:		// splice another seed
+			in.insert(pos, seeds[std::rand() % seeds.size()]);
+			break;
+		default:
+			in.resize(pos);
+	}
+}
+
+} // namespace
+
+/**
+ * fuzz_request_parser [-runs=N] [-seed=N] [file|dir]...
+ * With -runs, mutates the given inputs (tests/fuzz/corpus by default)
+ * N times; without, replays them once, like a libFuzzer binary does.
+ */
+int	main(int argc, char** argv) {
+	std::vector<string>	inputs;
+	long				runs = 0;
+	unsigned			seed = static_cast<unsigned>(std::time(NULL));
+
+	for (int i = 1; i < argc; ++i) {
+		string	arg = argv[i];
+		if (arg.compare(0, 6, "-runs=") == 0)
+			runs = std::atol(arg.c_str() + 6);
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = std::strtoul(arg.c_str() + 6, NULL, 10);
+		else
+			collect(arg, inputs);
+	}
+	if (inputs.empty())
+		collect("tests/fuzz/corpus", inputs);
+	if (inputs.empty()) {
+		std::fprintf(stderr, "no inputs\n");
+		return 2;
+	}
+	for (size_t i = 0; i < inputs.size(); ++i)
+		runOne(reinterpret_cast<const unsigned char*>(inputs[i].data()), inputs[i].size());
+	std::srand(seed);
+	std::fprintf(stderr, "replayed %lu inputs; %ld mutated runs, -seed=%u\n",
+		static_cast<unsigned long>(inputs.size()), runs, seed);
+	for (long r = 0; r < runs; ++r) {
+		string	input = inputs[std::rand() % inputs.size()];
+		for (int m = 1 + std::rand() % 8; m > 0; --m)
+			mutate(input, inputs);
+		if (input.size() > 65536)
+			input.resize(65536);
+		// written first, so the input that crashes is on disk
+		std::ofstream	last(FUZZ_LAST_INPUT, std::ios::binary | std::ios::trunc);
+		last << input;
+		last.close();
+		runOne(reinterpret_cast<const unsigned char*>(input.data()), input.size());
+	}
+	std::remove(FUZZ_LAST_INPUT);
+	return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+"""
+Access log (access_log, log_format), against a running server with
+configs/default.conf: each request gets its line in
+webserv_access.log, in the "timed" JSON format, with its timing, the
+time its script took and the connection it came on.
+"""
+
+import http.client
+import json
+import os
+import sys
+import time
+
+from webserv_test import HOST, ROOT, report, run
+
+PORT = 8080
+
+
+def test_access_log():
+    """Two CGI requests on one keep-alive connection: two JSON lines in
+    webserv_access.log (log_format timed) with timing and reuse count."""
+    agent = f"access-log-test/{time.time()}"
+    conn = http.client.HTTPConnection(HOST, PORT, timeout=10)
+    for _ in range(2):
+        conn.request("GET", "/cgi-bin/test.py",
+                     headers={"User-Agent": agent, "Connection": "keep-alive"})
+        conn.getresponse().read()
+    conn.close()
+    time.sleep(0.3)
+    with open(os.path.join(ROOT, "webserv_access.log")) as log:
+        lines = [json.loads(l) for l in log if agent in l]
+    for l in lines:
+        print(f"  {l['request']} {l['status']} conn {l['connection']}#{l['connection_requests']} "
+              f"{l['request_time']}s (cgi {l['upstream_response_time']}s) "
+              f"{l['request_length']} in, {l['bytes_sent']} out")
+    return (len(lines) == 2 and lines[0]["connection"] == lines[1]["connection"]
+            and [l["connection_requests"] for l in lines] == [1, 2]
+            and all(l["status"] == 200 and l["upstream_response_time"] != ""
+                    and l["request_time"] + 0.001 >= float(l["upstream_response_time"])
+                    and l["request_length"] > 0 and l["bytes_sent"] > 0 for l in lines))
+
+
+def main():
+    return report(run([
+        ("Access log line per request", test_access_log),
+    ]), printed=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
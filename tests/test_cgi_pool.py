@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""
+CGI through the launcher pool (CgiPool), against a running server with
+configs/default.conf: scripts run next to the event loop instead of
+inside it, many run in parallel, a hung one times out with 504 and
+long output is streamed while the script still runs, an upload while
+the client still sends it, a location's cgi_max_concurrent holds,
+cached answers are served without running the script again, and no
+control character in a header or the URI reaches the script's environment.
+"""
+
+import hashlib
+import http.client
+import socket
+import sys
+import threading
+import time
+
+import webserv_test
+from webserv_test import HOST, report, run
+
+PORT = 8080
+
+
+def fetch(method, path, body=None, headers={}, timeout=20):
+    return webserv_test.fetch(PORT, method, path, body, headers, timeout)
+
+
+def test_static_during_slow_cgi():
+    """timeout.py hangs for 10 s; static pages must not wait for it."""
+    result = {}
+
+    def slow():
+        result["cgi"] = fetch("GET", "/cgi-bin/timeout.py")[0]
+
+    t = threading.Thread(target=slow)
+    t.start()
+    time.sleep(0.3)
+    start = time.time()
+    status, _ = fetch("GET", "/index.html")
+    static_time = time.time() - start
+    t.join()
+    print(f"  static {status} in {static_time:.3f}s, hung script -> {result.get('cgi')}")
+    return status == 200 and static_time < 1.0 and result.get("cgi") == 504
+
+
+def test_parallel_scripts():
+    statuses = []
+    lock = threading.Lock()
+
+    def worker():
+        status, _ = fetch("GET", "/cgi-bin/test.py?n=1")
+        with lock:
+            statuses.append(status)
+
+    threads = [threading.Thread(target=worker) for _ in range(24)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    print(f"  {statuses.count(200)}/24 answered 200")
+    return statuses.count(200) == 24
+
+
+def test_large_post_body():
+    body = b"x" * (512 * 1024)
+    status, _ = fetch("POST", "/cgi-bin/test.py", body, {"Content-Type": "text/plain"})
+    return status == 200
+
+
+def test_streamed_output():
+    """stream.py takes ~4 s; its first piece must arrive long before that."""
+    conn = http.client.HTTPConnection(HOST, PORT, timeout=20)
+    start = time.time()
+    conn.request("GET", "/cgi-bin/stream.py?chunks=4&pause=1")
+    response = conn.getresponse()
+    head_time = time.time() - start
+    body = response.read()
+    conn.close()
+    expected = b"".join(str(i).encode() * 32768 for i in range(4))
+    print(f"  head after {head_time:.2f}s, {response.getheader('Transfer-Encoding')}, "
+          f"{len(body)} bytes in {time.time() - start:.2f}s")
+    return (response.status == 200 and head_time < 1.5 and body == expected
+            and response.getheader("Transfer-Encoding") == "chunked")
+
+
+def test_large_output_slow_reader():
+    """8 MB to an HTTP/1.0 client that starts reading late: the script is
+    paused meanwhile, the body ends with the connection."""
+    sock = socket.create_connection((HOST, PORT), timeout=20)
+    sock.sendall(b"GET /cgi-bin/stream.py?chunks=128&size=65536&pause=0 HTTP/1.0\r\n"
+                 b"Host: localhost\r\n\r\n")
+    time.sleep(2)
+    data = b""
+    while True:
+        part = sock.recv(1 << 20)
+        if not part:
+            break
+        data += part
+    sock.close()
+    head, _, body = data.partition(b"\r\n\r\n")
+    expected = b"".join(str(i % 10).encode() * 65536 for i in range(128))
+    print(f"  {len(body)} body bytes")
+    return head.startswith(b"HTTP/1.0 200") and body == expected
+
+
+def test_streamed_upload():
+    """A body sent slowly reaches echo_body.py while it is still being sent;
+    a request pipelined behind it is answered on the same connection."""
+    piece = bytes(range(256)) * 256
+    body = piece * 12
+    conn = http.client.HTTPConnection(HOST, PORT, timeout=20)
+    conn.putrequest("POST", "/cgi-bin/echo_body.py")
+    conn.putheader("Content-Length", str(len(body)))
+    conn.endheaders()
+    for _ in range(12):
+        conn.send(piece)
+        time.sleep(0.1)
+    sent = time.time()
+    response = conn.getresponse()
+    answer = response.read().split()
+    conn.request("GET", "/index.html")
+    next_status = conn.getresponse().status
+    conn.close()
+    started = float(answer[2])
+    print(f"  script started {sent - started:.2f}s before the upload ended, next request {next_status}")
+    return (response.status == 200 and int(answer[0]) == len(body)
+            and answer[1].decode() == hashlib.sha1(body).hexdigest()
+            and sent - started > 0.8 and next_status == 200)
+
+
+def test_location_limit():
+    """/cgi-bin/serial has cgi_max_concurrent 1: three requests sent at
+    once run one after the other, under the launcher's rlimits."""
+    answers = []
+    lock = threading.Lock()
+
+    def worker():
+        status, data = fetch("GET", "/cgi-bin/serial/limits.py?sleep=0.5")
+        with lock:
+            answers.append((status, data.split()))
+
+    threads = [threading.Thread(target=worker) for _ in range(3)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    runs = sorted((float(a[0]), float(a[1])) for status, a in answers if status == 200)
+    overlap = any(runs[k + 1][0] < runs[k][1] for k in range(len(runs) - 1))
+    nofile = set(a[2] for status, a in answers if status == 200)
+    print(f"  {len(runs)}/3 answered 200, overlapping: {overlap}, RLIMIT_NOFILE {nofile}")
+    return len(runs) == 3 and not overlap and nofile == {b"64"}
+
+
+def test_cache_coalescing():
+    """Five requests at once to a cached location run the script once;
+    the answer is served from memory until its 2 s TTL is over."""
+    bodies = []
+    lock = threading.Lock()
+
+    def worker():
+        status, data = fetch("GET", "/cgi-bin/cached/now.py?sleep=0.5")
+        with lock:
+            bodies.append(data if status == 200 else None)
+
+    threads = [threading.Thread(target=worker) for _ in range(5)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    hit = fetch("GET", "/cgi-bin/cached/now.py?sleep=0.5")[1]
+    time.sleep(2.5)
+    expired = fetch("GET", "/cgi-bin/cached/now.py?sleep=0.5")[1]
+    print(f"  {len(set(bodies))} distinct answer(s) for 5 requests, "
+          f"hit {'same' if hit == bodies[0] else 'different'}, "
+          f"after TTL {'same' if expired == bodies[0] else 'fresh'}")
+    return None not in bodies and len(set(bodies)) == 1 and hit == bodies[0] and expired != hit
+
+
+def test_cache_bypass():
+    """Cache-Control: no-store from the script and a different
+    Accept-Language (cgi_cache_vary) both get a fresh run."""
+    first = fetch("GET", "/cgi-bin/cached/now.py?cc=no-store")[1]
+    second = fetch("GET", "/cgi-bin/cached/now.py?cc=no-store")[1]
+    english = fetch("GET", "/cgi-bin/cached/now.py?v=1", headers={"Accept-Language": "en"})[1]
+    german = fetch("GET", "/cgi-bin/cached/now.py?v=1", headers={"Accept-Language": "de"})[1]
+    again = fetch("GET", "/cgi-bin/cached/now.py?v=1", headers={"Accept-Language": "en"})[1]
+    print(f"  no-store rerun: {first != second}, per language: {english != german}, "
+          f"en cached: {again == english}")
+    return first != second and english != german and again == english
+
+
+def test_cache_per_server():
+    """The same Host and URI on two server blocks that both cache
+    /cgi-bin/cached: each gets its own answer."""
+    path = "/cgi-bin/cached/now.py?vhost=1"
+    headers = {"Host": "localhost"}
+    first = webserv_test.fetch(PORT, "GET", path, headers=headers)
+    other = webserv_test.fetch(8081, "GET", path, headers=headers)
+    print(f"  {first[0]} and {other[0]}, {'shared' if first[1] == other[1] else 'separate'} answers")
+    return first[0] == 200 and other[0] == 200 and first[1] != other[1]
+
+
+def test_env_injection():
+    """A NUL in a header value or in the request-target is a 400, never
+    an extra variable in the script's environment."""
+    header = webserv_test.request(PORT, b"GET /cgi-bin/test.py HTTP/1.1\r\nHost: localhost\r\n"
+                                  b"X-Foo: a\0INJECTED_VAR=pwned\r\nConnection: close\r\n\r\n")
+    target = webserv_test.request(PORT, b"GET /cgi-bin/test.py?a\0INJECTED_VAR=pwned HTTP/1.1\r\n"
+                                  b"Host: localhost\r\nConnection: close\r\n\r\n")
+    status, plain = fetch("GET", "/cgi-bin/test.py", headers={"X-Foo": "a"})
+    print(f"  NUL in a header -> {webserv_test.status(header)}, "
+          f"in the target -> {webserv_test.status(target)}, plain -> {status}")
+    return (webserv_test.status(header) == 400 and webserv_test.status(target) == 400
+            and b"INJECTED_VAR" not in header + target and status == 200 and b"HTTP_X_FOO" in plain)
+
+
+def main():
+    tests = [
+        ("Static served while a script hangs", test_static_during_slow_cgi),
+        ("24 scripts in parallel", test_parallel_scripts),
+        ("512 KB body on CGI stdin", test_large_post_body),
+        ("Output streamed while the script runs", test_streamed_output),
+        ("8 MB output to a slow reader", test_large_output_slow_reader),
+        ("Upload streamed into the script", test_streamed_upload),
+        ("cgi_max_concurrent of a location", test_location_limit),
+        ("Cached answer, concurrent misses coalesced", test_cache_coalescing),
+        ("Cache bypassed by no-store and Vary", test_cache_bypass),
+        ("Cache entries kept per server block", test_cache_per_server),
+        ("No variable injected through a NUL", test_env_injection),
+    ]
+    return report(run(tests), printed=True)
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -51,6 +51,7 @@ def main():
         # Basic Static Files
         ("GET", "/", 200, "Root Index Page"),
         ("GET", "/index.html", 200, "Explicit Index File"),
+        ("GET", "/index.html", 200, "Server Header", ("Server", "webserv/1.0")),
         ("GET", "/about.html", 200, "About Page"),
         # ("GET", "/favicon.ico", 200, "Favicon"),
         
@@ -87,6 +88,9 @@ def main():
         ("DELETE", "/uploaded_images/test-image.png", 204, "Delete Uploaded Image"),
         ("GET", "/uploaded_images/test-image.png", 404, "Get Deleted Image (Should be 404)"),
 
+        # Chunked Transfer-Encoding (http.client chunks an iterable body)
+        ("POST", "/cgi-bin/test.py", 200, "Chunked Body", None, PORT, iter([b"hello ", b"chunked ", b"world"]), {"Content-Type": "text/plain"}),
+
         # Second Server (Port 8081)
         ("GET", "/", 301, "Server 2: Redirect Root -> /additional", None, 8081),
         ("GET", "/additional", 200, "Server 2: Additional Page", None, 8081),
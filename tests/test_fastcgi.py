@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+FastCGI backend (fastcgi_pass): starts tests/fastcgi_responder.py and
+webserv with configs/fastcgi.conf, then checks that requests reach the
+persistent worker, that its connections are reused, that parallel
+requests are spread over a bounded pool, that a slow answer is streamed
+to the client as the responder writes it and that upstream failures
+map to 502.
+"""
+
+import http.client
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+
+import webserv_test
+from webserv_test import HOST, ROOT, report, run, start, status, stop
+
+PORT = 8090
+SOCK = "/tmp/webserv_fcgi.sock"
+
+
+def request(raw):
+    head, _, body = webserv_test.request(PORT, raw).partition(b"\r\n\r\n")
+    return status(head), body.decode(errors="replace")
+
+
+def get(path):
+    return request("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n" % path)
+
+
+def field(body, name):
+    m = re.search(r"\b%s=(\S*)" % name, body)
+    return m.group(1) if m else None
+
+
+def test_get():
+    status, body = get("/fcgi/hello?x=1")
+    return status == 200 and field(body, "method") == "GET" \
+        and field(body, "script") == "/fcgi/hello" and field(body, "query") == "x=1"
+
+
+def test_post_body():
+    payload = "name=webserv&n=42"
+    status, body = request("POST /fcgi/form HTTP/1.1\r\nHost: localhost\r\n"
+                           "Content-Type: application/x-www-form-urlencoded\r\n"
+                           "Content-Length: %d\r\nConnection: close\r\n\r\n%s"
+                           % (len(payload), payload))
+    return status == 200 and field(body, "method") == "POST" and field(body, "body") == payload
+
+
+def test_connection_reuse():
+    conns = set()
+    for _ in range(5):
+        status, body = get("/fcgi/reuse")
+        if status != 200:
+            return False
+        conns.add(field(body, "conn"))
+    return len(conns) == 1
+
+
+def test_parallel_pool():
+    results = []
+    lock = threading.Lock()
+
+    def worker():
+        r = get("/fcgi/slow")
+        with lock:
+            results.append(r)
+
+    threads = [threading.Thread(target=worker) for _ in range(12)]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.time() - start
+    conns = set(field(b, "conn") for s, b in results if s == 200)
+    # 8 connections per upstream: 12 one-second requests take two rounds
+    ok = len(results) == 12 and all(s == 200 for s, _ in results)
+    return ok and 1 < len(conns) <= 8 and 1.5 < elapsed < 5
+
+
+def test_streamed_answer():
+    """/stream takes ~3 s; its first piece must arrive long before that."""
+    conn = http.client.HTTPConnection(HOST, PORT, timeout=20)
+    begin = time.time()
+    conn.request("GET", "/fcgi/stream")
+    response = conn.getresponse()
+    first = response.read(32768)
+    first_time = time.time() - begin
+    body = first + response.read()
+    conn.close()
+    expected = b"".join(str(i).encode() * 32768 for i in range(4))
+    print("  first piece after %.2fs, %d bytes in %.2fs"
+          % (first_time, len(body), time.time() - begin))
+    return response.status == 200 and first_time < 1.5 and body == expected
+
+
+def test_upstream_status():
+    status, _ = get("/fcgi/missing")
+    return status == 404
+
+
+def test_upstream_down():
+    status, _ = get("/fcgi-down/x")
+    return status == 502
+
+
+def main():
+    responder = subprocess.Popen([sys.executable, os.path.join(ROOT, "tests/fastcgi_responder.py"), SOCK])
+    server = start("configs/fastcgi.conf")
+    try:
+        results = run([
+            ("GET through fastcgi_pass", test_get),
+            ("POST body on FCGI_STDIN", test_post_body),
+            ("Persistent connection reused", test_connection_reuse),
+            ("Parallel requests over bounded pool", test_parallel_pool),
+            ("Answer streamed as it is written", test_streamed_answer),
+            ("Status header from responder", test_upstream_status),
+            ("Upstream down -> 502", test_upstream_down),
+        ])
+    finally:
+        stop(server)
+        responder.terminate()
+        responder.wait()
+    return report(results, printed=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Logger with a console that cannot keep up: starts webserv with its
+stdout on a non-blocking pipe nobody reads, logs far more than the pipe
+and the console buffer hold, then reads the pipe. Lines that did not
+fit are dropped whole and reported in webserv.log; none reaches the
+console cut short or without its closing color code.
+"""
+
+import http.client
+import os
+import re
+import sys
+import time
+
+from webserv_test import HOST, get, log_offset, log_since, report, start, stop, write_config
+
+PORT = 8096
+REQUESTS = 6000     # ~100 console bytes each: well over the pipe and LOG_BUFFER_SIZE
+RESET = b"\x1b[0m"
+STAMP = re.compile(rb"\[\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\] \[")   # one per line, at its start
+
+CONFIG = """
+server {
+	listen %d;
+	host 127.0.0.1;
+	server_name test_logger;
+	root www/web;
+
+	location / {
+		methods [GET];
+		index about.html;
+	}
+}
+""" % PORT
+
+
+def read_pipe(fd):
+    data = b""
+    while True:
+        try:
+            chunk = os.read(fd, 65536)
+        except BlockingIOError:
+            return data
+        if not chunk:
+            return data
+        data += chunk
+
+
+def main():
+    path = write_config(CONFIG)
+    r, w = os.pipe()
+    os.set_blocking(r, False)
+    os.set_blocking(w, False)   # the server's writes get EAGAIN once the pipe is full
+    offset = log_offset()
+    server = start(path, stdout=w)
+    os.close(w)
+    results = []
+    try:
+        conn = http.client.HTTPConnection(HOST, PORT, timeout=10)
+        answered = 0
+        for _ in range(REQUESTS):
+            conn.request("GET", "/", headers={"Connection": "keep-alive"})
+            response = conn.getresponse()
+            response.read()
+            answered += response.status == 200
+        conn.close()
+        results.append(("Served with the console stuck", answered == REQUESTS))
+
+        console = read_pipe(r)
+        time.sleep(1.5)     # a loop iteration or two: the rest of the buffer and the report
+        results.append(("Served once it is read again", get(PORT) == 200))
+        time.sleep(1.5)
+        console += read_pipe(r)
+        # the last piece may still wait in the buffer, unterminated
+        lines = console.split(b"\n")[:-1]
+        complete = all(l.startswith(b"\x1b[") and l.endswith(RESET) and len(STAMP.findall(l)) == 1
+                       for l in lines)
+        print("  %d console bytes, %d lines" % (len(console), len(lines)))
+        results.append(("No console line cut short", complete and len(lines) > 0))
+        results.append(("Dropped lines reported", b"log lines dropped: log buffer full" in log_since(offset)))
+    except Exception as e:
+        print("error: %s" % e)
+        results.append(("No exception", False))
+    finally:
+        stop(server)
+        os.close(r)
+        os.unlink(path)
+    return report(results)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+memory_budget: starts webserv with configs/memory.conf (1 MB for all
+connections), holds a few half-sent uploads open to cross it, then
+checks that large bodies are answered 503 with Retry-After, that small
+requests still pass, that the heaviest uploads are paused, that a
+paused upload outlasts the 30 s idle timeout, that uploads which end
+with shutdown(SHUT_WR) while paused are still answered and that large
+bodies are taken again once the uploads are done.
+"""
+
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+
+from webserv_test import HOST, read_response, report, request, run, start, status, stop
+
+PORT = 8091
+
+UPLOADS = 4
+UPLOAD_SIZE = 1500000   # under client_max_body_size 2m
+UPLOAD_SENT = 400000    # sent of each before the checks
+IDLE_TIMEOUT = 30       # ServerManager::checkTimeouts()
+
+
+def post_head(length):
+    return ("POST / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+            "Content-Type: text/plain\r\nContent-Length: %d\r\n\r\n" % length).encode()
+
+
+def metric(name, labels=""):
+    body = request(PORT, "GET /metrics HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n").decode()
+    m = re.search(r"^%s%s (\d+)$" % (re.escape(name), re.escape(labels)), body, re.M)
+    return int(m.group(1)) if m else None
+
+
+def start_uploads():
+    socks = []
+    for _ in range(UPLOADS):
+        sock = socket.create_connection((HOST, PORT), timeout=10.0)
+        sock.sendall(post_head(UPLOAD_SIZE))
+        sock.setblocking(False)
+        socks.append(sock)
+    # as much as the server takes; paused uploads stop taking
+    chunk = b"u" * 16384
+    sent = [0] * UPLOADS
+    deadline = time.time() + 5
+    while time.time() < deadline and min(sent) < UPLOAD_SENT:
+        for n, sock in enumerate(socks):
+            try:
+                if sent[n] < UPLOAD_SENT:
+                    sent[n] += sock.send(chunk)
+            except BlockingIOError:
+                pass
+        time.sleep(0.001)
+    time.sleep(1.5)     # a loop or two of poll(): budget checked
+    return [[sock, n] for sock, n in zip(socks, sent)]   # [socket, bytes sent]
+
+
+def test_metrics_gauges():
+    return metric("webserv_memory_budget_bytes") == 1024 * 1024 \
+        and metric("webserv_memory_bytes", '{state="idle"}') is not None \
+        and metric("webserv_memory_paused_connections") == 0
+
+
+def test_over_budget(socks):
+    held = metric("webserv_memory_bytes", '{state="body"}')
+    print("  held by uploads: %s bytes, paused %s" % (held, metric("webserv_memory_paused_connections")))
+    return held is not None and held > 1024 * 1024 \
+        and metric("webserv_memory_paused_connections") >= 1 \
+        and metric("webserv_memory_pauses_total") >= 1
+
+
+def test_paused_outlasts_idle_timeout(socks):
+    """Over budget for longer than the idle timeout: the uploads still
+    read keep sending a little, the paused ones are not closed as idle."""
+    timeouts = metric("webserv_idle_timeouts_total")
+    deadline = time.time() + IDLE_TIMEOUT + 3
+    while time.time() < deadline:
+        for upload in socks:
+            try:
+                upload[1] += upload[0].send(b"u" * 512)
+            except BlockingIOError:
+                pass
+        time.sleep(2)
+    return metric("webserv_memory_paused_connections") >= 1 \
+        and metric("webserv_idle_timeouts_total") == timeouts
+
+
+def test_large_body_shed(socks):
+    data = request(PORT, post_head(100000) + b"x" * 100000)
+    return status(data) == 503 and b"Retry-After: " in data \
+        and metric("webserv_memory_shed_bodies_total") >= 1
+
+
+def test_small_body_passes(socks):
+    data = request(PORT, post_head(10) + b"x" * 10)
+    return status(data) not in (0, 503)
+
+
+def test_half_closed_uploads_answered(socks):
+    """Every upload sends the rest of its body and shuts its sending side
+    down, the paused ones while paused: all of them are answered as
+    reads resume."""
+    paused = metric("webserv_memory_paused_connections")
+    statuses = []
+
+    def finish(sock, sent):
+        sock.setblocking(True)
+        sock.settimeout(30.0)
+        try:
+            sock.sendall(b"u" * (UPLOAD_SIZE - sent))
+            sock.shutdown(socket.SHUT_WR)
+            statuses.append(status(read_response(sock)))
+        except OSError:
+            statuses.append(0)
+        sock.close()
+
+    threads = [threading.Thread(target=finish, args=(sock, sent)) for sock, sent in socks]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    print("  paused before: %s, answered: %s" % (paused, statuses))
+    return paused >= 1 and len(statuses) == UPLOADS and 0 not in statuses \
+        and 503 not in statuses and metric("webserv_memory_paused_connections") == 0
+
+
+def test_recovers(socks):
+    time.sleep(1.5)
+    data = request(PORT, post_head(100000) + b"x" * 100000)
+    return status(data) not in (0, 503)
+
+
+def main():
+    server = start("configs/memory.conf")
+    try:
+        results = run([("Memory gauges in /metrics", test_metrics_gauges)])
+        socks = start_uploads()
+        results += run([
+            ("Uploads over budget are paused", test_over_budget),
+            ("Paused upload outlasts the idle timeout", test_paused_outlasts_idle_timeout),
+            ("Large body over budget -> 503", test_large_body_shed),
+            ("Small body over budget passes", test_small_body_passes),
+            ("Half-closed paused uploads answered", test_half_closed_uploads_answered),
+            ("Under budget again -> accepted", test_recovers),
+        ], socks)
+    finally:
+        stop(server)
+    return report(results, printed=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""
+Prometheus metrics at /metrics, against a running server with
+configs/default.conf: requests show up in the status counters, in the
+latency histogram of their location and in the CGI pool counters.
+"""
+
+import sys
+
+from webserv_test import fetch, metric, report, run
+
+PORT = 8080
+
+
+def test_metrics():
+    """A CGI request and a 404 show up in the status counters, in the
+    /cgi-bin latency histogram and in the CGI pool counters."""
+    before = fetch(PORT, "GET", "/metrics")[1].decode()
+    fetch(PORT, "GET", "/cgi-bin/test.py")
+    fetch(PORT, "GET", "/no-such-page")
+    status, body = fetch(PORT, "GET", "/metrics")
+    after = body.decode()
+    hist = 'webserv_request_duration_seconds_count{location="8080/cgi-bin"}'
+    deltas = {
+        "200": metric(after, 'webserv_responses_total{status="200"}')
+               - metric(before, 'webserv_responses_total{status="200"}'),
+        "404": metric(after, 'webserv_responses_total{status="404"}')
+               - metric(before, 'webserv_responses_total{status="404"}'),
+        "cgi histogram": metric(after, hist) - metric(before, hist),
+        "scripts": metric(after, 'webserv_cgi_scripts_total{ext="py"}')
+                   - metric(before, 'webserv_cgi_scripts_total{ext="py"}'),
+    }
+    inf = f'webserv_request_duration_seconds_bucket{{location="8080/cgi-bin",le="+Inf"}}'
+    print(f"  {status}, deltas {deltas}, +Inf bucket == count: {metric(after, inf) == metric(after, hist)}")
+    return (status == 200 and "# TYPE webserv_request_duration_seconds histogram" in after
+            and deltas["200"] >= 2 and deltas["404"] >= 1
+            and deltas["cgi histogram"] >= 1 and deltas["scripts"] >= 1
+            and metric(after, inf) == metric(after, hist)
+            and metric(after, "webserv_connections_active") >= 1)
+
+
+def main():
+    return report(run([
+        ("Prometheus counters at /metrics", test_metrics),
+    ]), printed=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""
+Memory pools, against a running server with configs/default.conf:
+keep-alive requests reuse pooled I/O buffers (BufferPool) and give
+them back between requests, and new connections take the context of
+closed ones (ContextPool).
+"""
+
+import http.client
+import sys
+import time
+
+from webserv_test import HOST, fetch, metric, report, run
+
+PORT = 8080
+
+
+def test_buffer_pool():
+    """Keep-alive requests reuse pooled I/O buffers, and the connection
+    gives them back between requests."""
+    before = fetch(PORT, "GET", "/metrics")[1].decode()
+    conn = http.client.HTTPConnection(HOST, PORT, timeout=10)
+    for _ in range(10):
+        conn.request("GET", "/index.html", headers={"Connection": "keep-alive"})
+        conn.getresponse().read()
+    after = fetch(PORT, "GET", "/metrics")[1].decode()
+    conn.close()
+    hits = metric(after, 'webserv_buffer_pool_hits_total{size="4096"}') \
+        - metric(before, 'webserv_buffer_pool_hits_total{size="4096"}')
+    idle = metric(after, 'webserv_memory_bytes{state="idle"}')
+    print(f"  4 KB buffers reused: {hits:.0f}, idle connections hold {idle:.0f} bytes")
+    return hits >= 10 and 0 < idle < 4096 \
+        and metric(after, 'webserv_buffer_pool_in_use_high_water{size="4096"}') >= 1
+
+
+
+def test_context_pool():
+    """Closed connections' contexts are reused by the next ones, also
+    for a connection to another server."""
+    before = fetch(PORT, "GET", "/metrics")[1].decode()
+    ok = True
+    for n in range(20):
+        port, expected = (8081, 301) if n % 2 else (PORT, 200)
+        conn = http.client.HTTPConnection(HOST, port, timeout=10)
+        conn.request("GET", "/")
+        status = conn.getresponse().status
+        conn.close()
+        ok = ok and status == expected
+        time.sleep(0.02)
+    after = fetch(PORT, "GET", "/metrics")[1].decode()
+    reused = metric(after, "webserv_context_pool_reuses_total") \
+        - metric(before, "webserv_context_pool_reuses_total")
+    print(f"  slots reused: {reused:.0f} of 21 connections")
+    return ok and reused >= 20 and metric(after, "webserv_context_pool_free") >= 1
+
+
+def main():
+    return report(run([
+        ("Pooled I/O buffers on keep-alive", test_buffer_pool),
+        ("Connection contexts reused", test_context_pool),
+    ]), printed=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
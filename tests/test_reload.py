@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+SIGHUP reload: starts webserv with a configuration written to a
+temporary file, rewrites it and sends SIGHUP. New connections get the
+new configuration on a listener that was never closed, a request begun
+before the reload finishes on the old one, an idle keep-alive
+connection moves to the new one, a file that does not parse changes
+nothing, and listeners are opened and closed as the file says.
+"""
+
+import os
+import signal
+import socket
+import sys
+import time
+
+from webserv_test import HOST, get, read_response, refused, report, start, status, stop, write_config
+
+PORT = 8092
+PORT_ADDED = 8093
+
+SERVER = """
+server {
+	listen %d;
+	host 127.0.0.1;
+	server_name test_reload;
+	root www/web;
+
+	location / {
+		methods [GET];
+		%s
+	}
+}
+"""
+OLD = SERVER % (PORT, "index about.html;")
+NEW = SERVER % (PORT, "return 301 /moved;") + SERVER % (PORT_ADDED, "index about.html;")
+
+
+def reload(server, path, text):
+    write_config(text, path)
+    server.send_signal(signal.SIGHUP)
+    time.sleep(0.5)
+
+
+def main():
+    path = write_config(OLD)
+    server = start(path)
+    results = []
+    try:
+        results.append(("Old configuration before SIGHUP", get(PORT) == 200))
+
+        # idle keep-alive, and a request whose head is half sent
+        idle = socket.create_connection((HOST, PORT), timeout=5.0)
+        idle.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n")
+        first = status(read_response(idle))
+        busy = socket.create_connection((HOST, PORT), timeout=5.0)
+        busy.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n")
+        time.sleep(0.2)
+
+        reload(server, path, NEW)
+        results.append(("New connections get the new configuration", get(PORT) == 301))
+        results.append(("Listener added by the reload", get(PORT_ADDED) == 200))
+
+        busy.sendall(b"Connection: close\r\n\r\n")
+        results.append(("Request begun before it finishes on the old one",
+                        status(read_response(busy)) == 200))
+        busy.close()
+        idle.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n")
+        results.append(("Idle keep-alive connection moves to the new one",
+                        first == 200 and status(read_response(idle)) == 301))
+        idle.close()
+
+        reload(server, path, "server {\n\tlisten 8092\n")
+        results.append(("Broken file: configuration unchanged",
+                        server.poll() is None and get(PORT) == 301 and get(PORT_ADDED) == 200))
+
+        reload(server, path, OLD)
+        results.append(("Listener removed by the reload",
+                        get(PORT) == 200 and refused(PORT_ADDED)))
+    except Exception as e:
+        print("error: %s" % e)
+        results.append(("No exception", False))
+    finally:
+        stop(server)
+        os.unlink(path)
+    return report(results)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
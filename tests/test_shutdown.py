@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Graceful shutdown: starts webserv with a configuration written to a
+temporary file (shutdown_timeout 3) and sends SIGTERM. No connection is
+accepted any more and idle keep-alive ones are closed, while a request
+begun before the signal and a CGI script in flight finish, the former
+with Connection: close. The server exits once they are done, after the
+grace period if one never is, and at once on a second signal.
+"""
+
+import os
+import signal
+import socket
+import subprocess
+import sys
+import time
+
+from webserv_test import HOST, log_offset, log_since, refused, report, start, status, write_config
+
+PORT = 8095
+GRACE = 3
+
+CONFIG = """
+shutdown_timeout %d;
+
+server {
+	listen %d;
+	host 127.0.0.1;
+	server_name test_shutdown;
+	root www/web;
+
+	location / {
+		methods [GET];
+		index about.html;
+	}
+
+	location /cgi-bin {
+		methods [GET];
+		cgi py /usr/bin/python3;
+	}
+}
+""" % (GRACE, PORT)
+
+# stream.py: 4 pieces of 1000 bytes, 0.4 s apart
+STREAM = b"GET /cgi-bin/stream.py?chunks=4&size=1000&pause=0.4 HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"
+
+
+def read_all(sock):
+    data = b""
+    while True:
+        try:
+            chunk = sock.recv(65536)
+        except OSError:
+            break
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def dechunk(body):
+    out = b""
+    while body:
+        size, _, rest = body.partition(b"\r\n")
+        n = int(size, 16)
+        if n == 0:
+            break
+        out += rest[:n]
+        body = rest[n + 2:]
+    return out
+
+
+def send_get(connection):
+    """GET / on a new connection, the answer left to read."""
+    sock = socket.create_connection((HOST, PORT), timeout=5.0)
+    sock.sendall(("GET / HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\n\r\n" % connection).encode())
+    return sock
+
+
+def closed(sock):
+    """The server closed `sock`: recv() sees the end (or a reset)."""
+    try:
+        return sock.recv(1) == b""
+    except ConnectionResetError:
+        return True
+
+
+def stopped_within(server, seconds):
+    try:
+        server.wait(timeout=seconds)
+    except subprocess.TimeoutExpired:
+        return False
+    return True
+
+
+def main():
+    path = write_config(CONFIG)
+    results = []
+    servers = []
+    try:
+        # 1. in-flight requests finish, the rest is turned away
+        server = start(path)
+        servers.append(server)
+        offset = log_offset()
+        idle = send_get("keep-alive")
+        idle.recv(65536)
+        busy = socket.create_connection((HOST, PORT), timeout=5.0)
+        busy.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n")
+        cgi = socket.create_connection((HOST, PORT), timeout=5.0)
+        cgi.sendall(STREAM)
+        time.sleep(0.3)
+
+        server.send_signal(signal.SIGTERM)
+        time.sleep(0.3)
+        results.append(("Still running for requests in flight", server.poll() is None))
+        results.append(("No new connection accepted", refused(PORT)))
+        results.append(("Idle keep-alive connection closed", closed(idle)))
+
+        busy.sendall(b"Connection: keep-alive\r\n\r\n")
+        answer = read_all(busy)
+        results.append(("Request begun before it answered with Connection: close",
+                        status(answer) == 200 and b"Connection: close" in answer))
+        head, _, body = read_all(cgi).partition(b"\r\n\r\n")
+        if b"Transfer-Encoding: chunked" in head:
+            body = dechunk(body)
+        results.append(("CGI script in flight finishes", status(head) == 200 and len(body) == 4000))
+        for sock in (idle, busy, cgi):
+            sock.close()
+        results.append(("Exits once they are done", stopped_within(server, GRACE)))
+        log = log_since(offset)
+        results.append(("Progress in the log", b"graceful shutdown" in log
+                        and b"Draining:" in log and b"Drained: every connection finished" in log))
+
+        # 2. a request that never ends is cut after shutdown_timeout
+        server = start(path)
+        servers.append(server)
+        stuck = socket.create_connection((HOST, PORT), timeout=5.0)
+        stuck.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n")
+        time.sleep(0.2)
+        begin = time.time()
+        server.send_signal(signal.SIGTERM)
+        results.append(("Grace period, then exit",
+                        stopped_within(server, GRACE + 3) and time.time() - begin >= GRACE - 1))
+        stuck.close()
+
+        # 3. a second signal does not wait
+        server = start(path)
+        servers.append(server)
+        stuck = socket.create_connection((HOST, PORT), timeout=5.0)
+        stuck.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n")
+        time.sleep(0.2)
+        server.send_signal(signal.SIGTERM)
+        time.sleep(0.2)
+        server.send_signal(signal.SIGINT)
+        results.append(("Second signal stops at once", stopped_within(server, 1)))
+        stuck.close()
+    except Exception as e:
+        print("error: %s" % e)
+        results.append(("No exception", False))
+    finally:
+        for server in servers:
+            if server.poll() is None:
+                server.kill()
+            server.wait()
+        os.unlink(path)
+    return report(results)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+"""
+Binary upgrade: starts webserv with a configuration written to a
+temporary file and sends SIGUSR2. A new process started from the same
+binary takes over the listening socket: no connection is refused while
+it starts, new connections are served by it, a request begun before the
+signal finishes on the old process, which then exits. A second upgrade
+works the same from the new process. A new binary that gives up before
+it listens (the file no longer parses, or it closes its readiness pipe
+and goes on running) leaves the server serving, with no zombie left
+behind once it exits.
+"""
+
+import os
+import re
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+from webserv_test import (HOST, ROOT, get, log_offset, log_since, read_response, report, start,
+                          status, stop, write_config)
+
+PORT = 8094
+
+CONFIG = """
+server {
+	listen %d;
+	host 127.0.0.1;
+	server_name test_upgrade;
+	root www/web;
+
+	location / {
+		methods [GET];
+		index about.html;
+	}
+}
+""" % PORT
+
+
+def new_pid(offset, timeout=5.0):
+    """The pid logged by the old process once it started the new one."""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        m = re.search(rb"Binary upgrade: started .*, pid (\d+)", log_since(offset))
+        if m:
+            return int(m.group(1))
+        time.sleep(0.1)
+    return None
+
+
+def zombies(parent):
+    """Children of `parent` that exited and were not reaped."""
+    found = 0
+    for entry in os.listdir("/proc"):
+        if not entry.isdigit():
+            continue
+        try:
+            with open("/proc/%s/stat" % entry) as f:
+                fields = f.read().rsplit(")", 1)[1].split()
+        except OSError:
+            continue
+        found += fields[0] == "Z" and int(fields[1]) == parent
+    return found
+
+
+def alive(pid):
+    try:
+        os.kill(pid, 0)
+    except OSError:
+        return False
+    return True
+
+
+def exits(pid, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if not alive(pid):
+            return True
+        time.sleep(0.1)
+    return False
+
+
+class Hammer(threading.Thread):
+    """Requests back to back; counts those refused or not answered 200."""
+
+    def __init__(self):
+        threading.Thread.__init__(self)
+        self.running = True
+        self.sent = 0
+        self.failed = 0
+
+    def run(self):
+        while self.running:
+            try:
+                ok = get(PORT) == 200
+            except OSError:
+                ok = False
+            self.sent += 1
+            self.failed += not ok
+
+
+def upgrade(pid):
+    """SIGUSR2 to `pid`, under load; returns the new pid and the failures."""
+    offset = log_offset()
+    hammer = Hammer()
+    hammer.start()
+    time.sleep(0.2)
+    os.kill(pid, signal.SIGUSR2)
+    successor = new_pid(offset)
+    gone = exits(pid)
+    time.sleep(0.3)
+    hammer.running = False
+    hammer.join()
+    return successor, gone, hammer
+
+
+# closes the readiness pipe it was given, then hangs on for a while
+HUNG = """#!/bin/sh
+eval "exec $WEBSERV_UPGRADE_READY>&-"
+sleep 3
+"""
+
+
+def hung_successor(path):
+    """webserv run from a copy, replaced by HUNG before SIGUSR2."""
+    folder = tempfile.mkdtemp()
+    binary = os.path.join(folder, "webserv")
+    shutil.copy(os.path.join(ROOT, "webserv"), binary)
+    server = subprocess.Popen([binary, path], cwd=ROOT,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    results = []
+    try:
+        time.sleep(1)
+        with open(binary + ".new", "w") as f:
+            f.write(HUNG)
+        os.chmod(binary + ".new", 0o755)
+        os.replace(binary + ".new", binary)
+        offset = log_offset()
+        os.kill(server.pid, signal.SIGUSR2)
+        time.sleep(0.5)
+        begin = time.time()
+        served = get(PORT) == 200 and time.time() - begin < 1
+        results.append(("Successor hangs after closing its pipe: still serving",
+                        served and b"gave up before listening" in log_since(offset)))
+        time.sleep(4)
+        results.append(("... and reaped once it exits", zombies(server.pid) == 0))
+    finally:
+        stop(server)
+        shutil.rmtree(folder)
+    return results
+
+
+def main():
+    path = write_config(CONFIG)
+    results = hung_successor(path)
+    server = start(path)
+    pids = [server.pid]
+    try:
+        results.append(("Served before SIGUSR2", get(PORT) == 200))
+
+        # a request whose head is half sent when the upgrade starts
+        busy = socket.create_connection((HOST, PORT), timeout=5.0)
+        busy.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\n")
+        time.sleep(0.2)
+        offset = log_offset()
+        os.kill(server.pid, signal.SIGUSR2)
+        successor = new_pid(offset)
+        time.sleep(0.5)
+        results.append(("New process started", successor is not None and alive(successor)))
+        if successor:
+            pids.append(successor)
+        results.append(("Old process waits for its request", server.poll() is None))
+        busy.sendall(b"Connection: close\r\n\r\n")
+        results.append(("Request begun before it finishes on the old process",
+                        status(read_response(busy)) == 200))
+        busy.close()
+        results.append(("Old process exits once drained", server.wait(timeout=5.0) is not None))
+        results.append(("New process serves", get(PORT) == 200))
+
+        # again from the new process, under load this time
+        if successor:
+            third, gone, hammer = upgrade(successor)
+            if third:
+                pids.append(third)
+            results.append(("Second upgrade: old process exits", third is not None and gone))
+            results.append(("No connection refused or failed during it (%d/%d)"
+                            % (hammer.sent - hammer.failed, hammer.sent),
+                            hammer.sent > 0 and hammer.failed == 0))
+            results.append(("Served after it", get(PORT) == 200))
+
+            # a new binary that fails: the file it parses is broken
+            if third:
+                write_config("server {\n\tlisten %d\n" % PORT, path)
+                offset = log_offset()
+                os.kill(third, signal.SIGUSR2)
+                time.sleep(1)
+                failed = b"gave up before listening, still serving" in log_since(offset)
+                results.append(("Failed upgrade: still serving, child reaped",
+                                failed and get(PORT) == 200 and zombies(third) == 0))
+    except Exception as e:
+        print("error: %s" % e)
+        results.append(("No exception", False))
+    finally:
+        for pid in pids:
+            if alive(pid):
+                os.kill(pid, signal.SIGTERM)
+        server.wait()
+        for pid in pids[1:]:
+            exits(pid)
+        os.unlink(path)
+    return report(results)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
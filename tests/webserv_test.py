@@ -0,0 +1,140 @@
+"""
+Shared by the tests: raw HTTP/1.1 over a socket, requests through
+http.client, /metrics samples, a server started on a configuration file
+and stopped again, webserv.log read from a given offset, and the
+"Total: x/y" report.
+"""
+
+import http.client
+import os
+import re
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+
+HOST = "127.0.0.1"
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+LOG = os.path.join(ROOT, "webserv.log")
+
+
+def read_response(sock):
+    """One response: up to Content-Length, else until the server closes."""
+    data = b""
+    while True:
+        chunk = sock.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+        head, sep, body = data.partition(b"\r\n\r\n")
+        m = re.search(rb"Content-Length: (\d+)", head)
+        if sep and m and len(body) >= int(m.group(1)):
+            break
+    return data
+
+
+def status(data):
+    return int(data.split(b" ")[1]) if data else 0
+
+
+def request(port, raw, timeout=10.0):
+    """Sends `raw` on a new connection; the response, head and body."""
+    sock = socket.create_connection((HOST, port), timeout=timeout)
+    sock.sendall(raw if isinstance(raw, bytes) else raw.encode())
+    data = read_response(sock)
+    sock.close()
+    return data
+
+
+def get(port, path="/", connection="close"):
+    """Status of GET `path` on a new connection."""
+    return status(request(port, "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\n\r\n"
+                          % (path, connection)))
+
+
+def fetch(port, method, path, body=None, headers={}, timeout=20):
+    """(status, body) of one request on a new connection."""
+    conn = http.client.HTTPConnection(HOST, port, timeout=timeout)
+    conn.request(method, path, body, headers)
+    response = conn.getresponse()
+    data = response.read()
+    conn.close()
+    return response.status, data
+
+
+def metric(text, name):
+    """Value of the /metrics sample line starting with `name`, 0 if absent."""
+    for line in text.splitlines():
+        if line.startswith(name + " "):
+            return float(line.rsplit(" ", 1)[1])
+    return 0
+
+
+def refused(port):
+    """No listener on `port` any more."""
+    try:
+        socket.create_connection((HOST, port), timeout=2.0).close()
+    except ConnectionRefusedError:
+        return True
+    return False
+
+
+def write_config(text, path=None):
+    """`text` into `path`, a new temporary .conf when None; returns the path."""
+    if path is None:
+        fd, path = tempfile.mkstemp(suffix=".conf")
+        os.close(fd)
+    with open(path, "w") as f:
+        f.write(text)
+    return path
+
+
+def start(config, wait=1.0, stdout=subprocess.DEVNULL):
+    """webserv on `config` (relative to the repository), `wait` s to listen."""
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), os.path.join(ROOT, config)],
+                              cwd=ROOT, stdout=stdout, stderr=subprocess.DEVNULL)
+    time.sleep(wait)
+    return server
+
+
+def stop(server):
+    if server.poll() is None:
+        server.send_signal(signal.SIGINT)
+        server.send_signal(signal.SIGINT)   # the second one does not drain
+    server.wait()
+
+
+def log_offset():
+    return os.path.getsize(LOG) if os.path.exists(LOG) else 0
+
+
+def log_since(offset):
+    with open(LOG, "rb") as f:
+        f.seek(offset)
+        return f.read()
+
+
+def run(tests, *args):
+    """(name, ok) per (name, function) of `tests`, called with `args`."""
+    results = []
+    for name, fn in tests:
+        try:
+            ok = bool(fn(*args))
+        except Exception as e:
+            print("%s: error %s" % (name, e))
+            ok = False
+        print("%s: %s" % (name, "✓ PASSED" if ok else "✗ FAILED"))
+        results.append((name, ok))
+    return results
+
+
+def report(results, printed=False):
+    """Prints the results (unless run() did) and the total; the exit code."""
+    passed = 0
+    for name, ok in results:
+        if not printed:
+            print("%s: %s" % (name, "✓ PASSED" if ok else "✗ FAILED"))
+        passed += ok
+    print("\nTotal: %d/%d tests passed" % (passed, len(results)))
+    return 0 if passed == len(results) else 1
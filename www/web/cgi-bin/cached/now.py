@@ -0,0 +1,19 @@
+#!/usr/bin/env python3
+
+# Answers "<pid> <time>" after ?sleep=S seconds (default 0), so a client
+# can tell a cached answer from a fresh run. ?cc=... is sent back as the
+# Cache-Control header.
+
+import os
+import sys
+import time
+import urllib.parse
+
+query = urllib.parse.parse_qs(os.environ.get("QUERY_STRING", ""))
+time.sleep(float(query.get("sleep", ["0"])[0]))
+
+sys.stdout.write("Content-Type: text/plain\r\n")
+if "cc" in query:
+    sys.stdout.write(f"Cache-Control: {query['cc'][0]}\r\n")
+sys.stdout.write("\r\n")
+sys.stdout.write(f"{os.getpid()} {time.time():.6f}\n")
@@ -0,0 +1,23 @@
+#!/usr/bin/env python3
+
+# Reads its stdin in pieces and answers "<bytes> <sha1> <start>", start
+# being the time the script was started (seconds since the epoch).
+
+import hashlib
+import os
+import sys
+import time
+
+start = time.time()
+length = int(os.environ.get("CONTENT_LENGTH", "0"))
+remaining = length
+digest = hashlib.sha1()
+while remaining > 0:
+    piece = sys.stdin.buffer.read1(min(remaining, 65536))
+    if not piece:
+        break
+    digest.update(piece)
+    remaining -= len(piece)
+
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.write(f"{length - remaining} {digest.hexdigest()} {start:.3f}\n")
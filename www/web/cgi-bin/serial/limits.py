@@ -0,0 +1,20 @@
+#!/usr/bin/env python3
+
+# Sleeps ?sleep=S seconds (default 0.5), then answers
+# "<start> <end> <RLIMIT_NOFILE> <RLIMIT_CPU>", times in seconds since
+# the epoch, limits as the soft values the script runs under.
+
+import os
+import resource
+import sys
+import time
+import urllib.parse
+
+start = time.time()
+query = urllib.parse.parse_qs(os.environ.get("QUERY_STRING", ""))
+time.sleep(float(query.get("sleep", ["0.5"])[0]))
+nofile = resource.getrlimit(resource.RLIMIT_NOFILE)[0]
+cpu = resource.getrlimit(resource.RLIMIT_CPU)[0]
+
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.write(f"{start:.3f} {time.time():.3f} {nofile} {cpu}\n")
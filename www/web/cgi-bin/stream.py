@@ -0,0 +1,22 @@
+#!/usr/bin/env python3
+
+# Writes its body in pieces: ?chunks=N pieces of ?size=B bytes with a
+# pause of ?pause=S seconds after each one (defaults 4, 32768, 0.5).
+# Piece i is made of the digit i % 10, so a client can check the order.
+
+import os
+import sys
+import time
+import urllib.parse
+
+query = urllib.parse.parse_qs(os.environ.get("QUERY_STRING", ""))
+chunks = int(query.get("chunks", ["4"])[0])
+size = int(query.get("size", ["32768"])[0])
+pause = float(query.get("pause", ["0.5"])[0])
+
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.flush()
+for i in range(chunks):
+    sys.stdout.write(str(i % 10) * size)
+    sys.stdout.flush()
+    time.sleep(pause)